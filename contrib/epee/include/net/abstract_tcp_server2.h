@@ -60,7 +60,9 @@
 #undef XCASH_DEFAULT_LOG_CATEGORY
 #define XCASH_DEFAULT_LOG_CATEGORY "net"
 
-#define ABSTRACT_SERVER_SEND_QUE_MAX_COUNT 1000
+#define ABSTRACT_SERVER_SEND_QUE_MAX_BYTES (256 * 1024 * 1024) // a connection queueing more is dropped
+#define ABSTRACT_SERVER_SEND_QUE_SOFT_BYTES (16 * 1024 * 1024) // past this, protocol handlers should hold back optional sends
+#define ABSTRACT_SERVER_SEND_GATHER_MAX 64 // most queued slices written by one async_write
 
 namespace epee
 {
@@ -118,7 +120,7 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb); ///< (see do_send from i_service_endpoint)
-    virtual bool do_send_chunk(const void* ptr, size_t cb); ///< will send (or queue) a part of data
+    virtual bool do_send(const shared_buffer &buffer); ///< queues the buffer without copying it, never waits
     virtual bool send_done();
     virtual bool close();
     virtual bool call_run_once_service_io();
@@ -136,6 +138,9 @@ namespace net_utils
     /// Handle completion of a write operation.
     void handle_write(const boost::system::error_code& e, size_t cb);
 
+    /// Write the first queued slices in one gather write, m_send_que_lock must be held.
+    void start_write();
+
     /// reset connection timeout timer and callback
     void reset_timer(boost::posix_time::milliseconds ms, bool add);
     boost::posix_time::milliseconds get_default_timeout();
@@ -157,7 +162,6 @@ namespace net_utils
     //typename t_protocol_handler::config_type m_dummy_config;
     std::list<boost::shared_ptr<connection<t_protocol_handler> > > m_self_refs; // add_ref/release support
     critical_section m_self_refs_lock;
-    critical_section m_chunking_lock; // held while we add small chunks of the big do_send() to small do_send_chunk()
     critical_section m_shutdown_lock; // held while shutting down
     
     t_connection_type m_connection_type;
@@ -412,97 +412,22 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   //---------------------------------------------------------------------------------
     template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb) {
+    // the caller keeps its buffer, so this is the one copy on the way out
+    return do_send(std::make_shared<const std::string>((const char*)ptr, cb));
+  }
+  //---------------------------------------------------------------------------------
+    template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send(const shared_buffer &buffer) {
     TRY_ENTRY();
 
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
     auto self = safe_shared_from_this();
     if (!self) return false;
     if (m_was_shutdown) return false;
-		// TODO avoid copy
-
-		const double factor = 32; // TODO config
-		typedef long long signed int t_safe; // my t_size to avoid any overunderflow in arithmetic
-		const t_safe chunksize_good = (t_safe)( 1024 * std::max(1.0,factor) );
-        const t_safe chunksize_max = chunksize_good * 2 ;
-		const bool allow_split = (m_connection_type == e_connection_type_RPC) ? false : true; // do not split RPC data
-
-        CHECK_AND_ASSERT_MES(! (chunksize_max<0), false, "Negative chunksize_max" ); // make sure it is unsigned before removin sign with cast:
-        long long unsigned int chunksize_max_unsigned = static_cast<long long unsigned int>( chunksize_max ) ;
-
-        if (allow_split && (cb > chunksize_max_unsigned)) {
-			{ // LOCK: chunking
-    		epee::critical_region_t<decltype(m_chunking_lock)> send_guard(m_chunking_lock); // *** critical *** 
-
-				MDEBUG("do_send() will SPLIT into small chunks, from packet="<<cb<<" B for ptr="<<ptr);
-				t_safe all = cb; // all bytes to send 
-				t_safe pos = 0; // current sending position
-				// 01234567890 
-				// ^^^^        (pos=0, len=4)     ;   pos:=pos+len, pos=4
-				//     ^^^^    (pos=4, len=4)     ;   pos:=pos+len, pos=8
-				//         ^^^ (pos=8, len=4)    ;   
-
-				// const size_t bufsize = chunksize_good; // TODO safecast
-				// char* buf = new char[ bufsize ];
-
-				bool all_ok = true;
-				while (pos < all) {
-					t_safe lenall = all-pos; // length from here to end
-					t_safe len = std::min( chunksize_good , lenall); // take a smaller part
-					CHECK_AND_ASSERT_MES(len<=chunksize_good, false, "len too large");
-					// pos=8; len=4; all=10;	len=3;
-
-                    CHECK_AND_ASSERT_MES(! (len<0), false, "negative len"); // check before we cast away sign:
-                    unsigned long long int len_unsigned = static_cast<long long int>( len );
-                    CHECK_AND_ASSERT_MES(len>0, false, "len not strictly positive"); // (redundant)
-                    CHECK_AND_ASSERT_MES(len_unsigned < std::numeric_limits<size_t>::max(), false, "Invalid len_unsigned");   // yeap we want strong < then max size, to be sure
-					
-					void *chunk_start = ((char*)ptr) + pos;
-					MDEBUG("chunk_start="<<chunk_start<<" ptr="<<ptr<<" pos="<<pos);
-					CHECK_AND_ASSERT_MES(chunk_start >= ptr, false, "Pointer wraparound"); // not wrapped around address?
-					//std::memcpy( (void*)buf, chunk_start, len);
-
-					MDEBUG("part of " << lenall << ": pos="<<pos << " len="<<len);
-
-					bool ok = do_send_chunk(chunk_start, len); // <====== ***
-
-					all_ok = all_ok && ok;
-					if (!all_ok) {
-						MDEBUG("do_send() DONE ***FAILED*** from packet="<<cb<<" B for ptr="<<ptr);
-						MDEBUG("do_send() SEND was aborted in middle of big package - this is mostly harmless "
-							<< " (e.g. peer closed connection) but if it causes trouble tell us at #xcash-dev. " << cb);
-						return false; // partial failure in sending
-					}
-					pos = pos+len;
-					CHECK_AND_ASSERT_MES(pos >0, false, "pos <= 0");
-
-					// (in catch block, or uniq pointer) delete buf;
-				} // each chunk
-
-				MDEBUG("do_send() DONE SPLIT from packet="<<cb<<" B for ptr="<<ptr);
-
-                MDEBUG("do_send() m_connection_type = " << m_connection_type);
-
-				return all_ok; // done - e.g. queued - all the chunks of current do_send call
-			} // LOCK: chunking
-		} // a big block (to be chunked) - all chunks
-		else { // small block
-			return do_send_chunk(ptr,cb); // just send as 1 big chunk
-		}
-
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
-	} // do_send()
-
-  //---------------------------------------------------------------------------------
-  template<class t_protocol_handler>
-  bool connection<t_protocol_handler>::do_send_chunk(const void* ptr, size_t cb)
-  {
-    TRY_ENTRY();
-    // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
-    auto self = safe_shared_from_this();
-    if(!self)
-      return false;
-    if(m_was_shutdown)
-      return false;
+    CHECK_AND_ASSERT_MES(buffer, false, "Null send buffer");
+    const size_t cb = buffer->size();
+    if (!cb)
+      return true;
     {
 		CRITICAL_REGION_LOCAL(m_throttle_speed_out_mutex);
 		m_throttle_speed_out.handle_trafic_exact(cb);
@@ -512,82 +437,82 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     //_info("[sock " << socket_.native_handle() << "] SEND " << cb);
     context.m_last_send = time(NULL);
     context.m_send_cnt += cb;
-    //some data should be wrote to stream
-    //request complete
-    
-    // No sleeping here; sleeping is done once and for all in "handle_write"
 
-    m_send_que_lock.lock(); // *** critical ***
-    epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){m_send_que_lock.unlock();});
+    // No sleeping here; sleeping is done once and for all in "handle_write",
+    // a full queue is reported to the protocol handler through the context
+
+    const double factor = 32; // TODO config
+    const size_t chunksize_good = (size_t)( 1024 * std::max(1.0,factor) );
+    const size_t chunksize_max = chunksize_good * 2;
+    const bool allow_split = (m_connection_type == e_connection_type_RPC) ? false : true; // do not split RPC data
 
-    long int retry=0;
-    const long int retry_limit = 5*4;
-    while (m_send_que.size() > ABSTRACT_SERVER_SEND_QUE_MAX_COUNT)
+    CRITICAL_REGION_LOCAL(m_send_que_lock);
+    if (m_send_que_bytes + cb > ABSTRACT_SERVER_SEND_QUE_MAX_BYTES)
     {
-        retry++;
-
-        /* if ( ::cryptonote::core::get_is_stopping() ) { // TODO re-add fast stop
-            _fact("ABORT queue wait due to stopping");
-            return false; // aborted
-        }*/
-
-        long int ms = 250 + (rand()%50);
-        MDEBUG("Sleeping because QUEUE is FULL, in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<cb); // XXX debug sleep
-        m_send_que_lock.unlock();
-        boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
-        m_send_que_lock.lock();
-        _dbg1("sleep for queue: " << ms);
-
-        if (retry > retry_limit) {
-            MWARNING("send que size is more than ABSTRACT_SERVER_SEND_QUE_MAX_COUNT(" << ABSTRACT_SERVER_SEND_QUE_MAX_COUNT << "), shutting down connection");
-            shutdown();
-            return false;
-        }
+      MWARNING("send queue would grow to " << m_send_que_bytes + cb << " bytes, more than ABSTRACT_SERVER_SEND_QUE_MAX_BYTES(" << ABSTRACT_SERVER_SEND_QUE_MAX_BYTES << "), shutting down connection");
+      shutdown();
+      return false;
     }
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
-    
-    if(m_send_que.size() > 1)
+    // big packets are queued as slices of the same buffer, so the throttle
+    // can pace them without copying anything
+    if (allow_split && cb > chunksize_max)
+    {
+      MDEBUG("do_send() will SPLIT into small chunks, from packet="<<cb<<" B");
+      for (size_t pos = 0; pos < cb; pos += chunksize_good)
+        m_send_que.push_back({buffer, pos, std::min(chunksize_good, cb - pos)});
+    }
+    else
+    {
+      m_send_que.push_back({buffer, 0, cb});
+    }
+    const bool was_backlogged = m_send_que_bytes > ABSTRACT_SERVER_SEND_QUE_SOFT_BYTES;
+    m_send_que_bytes += cb;
+    context.m_send_queue_bytes = m_send_que_bytes;
+    if (!was_backlogged && m_send_que_bytes > ABSTRACT_SERVER_SEND_QUE_SOFT_BYTES)
+      MDEBUG(context << "send queue backlogged, " << m_send_que_bytes << " bytes queued");
+
+    if (m_send_que_in_flight)
     { // active operation should be in progress, nothing to do, just wait last operation callback
-        auto size_now = cb;
-        MDEBUG("do_send_chunk() NOW just queues: packet="<<size_now<<" B, is added to queue-size="<<m_send_que.size());
-        //do_send_handler_delayed( ptr , size_now ); // (((H))) // empty function
-      
-      LOG_TRACE_CC(context, "[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front().size());
+      MDEBUG("do_send() NOW just queues: packet="<<cb<<" B, is added to queue-size="<<m_send_que.size());
+      LOG_TRACE_CC(context, "[sock " << socket_.native_handle() << "] Async send queued " << cb);
     }
     else
     { // no active operation
-
-        if(m_send_que.size()!=1)
-        {
-            _erro("Looks like no active operations, but send que size != 1!!");
-            return false;
-        }
-
-        auto size_now = m_send_que.front().size();
-        MDEBUG("do_send_chunk() NOW SENSD: packet="<<size_now<<" B");
-        if (speed_limit_is_enabled())
-			do_send_handler_write( ptr , size_now ); // (((H)))
-
-        CHECK_AND_ASSERT_MES( size_now == m_send_que.front().size(), false, "Unexpected queue size");
-        reset_timer(get_default_timeout(), false);
-        boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), size_now ) ,
-                                 //strand_.wrap(
-                                 boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2)
-                                 //)
-                                 );
-        //_dbg3("(chunk): " << size_now);
-        //logger_handle_net_write(size_now);
-        //_info("[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front().size());
+      start_write();
     }
-    
-    //do_send_handler_stop( ptr , cb ); // empty function
 
     return true;
 
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send_chunk", false);
-  } // do_send_chunk
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+  } // do_send()
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_write()
+  {
+    // throttled connections write a slice at a time, so handle_write can pace them,
+    // others gather as much of the queue as they can into one write
+    const size_t max_slices = speed_limit_is_enabled() ? 1 : ABSTRACT_SERVER_SEND_GATHER_MAX;
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(std::min(max_slices, m_send_que.size()));
+    size_t size_now = 0;
+    for (auto it = m_send_que.begin(); it != m_send_que.end() && buffers.size() < max_slices; ++it)
+    {
+      buffers.push_back(boost::asio::buffer(it->buffer->data() + it->offset, it->size));
+      size_now += it->size;
+    }
+    m_send_que_in_flight = buffers.size();
+
+    MDEBUG("start_write() NOW SENDS: " << size_now << " B in " << buffers.size() << " slices, from queue size=" << m_send_que.size());
+    if (speed_limit_is_enabled())
+      do_send_handler_write_from_queue(boost::system::error_code(), size_now, m_send_que.size()); // (((H)))
+    reset_timer(get_default_timeout(), false);
+    boost::asio::async_write(socket_, buffers,
+                             //strand_.wrap(
+                             boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)
+                             //)
+                             );
+  }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   boost::posix_time::milliseconds connection<t_protocol_handler>::get_default_timeout()
@@ -734,13 +659,19 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 
     bool do_shutdown = false;
     CRITICAL_REGION_BEGIN(m_send_que_lock);
-    if(m_send_que.empty())
+    if(!m_send_que_in_flight || m_send_que.size() < m_send_que_in_flight)
     {
-      _erro("[sock " << socket_.native_handle() << "] m_send_que.size() == 0 at handle_write!");
+      _erro("[sock " << socket_.native_handle() << "] m_send_que.size() == " << m_send_que.size() << " at handle_write, with " << m_send_que_in_flight << " slices in flight!");
       return;
     }
 
-    m_send_que.pop_front();
+    for (size_t n = 0; n < m_send_que_in_flight; ++n)
+    {
+      m_send_que_bytes -= m_send_que.front().size;
+      m_send_que.pop_front();
+    }
+    m_send_que_in_flight = 0;
+    context.m_send_queue_bytes = m_send_que_bytes;
     if(m_send_que.empty())
     {
       if(boost::interprocess::ipcdetail::atomic_read32(&m_want_close_connection))
@@ -750,18 +681,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }else
     {
       //have more data to send
-		reset_timer(get_default_timeout(), false);
-		auto size_now = m_send_que.front().size();
-		MDEBUG("handle_write() NOW SENDS: packet="<<size_now<<" B" <<", from  queue size="<<m_send_que.size());
-		if (speed_limit_is_enabled())
-			do_send_handler_write_from_queue(e, m_send_que.front().size() , m_send_que.size()); // (((H)))
-		CHECK_AND_ASSERT_MES( size_now == m_send_que.front().size(), void(), "Unexpected queue size");
-		boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), size_now) , 
-        // strand_.wrap(
-          boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)
-				// )
-        );
-      //_dbg3("(normal)" << size_now);
+      start_write();
     }
     CRITICAL_REGION_END();
 
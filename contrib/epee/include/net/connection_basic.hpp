@@ -43,6 +43,7 @@
 
 
 #include <boost/asio.hpp>
+#include <deque>
 #include <string>
 #include <vector>
 #include <boost/noncopyable.hpp>
@@ -90,7 +91,16 @@ class connection_basic { // not-templated base class for rapid developmet of som
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
     critical_section m_send_que_lock;
-    std::list<std::string> m_send_que;
+    /// A slice of a queued buffer: big buffers are queued as several slices, sharing the buffer
+    struct send_chunk
+    {
+      shared_buffer buffer;
+      size_t offset;
+      size_t size;
+    };
+    std::deque<send_chunk> m_send_que;
+    size_t m_send_que_bytes; // total size of the queued slices
+    size_t m_send_que_in_flight; // slices at the front of the queue given to the current async_write
     volatile bool m_is_multithreaded;
     double m_start_time;
     /// Strand to ensure the connection's handlers are not called concurrently.
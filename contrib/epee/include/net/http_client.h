@@ -276,6 +276,7 @@ namespace net_utils
 			std::string m_chunked_cache;
 			critical_section m_lock;
 			bool m_ssl;
+			std::function<bool(std::string&)> m_body_handler;
 
 		public:
 			explicit http_simple_client_template()
@@ -294,6 +295,7 @@ namespace net_utils
 				, m_chunked_cache()
 				, m_lock()
 				, m_ssl(false)
+				, m_body_handler()
 			{}
 
 			const std::string &get_host() const { return m_host_buff; };
@@ -339,11 +341,26 @@ namespace net_utils
 			virtual bool handle_target_data(std::string& piece_of_transfer)
 			{
 				CRITICAL_REGION_LOCAL(m_lock);
+				if (m_body_handler && m_response_info.m_response_code == 200)
+				{
+					const bool r = m_body_handler(piece_of_transfer);
+					piece_of_transfer.clear();
+					return r;
+				}
 				m_response_info.m_body += piece_of_transfer;
         piece_of_transfer.clear();
 				return true;
 			}
 			//---------------------------------------------------------------------------
+			/*! \brief hands the body of successful responses to `handler` piece by
+			 *  piece as it arrives, instead of collecting it in the response info.
+			 *  An empty handler restores the default. */
+			void set_body_handler(std::function<bool(std::string&)> handler)
+			{
+				CRITICAL_REGION_LOCAL(m_lock);
+				m_body_handler = std::move(handler);
+			}
+			//---------------------------------------------------------------------------
 			virtual bool on_header(const http_response_info &headers)
       {
         return true;
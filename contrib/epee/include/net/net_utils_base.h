@@ -31,6 +31,9 @@
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/asio/io_service.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
 #include <typeinfo>
 #include <type_traits>
 #include "serialization/keyvalue_serialization.h"
@@ -228,6 +231,7 @@ namespace net_utils
     uint64_t m_send_cnt;
     double m_current_speed_down;
     double m_current_speed_up;
+    std::atomic<uint64_t> m_send_queue_bytes; //!< bytes queued for sending and not written yet, for protocol handlers to apply backpressure, set by the connection's strand and read from others
 
     connection_context_base(boost::uuids::uuid connection_id,
                             const network_address &remote_address, bool is_income,
@@ -242,7 +246,8 @@ namespace net_utils
                                             m_recv_cnt(recv_cnt),
                                             m_send_cnt(send_cnt),
                                             m_current_speed_down(0),
-                                            m_current_speed_up(0)
+                                            m_current_speed_up(0),
+                                            m_send_queue_bytes(0)
     {}
 
     connection_context_base(): m_connection_id(),
@@ -254,7 +259,8 @@ namespace net_utils
                                m_recv_cnt(0),
                                m_send_cnt(0),
                                m_current_speed_down(0),
-                               m_current_speed_up(0)
+                               m_current_speed_up(0),
+                               m_send_queue_bytes(0)
     {}
 
     connection_context_base(const connection_context_base& a): connection_context_base()
@@ -282,9 +288,14 @@ namespace net_utils
 	/************************************************************************/
 	/*                                                                      */
 	/************************************************************************/
+	//! an immutable, reference counted byte buffer, which can be queued for sending without a copy
+	typedef std::shared_ptr<const std::string> shared_buffer;
+
 	struct i_service_endpoint
 	{
 		virtual bool do_send(const void* ptr, size_t cb)=0;
+    //! queues a whole buffer, keeping a reference to it where the endpoint can
+    virtual bool do_send(const shared_buffer &buffer) { return do_send(buffer->data(), buffer->size()); }
     virtual bool close()=0;
     virtual bool send_done()=0;
     virtual bool call_run_once_service_io()=0;
@@ -28,6 +28,7 @@
 #pragma once
 #include <boost/utility/string_ref.hpp>
 #include <chrono>
+#include <functional>
 #include <string>
 #include "portable_storage_template_helper.h"
 #include "net/http_base.h"
@@ -100,6 +101,39 @@ namespace epee
       return serialization::load_t_from_binary(result_struct, pri->m_body);
     }
 
+    template<class t_request, class t_transport>
+    bool invoke_http_bin_stream(const boost::string_ref uri, const t_request& out_struct, std::function<bool(std::string&)> body_handler, t_transport& transport, std::chrono::milliseconds timeout = std::chrono::seconds(15), const boost::string_ref method = "GET")
+    {
+      std::string req_param;
+      if(!serialization::store_t_to_binary(out_struct, req_param))
+        return false;
+
+      // the response body goes to body_handler as it arrives, not to pri->m_body
+      transport.set_body_handler(std::move(body_handler));
+      const http::http_response_info* pri = NULL;
+      const bool r = transport.invoke(uri, method, req_param, timeout, std::addressof(pri));
+      transport.set_body_handler(nullptr);
+      if(!r)
+      {
+        LOG_PRINT_L1("Failed to invoke http request to  " << uri);
+        return false;
+      }
+
+      if(!pri)
+      {
+        LOG_PRINT_L1("Failed to invoke http request to  " << uri << ", internal error (null response ptr)");
+        return false;
+      }
+
+      if(pri->m_response_code != 200)
+      {
+        LOG_PRINT_L1("Failed to invoke http request to  " << uri << ", wrong response code: " << pri->m_response_code);
+        return false;
+      }
+
+      return true;
+    }
+
     template<class t_request, class t_response, class t_transport>
     bool invoke_http_json_rpc(const boost::string_ref uri, std::string method_name, const t_request& out_struct, t_response& result_struct, t_transport& transport, std::chrono::milliseconds timeout = std::chrono::seconds(15), const boost::string_ref http_method = "GET", const std::string& req_id = "0")
     {
@@ -0,0 +1,1009 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include <boost/mpl/contains.hpp>
+#include <boost/mpl/assert.hpp>
+
+#include "misc_log_ex.h"
+#include "misc_language.h"
+#include "span.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+#include "portable_storage_from_bin.h"
+#include "portable_storage_val_converters.h"
+
+#define PORTABLE_STORAGE_FLAT_MIN_BLOCK   4096
+#define PORTABLE_STORAGE_FLAT_MAX_BLOCK   (4*1024*1024)
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /* Bump allocator: everything a flat storage owns is freed at once      */
+    /************************************************************************/
+    class flat_storage_arena
+    {
+    public:
+      flat_storage_arena(): m_ptr(nullptr), m_left(0), m_next_block(PORTABLE_STORAGE_FLAT_MIN_BLOCK) {}
+
+      void reserve(size_t size)
+      {
+        m_next_block = std::max(m_next_block, std::min<size_t>(size, PORTABLE_STORAGE_FLAT_MAX_BLOCK));
+      }
+
+      void* allocate(size_t size, size_t align)
+      {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(m_ptr) % align) % align;
+        if(pad + size > m_left)
+        {
+          const size_t block = std::max(size + align, m_next_block);
+          m_blocks.emplace_back(new char[block]);
+          m_ptr = m_blocks.back().get();
+          m_left = block;
+          m_next_block = std::min<size_t>(m_next_block * 2, PORTABLE_STORAGE_FLAT_MAX_BLOCK);
+          pad = (align - reinterpret_cast<uintptr_t>(m_ptr) % align) % align;
+        }
+        char* p = m_ptr + pad;
+        m_ptr = p + size;
+        m_left -= pad + size;
+        return p;
+      }
+
+      const char* copy(const char* data, size_t size)
+      {
+        if(!size)
+          return "";
+        char* p = static_cast<char*>(allocate(size, 1));
+        memcpy(p, data, size);
+        return p;
+      }
+
+      void clear()
+      {
+        m_blocks.clear();
+        m_ptr = nullptr;
+        m_left = 0;
+        m_next_block = PORTABLE_STORAGE_FLAT_MIN_BLOCK;
+      }
+
+    private:
+      std::vector<std::unique_ptr<char[]>> m_blocks;
+      char* m_ptr;
+      size_t m_left;
+      size_t m_next_block;
+    };
+
+    /************************************************************************/
+    /* One entry of a flat storage: a named value of a section or an        */
+    /* unnamed element of an array. Sections and arrays of strings,         */
+    /* sections or arrays link their children through m_next; arrays of     */
+    /* pod values keep them packed as in the binary format.                 */
+    /************************************************************************/
+    struct flat_node
+    {
+      const char* m_name;
+      flat_node* m_next;
+      union
+      {
+        uint8_t m_pod[8];
+        struct { const char* data; size_t size; } m_str;      //strings, and the packed bytes of pod arrays
+        struct { flat_node* first; flat_node* last; } m_list; //sections, arrays of strings/sections/arrays
+      };
+      size_t m_count;     //entries of a section, elements of an array
+      size_t m_capacity;  //arena bytes reserved for a pod array being written, 0 if m_str is a view
+      union { size_t index; const flat_node* node; } m_cursor; //read position for get_next_value/get_next_section
+      uint8_t m_name_len;
+      uint8_t m_type;     //SERIALIZE_TYPE_*, or'ed with SERIALIZE_FLAG_ARRAY for arrays
+    };
+
+    template<class t_type> struct flat_type_code;
+    template<> struct flat_type_code<int64_t>     { enum { value = SERIALIZE_TYPE_INT64 }; };
+    template<> struct flat_type_code<int32_t>     { enum { value = SERIALIZE_TYPE_INT32 }; };
+    template<> struct flat_type_code<int16_t>     { enum { value = SERIALIZE_TYPE_INT16 }; };
+    template<> struct flat_type_code<int8_t>      { enum { value = SERIALIZE_TYPE_INT8 }; };
+    template<> struct flat_type_code<uint64_t>    { enum { value = SERIALIZE_TYPE_UINT64 }; };
+    template<> struct flat_type_code<uint32_t>    { enum { value = SERIALIZE_TYPE_UINT32 }; };
+    template<> struct flat_type_code<uint16_t>    { enum { value = SERIALIZE_TYPE_UINT16 }; };
+    template<> struct flat_type_code<uint8_t>     { enum { value = SERIALIZE_TYPE_UINT8 }; };
+    template<> struct flat_type_code<double>      { enum { value = SERIALIZE_TYPE_DUOBLE }; };
+    template<> struct flat_type_code<bool>        { enum { value = SERIALIZE_TYPE_BOOL }; };
+    template<> struct flat_type_code<std::string> { enum { value = SERIALIZE_TYPE_STRING }; };
+
+    inline size_t flat_pod_size(uint8_t type)
+    {
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64:  return sizeof(int64_t);
+      case SERIALIZE_TYPE_INT32:  return sizeof(int32_t);
+      case SERIALIZE_TYPE_INT16:  return sizeof(int16_t);
+      case SERIALIZE_TYPE_INT8:   return sizeof(int8_t);
+      case SERIALIZE_TYPE_UINT64: return sizeof(uint64_t);
+      case SERIALIZE_TYPE_UINT32: return sizeof(uint32_t);
+      case SERIALIZE_TYPE_UINT16: return sizeof(uint16_t);
+      case SERIALIZE_TYPE_UINT8:  return sizeof(uint8_t);
+      case SERIALIZE_TYPE_DUOBLE: return sizeof(double);
+      case SERIALIZE_TYPE_BOOL:   return sizeof(bool);
+      default:                    return 0;
+      }
+    }
+
+    /************************************************************************/
+    /* Binary-only alternative to portable_storage with the same interface  */
+    /* for the KV_SERIALIZE macros. Loading does not copy: names, strings   */
+    /* and pod arrays point into the source buffer, which therefore has to  */
+    /* outlive the storage. All nodes come from one arena.                  */
+    /************************************************************************/
+    class portable_storage_flat
+    {
+    public:
+      typedef flat_node* hsection;
+      typedef flat_node* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_flat(){ reset(); }
+      portable_storage_flat(const portable_storage_flat&) = delete;
+      portable_storage_flat& operator=(const portable_storage_flat&) = delete;
+
+      hsection   open_section(const boost::string_ref section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool       get_value(const boost::string_ref value_name, t_value& val, hsection hparent_section);
+      bool       get_value(const boost::string_ref value_name, storage_entry& val, hsection hparent_section);
+      template<class t_value>
+      bool       set_value(const boost::string_ref value_name, const t_value& target, hsection hparent_section);
+      bool       set_value(const boost::string_ref value_name, const storage_entry& target, hsection hparent_section);
+
+      //serial access for arrays of values --------------------------------------
+      //values
+      template<class t_value>
+      harray get_first_value(const boost::string_ref value_name, t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool          get_next_value(harray hval_array, t_value& target);
+      template<class t_value>
+      harray insert_first_value(const boost::string_ref value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool          insert_next_value(harray hval_array, const t_value& target);
+      //sections
+      harray get_first_section(const boost::string_ref sec_name, hsection& h_child_section, hsection hparent_section);
+      bool            get_next_section(harray hsec_array, hsection& h_child_section);
+      harray insert_first_section(const boost::string_ref sec_name, hsection& hinserted_childsection, hsection hparent_section);
+      bool            insert_next_section(harray hsec_array, hsection& hinserted_childsection);
+
+      //-------------------------------------------------------------------------------
+      bool		store_to_binary(binarybuffer& target);
+      bool		load_from_binary(const epee::span<const uint8_t> source);
+      bool		load_from_binary(const binarybuffer& source)
+      {
+        return load_from_binary(epee::span<const uint8_t>(reinterpret_cast<const uint8_t*>(source.data()), source.size()));
+      }
+      bool		load_from_binary(binarybuffer&& source) = delete; //would leave the storage pointing into a temporary
+
+    private:
+      struct flat_reader
+      {
+        const uint8_t* m_ptr;
+        size_t m_count;
+
+        const char* take(size_t count)
+        {
+          CHECK_AND_ASSERT_THROW_MES(m_count >= count, " attempt to read " << count << " bytes from buffer with " << m_count << " bytes remained");
+          const char* p = reinterpret_cast<const char*>(m_ptr);
+          m_ptr += count;
+          m_count -= count;
+          return p;
+        }
+        template<class t_pod_type>
+        t_pod_type read()
+        {
+          t_pod_type v;
+          memcpy(&v, take(sizeof(v)), sizeof(v));
+          return v;
+        }
+        size_t read_varint();
+      };
+
+      struct size_counter
+      {
+        size_t m_size;
+        void write(const char*, size_t count) { m_size += count; }
+      };
+
+      struct buffer_writer
+      {
+        char* m_ptr;
+        void write(const char* data, size_t count) { memcpy(m_ptr, data, count); m_ptr += count; }
+      };
+
+      struct entry_assign_visitor;
+      struct array_assign_visitor;
+
+      flat_node m_root;
+      flat_storage_arena m_arena;
+
+      void reset();
+      flat_node* new_node();
+      static void reset_content(flat_node& node, uint8_t type);
+      static void link_child(flat_node& parent, flat_node* child);
+      static flat_node* find_entry(const boost::string_ref name, hsection psection);
+      flat_node* insert_new_entry(const boost::string_ref name, hsection psection);
+      flat_node* find_or_insert_entry(const boost::string_ref name, hsection psection);
+      flat_node* append_element(flat_node& array);
+
+      template<class t_value>
+      void assign_value(flat_node& node, const t_value& v);
+      void assign_value(flat_node& node, const std::string& v);
+      void assign_value(flat_node& node, const storage_entry& v);
+      template<class t_value>
+      void append_value(flat_node& array, const t_value& v);
+      void append_value(flat_node& array, const std::string& v);
+      void append_pod(flat_node& array, const void* v, size_t size);
+
+      template<class t_pod_type>
+      static t_pod_type load_pod(const char* p) { t_pod_type v; memcpy(&v, p, sizeof(v)); return v; }
+      template<class t_value>
+      static void read_pod_as(uint8_t type, const char* p, t_value& target);
+      static void read_string(const flat_node& node, std::string& target) { target.assign(node.m_str.data, node.m_str.size); }
+      template<class t_value>
+      static void read_string(const flat_node& node, t_value& target) { convert_t(std::string(node.m_str.data, node.m_str.size), target); }
+      template<class t_value>
+      static void read_value(const flat_node& node, t_value& target);
+      template<class t_value>
+      static bool read_next_element(flat_node& array, t_value& target);
+      static bool is_list_array(uint8_t type);
+      template<class t_pod_type>
+      static storage_entry pod_array_to_storage_entry(const flat_node& array);
+      static storage_entry to_storage_entry(const flat_node& node);
+
+      template<class t_stream>
+      static void pack_section(t_stream& strm, const flat_node& sec);
+      template<class t_stream>
+      static void pack_entry(t_stream& strm, const flat_node& node);
+
+      void load_section(flat_reader& reader, flat_node& sec, size_t depth);
+      void load_entry(flat_reader& reader, flat_node& node, uint8_t type, size_t depth);
+      void load_array(flat_reader& reader, flat_node& node, uint8_t type, size_t depth);
+      static void load_string(flat_reader& reader, flat_node& node);
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    struct portable_storage_flat::entry_assign_visitor: boost::static_visitor<void>
+    {
+      portable_storage_flat& m_storage;
+      flat_node& m_node;
+      entry_assign_visitor(portable_storage_flat& storage, flat_node& node): m_storage(storage), m_node(node) {}
+
+      template<class t_value>
+      void operator()(const t_value& v) { m_storage.assign_value(m_node, v); }
+      void operator()(const section& sec)
+      {
+        reset_content(m_node, SERIALIZE_TYPE_OBJECT);
+        for(const auto& e: sec.m_entries)
+        {
+          entry_assign_visitor v(m_storage, *m_storage.insert_new_entry(e.first, &m_node));
+          boost::apply_visitor(v, e.second);
+        }
+      }
+      void operator()(const array_entry& ae);
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    struct portable_storage_flat::array_assign_visitor: boost::static_visitor<void>
+    {
+      portable_storage_flat& m_storage;
+      flat_node& m_node;
+      array_assign_visitor(portable_storage_flat& storage, flat_node& node): m_storage(storage), m_node(node) {}
+
+      template<class t_value>
+      void operator()(const array_entry_t<t_value>& a)
+      {
+        reset_content(m_node, flat_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY);
+        for(const t_value& v: a.m_array)
+          m_storage.append_value(m_node, v);
+      }
+      void operator()(const array_entry_t<section>& a)
+      {
+        reset_content(m_node, SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY);
+        for(const section& s: a.m_array)
+        {
+          entry_assign_visitor v(m_storage, *m_storage.append_element(m_node));
+          v(s);
+        }
+      }
+      void operator()(const array_entry_t<array_entry>& a)
+      {
+        reset_content(m_node, SERIALIZE_TYPE_ARRAY | SERIALIZE_FLAG_ARRAY);
+        for(const array_entry& ae: a.m_array)
+        {
+          array_assign_visitor v(m_storage, *m_storage.append_element(m_node));
+          boost::apply_visitor(v, ae);
+        }
+      }
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::entry_assign_visitor::operator()(const array_entry& ae)
+    {
+      array_assign_visitor v(m_storage, m_node);
+      boost::apply_visitor(v, ae);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::reset()
+    {
+      m_arena.clear();
+      m_root = flat_node();
+      reset_content(m_root, SERIALIZE_TYPE_OBJECT);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    flat_node* portable_storage_flat::new_node()
+    {
+      return new (m_arena.allocate(sizeof(flat_node), alignof(flat_node))) flat_node();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::reset_content(flat_node& node, uint8_t type)
+    {
+      node.m_type = type;
+      node.m_str.data = nullptr;
+      node.m_str.size = 0;
+      node.m_count = 0;
+      node.m_capacity = 0;
+      node.m_cursor.index = 0;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::link_child(flat_node& parent, flat_node* child)
+    {
+      if(parent.m_list.last)
+        parent.m_list.last->m_next = child;
+      else
+        parent.m_list.first = child;
+      parent.m_list.last = child;
+      ++parent.m_count;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    flat_node* portable_storage_flat::find_entry(const boost::string_ref name, hsection psection)
+    {
+      CHECK_AND_ASSERT(psection, nullptr);
+      for(flat_node* n = psection->m_list.first; n; n = n->m_next)
+      {
+        if(n->m_name_len == name.size() && !memcmp(n->m_name, name.data(), name.size()))
+          return n;
+      }
+      return nullptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    flat_node* portable_storage_flat::insert_new_entry(const boost::string_ref name, hsection psection)
+    {
+      CHECK_AND_ASSERT_THROW_MES(name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << name.size() << ", val: " << name);
+      flat_node* n = new_node();
+      n->m_name = m_arena.copy(name.data(), name.size());
+      n->m_name_len = static_cast<uint8_t>(name.size());
+      link_child(*psection, n);
+      return n;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    flat_node* portable_storage_flat::find_or_insert_entry(const boost::string_ref name, hsection psection)
+    {
+      flat_node* n = find_entry(name, psection);
+      return n ? n : insert_new_entry(name, psection);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    flat_node* portable_storage_flat::append_element(flat_node& array)
+    {
+      flat_node* n = new_node();
+      link_child(array, n);
+      return n;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_storage_flat::assign_value(flat_node& node, const t_value& v)
+    {
+      reset_content(node, flat_type_code<t_value>::value);
+      static_assert(sizeof(v) <= sizeof(node.m_pod), "pod value does not fit a flat node");
+      memcpy(node.m_pod, &v, sizeof(v));
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::assign_value(flat_node& node, const std::string& v)
+    {
+      reset_content(node, SERIALIZE_TYPE_STRING);
+      node.m_str.data = m_arena.copy(v.data(), v.size());
+      node.m_str.size = v.size();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::assign_value(flat_node& node, const storage_entry& v)
+    {
+      entry_assign_visitor eav(*this, node);
+      boost::apply_visitor(eav, v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_storage_flat::append_value(flat_node& array, const t_value& v)
+    {
+      append_pod(array, &v, sizeof(v));
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::append_value(flat_node& array, const std::string& v)
+    {
+      assign_value(*append_element(array), v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::append_pod(flat_node& array, const void* v, size_t size)
+    {
+      const size_t used = array.m_str.size;
+      if(used + size > array.m_capacity)
+      {
+        //views into the source buffer are copied on first write
+        const size_t capacity = std::max(16 * size, array.m_capacity * 2);
+        char* data = static_cast<char*>(m_arena.allocate(capacity, sizeof(uint64_t)));
+        if(used)
+          memcpy(data, array.m_str.data, used);
+        array.m_str.data = data;
+        array.m_capacity = capacity;
+      }
+      memcpy(const_cast<char*>(array.m_str.data) + used, v, size);
+      array.m_str.size = used + size;
+      ++array.m_count;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_storage_flat::read_pod_as(uint8_t type, const char* p, t_value& target)
+    {
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64:  convert_t(load_pod<int64_t>(p), target); break;
+      case SERIALIZE_TYPE_INT32:  convert_t(load_pod<int32_t>(p), target); break;
+      case SERIALIZE_TYPE_INT16:  convert_t(load_pod<int16_t>(p), target); break;
+      case SERIALIZE_TYPE_INT8:   convert_t(load_pod<int8_t>(p), target); break;
+      case SERIALIZE_TYPE_UINT64: convert_t(load_pod<uint64_t>(p), target); break;
+      case SERIALIZE_TYPE_UINT32: convert_t(load_pod<uint32_t>(p), target); break;
+      case SERIALIZE_TYPE_UINT16: convert_t(load_pod<uint16_t>(p), target); break;
+      case SERIALIZE_TYPE_UINT8:  convert_t(load_pod<uint8_t>(p), target); break;
+      case SERIALIZE_TYPE_DUOBLE: convert_t(load_pod<double>(p), target); break;
+      case SERIALIZE_TYPE_BOOL:   convert_t(load_pod<bool>(p), target); break;
+      default:
+        ASSERT_MES_AND_THROW("WRONG DATA CONVERSION: from entry type=" << (int)type << " to type " << typeid(t_value).name());
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_storage_flat::read_value(const flat_node& node, t_value& target)
+    {
+      if(node.m_type == SERIALIZE_TYPE_STRING)
+        read_string(node, target);
+      else
+        read_pod_as(node.m_type, reinterpret_cast<const char*>(node.m_pod), target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_flat::is_list_array(uint8_t type)
+    {
+      type &= ~SERIALIZE_FLAG_ARRAY;
+      return type == SERIALIZE_TYPE_STRING || type == SERIALIZE_TYPE_OBJECT || type == SERIALIZE_TYPE_ARRAY;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_flat::read_next_element(flat_node& array, t_value& target)
+    {
+      if(is_list_array(array.m_type))
+      {
+        const flat_node* n = array.m_cursor.node;
+        if(!n)
+          return false;
+        array.m_cursor.node = n->m_next;
+        read_value(*n, target);
+        return true;
+      }
+      if(array.m_cursor.index >= array.m_count)
+        return false;
+      const uint8_t type = array.m_type & ~SERIALIZE_FLAG_ARRAY;
+      read_pod_as(type, array.m_str.data + array.m_cursor.index++ * flat_pod_size(type), target);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_pod_type>
+    storage_entry portable_storage_flat::pod_array_to_storage_entry(const flat_node& array)
+    {
+      array_entry_t<t_pod_type> a;
+      for(size_t i = 0; i < array.m_count; ++i)
+        a.m_array.push_back(load_pod<t_pod_type>(array.m_str.data + i * sizeof(t_pod_type)));
+      return storage_entry(array_entry(a));
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    storage_entry portable_storage_flat::to_storage_entry(const flat_node& node)
+    {
+      const char* p = reinterpret_cast<const char*>(node.m_pod);
+      switch(node.m_type)
+      {
+      case SERIALIZE_TYPE_INT64:  return storage_entry(load_pod<int64_t>(p));
+      case SERIALIZE_TYPE_INT32:  return storage_entry(load_pod<int32_t>(p));
+      case SERIALIZE_TYPE_INT16:  return storage_entry(load_pod<int16_t>(p));
+      case SERIALIZE_TYPE_INT8:   return storage_entry(load_pod<int8_t>(p));
+      case SERIALIZE_TYPE_UINT64: return storage_entry(load_pod<uint64_t>(p));
+      case SERIALIZE_TYPE_UINT32: return storage_entry(load_pod<uint32_t>(p));
+      case SERIALIZE_TYPE_UINT16: return storage_entry(load_pod<uint16_t>(p));
+      case SERIALIZE_TYPE_UINT8:  return storage_entry(load_pod<uint8_t>(p));
+      case SERIALIZE_TYPE_DUOBLE: return storage_entry(load_pod<double>(p));
+      case SERIALIZE_TYPE_BOOL:   return storage_entry(load_pod<bool>(p));
+      case SERIALIZE_TYPE_STRING: return storage_entry(std::string(node.m_str.data, node.m_str.size));
+      case SERIALIZE_TYPE_OBJECT:
+        {
+          section s;
+          for(const flat_node* n = node.m_list.first; n; n = n->m_next)
+            s.m_entries.insert(std::make_pair(std::string(n->m_name, n->m_name_len), to_storage_entry(*n)));
+          return storage_entry(s);
+        }
+      case SERIALIZE_TYPE_INT64 | SERIALIZE_FLAG_ARRAY:  return pod_array_to_storage_entry<int64_t>(node);
+      case SERIALIZE_TYPE_INT32 | SERIALIZE_FLAG_ARRAY:  return pod_array_to_storage_entry<int32_t>(node);
+      case SERIALIZE_TYPE_INT16 | SERIALIZE_FLAG_ARRAY:  return pod_array_to_storage_entry<int16_t>(node);
+      case SERIALIZE_TYPE_INT8 | SERIALIZE_FLAG_ARRAY:   return pod_array_to_storage_entry<int8_t>(node);
+      case SERIALIZE_TYPE_UINT64 | SERIALIZE_FLAG_ARRAY: return pod_array_to_storage_entry<uint64_t>(node);
+      case SERIALIZE_TYPE_UINT32 | SERIALIZE_FLAG_ARRAY: return pod_array_to_storage_entry<uint32_t>(node);
+      case SERIALIZE_TYPE_UINT16 | SERIALIZE_FLAG_ARRAY: return pod_array_to_storage_entry<uint16_t>(node);
+      case SERIALIZE_TYPE_UINT8 | SERIALIZE_FLAG_ARRAY:  return pod_array_to_storage_entry<uint8_t>(node);
+      case SERIALIZE_TYPE_DUOBLE | SERIALIZE_FLAG_ARRAY: return pod_array_to_storage_entry<double>(node);
+      case SERIALIZE_TYPE_BOOL | SERIALIZE_FLAG_ARRAY:   return pod_array_to_storage_entry<bool>(node);
+      case SERIALIZE_TYPE_STRING | SERIALIZE_FLAG_ARRAY:
+        {
+          array_entry_t<std::string> a;
+          for(const flat_node* n = node.m_list.first; n; n = n->m_next)
+            a.m_array.push_back(std::string(n->m_str.data, n->m_str.size));
+          return storage_entry(array_entry(a));
+        }
+      case SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY:
+        {
+          array_entry_t<section> a;
+          for(const flat_node* n = node.m_list.first; n; n = n->m_next)
+          {
+            storage_entry e = to_storage_entry(*n);
+            a.m_array.push_back(boost::get<section>(e));
+          }
+          return storage_entry(array_entry(a));
+        }
+      case SERIALIZE_TYPE_ARRAY | SERIALIZE_FLAG_ARRAY:
+        {
+          array_entry_t<array_entry> a;
+          for(const flat_node* n = node.m_list.first; n; n = n->m_next)
+          {
+            storage_entry e = to_storage_entry(*n);
+            a.m_array.push_back(boost::get<array_entry>(e));
+          }
+          return storage_entry(array_entry(a));
+        }
+      default:
+        ASSERT_MES_AND_THROW("unknown entry_type code = " << (int)node.m_type);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_flat::hsection portable_storage_flat::open_section(const boost::string_ref section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      TRY_ENTRY();
+      hparent_section = hparent_section ? hparent_section : &m_root;
+      flat_node* pentry = find_entry(section_name, hparent_section);
+      if(!pentry)
+      {
+        if(!create_if_notexist)
+          return nullptr;
+        pentry = insert_new_entry(section_name, hparent_section);
+        reset_content(*pentry, SERIALIZE_TYPE_OBJECT);
+        return pentry;
+      }
+      if(pentry->m_type != SERIALIZE_TYPE_OBJECT)
+      {
+        if(!create_if_notexist)
+          return nullptr;
+        reset_content(*pentry, SERIALIZE_TYPE_OBJECT);//replace
+      }
+      return pentry;
+      CATCH_ENTRY("portable_storage_flat::open_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_flat::get_value(const boost::string_ref value_name, t_value& val, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      TRY_ENTRY();
+      if(!hparent_section) hparent_section = &m_root;
+      flat_node* pentry = find_entry(value_name, hparent_section);
+      if(!pentry)
+        return false;
+      read_value(*pentry, val);
+      return true;
+      CATCH_ENTRY("portable_storage_flat::template<>get_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_flat::get_value(const boost::string_ref value_name, storage_entry& val, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!hparent_section) hparent_section = &m_root;
+      flat_node* pentry = find_entry(value_name, hparent_section);
+      if(!pentry)
+        return false;
+      val = to_storage_entry(*pentry);
+      return true;
+      CATCH_ENTRY("portable_storage_flat::get_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_flat::set_value(const boost::string_ref value_name, const t_value& v, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!hparent_section) hparent_section = &m_root;
+      assign_value(*find_or_insert_entry(value_name, hparent_section), v);
+      return true;
+      CATCH_ENTRY("portable_storage_flat::template<>set_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_flat::set_value(const boost::string_ref value_name, const storage_entry& v, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!hparent_section) hparent_section = &m_root;
+      assign_value(*find_or_insert_entry(value_name, hparent_section), v);
+      return true;
+      CATCH_ENTRY("portable_storage_flat::set_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_storage_flat::harray portable_storage_flat::get_first_value(const boost::string_ref value_name, t_value& target, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      if(!hparent_section) hparent_section = &m_root;
+      flat_node* pentry = find_entry(value_name, hparent_section);
+      if(!pentry || !(pentry->m_type & SERIALIZE_FLAG_ARRAY))
+        return nullptr;
+      if(is_list_array(pentry->m_type))
+        pentry->m_cursor.node = pentry->m_list.first;
+      else
+        pentry->m_cursor.index = 0;
+      if(!read_next_element(*pentry, target))
+        return nullptr;
+      return pentry;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_flat::get_next_value(harray hval_array, t_value& target)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      CHECK_AND_ASSERT(hval_array, false);
+      return read_next_element(*hval_array, target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_storage_flat::harray portable_storage_flat::insert_first_value(const boost::string_ref value_name, const t_value& target, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!hparent_section) hparent_section = &m_root;
+      flat_node* pentry = find_or_insert_entry(value_name, hparent_section);
+      reset_content(*pentry, flat_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY);
+      append_value(*pentry, target);
+      return pentry;
+      CATCH_ENTRY("portable_storage_flat::insert_first_value", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_flat::insert_next_value(harray hval_array, const t_value& target)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT(hval_array, false);
+      CHECK_AND_ASSERT_MES(hval_array->m_type == (flat_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY),
+        false, "unexpected type in insert_next_value: " << typeid(t_value).name());
+      append_value(*hval_array, target);
+      return true;
+      CATCH_ENTRY("portable_storage_flat::insert_next_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    //sections
+    inline
+    portable_storage_flat::harray portable_storage_flat::get_first_section(const boost::string_ref sec_name, hsection& h_child_section, hsection hparent_section)
+    {
+      if(!hparent_section) hparent_section = &m_root;
+      flat_node* pentry = find_entry(sec_name, hparent_section);
+      if(!pentry || pentry->m_type != (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY) || !pentry->m_list.first)
+        return nullptr;
+      h_child_section = pentry->m_list.first;
+      pentry->m_cursor.node = h_child_section->m_next;
+      return pentry;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_flat::get_next_section(harray hsec_array, hsection& h_child_section)
+    {
+      CHECK_AND_ASSERT(hsec_array, false);
+      if(hsec_array->m_type != (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY) || !hsec_array->m_cursor.node)
+        return false;
+      h_child_section = const_cast<flat_node*>(hsec_array->m_cursor.node);
+      hsec_array->m_cursor.node = h_child_section->m_next;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_flat::harray portable_storage_flat::insert_first_section(const boost::string_ref sec_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      if(!hparent_section) hparent_section = &m_root;
+      flat_node* pentry = find_or_insert_entry(sec_name, hparent_section);
+      reset_content(*pentry, SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY);
+      hinserted_childsection = append_element(*pentry);
+      reset_content(*hinserted_childsection, SERIALIZE_TYPE_OBJECT);
+      return pentry;
+      CATCH_ENTRY("portable_storage_flat::insert_first_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_flat::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT(hsec_array, false);
+      CHECK_AND_ASSERT_MES(hsec_array->m_type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY),
+        false, "unexpected type(not 'section') in insert_next_section, type: " << (int)hsec_array->m_type);
+      hinserted_childsection = append_element(*hsec_array);
+      reset_content(*hinserted_childsection, SERIALIZE_TYPE_OBJECT);
+      return true;
+      CATCH_ENTRY("portable_storage_flat::insert_next_section", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_stream>
+    void portable_storage_flat::pack_section(t_stream& strm, const flat_node& sec)
+    {
+      pack_varint(strm, sec.m_count);
+      for(const flat_node* n = sec.m_list.first; n; n = n->m_next)
+      {
+        strm.write(reinterpret_cast<const char*>(&n->m_name_len), sizeof(n->m_name_len));
+        strm.write(n->m_name, n->m_name_len);
+        pack_entry(strm, *n);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_stream>
+    void portable_storage_flat::pack_entry(t_stream& strm, const flat_node& node)
+    {
+      strm.write(reinterpret_cast<const char*>(&node.m_type), sizeof(node.m_type));
+      if(node.m_type & SERIALIZE_FLAG_ARRAY)
+      {
+        pack_varint(strm, node.m_count);
+        switch(node.m_type & ~SERIALIZE_FLAG_ARRAY)
+        {
+        case SERIALIZE_TYPE_STRING:
+          for(const flat_node* n = node.m_list.first; n; n = n->m_next)
+          {
+            pack_varint(strm, n->m_str.size);
+            strm.write(n->m_str.data, n->m_str.size);
+          }
+          break;
+        case SERIALIZE_TYPE_OBJECT:
+          for(const flat_node* n = node.m_list.first; n; n = n->m_next)
+            pack_section(strm, *n);
+          break;
+        case SERIALIZE_TYPE_ARRAY:
+          for(const flat_node* n = node.m_list.first; n; n = n->m_next)
+            pack_entry(strm, *n);
+          break;
+        default:
+          //pod arrays are already packed
+          strm.write(node.m_str.data, node.m_str.size);
+        }
+        return;
+      }
+      switch(node.m_type)
+      {
+      case SERIALIZE_TYPE_STRING:
+        pack_varint(strm, node.m_str.size);
+        strm.write(node.m_str.data, node.m_str.size);
+        break;
+      case SERIALIZE_TYPE_OBJECT:
+        pack_section(strm, node);
+        break;
+      default:
+        strm.write(reinterpret_cast<const char*>(node.m_pod), flat_pod_size(node.m_type));
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_flat::store_to_binary(binarybuffer& target)
+    {
+      TRY_ENTRY();
+      const uint32_t signature_a = PORTABLE_STORAGE_SIGNATUREA;
+      const uint32_t signature_b = PORTABLE_STORAGE_SIGNATUREB;
+      const uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+
+      //size the buffer first so the payload is written with a single allocation
+      size_counter counter = {sizeof(signature_a) + sizeof(signature_b) + sizeof(ver)};
+      pack_section(counter, m_root);
+      target.resize(counter.m_size);
+
+      buffer_writer writer = {&target[0]};
+      writer.write(reinterpret_cast<const char*>(&signature_a), sizeof(signature_a));
+      writer.write(reinterpret_cast<const char*>(&signature_b), sizeof(signature_b));
+      writer.write(reinterpret_cast<const char*>(&ver), sizeof(ver));
+      pack_section(writer, m_root);
+      CHECK_AND_ASSERT_MES(writer.m_ptr == &target[0] + target.size(), false, "portable_storage_flat: packed size mismatch");
+      return true;
+      CATCH_ENTRY("portable_storage_flat::store_to_binary", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    size_t portable_storage_flat::flat_reader::read_varint()
+    {
+      CHECK_AND_ASSERT_THROW_MES(m_count >= 1, "empty buff, expected place for varint");
+      size_t v = 0;
+      uint8_t size_mask = (*m_ptr) & PORTABLE_RAW_SIZE_MARK_MASK;
+      switch (size_mask)
+      {
+      case PORTABLE_RAW_SIZE_MARK_BYTE: v = read<uint8_t>();break;
+      case PORTABLE_RAW_SIZE_MARK_WORD: v = read<uint16_t>();break;
+      case PORTABLE_RAW_SIZE_MARK_DWORD: v = read<uint32_t>();break;
+      case PORTABLE_RAW_SIZE_MARK_INT64: v = read<uint64_t>();break;
+      default:
+        CHECK_AND_ASSERT_THROW_MES(false, "unknown varint size_mask = " << size_mask);
+      }
+      v >>= 2;
+      return v;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::load_string(flat_reader& reader, flat_node& node)
+    {
+      reset_content(node, SERIALIZE_TYPE_STRING);
+      size_t len = reader.read_varint();
+      CHECK_AND_ASSERT_THROW_MES(len < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << len);
+      node.m_str.data = reader.take(len);
+      node.m_str.size = len;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::load_section(flat_reader& reader, flat_node& sec, size_t depth)
+    {
+      CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      reset_content(sec, SERIALIZE_TYPE_OBJECT);
+      size_t count = reader.read_varint();
+      while(count--)
+      {
+        flat_node* n = new_node();
+        n->m_name_len = reader.read<uint8_t>();
+        n->m_name = reader.take(n->m_name_len);
+        link_child(sec, n);
+        load_entry(reader, *n, reader.read<uint8_t>(), depth);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::load_entry(flat_reader& reader, flat_node& node, uint8_t type, size_t depth)
+    {
+      if(type & SERIALIZE_FLAG_ARRAY)
+        return load_array(reader, node, type, depth);
+
+      switch(type)
+      {
+      case SERIALIZE_TYPE_STRING:
+        load_string(reader, node);
+        break;
+      case SERIALIZE_TYPE_OBJECT:
+        load_section(reader, node, depth + 1);
+        break;
+      case SERIALIZE_TYPE_ARRAY:
+        type = reader.read<uint8_t>();
+        CHECK_AND_ASSERT_THROW_MES(type & SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+        load_array(reader, node, type, depth);
+        break;
+      default:
+        {
+          const size_t size = flat_pod_size(type);
+          CHECK_AND_ASSERT_THROW_MES(size, "unknown entry_type code = " << (int)type);
+          reset_content(node, type);
+          memcpy(node.m_pod, reader.take(size), size);
+        }
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_flat::load_array(flat_reader& reader, flat_node& node, uint8_t type, size_t depth)
+    {
+      CHECK_AND_ASSERT_THROW_MES(depth + 1 < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      reset_content(node, type);
+      size_t count = reader.read_varint();
+      switch(type & ~SERIALIZE_FLAG_ARRAY)
+      {
+      case SERIALIZE_TYPE_STRING:
+        CHECK_AND_ASSERT_THROW_MES(count <= reader.m_count, "Invalid");
+        while(count--)
+          load_string(reader, *append_element(node));
+        break;
+      case SERIALIZE_TYPE_OBJECT:
+        CHECK_AND_ASSERT_THROW_MES(count <= reader.m_count, "Invalid");
+        while(count--)
+          load_section(reader, *append_element(node), depth + 1);
+        break;
+      case SERIALIZE_TYPE_ARRAY:
+        CHECK_AND_ASSERT_THROW_MES(count == 0, "Reading array entry is not supported");
+        break;
+      default:
+        {
+          const size_t size = flat_pod_size(type & ~SERIALIZE_FLAG_ARRAY);
+          CHECK_AND_ASSERT_THROW_MES(size, "unknown entry_type code = " << (int)type);
+          CHECK_AND_ASSERT_THROW_MES(count <= reader.m_count / size, "Invalid");
+          node.m_str.data = reader.take(count * size);
+          node.m_str.size = count * size;
+          node.m_count = count;
+        }
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_flat::load_from_binary(const epee::span<const uint8_t> source)
+    {
+      reset();
+      const size_t header_size = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint8_t);
+      if(source.size() < header_size)
+      {
+        LOG_ERROR("portable_storage_flat: wrong binary format, packet size = " << source.size() << " less than expected header size " << header_size);
+        return false;
+      }
+      flat_reader reader = {source.data(), source.size()};
+      const uint32_t signature_a = reader.read<uint32_t>();
+      const uint32_t signature_b = reader.read<uint32_t>();
+      const uint8_t ver = reader.read<uint8_t>();
+      if(signature_a != PORTABLE_STORAGE_SIGNATUREA ||
+        signature_b != PORTABLE_STORAGE_SIGNATUREB
+        )
+      {
+        LOG_ERROR("portable_storage_flat: wrong binary format - signature mismatch");
+        return false;
+      }
+      if(ver != PORTABLE_STORAGE_FORMAT_VER)
+      {
+        LOG_ERROR("portable_storage_flat: wrong binary format - unknown format ver = " << (int)ver);
+        return false;
+      }
+      TRY_ENTRY();
+      //nodes take a small fraction of the payload, which is mostly blobs
+      m_arena.reserve(source.size() / 8);
+      load_section(reader, m_root, 0);
+      return true;
+      CATCH_ENTRY("portable_storage_flat::load_from_binary", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+  }
+}
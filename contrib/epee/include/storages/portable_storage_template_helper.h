@@ -30,6 +30,7 @@
 
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_flat.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -86,7 +87,7 @@ namespace epee
     template<class t_struct>
     bool load_t_from_binary(t_struct& out, const std::string& binary_buff)
     {
-      portable_storage ps;
+      portable_storage_flat ps;
       bool rs = ps.load_from_binary(binary_buff);
       if(!rs)
         return false;
@@ -107,7 +108,7 @@ namespace epee
     template<class t_struct>
     bool store_t_to_binary(t_struct& str_in, std::string& binary_buff, size_t indent = 0)
     {
-      portable_storage ps;
+      portable_storage_flat ps;
       str_in.store(ps);
       return ps.store_to_binary(binary_buff);
     }
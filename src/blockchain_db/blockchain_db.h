@@ -1335,6 +1335,26 @@ public:
    */
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const = 0;
 
+  /**
+   * @brief gets output indices (amount-specific) for a run of transactions
+   *
+   * Transaction IDs are handed out sequentially as blocks are added, so the
+   * transactions of a range of blocks (miner tx first, then the block's txs,
+   * block after block) occupy consecutive IDs.  The subclass should fetch
+   * the amount-specific output indices of the n_txes transactions starting
+   * at tx_id with a single sequential scan, rather than one lookup per
+   * transaction.
+   *
+   * If any of the transactions does not exist, the subclass should throw
+   * TX_DNE.
+   *
+   * @param tx_id the ID of the first transaction
+   * @param n_txes the number of transactions to fetch
+   *
+   * @return one list of amount-specific output indices per transaction
+   */
+  virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_id, size_t n_txes) const = 0;
+
   /**
    * @brief check if a key image is stored as spent
    *
@@ -1527,6 +1547,81 @@ public:
    */
   virtual void drop_hard_fork_info() = 0;
 
+
+  //
+  // PoS block validity storage
+  //
+
+  /**
+   * @brief records the reserve bytes data hash the seed nodes confirmed for a height
+   *
+   * Only confirmed hashes are stored: a rejection may just mean the seed nodes
+   * were unreachable. The records are kept when blocks are popped, so a block
+   * re-added at a height is verified locally.
+   *
+   * @param height the height
+   * @param data_hash the reserve bytes data hash carried by the block
+   */
+  virtual void set_verified_block_data_hash(uint64_t height, const std::string& data_hash) = 0;
+
+  /**
+   * @brief gets the confirmed reserve bytes data hash of a height
+   *
+   * @param height the height
+   * @param data_hash return-by-reference the confirmed data hash
+   *
+   * @return true if a data hash was confirmed for this height, otherwise false
+   */
+  virtual bool get_verified_block_data_hash(uint64_t height, std::string& data_hash) const = 0;
+
+  //
+  // Pruning
+  //
+
+  /**
+   * @brief gets the pruning seed of the database
+   *
+   * @return the pruning seed, or 0 if the database is not pruned
+   */
+  virtual uint32_t get_blockchain_pruning_seed() const = 0;
+
+  /**
+   * @brief prunes the prunable data of transactions outside the kept stripe
+   *
+   * The prunable part (signatures, range proofs) of version 2 transactions is
+   * removed for blocks which are neither in the stripe selected by the seed
+   * nor in the last CRYPTONOTE_PRUNING_TIP_BLOCKS blocks. Transactions in the
+   * tip are recorded so update_pruning can prune them as the chain grows.
+   *
+   * The work is split in short transactions. If a lock is given, it is
+   * held for each of them only, so the owner of the lock can write blocks
+   * in between.
+   *
+   * @param pruning_seed the seed to prune with, 0 to keep the current one or pick a random stripe
+   * @param lock optional lock to take around each transaction
+   *
+   * @return true on success, false if the database is already pruned with another seed
+   */
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0, epee::critical_section *lock = NULL) = 0;
+
+  /**
+   * @brief prunes the transactions which left the tip since the last call
+   *
+   * @param lock optional lock to take around each transaction
+   *
+   * @return true on success, or if the database is not pruned
+   */
+  virtual bool update_pruning(epee::critical_section *lock = NULL) = 0;
+
+  /**
+   * @brief checks prunable data is present exactly where the seed says it should be
+   *
+   * @param lock optional lock to take around each transaction
+   *
+   * @return true if the database is consistent with its pruning seed
+   */
+  virtual bool check_pruning(epee::critical_section *lock = NULL) = 0;
+
   /**
    * @brief return a histogram of outputs on the blockchain
    *
@@ -37,6 +37,7 @@
 #include "string_tools.h"
 #include "file_io_utils.h"
 #include "common/util.h"
+#include "common/pruning.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "crypto/crypto.h"
 #include "profile_tools.h"
@@ -56,6 +57,9 @@ using namespace crypto;
 // Increase when the DB structure changes
 #define VERSION 3
 
+// Txes handled per write transaction while pruning, so block writes can interleave
+#define PRUNING_TXN_SIZE 10000
+
 namespace
 {
 
@@ -167,6 +171,7 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * txs_pruned       txn ID       pruned txn blob
  * txs_prunable     txn ID       prunable txn blob
  * txs_prunable_hash txn ID      prunable txn hash
+ * txs_prunable_tip txn ID       block height (pruned DBs only, txs in the unpruned tip)
  * tx_indices       txn hash     {txn ID, metadata}
  * tx_outputs       txn ID       [txn amount output indices]
  *
@@ -194,6 +199,7 @@ const char* const LMDB_TXS = "txs";
 const char* const LMDB_TXS_PRUNED = "txs_pruned";
 const char* const LMDB_TXS_PRUNABLE = "txs_prunable";
 const char* const LMDB_TXS_PRUNABLE_HASH = "txs_prunable_hash";
+const char* const LMDB_TXS_PRUNABLE_TIP = "txs_prunable_tip";
 const char* const LMDB_TX_INDICES = "tx_indices";
 const char* const LMDB_TX_OUTPUTS = "tx_outputs";
 
@@ -207,6 +213,8 @@ const char* const LMDB_TXPOOL_BLOB = "txpool_blob";
 const char* const LMDB_HF_STARTING_HEIGHTS = "hf_starting_heights";
 const char* const LMDB_HF_VERSIONS = "hf_versions";
 
+const char* const LMDB_BLOCK_DATA_HASHES = "block_data_hashes";
+
 const char* const LMDB_PROPERTIES = "properties";
 
 const char zerokey[8] = {0};
@@ -855,6 +863,15 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
     result = mdb_cursor_put(m_cur_txs_prunable_hash, &val_tx_id, &val_prunable_hash, MDB_APPEND);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to add prunable tx prunable hash to db transaction: ", result).c_str()));
+
+    // a new block is always in the tip, update_pruning prunes it once it leaves
+    if (m_pruning_seed)
+    {
+      MDB_val_copy<uint64_t> val_height(m_height);
+      result = mdb_put(*m_write_txn, m_txs_prunable_tip, &val_tx_id, &val_height, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to add prunable tip tx to db transaction: ", result).c_str()));
+    }
   }
 
   return tx_id;
@@ -889,11 +906,15 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
   if (result)
       throw1(DB_ERROR(lmdb_error("Failed to add removal of pruned tx to db transaction: ", result).c_str()));
 
-  if ((result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET)))
+  result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET);
+  if (result == 0)
+  {
+    result = mdb_cursor_del(m_cur_txs_prunable, 0);
+    if (result)
+        throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
+  }
+  else if (result != MDB_NOTFOUND || !m_pruning_seed)
       throw1(DB_ERROR(lmdb_error("Failed to locate prunable tx for removal: ", result).c_str()));
-  result = mdb_cursor_del(m_cur_txs_prunable, 0);
-  if (result)
-      throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
 
   if (tx.version > 1)
   {
@@ -902,6 +923,13 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
     result = mdb_cursor_del(m_cur_txs_prunable_hash, 0);
     if (result)
         throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable hash tx to db transaction: ", result).c_str()));
+
+    if (m_pruning_seed)
+    {
+      result = mdb_del(*m_write_txn, m_txs_prunable_tip, &val_tx_id, NULL);
+      if (result && result != MDB_NOTFOUND)
+        throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tip tx to db transaction: ", result).c_str()));
+    }
   }
 
   remove_tx_outputs(tip->data.tx_id, tx);
@@ -1166,6 +1194,7 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_pruning_seed = 0;
 
   // reset may also need changing when initialize things here
 
@@ -1283,6 +1312,13 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   lmdb_db_open(txn, LMDB_TXS_PRUNED, MDB_INTEGERKEY | MDB_CREATE, m_txs_pruned, "Failed to open db handle for m_txs_pruned");
   lmdb_db_open(txn, LMDB_TXS_PRUNABLE, MDB_INTEGERKEY | MDB_CREATE, m_txs_prunable, "Failed to open db handle for m_txs_prunable");
   lmdb_db_open(txn, LMDB_TXS_PRUNABLE_HASH, MDB_INTEGERKEY | MDB_CREATE, m_txs_prunable_hash, "Failed to open db handle for m_txs_prunable_hash");
+  // the tip table is only written as blocks are added, which a read-only open
+  // never does, so tolerate it missing from a database made before pruning support
+  m_has_txs_prunable_tip = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_TXS_PRUNABLE_TIP, MDB_INTEGERKEY | MDB_CREATE, m_txs_prunable_tip, "Failed to open db handle for m_txs_prunable_tip");
+  else if (mdb_dbi_open(txn, LMDB_TXS_PRUNABLE_TIP, MDB_INTEGERKEY, &m_txs_prunable_tip))
+    m_has_txs_prunable_tip = false;
   lmdb_db_open(txn, LMDB_TX_INDICES, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_tx_indices, "Failed to open db handle for m_tx_indices");
   lmdb_db_open(txn, LMDB_TX_OUTPUTS, MDB_INTEGERKEY | MDB_CREATE, m_tx_outputs, "Failed to open db handle for m_tx_outputs");
 
@@ -1302,6 +1338,14 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   lmdb_db_open(txn, LMDB_HF_VERSIONS, MDB_INTEGERKEY | MDB_CREATE, m_hf_versions, "Failed to open db handle for m_hf_versions");
 
+  // seed verdicts are only written by a writable daemon, so a read-only open of
+  // a database that predates them must not fail; lookups then just miss
+  m_has_block_data_hashes = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_BLOCK_DATA_HASHES, MDB_INTEGERKEY | MDB_CREATE, m_block_data_hashes, "Failed to open db handle for m_block_data_hashes");
+  else if (mdb_dbi_open(txn, LMDB_BLOCK_DATA_HASHES, MDB_INTEGERKEY, &m_block_data_hashes))
+    m_has_block_data_hashes = false;
+
   lmdb_db_open(txn, LMDB_PROPERTIES, MDB_CREATE, m_properties, "Failed to open db handle for m_properties");
 
   mdb_set_dupsort(txn, m_spent_keys, compare_hash32);
@@ -1364,6 +1408,11 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       compatible = false;
   }
 
+  m_pruning_seed = 0;
+  MDB_val_copy<const char*> pk("pruning_seed");
+  if (mdb_get(txn, m_properties, &pk, &v) == MDB_SUCCESS)
+    m_pruning_seed = *(const uint32_t*)v.mv_data;
+
   if (!compatible)
   {
     txn.abort();
@@ -1459,6 +1508,8 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_txs_prunable: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs_prunable_hash, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_txs_prunable_hash: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_txs_prunable_tip, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_txs_prunable_tip: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_tx_indices, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_tx_indices: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_tx_outputs, 0))
@@ -1474,6 +1525,7 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_hf_versions: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_properties, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_properties: ", result).c_str()));
+  // m_block_data_hashes is kept, the seed nodes' verdicts do not depend on the local chain
 
   // init with current version
   MDB_val_copy<const char*> k("version");
@@ -1484,6 +1536,7 @@ void BlockchainLMDB::reset()
   txn.commit();
   m_cum_size = 0;
   m_cum_count = 0;
+  m_pruning_seed = 0;
 }
 
 std::vector<std::string> BlockchainLMDB::get_filenames() const
@@ -2578,6 +2631,44 @@ std::vector<uint64_t> BlockchainLMDB::get_tx_amount_output_indices(const uint64_
   return amount_output_indices;
 }
 
+std::vector<std::vector<uint64_t>> BlockchainLMDB::get_tx_amount_output_indices(const uint64_t tx_id, size_t n_txes) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_outputs);
+
+  MDB_val_set(k_tx_id, tx_id);
+  MDB_val v;
+  std::vector<std::vector<uint64_t>> amount_output_indices_set;
+  amount_output_indices_set.reserve(n_txes);
+
+  // tx_outputs is keyed by tx_id, so a run of consecutive transactions is a
+  // run of consecutive records: position once, then walk forward
+  MDB_cursor_op op = MDB_SET;
+  for (size_t n = 0; n < n_txes; ++n)
+  {
+    int result = mdb_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, op);
+    if (result == MDB_NOTFOUND)
+      throw1(TX_DNE(std::string("Transaction with id ").append(std::to_string(tx_id + n)).append(" not found in tx_outputs").c_str()));
+    else if (result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to get data for tx_outputs[tx_index]", result).c_str()));
+    op = MDB_NEXT;
+
+    if (*(const uint64_t*)k_tx_id.mv_data != tx_id + n)
+      throw0(DB_ERROR("Unexpected gap in tx_outputs while reading a range of transactions"));
+
+    const uint64_t* indices = (const uint64_t*)v.mv_data;
+    const size_t num_outputs = v.mv_size / sizeof(uint64_t);
+    amount_output_indices_set.emplace_back(indices, indices + num_outputs);
+  }
+
+  TXN_POSTFIX_RDONLY();
+  return amount_output_indices_set;
+}
+
 
 bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
 {
@@ -3463,6 +3554,273 @@ uint8_t BlockchainLMDB::get_hard_fork_version(uint64_t height) const
   return ret;
 }
 
+void BlockchainLMDB::set_verified_block_data_hash(uint64_t height, const std::string& data_hash)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_BLOCK_PREFIX(0);
+
+  MDB_val_copy<uint64_t> val_key(height);
+  MDB_val val_value = {data_hash.size(), (void*)data_hash.data()};
+  int result = mdb_put(*txn_ptr, m_block_data_hashes, &val_key, &val_value, 0);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error adding block data hash to db transaction: ", result).c_str()));
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+}
+
+bool BlockchainLMDB::get_verified_block_data_hash(uint64_t height, std::string& data_hash) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (!m_has_block_data_hashes)
+    return false;
+
+  TXN_PREFIX_RDONLY();
+
+  MDB_val_copy<uint64_t> val_key(height);
+  MDB_val val_ret;
+  auto result = mdb_get(m_txn, m_block_data_hashes, &val_key, &val_ret);
+  if (result == MDB_NOTFOUND)
+    return false;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block data hash at height " + boost::lexical_cast<std::string>(height) + " from the db: ", result).c_str()));
+
+  data_hash.assign((const char*)val_ret.mv_data, val_ret.mv_size);
+  TXN_POSTFIX_RDONLY();
+  return true;
+}
+
+uint32_t BlockchainLMDB::get_blockchain_pruning_seed() const
+{
+  return m_pruning_seed;
+}
+
+bool BlockchainLMDB::prune_blockchain(uint32_t pruning_seed, epee::critical_section *lock)
+{
+  return prune_worker(prune_mode_prune, pruning_seed, lock);
+}
+
+bool BlockchainLMDB::update_pruning(epee::critical_section *lock)
+{
+  return prune_worker(prune_mode_update, 0, lock);
+}
+
+bool BlockchainLMDB::check_pruning(epee::critical_section *lock)
+{
+  return prune_worker(prune_mode_check, 0, lock);
+}
+
+bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed, epee::critical_section *lock)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (is_read_only())
+    throw0(DB_ERROR("Cannot prune a read-only database"));
+  if (!m_has_txs_prunable_tip)
+    throw0(DB_ERROR("Database lacks the prunable tip table"));
+
+  if (mode == prune_mode_prune)
+  {
+    if (pruning_seed == 0)
+      pruning_seed = m_pruning_seed ? m_pruning_seed : tools::make_pruning_seed(tools::get_random_stripe(), CRYPTONOTE_PRUNING_LOG_STRIPES);
+    if (tools::get_pruning_log_stripes(pruning_seed) != CRYPTONOTE_PRUNING_LOG_STRIPES)
+      throw0(DB_ERROR("Pruning seed not in range"));
+    if (m_pruning_seed && m_pruning_seed != pruning_seed)
+    {
+      MERROR("Blockchain already pruned with seed " << m_pruning_seed << ", cannot prune with " << pruning_seed);
+      return false;
+    }
+  }
+  else
+  {
+    pruning_seed = m_pruning_seed;
+    if (pruning_seed == 0)
+      return mode == prune_mode_update;
+  }
+  const uint32_t stripe = tools::get_pruning_stripe(pruning_seed);
+
+  MDB_val k, v;
+  int result;
+  uint64_t n_total = 0, n_prunable = 0, n_pruned = 0, n_tip = 0, n_bad = 0;
+  crypto::hash last_hash = crypto::null_hash;
+  bool done = false, started = false;
+  while (!done)
+  {
+    // short transactions let the daemon keep writing in between, and let the map grow
+    if (lock)
+      lock->lock();
+    const auto unlock = epee::misc_utils::create_scope_leave_handler([lock]() { if (lock) lock->unlock(); });
+
+    // the lock owner only batches while holding it
+    if (m_batch_active)
+      throw0(DB_ERROR("Cannot prune while a batch transaction is active"));
+
+    if (need_resize())
+    {
+      MINFO("DB resize needed while pruning");
+      do_resize();
+    }
+
+    mdb_txn_safe txn;
+    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, txn))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
+
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    const uint64_t blockchain_height = db_stats.ms_entries;
+
+    if (mode == prune_mode_prune && !m_pruning_seed)
+    {
+      // from here, new transactions get recorded in the tip table
+      MDB_val_copy<const char*> pk("pruning_seed");
+      MDB_val_copy<uint32_t> pv(pruning_seed);
+      if ((result = mdb_put(txn, m_properties, &pk, &pv, 0)))
+        throw0(DB_ERROR(lmdb_error("Failed to save pruning seed: ", result).c_str()));
+    }
+
+    size_t n = 0;
+    if (mode == prune_mode_update)
+    {
+      MDB_cursor *c_tip;
+      if ((result = mdb_cursor_open(txn, m_txs_prunable_tip, &c_tip)))
+        throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_tip: ", result).c_str()));
+      while (n < PRUNING_TXN_SIZE)
+      {
+        result = mdb_cursor_get(c_tip, &k, &v, MDB_FIRST);
+        if (result == MDB_NOTFOUND)
+        {
+          done = true;
+          break;
+        }
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to enumerate txs_prunable_tip: ", result).c_str()));
+        // tx ids grow with height, so the first one still in the tip ends the walk
+        const uint64_t block_height = *(const uint64_t*)v.mv_data;
+        const uint32_t block_stripe = tools::get_pruning_stripe(block_height, blockchain_height, CRYPTONOTE_PRUNING_LOG_STRIPES);
+        if (block_stripe == 0)
+        {
+          done = true;
+          break;
+        }
+        ++n_total;
+        if (block_stripe != stripe)
+        {
+          result = mdb_del(txn, m_txs_prunable, &k, NULL);
+          if (result == 0)
+            ++n_pruned;
+          else if (result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("Failed to delete prunable tx data: ", result).c_str()));
+        }
+        if ((result = mdb_cursor_del(c_tip, 0)))
+          throw0(DB_ERROR(lmdb_error("Failed to delete txs_prunable_tip entry: ", result).c_str()));
+        ++n;
+      }
+    }
+    else
+    {
+      MDB_cursor *c_tx_indices;
+      if ((result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices)))
+        throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+      MDB_cursor_op op = MDB_FIRST;
+      if (started)
+      {
+        // resume after the last hash seen by the previous transaction
+        k = zerokval;
+        MDB_val_set(vh, last_hash);
+        v = vh;
+        result = mdb_cursor_get(c_tx_indices, &k, &v, MDB_GET_BOTH_RANGE);
+        if (result == MDB_NOTFOUND)
+          done = true;
+        else if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to locate tx_indices position: ", result).c_str()));
+        op = (result == 0 && ((const txindex*)v.mv_data)->key == last_hash) ? MDB_NEXT : MDB_GET_CURRENT;
+      }
+      started = true;
+      while (!done && n < PRUNING_TXN_SIZE)
+      {
+        result = mdb_cursor_get(c_tx_indices, &k, &v, op);
+        op = MDB_NEXT;
+        if (result == MDB_NOTFOUND)
+        {
+          done = true;
+          break;
+        }
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to enumerate tx_indices: ", result).c_str()));
+        const txindex *ti = (const txindex*)v.mv_data;
+        last_hash = ti->key;
+        ++n_total;
+        ++n;
+
+        // only txes with a prunable hash can be verified once their prunable data is gone
+        MDB_val_set(val_tx_id, ti->data.tx_id);
+        MDB_val val_unused;
+        result = mdb_get(txn, m_txs_prunable_hash, &val_tx_id, &val_unused);
+        if (result == MDB_NOTFOUND)
+          continue;
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get prunable hash: ", result).c_str()));
+        ++n_prunable;
+
+        const uint64_t block_height = ti->data.block_id;
+        const uint32_t block_stripe = tools::get_pruning_stripe(block_height, blockchain_height, CRYPTONOTE_PRUNING_LOG_STRIPES);
+        if (mode == prune_mode_check)
+        {
+          const bool should_have = block_stripe == 0 || block_stripe == stripe;
+          result = mdb_get(txn, m_txs_prunable, &val_tx_id, &val_unused);
+          if (result && result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data: ", result).c_str()));
+          if (should_have != (result == 0))
+          {
+            MERROR("Prunable data of tx " << ti->key << " at height " << block_height << (should_have ? " is missing" : " should have been pruned"));
+            ++n_bad;
+          }
+        }
+        else if (block_stripe == 0)
+        {
+          MDB_val_copy<uint64_t> val_height(block_height);
+          if ((result = mdb_put(txn, m_txs_prunable_tip, &val_tx_id, &val_height, 0)))
+            throw0(DB_ERROR(lmdb_error("Failed to add prunable tip tx: ", result).c_str()));
+          ++n_tip;
+        }
+        else if (block_stripe != stripe)
+        {
+          result = mdb_del(txn, m_txs_prunable, &val_tx_id, NULL);
+          if (result == 0)
+            ++n_pruned;
+          else if (result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("Failed to delete prunable tx data: ", result).c_str()));
+        }
+      }
+    }
+
+    if (mode == prune_mode_check)
+      txn.abort();
+    else
+      txn.commit();
+    if (mode == prune_mode_prune)
+    {
+      m_pruning_seed = pruning_seed;
+      if (!done)
+        MINFO("Pruning: " << n_total << " txes scanned, " << n_pruned << " pruned");
+    }
+  }
+
+  if (mode == prune_mode_check)
+  {
+    MINFO("Checked pruning: " << n_total << " txes, " << n_prunable << " prunable, " << n_bad << " inconsistent");
+    return n_bad == 0;
+  }
+  MINFO((mode == prune_mode_prune ? "Pruned blockchain: " : "Updated pruning: ") << n_total << " txes scanned, " <<
+      n_pruned << " pruned, " << n_tip << " kept in the tip, seed " << pruning_seed);
+  return true;
+}
+
 bool BlockchainLMDB::is_read_only() const
 {
   unsigned int flags;
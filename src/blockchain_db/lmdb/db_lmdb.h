@@ -253,6 +253,7 @@ public:
   virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const;
 
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const;
+  virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_id, size_t n_txes) const;
 
   virtual bool has_key_image(const crypto::key_image& img) const;
 
@@ -357,6 +358,14 @@ private:
   virtual void check_hard_fork_info();
   virtual void drop_hard_fork_info();
 
+  virtual void set_verified_block_data_hash(uint64_t height, const std::string& data_hash);
+  virtual bool get_verified_block_data_hash(uint64_t height, std::string& data_hash) const;
+
+  virtual uint32_t get_blockchain_pruning_seed() const;
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0, epee::critical_section *lock = NULL);
+  virtual bool update_pruning(epee::critical_section *lock = NULL);
+  virtual bool check_pruning(epee::critical_section *lock = NULL);
+
   /**
    * @brief convert a tx output to a blob for storage
    *
@@ -395,6 +404,9 @@ private:
 
   void cleanup_batch();
 
+  enum { prune_mode_prune, prune_mode_update, prune_mode_check };
+  bool prune_worker(int mode, uint32_t pruning_seed, epee::critical_section *lock);
+
 private:
   MDB_env* m_env;
 
@@ -406,6 +418,8 @@ private:
   MDB_dbi m_txs_pruned;
   MDB_dbi m_txs_prunable;
   MDB_dbi m_txs_prunable_hash;
+  MDB_dbi m_txs_prunable_tip;
+  bool m_has_txs_prunable_tip; // false for a pre-pruning database opened read-only
   MDB_dbi m_tx_indices;
   MDB_dbi m_tx_outputs;
 
@@ -420,8 +434,13 @@ private:
   MDB_dbi m_hf_starting_heights;
   MDB_dbi m_hf_versions;
 
+  MDB_dbi m_block_data_hashes;
+  bool m_has_block_data_hashes; // false for a pre-verdict database opened read-only
+
   MDB_dbi m_properties;
 
+  uint32_t m_pruning_seed; // 0 if not pruned
+
   mutable uint64_t m_cum_size;	// used in batch size estimation
   mutable unsigned int m_cum_count;
   std::string m_folder;
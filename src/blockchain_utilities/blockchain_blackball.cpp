@@ -33,6 +33,7 @@
 #include "common/unordered_containers_boost_serialization.h"
 #include "common/command_line.h"
 #include "common/varint.h"
+#include "common/threadpool.h"
 #include "serialization/crypto.h"
 #include "cryptonote_basic/cryptonote_boost_serialization.h"
 #include "cryptonote_core/tx_pool.h"
@@ -54,6 +55,9 @@ static const char zerokey[8] = {0};
 static const MDB_val zerokval = { sizeof(zerokey), (void *)zerokey };
 
 static uint64_t records_per_sync = 200;
+static const size_t tx_prepare_batch_size = 1000;
+static const size_t max_prepared_subset_keys = 1 << 20; // a ring of 11 has 2046 subsets
+static const size_t secondary_pass_slice_size = 1000;
 static uint64_t db_flags = 0;
 static MDB_dbi dbi_relative_rings;
 static MDB_dbi dbi_outputs;
@@ -230,7 +234,8 @@ static void init(std::string cache_filename)
 
   tools::create_directories_if_necessary(cache_filename);
 
-  int flags = 0;
+  // read only snapshots are used from threadpool workers
+  int flags = MDB_NOTLS;
   if (db_flags & DBF_FAST)
     flags |= MDB_NOSYNC;
   if (db_flags & DBF_FASTEST)
@@ -328,7 +333,73 @@ static std::vector<uint64_t> decompress_ring(const std::string &s)
   return ring;
 }
 
-static bool for_all_transactions(const std::string &filename, uint64_t &start_idx, uint64_t &n_txes, const std::function<bool(const cryptonote::transaction_prefix&)> &f)
+static std::vector<uint64_t> canonicalize(const std::vector<uint64_t> &v);
+static std::string keep_under_511(const std::string &s);
+
+// an input, with everything the scan needs from it that does not depend on
+// the scan's state, so inputs can be prepared on the threadpool
+struct prepared_input
+{
+  const txin_to_key *txin;
+  std::vector<uint64_t> absolute;
+  std::vector<uint64_t> canonical;
+  std::string ring_key;
+  // ring_instances keys of the subsets of the canonical ring, back to back
+  std::string subset_keys;
+  std::vector<uint32_t> subset_key_ends;
+};
+
+struct prepared_tx
+{
+  cryptonote::transaction_prefix tx;
+  std::vector<prepared_input> inputs;
+};
+
+static std::string get_ring_key(uint64_t amount, const std::vector<uint64_t> &ring)
+{
+  return keep_under_511(compress_ring(amount, ring));
+}
+
+static void prepare_input(const txin_to_key &txin, prepared_input &pi)
+{
+  pi.txin = &txin;
+  pi.absolute = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
+  pi.canonical = canonicalize(txin.key_offsets);
+  pi.ring_key = get_ring_key(txin.amount, pi.canonical);
+}
+
+static size_t get_num_subsets(const prepared_input &pi)
+{
+  if (pi.canonical.size() > 11)
+    return 0;
+  return (((size_t)1) << pi.canonical.size()) - 2;
+}
+
+static void prepare_subsets(prepared_input &pi)
+{
+  if (pi.canonical.size() > 11)
+    return;
+
+  const std::vector<uint64_t> &ring = pi.canonical;
+  std::vector<uint64_t> subset;
+  subset.reserve(ring.size());
+  pi.subset_key_ends.reserve(get_num_subsets(pi));
+  for (uint64_t mask = 1; mask < (((uint64_t)1) << ring.size()) - 1; ++mask)
+  {
+    subset.resize(0);
+    for (size_t i = 0; i < ring.size(); ++i)
+      if ((mask >> i) & 1)
+        subset.push_back(ring[i]);
+    pi.subset_keys += get_ring_key(pi.txin->amount, subset);
+    pi.subset_key_ends.push_back(pi.subset_keys.size());
+  }
+}
+
+// Reads transactions in batches, parses them and prepares their inputs on
+// the threadpool, then calls f on each in order. Ring subsets, which can be
+// thousands per input, are prepared for as many transactions at a time as
+// fit in max_prepared_subset_keys, and dropped once f has seen them
+static bool for_all_transactions(const std::string &filename, uint64_t &start_idx, uint64_t &n_txes, bool rct_only, bool with_subsets, const std::function<bool(const prepared_tx&)> &f)
 {
   MDB_env *env;
   MDB_dbi dbi;
@@ -365,38 +436,112 @@ static bool for_all_transactions(const std::string &filename, uint64_t &start_id
   n_txes = stat.ms_entries;
 
   bool fret = true;
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  std::vector<uint64_t> idxs;
+  std::vector<blobdata> blobs;
+  std::vector<prepared_tx> txs;
+  std::unique_ptr<std::atomic<bool>[]> parsed(new std::atomic<bool>[tx_prepare_batch_size]);
 
   k.mv_size = sizeof(uint64_t);
   k.mv_data = &start_idx;
   MDB_cursor_op op = MDB_SET;
-  while (1)
+  bool done = false;
+  while (fret && !done)
   {
-    int ret = mdb_cursor_get(cur, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(ret)));
+    idxs.clear();
+    blobs.clear();
+    while (blobs.size() < tx_prepare_batch_size)
+    {
+      int ret = mdb_cursor_get(cur, &k, &v, op);
+      op = MDB_NEXT;
+      if (ret == MDB_NOTFOUND)
+      {
+        done = true;
+        break;
+      }
+      if (ret)
+        throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(ret)));
+
+      if (k.mv_size != sizeof(uint64_t))
+        throw std::runtime_error("Bad key size");
+      const uint64_t idx = *(uint64_t*)k.mv_data;
+      if (idx < start_idx)
+        continue;
+      idxs.push_back(idx);
+      blobs.push_back(blobdata(reinterpret_cast<char*>(v.mv_data), v.mv_size));
+    }
 
-    if (k.mv_size != sizeof(uint64_t))
-      throw std::runtime_error("Bad key size");
-    const uint64_t idx = *(uint64_t*)k.mv_data;
-    if (idx < start_idx)
-      continue;
+    txs.clear();
+    txs.resize(blobs.size());
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < blobs.size(); ++i)
+    {
+      parsed[i] = false;
+      tpool.submit(&waiter, [&, i]() {
+        try
+        {
+          std::stringstream ss;
+          ss << blobs[i];
+          binary_archive<false> ba(ss);
+          if (!do_serialize(ba, txs[i].tx))
+            return;
+          for (const auto &in: txs[i].tx.vin)
+          {
+            if (in.type() != typeid(txin_to_key))
+              continue;
+            const auto &txin = boost::get<txin_to_key>(in);
+            if (rct_only && txin.amount != 0)
+              continue;
+            txs[i].inputs.push_back(prepared_input());
+            prepare_input(txin, txs[i].inputs.back());
+          }
+          parsed[i] = true;
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to prepare transaction " << idxs[i] << ": " << e.what());
+        }
+      }, true);
+    }
+    waiter.wait(&tpool);
 
-    cryptonote::transaction_prefix tx;
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    std::stringstream ss;
-    ss << bd;
-    binary_archive<false> ba(ss);
-    bool r = do_serialize(ba, tx);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
-
-    start_idx = *(uint64_t*)k.mv_data;
-    if (!f(tx)) {
-      fret = false;
-      break;
+    size_t begin = 0;
+    while (fret && begin < txs.size())
+    {
+      size_t end = txs.size();
+      if (with_subsets)
+      {
+        size_t n_subsets = 0;
+        for (end = begin; end < txs.size(); ++end)
+        {
+          size_t tx_subsets = 0;
+          for (const auto &pi: txs[end].inputs)
+            tx_subsets += get_num_subsets(pi);
+          if (end > begin && n_subsets + tx_subsets > max_prepared_subset_keys)
+            break;
+          n_subsets += tx_subsets;
+        }
+        for (size_t i = begin; i < end; ++i)
+          for (size_t j = 0; j < txs[i].inputs.size(); ++j)
+            tpool.submit(&waiter, [&txs, i, j]() { prepare_subsets(txs[i].inputs[j]); }, true);
+        waiter.wait(&tpool);
+      }
+
+      for (size_t i = begin; i < end; ++i)
+      {
+        CHECK_AND_ASSERT_MES(parsed[i], false, "Failed to parse transaction from blob");
+        start_idx = idxs[i];
+        if (!f(txs[i])) {
+          fret = false;
+          break;
+        }
+        for (auto &pi: txs[i].inputs)
+        {
+          std::string().swap(pi.subset_keys);
+          std::vector<uint32_t>().swap(pi.subset_key_ends);
+        }
+      }
+      begin = end;
     }
   }
 
@@ -658,12 +803,11 @@ static std::string keep_under_511(const std::string &s)
   return std::string((const char*)&hash, 32);
 }
 
-static uint64_t get_ring_instances(MDB_txn *txn, uint64_t amount, const std::vector<uint64_t> &ring)
+static uint64_t get_ring_instances(MDB_txn *txn, const char *key, size_t key_size)
 {
-  const std::string sring = keep_under_511(compress_ring(amount, ring));
   MDB_val k, v;
-  k.mv_data = (void*)sring.data();
-  k.mv_size = sring.size();
+  k.mv_data = (void*)key;
+  k.mv_size = key_size;
   int dbr = mdb_get(txn, dbi_ring_instances, &k, &v);
   if (dbr == MDB_NOTFOUND)
     return 0;
@@ -671,29 +815,20 @@ static uint64_t get_ring_instances(MDB_txn *txn, uint64_t amount, const std::vec
   return *(const uint64_t*)v.mv_data;
 }
 
-static uint64_t get_ring_subset_instances(MDB_txn *txn, uint64_t amount, const std::vector<uint64_t> &ring)
+static uint64_t get_ring_subset_instances(MDB_txn *txn, const prepared_input &pi)
 {
-  uint64_t instances = get_ring_instances(txn, amount, ring);
-  if (ring.size() > 11)
-    return instances;
-
-  uint64_t extra = 0;
-  std::vector<uint64_t> subset;
-  subset.reserve(ring.size());
-  for (uint64_t mask = 1; mask < (((uint64_t)1) << ring.size()) - 1; ++mask)
+  uint64_t instances = get_ring_instances(txn, pi.ring_key.data(), pi.ring_key.size());
+  uint32_t start = 0;
+  for (uint32_t end: pi.subset_key_ends)
   {
-    subset.resize(0);
-    for (size_t i = 0; i < ring.size(); ++i)
-      if ((mask >> i) & 1)
-        subset.push_back(ring[i]);
-    extra += get_ring_instances(txn, amount, subset);
+    instances += get_ring_instances(txn, pi.subset_keys.data() + start, end - start);
+    start = end;
   }
-  return instances + extra;
+  return instances;
 }
 
-static uint64_t inc_ring_instances(MDB_txn *txn, uint64_t amount, const std::vector<uint64_t> &ring)
+static uint64_t inc_ring_instances(MDB_txn *txn, const std::string &sring)
 {
-  const std::string sring = keep_under_511(compress_ring(amount, ring));
   MDB_val k, v;
   k.mv_data = (void*)sring.data();
   k.mv_size = sring.size();
@@ -1190,26 +1325,21 @@ int main(int argc, char* argv[])
     const std::string filename = inputs[n];
     std::vector<std::pair<uint64_t, uint64_t>> blackballs;
     uint64_t n_txes;
-    for_all_transactions(filename, start_idx, n_txes, [&](const cryptonote::transaction_prefix &tx)->bool
+    for_all_transactions(filename, start_idx, n_txes, opt_rct_only, n == 0 && opt_check_subsets, [&](const prepared_tx &ptx)->bool
     {
       std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-      for (const auto &in: tx.vin)
+      for (const prepared_input &pi: ptx.inputs)
       {
-        if (in.type() != typeid(txin_to_key))
-          continue;
-        const auto &txin = boost::get<txin_to_key>(in);
-        if (opt_rct_only && txin.amount != 0)
-          continue;
-
-        const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
+        const txin_to_key &txin = *pi.txin;
+        const std::vector<uint64_t> &absolute = pi.absolute;
         if (n == 0)
           for (uint64_t out: absolute)
             add_key_image(txn, output_data(txin.amount, out), txin.k_image);
 
         std::vector<uint64_t> relative_ring;
-        std::vector<uint64_t> new_ring = canonicalize(txin.key_offsets);
+        std::vector<uint64_t> new_ring = pi.canonical;
         const uint32_t ring_size = txin.key_offsets.size();
-        const uint64_t instances = inc_ring_instances(txn, txin.amount, new_ring);
+        const uint64_t instances = inc_ring_instances(txn, pi.ring_key);
         if (n == 0 && ring_size == 1)
         {
           const std::pair<uint64_t, uint64_t> output = std::make_pair(txin.amount, absolute[0]);
@@ -1237,7 +1367,7 @@ int main(int argc, char* argv[])
               inc_stat(txn, txin.amount ? "pre-rct-duplicate-rings" : "rct-duplicate-rings");
           }
         }
-        else if (n == 0 && opt_check_subsets && get_ring_subset_instances(txn, txin.amount, new_ring) >= new_ring.size())
+        else if (n == 0 && opt_check_subsets && get_ring_subset_instances(txn, pi) >= new_ring.size())
         {
           for (size_t o = 0; o < new_ring.size(); ++o)
           {
@@ -1356,6 +1486,79 @@ int main(int argc, char* argv[])
   {
     LOG_PRINT_L0("Secondary pass on " << work_spent.size() << " spent outputs");
 
+    std::vector<output_data> scan_spent = std::move(work_spent);
+    work_spent.clear();
+
+    // Look for rings with a single output not known to be spent. Slices of
+    // the work are searched in parallel, each on a read only snapshot, so an
+    // output marked in this pass is only seen by the rings containing it in
+    // the next pass, which is where it is queued anyway.
+    struct chain_reaction
+    {
+      output_data od;
+      size_t ring_size;
+    };
+    const size_t n_slices = (scan_spent.size() + secondary_pass_slice_size - 1) / secondary_pass_slice_size;
+    std::vector<std::vector<chain_reaction>> found(n_slices);
+    std::vector<std::string> slice_errors(n_slices);
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    for (size_t slice = 0; slice < n_slices; ++slice)
+    {
+      tpool.submit(&waiter, [&, slice]() {
+        MDB_txn *rtxn = NULL;
+        MDB_cursor *rcur = NULL;
+        try
+        {
+          int dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &rtxn);
+          CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+          dbr = mdb_cursor_open(rtxn, dbi_spent, &rcur);
+          CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB cursor: " + std::string(mdb_strerror(dbr)));
+          const size_t end = std::min(scan_spent.size(), (slice + 1) * secondary_pass_slice_size);
+          for (size_t i = slice * secondary_pass_slice_size; i < end && !stop_requested; ++i)
+          {
+            const output_data &od = scan_spent[i];
+            std::vector<crypto::key_image> key_images = get_key_images(rtxn, od);
+            for (const crypto::key_image &ki: key_images)
+            {
+              std::vector<uint64_t> relative_ring;
+              CHECK_AND_ASSERT_THROW_MES(get_relative_ring(rtxn, ki, relative_ring), "Relative ring not found");
+              std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(relative_ring);
+              size_t known = 0;
+              uint64_t last_unknown = 0;
+              for (uint64_t out: absolute)
+              {
+                output_data new_od(od.amount, out);
+                if (is_output_spent(rcur, new_od))
+                  ++known;
+                else
+                  last_unknown = out;
+              }
+              if (known == absolute.size() - 1)
+                found[slice].push_back({output_data(od.amount, last_unknown), absolute.size()});
+            }
+          }
+        }
+        catch (const std::exception &e)
+        {
+          slice_errors[slice] = e.what();
+        }
+        if (rcur)
+          mdb_cursor_close(rcur);
+        if (rtxn)
+          mdb_txn_abort(rtxn);
+      }, true);
+    }
+    waiter.wait(&tpool);
+    for (const std::string &error: slice_errors)
+      CHECK_AND_ASSERT_THROW_MES(error.empty(), error);
+
+    if (stop_requested)
+    {
+      MINFO("Stopping secondary passes. Secondary passes are not incremental, they will re-run fully.");
+      return 0;
+    }
+
     int dbr = resize_env(cache_dir.c_str());
     CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to resize LMDB database: " + std::string(mdb_strerror(dbr)));
 
@@ -1367,45 +1570,22 @@ int main(int argc, char* argv[])
     CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB cursor: " + std::string(mdb_strerror(dbr)));
 
     std::vector<std::pair<uint64_t, uint64_t>> blackballs;
-    std::vector<output_data> scan_spent = std::move(work_spent);
-    work_spent.clear();
-    for (const output_data &od: scan_spent)
+    for (const auto &slice: found)
     {
-      std::vector<crypto::key_image> key_images = get_key_images(txn, od);
-      for (const crypto::key_image &ki: key_images)
+      for (const chain_reaction &cr: slice)
       {
-        std::vector<uint64_t> relative_ring;
-        CHECK_AND_ASSERT_THROW_MES(get_relative_ring(txn, ki, relative_ring), "Relative ring not found");
-        std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(relative_ring);
-        size_t known = 0;
-        uint64_t last_unknown = 0;
-        for (uint64_t out: absolute)
+        // several rings may have found the same output
+        if (!add_spent_output(cur, cr.od))
+          continue;
+        const std::pair<uint64_t, uint64_t> output = std::make_pair(cr.od.amount, cr.od.offset);
+        if (opt_verbose)
         {
-          output_data new_od(od.amount, out);
-          if (is_output_spent(cur, new_od))
-            ++known;
-          else
-            last_unknown = out;
+          MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in a " <<
+              cr.ring_size << "-ring where all other outputs are known to be spent");
         }
-        if (known == absolute.size() - 1)
-        {
-          const std::pair<uint64_t, uint64_t> output = std::make_pair(od.amount, last_unknown);
-          if (opt_verbose)
-          {
-            MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in a " <<
-                absolute.size() << "-ring where all other outputs are known to be spent");
-          }
-          blackballs.push_back(output);
-          if (add_spent_output(cur, output_data(od.amount, last_unknown)))
-            inc_stat(txn, od.amount ? "pre-rct-chain-reaction" : "rct-chain-reaction");
-          work_spent.push_back(output_data(od.amount, last_unknown));
-        }
-      }
-
-      if (stop_requested)
-      {
-        MINFO("Stopping secondary passes. Secondary passes are not incremental, they will re-run fully.");
-        return 0;
+        blackballs.push_back(output);
+        inc_stat(txn, cr.od.amount ? "pre-rct-chain-reaction" : "rct-chain-reaction");
+        work_spent.push_back(cr.od);
       }
     }
     if (!blackballs.empty())
@@ -27,9 +27,12 @@
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <algorithm>
+#include <deque>
 #include <fstream>
+#include <iomanip>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
@@ -43,6 +46,7 @@
 #include "include_base_utils.h"
 #include "blockchain_db/db_types.h"
 #include "cryptonote_core/cryptonote_core.h"
+#include "common/threadpool.h"
 
 #undef XCASH_DEFAULT_LOG_CATEGORY
 #define XCASH_DEFAULT_LOG_CATEGORY "bcutil"
@@ -165,46 +169,291 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
   return num_blocks;
 }
 
-int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &blocks, bool force)
+namespace
 {
-  if (blocks.empty())
-    return 0;
-  if (!force && blocks.size() < db_batch_size)
-    return 0;
+// a run of consecutive blocks from the bootstrap file, deserialized by the
+// reader stage and ready to be verified or added
+struct import_batch
+{
+  uint64_t start_height;
+  uint64_t bytes;
+  std::vector<bootstrap::block_package> packages;   // unverified import
+  std::vector<block_complete_entry> blocks;         // verified import
+  std::vector<crypto::hash> hashes;
 
-  // wait till we can verify a full HOH without extra, for speed
-  uint64_t new_height = core.get_blockchain_storage().get_db().height() + blocks.size();
-  if (!force && new_height % HASH_OF_HASHES_STEP)
-    return 0;
+  size_t size() const { return opt_verify ? blocks.size() : packages.size(); }
+};
 
-  std::vector<crypto::hash> hashes;
-  for (const auto &b: blocks)
+// how much one stage of the import got through, and in how long, not
+// counting the time it spent waiting on the other stage
+// added to by one stage's thread, and summarized from the main thread
+struct stage_stats
+{
+  std::atomic<uint64_t> blocks{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> busy_us{0};
+
+  void add(uint64_t n_blocks, uint64_t n_bytes, std::chrono::steady_clock::time_point start)
+  {
+    blocks += n_blocks;
+    bytes += n_bytes;
+    busy_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  std::string summary() const
+  {
+    const uint64_t blocks = this->blocks, bytes = this->bytes;
+    const double seconds = std::max<double>(busy_us, 1) / 1000000;
+    std::stringstream ss;
+    ss << blocks << " blocks, " << std::fixed << std::setprecision(1) << blocks / seconds << " blocks/s, "
+      << bytes / seconds / 1048576 << " MB/s, busy " << seconds << " s";
+    return ss.str();
+  }
+};
+
+// hands batches from the reader thread to the verifier, holding at most
+// a couple so the reader stays just ahead
+class batch_queue
+{
+public:
+  batch_queue(size_t max_batches): m_max_batches(max_batches), m_closed(false) {}
+
+  bool push(import_batch &&batch)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (!m_closed && m_batches.size() >= m_max_batches)
+      m_cond.wait(lock);
+    if (m_closed)
+      return false;
+    m_batches.push_back(std::move(batch));
+    m_cond.notify_all();
+    return true;
+  }
+
+  bool pop(import_batch &batch)
   {
-    cryptonote::block block;
-    if (!parse_and_validate_block_from_blob(b.block, block))
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_batches.empty() && !m_closed)
+      m_cond.wait(lock);
+    if (m_batches.empty())
+      return false;
+    batch = std::move(m_batches.front());
+    m_batches.pop_front();
+    m_cond.notify_all();
+    return true;
+  }
+
+  void close()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_closed = true;
+    m_cond.notify_all();
+  }
+
+private:
+  const size_t m_max_batches;
+  boost::mutex m_mutex;
+  boost::condition_variable m_cond;
+  std::deque<import_batch> m_batches;
+  bool m_closed;
+};
+
+// reads one chunk, returns false at the end of the file, or if it was truncated
+bool read_chunk(std::ifstream &import_file, std::string &chunk, uint64_t &bytes_read)
+{
+  uint32_t chunk_size;
+  char buf[sizeof(chunk_size)];
+  import_file.read(buf, sizeof(chunk_size));
+  if (! import_file) {
+    MINFO("End of file reached");
+    return false;
+  }
+  bytes_read += sizeof(chunk_size);
+
+  if (! ::serialization::parse_binary(std::string(buf, sizeof(chunk_size)), chunk_size))
+  {
+    throw std::runtime_error("Error in deserialization of chunk size");
+  }
+  MDEBUG("chunk_size: " << chunk_size);
+
+  if (chunk_size > BUFFER_SIZE)
+  {
+    MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
+    throw std::runtime_error("Aborting: chunk size exceeds buffer size");
+  }
+  if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+  {
+    MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
+  }
+  else if (chunk_size == 0) {
+    throw std::runtime_error("ERROR: chunk_size == 0");
+  }
+  chunk.resize(chunk_size);
+  import_file.read(&chunk[0], chunk_size);
+  if (! import_file) {
+    if (import_file.eof())
     {
-      MERROR("Failed to parse block: "
-          << epee::string_tools::pod_to_hex(get_blob_hash(b.block)));
-      core.cleanup_handle_incoming_blocks();
-      return 1;
+      MINFO("End of file reached - file was truncated");
+      return false;
+    }
+    throw std::runtime_error("ERROR: unexpected end of file: bytes read before error: "
+        + std::to_string(import_file.gcount()) + " of chunk_size " + std::to_string(chunk_size));
+  }
+  bytes_read += chunk_size;
+  return true;
+}
+
+// the number of blocks to read into the batch starting at start_height
+uint64_t get_batch_size(uint64_t start_height)
+{
+  if (!opt_verify)
+    return db_batch_size;
+  // end verified batches on a hash of hashes boundary, so it can be checked
+  // without anything extra
+  const uint64_t end_height = (start_height + db_batch_size + HASH_OF_HASHES_STEP - 1) / HASH_OF_HASHES_STEP * HASH_OF_HASHES_STEP;
+  return end_height - start_height;
+}
+
+// reader stage: reads the chunks of a batch, then deserializes them on the
+// threadpool, and queues the batch for the verifier. If the file is indexed
+// and mapped, chunks are taken straight from the mapping by the workers,
+// else chunks read from an indexed file are checked against its index.
+void read_batches(std::ifstream &import_file, const BootstrapFile &bootstrap, bool mapped, uint64_t start_height, uint64_t block_stop, batch_queue &queue, stage_stats &stats, std::atomic<int> &status)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  uint64_t height = start_height;
+  bool eof = false;
+  try
+  {
+    while (!eof && height <= block_stop)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      import_batch batch;
+      batch.start_height = height;
+      batch.bytes = 0;
+
+      std::vector<std::string> chunks;
+      uint64_t batch_size = std::min(get_batch_size(height), block_stop + 1 - height);
+      if (mapped)
+      {
+        const uint64_t mapped_end = bootstrap.indexed_block_first() + bootstrap.indexed_block_count();
+        if (height + batch_size >= mapped_end)
+        {
+          batch_size = mapped_end > height ? mapped_end - height : 0;
+          eof = true;
+        }
+        chunks.resize(batch_size);
+      }
+      else
+      {
+        chunks.reserve(batch_size);
+        while (chunks.size() < batch_size)
+        {
+          std::string chunk;
+          if (!read_chunk(import_file, chunk, batch.bytes))
+          {
+            eof = true;
+            break;
+          }
+          chunks.push_back(std::move(chunk));
+        }
+      }
+      if (chunks.empty())
+        break;
+
+      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
+      batch.packages.resize(chunks.size());
+      if (opt_verify)
+      {
+        batch.blocks.resize(chunks.size());
+        batch.hashes.resize(chunks.size());
+      }
+      std::atomic<bool> parse_error(false);
+      std::atomic<uint64_t> mapped_bytes(0);
+      tools::threadpool::waiter waiter;
+      for (size_t n = 0; n < chunks.size(); ++n)
+      {
+        tpool.submit(&waiter, [&, n]() {
+          if (mapped)
+          {
+            if (!bootstrap.get_chunk(batch.start_height + n, chunks[n]))
+            {
+              MERROR("Error reading chunk at height " << batch.start_height + n);
+              parse_error = true;
+              return;
+            }
+            mapped_bytes += sizeof(uint32_t) + chunks[n].size();
+          }
+          else if (!bootstrap.check_chunk(batch.start_height + n, chunks[n]))
+          {
+            MERROR("Checksum mismatch in chunk at height " << batch.start_height + n);
+            parse_error = true;
+            return;
+          }
+          bootstrap::block_package &bp = batch.packages[n];
+          if (! ::serialization::parse_binary(chunks[n], bp))
+          {
+            MERROR("Error in deserialization of chunk at height " << batch.start_height + n);
+            parse_error = true;
+            return;
+          }
+          std::string().swap(chunks[n]);
+          if (opt_verify)
+          {
+            block_complete_entry &bce = batch.blocks[n];
+            cryptonote::block_to_blob(bp.block, bce.block);
+            bce.txs.reserve(bp.txs.size());
+            for (const auto &tx: bp.txs)
+            {
+              bce.txs.push_back(cryptonote::blobdata());
+              cryptonote::tx_to_blob(tx, bce.txs.back());
+            }
+            batch.hashes[n] = cryptonote::get_block_hash(bp.block);
+          }
+        }, true);
+      }
+      waiter.wait(&tpool);
+      if (parse_error)
+        throw std::runtime_error("Error in deserialization of chunk");
+      if (mapped)
+        batch.bytes = mapped_bytes;
+      if (opt_verify)
+        batch.packages.clear();
+
+      height += chunks.size();
+      stats.add(chunks.size(), batch.bytes, start);
+      if (!queue.push(std::move(batch)))
+        break;
     }
-    hashes.push_back(cryptonote::get_block_hash(block));
   }
-  core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), hashes);
+  catch (const std::exception &e)
+  {
+    MFATAL("exception while reading from file, height=" << height << ": " << e.what());
+    status = 2;
+  }
+  queue.close();
+}
 
-  core.prepare_handle_incoming_blocks(blocks);
+// verifier stage: checks the batch against the hash of hashes, then hands
+// it to core, which verifies blocks and their txes on the threadpool and
+// commits them to the db as one batch
+int verify_and_add(cryptonote::core &core, import_batch &batch)
+{
+  core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), batch.hashes);
 
-  for(const block_complete_entry& block_entry: blocks)
+  core.prepare_handle_incoming_blocks(batch.blocks);
+
+  for(const block_complete_entry& block_entry: batch.blocks)
   {
     // process transactions
-    for(auto& tx_blob: block_entry.txs)
+    std::vector<tx_verification_context> tvc;
+    core.handle_incoming_txs(block_entry.txs, tvc, true, true, false);
+    for (size_t i = 0; i < tvc.size(); ++i)
     {
-      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      core.handle_incoming_tx(tx_blob, tvc, true, true, false);
-      if(tvc.m_verifivation_failed)
+      if(tvc[i].m_verifivation_failed)
       {
         MERROR("transaction verification failed, tx_id = "
-            << epee::string_tools::pod_to_hex(get_blob_hash(tx_blob)));
+            << epee::string_tools::pod_to_hex(get_blob_hash(block_entry.txs[i])));
         core.cleanup_handle_incoming_blocks();
         return 1;
       }
@@ -234,10 +483,44 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
   if (!core.cleanup_handle_incoming_blocks())
     return 1;
 
-  blocks.clear();
   return 0;
 }
 
+// adds blocks as they are in the file, in one db batch if enabled
+int add_unverified(cryptonote::core &core, import_batch &batch)
+{
+  BlockchainDB &db = core.get_blockchain_storage().get_db();
+  if (opt_batch)
+    db.batch_start(batch.packages.size(), batch.bytes);
+
+  for (const bootstrap::block_package &bp: batch.packages)
+  {
+    // add_block() adds the coinbase transaction itself, bp.txs are the others
+    try
+    {
+      db.add_block(bp.block, bp.block_weight, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
+    }
+    catch (const std::exception& e)
+    {
+      std::cout << refresh_string;
+      MFATAL("Error adding block to blockchain: " << e.what());
+      // don't commit partial block data, the destructor aborts the write txn
+      return 2;
+    }
+  }
+
+  if (opt_batch)
+  {
+    db.batch_stop();
+    std::cout << refresh_string;
+    // zero-based height
+    std::cout << ENDL << "[- batch commit at height " << batch.start_height + batch.packages.size() - 1 << " -]" << ENDL;
+    db.show_stats();
+  }
+  return 0;
+}
+}
+
 int import_from_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop=0)
 {
   // Reset stats, in case we're using newly created db, accumulating stats
@@ -287,13 +570,7 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   // 4 byte magic + (currently) 1024 byte header structures
   bootstrap.seek_to_first_chunk(import_file);
 
-  std::string str1;
-  char buffer1[1024];
-  char buffer_block[BUFFER_SIZE];
-  block b;
-  transaction tx;
   int quit = 0;
-  uint64_t bytes_read;
 
   // Note that a new blockchain will start with block number 0 (total blocks: 1)
   // due to genesis block being added at initialization.
@@ -308,253 +585,84 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   MINFO("start block: " << start_height << "  stop block: " <<
       block_stop);
 
-  bool use_batch = opt_batch && !opt_verify;
-
   MINFO("Reading blockchain from bootstrap file...");
   std::cout << ENDL;
 
-  std::vector<block_complete_entry> blocks;
-
-  // Skip to start_height before we start adding.
+  // Skip to start_height before we start adding. An indexed file already
+  // gave the position of start_height, and is read through a mapping.
+  const bool mapped = bootstrap.map_indexed(import_file_path);
+  if (!mapped)
   {
+    if (bootstrap.load_index(import_file_path))
+      MINFO("Checking chunks against the bootstrap file index");
     bool q2 = false;
     import_file.seekg(pos);
-    bytes_read = bootstrap.count_bytes(import_file, start_height-seek_height, h, q2);
+    if (start_height > seek_height)
+      bootstrap.count_bytes(import_file, start_height-seek_height, h, q2);
     if (q2)
     {
-      quit = 2;
-      goto quitting;
+      import_file.close();
+      return 0;
     }
-    h = start_height;
-  }
-
-  if (use_batch)
-  {
-    uint64_t bytes, h2;
-    bool q2;
-    pos = import_file.tellg();
-    bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-    if (import_file.eof())
-      import_file.clear();
-    import_file.seekg(pos);
-    core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
   }
-  while (! quit)
-  {
-    uint32_t chunk_size;
-    import_file.read(buffer1, sizeof(chunk_size));
-    // TODO: bootstrap.read_chunk();
-    if (! import_file) {
-      std::cout << refresh_string;
-      MINFO("End of file reached");
-      quit = 1;
-      break;
-    }
-    bytes_read += sizeof(chunk_size);
+  h = start_height;
 
-    str1.assign(buffer1, sizeof(chunk_size));
-    if (! ::serialization::parse_binary(str1, chunk_size))
-    {
-      throw std::runtime_error("Error in deserialization of chunk size");
-    }
-    MDEBUG("chunk_size: " << chunk_size);
+  // the reader thread reads and deserializes the next batch while this
+  // thread verifies and adds the current one
+  stage_stats read_stats, add_stats;
+  batch_queue queue(2);
+  std::atomic<int> read_status(0);
+  boost::thread reader([&]() { read_batches(import_file, bootstrap, mapped, start_height, block_stop, queue, read_stats, read_status); });
 
-    if (chunk_size > BUFFER_SIZE)
-    {
-      MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
-      throw std::runtime_error("Aborting: chunk size exceeds buffer size");
-    }
-    if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+  try
+  {
+    import_batch batch;
+    while (queue.pop(batch))
     {
-      MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
-    }
-    else if (chunk_size == 0) {
-      MFATAL("ERROR: chunk_size == 0");
-      return 2;
-    }
-    import_file.read(buffer_block, chunk_size);
-    if (! import_file) {
-      if (import_file.eof())
+      const auto start = std::chrono::steady_clock::now();
+      const size_t n_blocks = batch.size();
+      int ret = opt_verify ? verify_and_add(core, batch) : add_unverified(core, batch);
+      if (ret)
       {
-        std::cout << refresh_string;
-        MINFO("End of file reached - file was truncated");
-        quit = 1;
+        quit = 2; // make sure we don't commit partial block data
         break;
       }
-      else
-      {
-        MFATAL("ERROR: unexpected end of file: bytes read before error: "
-            << import_file.gcount() << " of chunk_size " << chunk_size);
-        return 2;
-      }
-    }
-    bytes_read += chunk_size;
-    MDEBUG("Total bytes read: " << bytes_read);
+      add_stats.add(n_blocks, batch.bytes, start);
+      h = batch.start_height + n_blocks;
+      num_imported += n_blocks;
 
-    if (h > block_stop)
-    {
       std::cout << refresh_string << "block " << h-1
         << " / " << block_stop
         << std::flush;
-      std::cout << ENDL << ENDL;
-      MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
-      quit = 1;
-      break;
+      MINFO("read: " << read_stats.summary());
+      MINFO((opt_verify ? "verify/write: " : "write: ") << add_stats.summary());
     }
-
-    try
-    {
-      str1.assign(buffer_block, chunk_size);
-      bootstrap::block_package bp;
-      if (! ::serialization::parse_binary(str1, bp))
-        throw std::runtime_error("Error in deserialization of chunk");
-
-      int display_interval = 1000;
-      int progress_interval = 10;
-      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-      for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
-      {
-        ++h;
-        if ((h-1) % display_interval == 0)
-        {
-          std::cout << refresh_string;
-          MDEBUG("loading block number " << h-1);
-        }
-        else
-        {
-          MDEBUG("loading block number " << h-1);
-        }
-        b = bp.block;
-        MDEBUG("block prev_id: " << b.prev_id << ENDL);
-
-        if ((h-1) % progress_interval == 0)
-        {
-          std::cout << refresh_string << "block " << h-1
-            << " / " << block_stop
-            << std::flush;
-        }
-
-        if (opt_verify)
-        {
-          cryptonote::blobdata block;
-          cryptonote::block_to_blob(bp.block, block);
-          std::vector<cryptonote::blobdata> txs;
-          for (const auto &tx: bp.txs)
-          {
-            txs.push_back(cryptonote::blobdata());
-            cryptonote::tx_to_blob(tx, txs.back());
-          }
-          blocks.push_back({block, txs});
-          int ret = check_flush(core, blocks, false);
-          if (ret)
-          {
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-        }
-        else
-        {
-          std::vector<transaction> txs;
-          std::vector<transaction> archived_txs;
-
-          archived_txs = bp.txs;
-
-          // tx number 1: coinbase tx
-          // tx number 2 onwards: archived_txs
-          for (const transaction &tx : archived_txs)
-          {
-            // add blocks with verification.
-            // for Blockchain and blockchain_storage add_new_block().
-            // for add_block() method, without (much) processing.
-            // don't add coinbase transaction to txs.
-            //
-            // because add_block() calls
-            // add_transaction(blk_hash, blk.miner_tx) first, and
-            // then a for loop for the transactions in txs.
-            txs.push_back(tx);
-          }
-
-          size_t block_weight;
-          difficulty_type cumulative_difficulty;
-          uint64_t coins_generated;
-
-          block_weight = bp.block_weight;
-          cumulative_difficulty = bp.cumulative_difficulty;
-          coins_generated = bp.coins_generated;
-
-          try
-          {
-            core.get_blockchain_storage().get_db().add_block(b, block_weight, cumulative_difficulty, coins_generated, txs);
-          }
-          catch (const std::exception& e)
-          {
-            std::cout << refresh_string;
-            MFATAL("Error adding block to blockchain: " << e.what());
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-
-          if (use_batch)
-          {
-            if ((h-1) % db_batch_size == 0)
-            {
-              uint64_t bytes, h2;
-              bool q2;
-              std::cout << refresh_string;
-              // zero-based height
-              std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
-              core.get_blockchain_storage().get_db().batch_stop();
-              pos = import_file.tellg();
-              bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-              import_file.seekg(pos);
-              core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
-              std::cout << ENDL;
-              core.get_blockchain_storage().get_db().show_stats();
-            }
-          }
-        }
-        ++num_imported;
-      }
-    }
-    catch (const std::exception& e)
-    {
-      std::cout << refresh_string;
-      MFATAL("exception while reading from file, height=" << h << ": " << e.what());
-      return 2;
-    }
-  } // while
-
-quitting:
-  import_file.close();
-
-  if (opt_verify)
-  {
-    int ret = check_flush(core, blocks, true);
-    if (ret)
-      return ret;
   }
-
-  if (use_batch)
+  catch (const std::exception& e)
   {
-    if (quit > 1)
-    {
-      // There was an error, so don't commit pending data.
-      // Destructor will abort write txn.
-    }
-    else
-    {
-      core.get_blockchain_storage().get_db().batch_stop();
-    }
+    std::cout << refresh_string;
+    MFATAL("exception while importing, height=" << h << ": " << e.what());
+    quit = 2;
   }
+  queue.close();
+  reader.join();
+  import_file.close();
+  std::cout << refresh_string;
+
+  if (!quit)
+    quit = read_status;
+  if (!quit && h > block_stop)
+    MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
 
   core.get_blockchain_storage().get_db().show_stats();
   MINFO("Number of blocks imported: " << num_imported);
   if (h > 0)
-    // TODO: if there was an error, the last added block is probably at zero-based height h-2
     MINFO("Finished at block: " << h-1 << "  total blocks: " << h);
+  MINFO("Read stage: " << read_stats.summary());
+  MINFO((opt_verify ? "Verify/write stage: " : "Write stage: ") << add_stats.summary());
 
   std::cout << ENDL;
-  return 0;
+  return quit;
 }
 
 int main(int argc, char* argv[])
@@ -26,7 +26,10 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <boost/crc.hpp>
+
 #include "bootstrap_serialization.h"
+#include "common/int-util.h"
 #include "serialization/binary_utils.h" // dump_binary(), parse_binary()
 #include "serialization/json_utils.h" // dump_json()
 
@@ -47,12 +50,146 @@ namespace
   const uint32_t blockchain_raw_magic = 0x28721586;
   const uint32_t header_size = 1024;
 
+  // leading 4 bytes of: echo X-CASH bootstrap index | sha1sum
+  const uint32_t index_magic = 0x21045e68;
+  const uint8_t indexed_major_version = 2;
+  const uint64_t index_entry_size = 16;
+  const uint64_t index_trailer_size = 32;
+
   std::string refresh_string = "\r                                    \r";
+
+  void put_u32(std::string& blob, uint32_t v)
+  {
+    v = SWAP32LE(v);
+    blob.append((const char*)&v, sizeof(v));
+  }
+
+  void put_u64(std::string& blob, uint64_t v)
+  {
+    v = SWAP64LE(v);
+    blob.append((const char*)&v, sizeof(v));
+  }
+
+  uint32_t get_u32(const char* p)
+  {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return SWAP32LE(v);
+  }
+
+  uint64_t get_u64(const char* p)
+  {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return SWAP64LE(v);
+  }
+
+  uint32_t chunk_checksum(const char* data, size_t size)
+  {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+  }
+
+  void parse_index_entry(const char* p, bootstrap::chunk_index_entry& entry)
+  {
+    entry.offset = get_u64(p);
+    entry.size = get_u32(p + 8);
+    entry.checksum = get_u32(p + 12);
+  }
+
+  // the header only says the file is indexed once its index is complete, so
+  // a file left without one (export interrupted) is read sequentially
+  bool write_header_version(const std::string& file_path, bool indexed)
+  {
+    bootstrap::file_info bfi;
+    bfi.major_version = indexed ? indexed_major_version : 0;
+    bfi.minor_version = indexed ? 0 : 1;
+    bfi.header_size = header_size;
+    const blobdata bd = t_serializable_object_to_blob(bfi);
+
+    std::fstream file(file_path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+    file.seekp(sizeof(blockchain_raw_magic) + sizeof(uint32_t));
+    file.write(bd.data(), bd.size());
+    file.flush();
+    return !file.fail();
+  }
+
+  bool read_header_version(std::istream& file, bootstrap::file_info& bfi)
+  {
+    char buf[sizeof(blockchain_raw_magic) + sizeof(uint32_t)];
+    file.clear();
+    file.seekg(0);
+    file.read(buf, sizeof(buf));
+    if (! file || get_u32(buf) != blockchain_raw_magic)
+      return false;
+    const uint32_t bd_size = get_u32(buf + sizeof(blockchain_raw_magic));
+    if (bd_size > header_size)
+      return false;
+    std::string bd(bd_size, 0);
+    file.read(&bd[0], bd.size());
+    return file && ::serialization::parse_binary(bd, bfi);
+  }
+
+  // reads the trailer at the end of an indexed file, returns false if the
+  // file has none, or if it does not match the file
+  bool read_index_trailer(std::istream& file, bootstrap::index_trailer& trailer)
+  {
+    bootstrap::file_info bfi;
+    if (!read_header_version(file, bfi) || bfi.major_version != indexed_major_version)
+      return false;
+
+    file.clear();
+    file.seekg(0, std::ios_base::end);
+    const std::streamoff file_size = file.tellg();
+    if (file_size < 0 || static_cast<uint64_t>(file_size) < sizeof(blockchain_raw_magic) + header_size + index_trailer_size)
+      return false;
+
+    char buf[index_trailer_size];
+    file.seekg(file_size - index_trailer_size);
+    file.read(buf, sizeof(buf));
+    if (! file)
+      return false;
+    trailer.index_offset = get_u64(buf);
+    trailer.block_first = get_u64(buf + 8);
+    trailer.num_chunks = get_u64(buf + 16);
+    trailer.reserved = get_u32(buf + 24);
+    trailer.magic = get_u32(buf + 28);
+    if (trailer.magic != index_magic)
+      return false;
+
+    const uint64_t index_end = static_cast<uint64_t>(file_size) - index_trailer_size;
+    if (trailer.index_offset < sizeof(blockchain_raw_magic) + header_size || trailer.index_offset > index_end
+        || (index_end - trailer.index_offset) % index_entry_size != 0
+        || (index_end - trailer.index_offset) / index_entry_size != trailer.num_chunks)
+    {
+      MWARNING("bootstrap file index does not match the file, ignoring it");
+      return false;
+    }
+    return true;
+  }
+
+  bool read_index_entries(std::istream& file, const bootstrap::index_trailer& trailer, uint64_t first, uint64_t count,
+      std::vector<bootstrap::chunk_index_entry>& entries)
+  {
+    if (first > trailer.num_chunks || count > trailer.num_chunks - first)
+      return false;
+    std::string buf(count * index_entry_size, 0);
+    file.clear();
+    file.seekg(trailer.index_offset + first * index_entry_size);
+    file.read(&buf[0], buf.size());
+    if (! file)
+      return false;
+    entries.resize(count);
+    for (uint64_t i = 0; i < count; ++i)
+      parse_index_entry(buf.data() + i * index_entry_size, entries[i]);
+    return true;
+  }
 }
 
 
 
-bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
+bool BootstrapFile::open_writer(const boost::filesystem::path& file_path, bool indexed)
 {
   const boost::filesystem::path dir_path = file_path.parent_path();
   if (!dir_path.empty())
@@ -76,20 +213,50 @@ bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
   }
 
   m_raw_data_file = new std::ofstream();
+  m_file_path = file_path.string();
 
   bool do_initialize_file = false;
   uint64_t num_blocks = 0;
+  m_index.clear();
+  m_block_first = 0;
 
   if (! boost::filesystem::exists(file_path))
   {
     MDEBUG("creating file");
     do_initialize_file = true;
     num_blocks = 0;
+    m_indexed = indexed;
   }
   else
   {
-    num_blocks = count_blocks(file_path.string());
-    MDEBUG("appending to existing file with height: " << num_blocks-1 << "  total blocks: " << num_blocks);
+    // an existing file is appended to in its own format
+    std::ifstream existing_file(file_path.string(), std::ios_base::binary | std::ifstream::in);
+    bootstrap::index_trailer trailer;
+    if (read_index_trailer(existing_file, trailer) && read_index_entries(existing_file, trailer, 0, trailer.num_chunks, m_index))
+    {
+      existing_file.close();
+      m_indexed = true;
+      m_block_first = trailer.block_first;
+      num_blocks = trailer.block_first + trailer.num_chunks * NUM_BLOCKS_PER_CHUNK;
+      // new chunks overwrite the index, which is written again on close;
+      // until then the header says there is none
+      boost::filesystem::resize_file(file_path, trailer.index_offset);
+      if (!write_header_version(m_file_path, false))
+      {
+        MFATAL("Failed to update the header of " << file_path);
+        return false;
+      }
+      MDEBUG("appending to existing indexed file with height: " << num_blocks-1 << "  total blocks: " << num_blocks);
+    }
+    else
+    {
+      existing_file.close();
+      m_indexed = false;
+      if (indexed)
+        MWARNING("existing file has no index, appending to it without one");
+      num_blocks = count_blocks(file_path.string());
+      MDEBUG("appending to existing file with height: " << num_blocks-1 << "  total blocks: " << num_blocks);
+    }
   }
   m_height = num_blocks;
 
@@ -123,6 +290,7 @@ bool BootstrapFile::initialize_file()
   }
   *m_raw_data_file << blob;
 
+  // an indexed file is marked as such on close, once its index is written
   bootstrap::file_info bfi;
   bfi.major_version = 0;
   bfi.minor_version = 1;
@@ -184,6 +352,7 @@ void BootstrapFile::flush_chunk()
   {
     throw std::runtime_error("Error in serialization of chunk size");
   }
+  const uint64_t chunk_offset = m_raw_data_file->tellp();
   *m_raw_data_file << blob;
 
   if (m_max_chunk < chunk_size)
@@ -200,6 +369,8 @@ void BootstrapFile::flush_chunk()
     MFATAL("Error writing chunk:  height: " << m_cur_height << "  chunk_size: " << chunk_size << "  num chars written: " << num_chars_written);
     throw std::runtime_error("Error writing chunk");
   }
+  if (m_indexed)
+    m_index.push_back({chunk_offset, chunk_size, chunk_checksum(m_buffer.data(), m_buffer.size())});
 
   m_buffer.clear();
   delete m_output_stream;
@@ -249,19 +420,49 @@ void BootstrapFile::write_block(block& block)
   m_output_stream->write((const char*)bd.data(), bd.size());
 }
 
+void BootstrapFile::write_index()
+{
+  const uint64_t index_offset = m_raw_data_file->tellp();
+  std::string blob;
+  blob.reserve(m_index.size() * index_entry_size + index_trailer_size);
+  for (const auto& entry : m_index)
+  {
+    put_u64(blob, entry.offset);
+    put_u32(blob, entry.size);
+    put_u32(blob, entry.checksum);
+  }
+  put_u64(blob, index_offset);
+  put_u64(blob, m_block_first);
+  put_u64(blob, m_index.size());
+  put_u32(blob, 0);
+  put_u32(blob, index_magic);
+  *m_raw_data_file << blob;
+  MDEBUG("wrote index of " << m_index.size() << " chunks at offset " << index_offset);
+}
+
 bool BootstrapFile::close()
 {
   if (m_raw_data_file->fail())
     return false;
 
+  if (m_indexed)
+    write_index();
   m_raw_data_file->flush();
+  const bool failed = m_raw_data_file->fail();
   delete m_output_stream;
   delete m_raw_data_file;
+  if (failed)
+    return false;
+  if (m_indexed && !write_header_version(m_file_path, true))
+  {
+    MERROR("Failed to mark " << m_file_path << " as indexed");
+    return false;
+  }
   return true;
 }
 
 
-bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_memory_pool* _tx_pool, boost::filesystem::path& output_file, uint64_t requested_block_stop)
+bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_memory_pool* _tx_pool, boost::filesystem::path& output_file, uint64_t requested_block_stop, bool indexed)
 {
   uint64_t num_blocks_written = 0;
   m_max_chunk = 0;
@@ -269,7 +470,7 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
   m_tx_pool = _tx_pool;
   uint64_t progress_interval = 100;
   MINFO("Storing blocks raw data...");
-  if (!BootstrapFile::open_writer(output_file))
+  if (!BootstrapFile::open_writer(output_file, indexed))
   {
     MFATAL("failed to open raw file for write");
     return false;
@@ -452,6 +653,32 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path, std::s
   std::ifstream import_file;
   import_file.open(import_file_path, std::ios_base::binary | std::ifstream::in);
 
+  // an indexed file knows its block count and where each block starts
+  bootstrap::index_trailer trailer;
+  if (!import_file.fail() && read_index_trailer(import_file, trailer))
+  {
+    const uint64_t num_blocks = trailer.block_first + trailer.num_chunks * NUM_BLOCKS_PER_CHUNK;
+    if (seek_height >= trailer.block_first && seek_height < num_blocks)
+    {
+      const uint64_t chunk = (seek_height - trailer.block_first) / NUM_BLOCKS_PER_CHUNK;
+      std::vector<bootstrap::chunk_index_entry> entries;
+      if (!read_index_entries(import_file, trailer, chunk, 1, entries))
+      {
+        MFATAL("Error reading bootstrap file index");
+        throw std::runtime_error("Aborting");
+      }
+      start_pos = entries[0].offset;
+      seek_height = trailer.block_first + chunk * NUM_BLOCKS_PER_CHUNK;
+    }
+    import_file.close();
+
+    std::cout << "Number of blocks: " << num_blocks << " (from the index)" << ENDL;
+    std::cout << ENDL;
+    return num_blocks;
+  }
+  import_file.clear();
+  import_file.seekg(0);
+
   uint64_t start_height = seek_height;
   uint64_t h = 0;
   if (import_file.fail())
@@ -501,3 +728,89 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path, std::s
   // one-based height.
   return h;
 }
+
+bool BootstrapFile::map_indexed(const std::string& import_file_path)
+{
+  {
+    std::ifstream import_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+    if (import_file.fail() || !read_index_trailer(import_file, m_trailer))
+      return false;
+  }
+
+  try
+  {
+    boost::interprocess::file_mapping mapping(import_file_path.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+    m_mapping.swap(mapping);
+    m_region.swap(region);
+  }
+  catch (const boost::interprocess::interprocess_exception& e)
+  {
+    MWARNING("Failed to map bootstrap file, reading it sequentially: " << e.what());
+    m_trailer = {};
+    return false;
+  }
+
+  const char* base = static_cast<const char*>(m_region.get_address());
+  if (m_region.get_size() < m_trailer.index_offset + m_trailer.num_chunks * index_entry_size + index_trailer_size
+      || get_u32(base) != blockchain_raw_magic)
+  {
+    MWARNING("Mapped bootstrap file does not match its index, reading it sequentially");
+    m_trailer = {};
+    return false;
+  }
+  MINFO("mapped indexed bootstrap file, blocks " << indexed_block_first() << " to " << indexed_block_first() + indexed_block_count() - 1);
+  return true;
+}
+
+bool BootstrapFile::get_chunk(uint64_t height, std::string& chunk) const
+{
+  if (height < m_trailer.block_first)
+    return false;
+  const uint64_t i = (height - m_trailer.block_first) / NUM_BLOCKS_PER_CHUNK;
+  if (i >= m_trailer.num_chunks)
+    return false;
+
+  const char* base = static_cast<const char*>(m_region.get_address());
+  bootstrap::chunk_index_entry entry;
+  parse_index_entry(base + m_trailer.index_offset + i * index_entry_size, entry);
+  if (entry.offset > m_trailer.index_offset || m_trailer.index_offset - entry.offset < sizeof(entry.size)
+      || entry.size > m_trailer.index_offset - entry.offset - sizeof(entry.size) || get_u32(base + entry.offset) != entry.size)
+  {
+    MERROR("Bad index entry for height " << height << ", offset " << entry.offset);
+    return false;
+  }
+  const char* data = base + entry.offset + sizeof(entry.size);
+  if (chunk_checksum(data, entry.size) != entry.checksum)
+  {
+    MERROR("Checksum mismatch in chunk for height " << height << ", offset " << entry.offset);
+    return false;
+  }
+  chunk.assign(data, entry.size);
+  return true;
+}
+
+bool BootstrapFile::load_index(const std::string& import_file_path)
+{
+  std::ifstream import_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+  if (import_file.fail() || !read_index_trailer(import_file, m_trailer)
+      || !read_index_entries(import_file, m_trailer, 0, m_trailer.num_chunks, m_index))
+  {
+    m_trailer = {};
+    m_index.clear();
+    return false;
+  }
+  return true;
+}
+
+bool BootstrapFile::check_chunk(uint64_t height, const std::string& chunk) const
+{
+  if (m_index.empty())
+    return true;
+  if (height < m_trailer.block_first)
+    return false;
+  const uint64_t i = (height - m_trailer.block_first) / NUM_BLOCKS_PER_CHUNK;
+  if (i >= m_index.size())
+    return false;
+  return m_index[i].size == chunk.size() && chunk_checksum(chunk.data(), chunk.size()) == m_index[i].checksum;
+}
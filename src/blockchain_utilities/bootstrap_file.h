@@ -34,6 +34,8 @@
 #include <boost/iostreams/filtering_streambuf.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_core/blockchain.h"
@@ -48,6 +50,7 @@
 #include "version.h"
 
 #include "blockchain_utilities.h"
+#include "bootstrap_serialization.h"
 
 
 using namespace cryptonote;
@@ -63,7 +66,22 @@ public:
   uint64_t seek_to_first_chunk(std::ifstream& import_file);
 
   bool store_blockchain_raw(cryptonote::Blockchain* cs, cryptonote::tx_memory_pool* txp,
-      boost::filesystem::path& output_file, uint64_t use_block_height=0);
+      boost::filesystem::path& output_file, uint64_t use_block_height=0, bool indexed=true);
+
+  // maps an indexed (v2) file for reading, returns false if the file has no index
+  bool map_indexed(const std::string& import_file_path);
+  uint64_t indexed_block_first() const { return m_trailer.block_first; }
+  uint64_t indexed_block_count() const { return m_trailer.num_chunks * NUM_BLOCKS_PER_CHUNK; }
+  // copies the chunk holding the block at height, after checking its checksum,
+  // safe to call from several threads at once
+  bool get_chunk(uint64_t height, std::string& chunk) const;
+
+  // loads the index of an indexed (v2) file which is read sequentially,
+  // returns false if the file has no index
+  bool load_index(const std::string& import_file_path);
+  // checks a chunk read sequentially against the loaded index, if any,
+  // safe to call from several threads at once
+  bool check_chunk(uint64_t height, const std::string& chunk) const;
 
 protected:
 
@@ -72,19 +90,31 @@ protected:
   tx_memory_pool* m_tx_pool;
   typedef std::vector<char> buffer_type;
   std::ofstream * m_raw_data_file;
+  std::string m_file_path;
   buffer_type m_buffer;
   boost::iostreams::stream<boost::iostreams::back_insert_device<buffer_type>>* m_output_stream;
 
   // open export file for write
-  bool open_writer(const boost::filesystem::path& file_path);
+  bool open_writer(const boost::filesystem::path& file_path, bool indexed);
   bool initialize_file();
   bool close();
   void write_block(block& block);
   void flush_chunk();
+  void write_index();
+
+  // index of an indexed file, built while writing, or loaded by load_index
+  bool m_indexed;
+  std::vector<bootstrap::chunk_index_entry> m_index;
+  uint64_t m_block_first;
+
+  // indexed file mapped for reading
+  boost::interprocess::file_mapping m_mapping;
+  boost::interprocess::mapped_region m_region;
+  bootstrap::index_trailer m_trailer = {};
 
 private:
 
-  uint64_t m_height;
-  uint64_t m_cur_height; // tracks current height during export
-  uint32_t m_max_chunk;
+  uint64_t m_height = 0;
+  uint64_t m_cur_height = 0; // tracks current height during export
+  uint32_t m_max_chunk = 0;
 };
@@ -66,6 +66,25 @@ namespace cryptonote
       END_SERIALIZE()
     };
 
+    // v2 files end with an index of their chunks, followed by a fixed size
+    // trailer, so a reader can map the file and go straight to any height.
+    // Both are stored little endian, field by field, in this order.
+    struct chunk_index_entry
+    {
+      uint64_t offset;    // file position of the chunk's size field
+      uint32_t size;      // chunk size, not counting the size field
+      uint32_t checksum;  // crc32 of the chunk data
+    };
+
+    struct index_trailer
+    {
+      uint64_t index_offset;  // file position of the first chunk_index_entry
+      uint64_t block_first;   // zero-based height of the file's first block
+      uint64_t num_chunks;
+      uint32_t reserved;
+      uint32_t magic;
+    };
+
     struct block_package
     {
       cryptonote::block block;
@@ -6,190 +6,356 @@
 #include <memory> // For std::shared_ptr
 
 
+#include "misc_log_ex.h"
 #include "common/send_and_receive_data.h"
-#include "common/blocking_tcp_client.h"
-#include "send_and_receive_data.h"
+
+#undef XCASH_DEFAULT_LOG_CATEGORY
+#define XCASH_DEFAULT_LOG_CATEGORY "net.xcash"
 
 
 std::string send_and_receive_data(std::string IP_address,std::string data2, int send_or_receive_socket_data_timeout_settings)
 {
-  // Variables
-  std::string string;
-  auto connection_timeout = boost::posix_time::milliseconds(CONNECTION_TIMEOUT_SETTINGS);
-  auto send_and_receive_data_timeout = boost::posix_time::milliseconds(send_or_receive_socket_data_timeout_settings);
-
-  try
-  {
-    // add the end string to the data
-    data2 += SOCKET_END_STRING;
-
-    client c;
-    c.connect(IP_address, SEND_DATA_PORT, connection_timeout);
-    
-    // send the message and read the response
-    c.write_line(data2, send_and_receive_data_timeout);
-    string = c.read_until('}', send_and_receive_data_timeout);
-  }
-  catch (std::exception &ex)
-  {
+  // block verifiers end their reply with '}' and may keep writing after it, so these
+  // connections are not reused
+  xcash_net::request_options options;
+  options.connect_timeout = std::chrono::milliseconds(CONNECTION_TIMEOUT_SETTINGS);
+  options.deadline = std::chrono::milliseconds(CONNECTION_TIMEOUT_SETTINGS + 2 * send_or_receive_socket_data_timeout_settings);
+  options.message_ender = "}";
+  options.keep_alive = false;
+
+  xcash_net::XcashResult result = xcash_net::connection_pool::getInstance().send(IP_address, SEND_DATA_PORT, data2, options).get();
+  if (result.reply.rfind("Error:", 0) == 0)
     return "";
-  }
-  return string;
+  // the reply is returned without the '}' it ends with
+  result.reply.pop_back();
+  return result.reply;
 }
 
 
 namespace xcash_net {
-// Function to send a message and receive a reply from a single server asynchronously
-void xcash_send_msg_async(
-    const std::string& server,
-    const std::string& port,
-    const std::string& message,
-    boost::asio::io_context& io_context,
-    std::vector<XcashResult>* results,
-    std::function<void()> on_complete,
-    const std::string& message_ender = "|END|"
-) {
-    auto socket = std::make_shared<tcp::socket>(io_context);
-    auto timer = std::make_shared<boost::asio::steady_timer>(io_context);
-    auto reply_buffer = std::make_shared<boost::asio::streambuf>();
-    auto result = std::make_shared<XcashResult>();
-
-    result->server_info = server + ":" + port;
+struct connection_pool::connection
+{
+    connection(boost::asio::io_context &io_context): socket(io_context), reused(false) {}
 
-    const std::string xcash_message = message + "|END|";
+    tcp::socket socket;
+    boost::asio::streambuf buffer;
+    std::chrono::steady_clock::time_point last_used;
+    bool reused;
+};
 
-    try {
-        tcp::resolver resolver(io_context);
-        auto endpoints = resolver.resolve(server, port);
-    
-        // Start timer for timeout
-        timer->expires_after(std::chrono::milliseconds(300));
-        timer->async_wait([=](const boost::system::error_code& ec) mutable {
-            if (!ec) {
-                socket->close(); // Timeout occurred
-                result->reply = "Error: Connection Timeout occurred";
-                results->push_back(*result);
-                on_complete();
+struct connection_pool::request
+{
+    request(boost::asio::io_context &io_context): timer(io_context), finished(false), retried(false) {}
+
+    std::string key;
+    std::string server;
+    std::string port;
+    std::string message;
+    request_options options;
+    callback_t callback;
+    boost::asio::steady_timer timer;
+    std::chrono::steady_clock::time_point deadline;
+    std::shared_ptr<connection> conn;
+    bool finished;
+    bool retried;
+};
+
+connection_pool::connection_pool():
+    m_work(boost::asio::make_work_guard(m_io_context)),
+    m_resolver(m_io_context)
+{
+    m_thread = boost::thread([this]() {
+        for (;;) {
+            try {
+                m_io_context.run();
+                break;
+            } catch (const std::exception &e) {
+                MERROR("xcash_net io thread: " << e.what());
             }
-        });
+        }
+    });
+}
+
+connection_pool::~connection_pool()
+{
+    m_work.reset();
+    m_io_context.stop();
+    if (m_thread.joinable())
+        m_thread.join();
+}
 
+void connection_pool::send_async(const std::string &server, const std::string &port, const std::string &message, callback_t callback, const request_options &options)
+{
+    auto req = std::make_shared<request>(m_io_context);
+    req->key = server + ":" + port;
+    req->server = server;
+    req->port = port;
+    req->message = message + SOCKET_END_STRING;
+    req->options = options;
+    req->callback = std::move(callback);
+    req->deadline = std::chrono::steady_clock::now() + options.deadline;
+    boost::asio::post(m_io_context, [this, req]() { start(req); });
+}
+
+std::future<XcashResult> connection_pool::send(const std::string &server, const std::string &port, const std::string &message, const request_options &options)
+{
+    auto promise = std::make_shared<std::promise<XcashResult>>();
+    std::future<XcashResult> future = promise->get_future();
+    send_async(server, port, message, [promise](const XcashResult &result) { promise->set_value(result); }, options);
+    return future;
+}
 
-        // Start connection
-        socket->async_connect(*endpoints.begin(), [=](const boost::system::error_code& ec) mutable {
-            timer->cancel(); // Cancel timer on successful connection
+std::vector<XcashResult> connection_pool::send_multi(const std::vector<std::string> &servers, const std::string &port, const std::string &message, const request_options &options)
+{
+    std::vector<std::future<XcashResult>> futures;
+    futures.reserve(servers.size());
+    for (const auto &server : servers)
+        futures.push_back(send(server, port, message, options));
 
+    std::vector<XcashResult> results;
+    results.reserve(futures.size());
+    for (auto &future : futures)
+        results.push_back(future.get());
+    return results;
+}
+
+void connection_pool::start(const std::shared_ptr<request> &req)
+{
+    req->timer.expires_at(req->deadline);
+    req->timer.async_wait([this, req](const boost::system::error_code &ec) {
+        if (!ec)
+            finish(req, "Error: Timeout occurred", false);
+    });
+
+    if (req->options.keep_alive && !m_no_keep_alive[req->key])
+        req->conn = get_idle_connection(req->key);
+    if (req->conn)
+        write(req);
+    else
+        connect(req);
+}
+
+void connection_pool::connect(const std::shared_ptr<request> &req)
+{
+    req->conn = std::make_shared<connection>(m_io_context);
+
+    auto on_resolved = [this, req](const tcp::resolver::results_type &endpoints) {
+        if (req->finished)
+            return;
+
+        // a dead server must not eat the whole deadline
+        const auto connect_deadline = std::min(req->deadline, std::chrono::steady_clock::now() + req->options.connect_timeout);
+        auto connect_timer = std::make_shared<boost::asio::steady_timer>(m_io_context, connect_deadline);
+        // 0: connecting, 1: connected or failed, 2: timed out
+        auto state = std::make_shared<int>(0);
+        std::shared_ptr<connection> conn = req->conn;
+        connect_timer->async_wait([conn, state](const boost::system::error_code &ec) {
+            if (!ec && *state == 0) {
+                *state = 2;
+                boost::system::error_code ignored_ec;
+                conn->socket.close(ignored_ec);
+            }
+        });
+
+        boost::asio::async_connect(conn->socket, endpoints, [this, req, conn, connect_timer, state](const boost::system::error_code &ec, const tcp::endpoint&) {
+            const bool timed_out = *state == 2;
+            *state = 1;
+            connect_timer->cancel();
+            if (req->finished || req->conn != conn)
+                return;
             if (ec) {
-                result->reply = "Error: " + ec.message();
-                results->push_back(*result);
-                on_complete();
+                // the address may have moved, look it up again next time
+                m_dns_cache.erase(req->key);
+                finish(req, timed_out ? "Error: Connection Timeout occurred" : "Error: " + ec.message(), false);
                 return;
             }
-
-            timer->expires_after(std::chrono::milliseconds(600));
-            timer->async_wait([=](const boost::system::error_code& ec) mutable {
-                if (!ec) {
-                    socket->close(); // Timeout occurred
-                    result->reply = "Error: Write Timeout occurred";
-                    results->push_back(*result);
-                    on_complete();
-                }
-            });
-
-            // Send message
-            boost::asio::async_write(*socket, boost::asio::buffer(xcash_message), [=](const boost::system::error_code& ec, std::size_t) mutable {
-                timer->cancel(); // Cancel timer on successful read
-                if (ec) {
-                    result->reply = "Error: " + ec.message();
-                    results->push_back(*result);
-                    on_complete();
-                    return;
-                }
-
-                // Start timer for timeout
-                timer->expires_after(std::chrono::seconds(6));
-                timer->async_wait([=](const boost::system::error_code& ec) mutable {
-                    if (!ec) {
-                        socket->close(); // Timeout occurred
-                        result->reply = "Error: Read Timeout occurred";
-                        results->push_back(*result);
-                        on_complete();
-                    }
-                });
-
-                // Receive reply
-                boost::asio::async_read_until(*socket, *reply_buffer, message_ender, [=](const boost::system::error_code& ec, std::size_t bytes_transferred) mutable {
-                    timer->cancel(); // Cancel timer on successful read
-                    if (!ec) {
-                        result->reply = std::string(boost::asio::buffers_begin(reply_buffer->data()),
-                                                    boost::asio::buffers_begin(reply_buffer->data()) + bytes_transferred);
-                    } else {
-                        result->reply = "Error: " + ec.message();
-                    }
-                    results->push_back(*result);
-                    on_complete();
-                });
-            });
+            write(req);
         });
-    } catch (const std::exception& ex) {
-        result->reply = "Error: " + std::string(ex.what());
-        results->push_back(*result);
-        on_complete();
+    };
+
+    auto it = m_dns_cache.find(req->key);
+    if (it != m_dns_cache.end() && it->second.expires > std::chrono::steady_clock::now()) {
+        on_resolved(it->second.endpoints);
+        return;
     }
+
+    m_resolver.async_resolve(req->server, req->port, [this, req, on_resolved](const boost::system::error_code &ec, const tcp::resolver::results_type &endpoints) {
+        if (req->finished)
+            return;
+        if (ec) {
+            finish(req, "Error: " + ec.message(), false);
+            return;
+        }
+        m_dns_cache[req->key] = {endpoints, std::chrono::steady_clock::now() + std::chrono::seconds(XCASH_NET_DNS_CACHE_TIME)};
+        on_resolved(endpoints);
+    });
 }
 
+void connection_pool::write(const std::shared_ptr<request> &req)
+{
+    boost::asio::async_write(req->conn->socket, boost::asio::buffer(req->message), [this, req](const boost::system::error_code &ec, std::size_t) {
+        if (req->finished)
+            return;
+        if (ec) {
+            on_io_error(req, ec);
+            return;
+        }
+        read(req);
+    });
+}
 
-void xcash_send_multi_msg_async(
-    const std::vector<std::string>& servers,
-    const std::string& message,
-    std::vector<XcashResult>* results,
-    const std::string& message_ender = "|END|"
-    ) {
-    boost::asio::io_context io_context;
-    std::size_t pending_operations = servers.size();
-    std::vector<XcashResult> all_results;
+void connection_pool::read(const std::shared_ptr<request> &req)
+{
+    std::shared_ptr<connection> conn = req->conn;
+    boost::asio::async_read_until(conn->socket, conn->buffer, req->options.message_ender, [this, req, conn](const boost::system::error_code &ec, std::size_t bytes_transferred) {
+        if (req->finished)
+            return;
+        if (ec) {
+            on_io_error(req, ec);
+            return;
+        }
+        const std::string reply(boost::asio::buffers_begin(conn->buffer.data()), boost::asio::buffers_begin(conn->buffer.data()) + bytes_transferred);
+        conn->buffer.consume(bytes_transferred);
+        finish(req, reply, true);
+    });
+}
 
-    if (servers.empty()) {
-        std::cerr << "Error: No servers provided." << std::endl;
+void connection_pool::on_io_error(const std::shared_ptr<request> &req, const boost::system::error_code &ec)
+{
+    // a pooled connection the server has since closed: retry once on a new one. A server
+    // that closes the connection right after its previous reply does not do keep-alive,
+    // so stop pooling its connections
+    if (req->conn->reused && !req->retried && req->conn->buffer.size() == 0 &&
+        (ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset || ec == boost::asio::error::broken_pipe)) {
+        if (ec == boost::asio::error::eof &&
+            std::chrono::steady_clock::now() - req->conn->last_used < std::chrono::seconds(1)) {
+            MDEBUG("xcash_net: " << req->key << " does not keep connections alive");
+            m_no_keep_alive[req->key] = true;
+            m_idle_connections.erase(req->key);
+        }
+        boost::system::error_code ignored_ec;
+        req->conn->socket.close(ignored_ec);
+        req->retried = true;
+        connect(req);
         return;
     }
-    bool all_done = false;
+    finish(req, "Error: " + ec.message(), false);
+}
 
-    // Completion handler
-    auto on_complete = [&]() {
-        if (--pending_operations == 0) {
-            all_done = true;
-            io_context.stop();
+void connection_pool::finish(const std::shared_ptr<request> &req, const std::string &reply, bool ok)
+{
+    if (req->finished)
+        return;
+    req->finished = true;
+    req->timer.cancel();
+
+    if (req->conn) {
+        if (ok && req->options.keep_alive && !m_no_keep_alive[req->key] && req->conn->buffer.size() == 0) {
+            release_connection(req->key, req->conn);
+        } else {
+            boost::system::error_code ignored_ec;
+            req->conn->socket.close(ignored_ec);
         }
-    };
+        req->conn.reset();
+    }
 
-    // Start sending messages asynchronously
-    for (const auto& server : servers) {
-        xcash_send_msg_async(server, "18283", message, io_context, &all_results, on_complete, message_ender);
+    XcashResult result;
+    result.server_info = req->key;
+    result.reply = reply;
+    try {
+        req->callback(result);
+    } catch (const std::exception &e) {
+        MERROR("xcash_net request callback for " << req->key << " failed: " << e.what());
     }
+}
 
-    io_context.run();
-    while (!all_done) {
-        // io_context.run_one(); // Run only one asynchronous operation at a time
-        // Optionally, add a small delay to avoid tight looping
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+std::shared_ptr<connection_pool::connection> connection_pool::get_idle_connection(const std::string &key)
+{
+    auto it = m_idle_connections.find(key);
+    if (it == m_idle_connections.end())
+        return nullptr;
+
+    const auto now = std::chrono::steady_clock::now();
+    auto &idle = it->second;
+    while (!idle.empty()) {
+        std::shared_ptr<connection> conn = idle.back();
+        idle.pop_back();
+        if (conn->socket.is_open() && now - conn->last_used < std::chrono::seconds(XCASH_NET_IDLE_CONNECTION_TIMEOUT)) {
+            conn->reused = true;
+            return conn;
+        }
+        boost::system::error_code ignored_ec;
+        conn->socket.close(ignored_ec);
     }
+    return nullptr;
+}
 
+void connection_pool::release_connection(const std::string &key, const std::shared_ptr<connection> &conn)
+{
+    auto &idle = m_idle_connections[key];
+    if (idle.size() >= XCASH_NET_MAX_IDLE_CONNECTIONS) {
+        boost::system::error_code ignored_ec;
+        conn->socket.close(ignored_ec);
+        return;
+    }
+    conn->last_used = std::chrono::steady_clock::now();
+    idle.push_back(conn);
+}
+
+
+// Keeps only the successful replies, with the message ender removed
+static void collect_replies(const std::vector<XcashResult>& all_results, std::vector<XcashResult>* results, const std::string& message_ender) {
     for (auto result : all_results) {
-    // std::cout << "Server: " << result.server_info << "\n";
-    if (result.reply.rfind("Error:", 0) != 0) {
-        // Remove message ender
-        if (result.reply.size() >= message_ender.size() && 
-            result.reply.compare(result.reply.size() - message_ender.size(), message_ender.size(), message_ender) == 0) {
-            result.reply.erase(result.reply.size() - message_ender.size());
-    
-            results->push_back(result);
+        if (result.reply.rfind("Error:", 0) != 0) {
+            // Remove message ender
+            if (result.reply.size() >= message_ender.size() &&
+                result.reply.compare(result.reply.size() - message_ender.size(), message_ender.size(), message_ender) == 0) {
+                result.reply.erase(result.reply.size() - message_ender.size());
+
+                results->push_back(result);
+            }
         }
-        // std::cout << "Reply: " << result.reply << "\n";
-    }else{
-        // std::cout << result.server_info << " : " << result.reply << "\n";
     }
 }
 
+// Extracts the "block_hash" field of every reply
+static void parse_block_hash_replies(const std::vector<XcashResult>& results, std::vector<std::string>& hashes) {
+    static const std::string key = "\"block_hash\":\"";
+    for (const auto& result : results) {
+        if (!result.reply.empty()) {
+            std::size_t start_pos = result.reply.find(key);
+            if (start_pos != std::string::npos) {
+                start_pos += key.length();
+                std::size_t end_pos = result.reply.find("\"", start_pos);
+                if (end_pos != std::string::npos) {
+                    hashes.push_back(result.reply.substr(start_pos, end_pos - start_pos));
+                }
+            }
+        }
+    }
+}
+
+static std::string get_block_hash_message(std::size_t block_height) {
+    return "{\r\n \"message_settings\": \"XCASH_GET_BLOCK_HASH\",\r\n\"block_height\": " + std::to_string(block_height) + "\r\n}";
+}
+
+
+void xcash_send_multi_msg_async(
+    const std::vector<std::string>& servers,
+    const std::string& message,
+    std::vector<XcashResult>* results,
+    const std::string& message_ender = "|END|"
+    ) {
+    if (servers.empty()) {
+        std::cerr << "Error: No servers provided." << std::endl;
+        return;
+    }
+
+    request_options options;
+    options.message_ender = message_ender;
+    const std::vector<XcashResult> all_results = connection_pool::getInstance().send_multi(servers, SEND_DATA_PORT, message, options);
+
+    collect_replies(all_results, results, message_ender);
 }
 
 std::vector<std::string> extract_block_verifiers_IP_address_list(const std::string& message) {
@@ -216,24 +382,36 @@ std::vector<std::string> extract_block_verifiers_IP_address_list(const std::stri
 
 
 void get_block_hashes(std::size_t block_height, std::vector<std::string>& servers, std::vector<std::string>& hashes) {
-    std::string message_str = "{\r\n \"message_settings\": \"XCASH_GET_BLOCK_HASH\",\r\n\"block_height\": " + std::to_string(block_height) + "\r\n}";
-
     std::vector<XcashResult> results;
-    xcash_send_multi_msg_async(servers, message_str, &results);
+    xcash_send_multi_msg_async(servers, get_block_hash_message(block_height), &results);
 
-    // Populate the cache with the results
-    for (const auto& result : results) {
-        if (!result.reply.empty()) {
-            std::size_t start_pos = result.reply.find("\"block_hash\":\"");
-            if (start_pos != std::string::npos) {
-                start_pos += std::string("\"block_hash\":\"").length();
-                std::size_t end_pos = result.reply.find("\"", start_pos);
-                if (end_pos != std::string::npos) {
-                    std::string hash = result.reply.substr(start_pos, end_pos - start_pos);
-                    hashes.push_back({hash});
-                }
-            }
+    parse_block_hash_replies(results, hashes);
+}
+
+
+void get_block_hashes_batch(const std::vector<std::size_t>& block_heights, const std::vector<std::string>& servers, std::map<std::size_t, std::vector<std::string>>& hashes) {
+    if (block_heights.empty() || servers.empty()) {
+        return;
+    }
+
+    // every (height, server) query is in flight at once over the pooled connections
+    connection_pool &pool = connection_pool::getInstance();
+    std::vector<std::vector<std::future<XcashResult>>> futures(block_heights.size());
+    for (std::size_t i = 0; i < block_heights.size(); ++i) {
+        const std::string message = get_block_hash_message(block_heights[i]);
+        for (const auto& server : servers) {
+            futures[i].push_back(pool.send(server, SEND_DATA_PORT, message));
+        }
+    }
+
+    for (std::size_t i = 0; i < block_heights.size(); ++i) {
+        std::vector<XcashResult> all_results;
+        for (auto& future : futures[i]) {
+            all_results.push_back(future.get());
         }
+        std::vector<XcashResult> results;
+        collect_replies(all_results, &results, SOCKET_END_STRING);
+        parse_block_hash_replies(results, hashes[block_heights[i]]);
     }
 }
 
@@ -24,6 +24,13 @@
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <map>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <boost/asio/steady_timer.hpp>
 
 using boost::asio::deadline_timer;
 using boost::asio::ip::tcp;
@@ -34,14 +41,94 @@ using boost::asio::ip::tcp;
 
 std::string send_and_receive_data(std::string IP_address,std::string data2, int send_or_receive_socket_data_timeout_settings = SEND_OR_RECEIVE_SOCKET_DATA_TIMEOUT_SETTINGS);
 
+// Default deadline for a whole request to a seed node, from resolving to the end of the reply
+#define XCASH_NET_REQUEST_DEADLINE 7000 // milliseconds
+// The part of the deadline a new connection may spend connecting
+#define XCASH_NET_CONNECT_TIMEOUT 300 // milliseconds
+// How long a resolved host name is reused before it is looked up again
+#define XCASH_NET_DNS_CACHE_TIME 300 // seconds
+// Idle keep-alive connections kept per server, and how long they may stay idle
+#define XCASH_NET_MAX_IDLE_CONNECTIONS 4
+#define XCASH_NET_IDLE_CONNECTION_TIMEOUT 30 // seconds
+
 namespace xcash_net {
 // Structure to store results
 struct XcashResult {
     std::string server_info;
     std::string reply;
 };
-void xcash_send_msg_async(const std::string &server, const std::string &port, const std::string &message, boost::asio::io_context &io_context, std::vector<XcashResult> *results, std::function<void()> on_complete, const std::string &message_ender);
+
+struct request_options {
+    request_options():
+        deadline(XCASH_NET_REQUEST_DEADLINE),
+        connect_timeout(XCASH_NET_CONNECT_TIMEOUT),
+        message_ender(SOCKET_END_STRING),
+        keep_alive(true) {}
+
+    std::chrono::milliseconds deadline;
+    std::chrono::milliseconds connect_timeout;
+    std::string message_ender;   // the reply is complete once this has been read
+    bool keep_alive;             // return the connection to the pool after the reply
+};
+
+// A long lived client for the seed and block verifier nodes. It owns one io
+// thread, caches DNS lookups and keeps connections to each server open between
+// requests, so concurrent queries cost one round trip instead of a resolve,
+// a TCP handshake and a round trip each.
+// Replies on the node protocol carry no request id, so a connection carries one
+// request at a time; concurrent requests to a server use parallel connections.
+// A server that closes connections after replying is detected and no longer pooled.
+class connection_pool
+{
+public:
+    typedef std::function<void(const XcashResult&)> callback_t;
+
+    static connection_pool& getInstance() {
+        static connection_pool instance;
+        return instance;
+    }
+
+    // The callback is invoked exactly once, from the io thread, with either the
+    // reply (message ender included) or a reply starting with "Error:"
+    void send_async(const std::string &server, const std::string &port, const std::string &message, callback_t callback, const request_options &options = request_options());
+    std::future<XcashResult> send(const std::string &server, const std::string &port, const std::string &message, const request_options &options = request_options());
+    // Sends the message to every server concurrently and waits for all of them
+    std::vector<XcashResult> send_multi(const std::vector<std::string> &servers, const std::string &port, const std::string &message, const request_options &options = request_options());
+
+    ~connection_pool();
+
+private:
+    struct connection;
+    struct request;
+    struct dns_entry {
+        tcp::resolver::results_type endpoints;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    connection_pool();
+
+    void start(const std::shared_ptr<request> &req);
+    void connect(const std::shared_ptr<request> &req);
+    void write(const std::shared_ptr<request> &req);
+    void read(const std::shared_ptr<request> &req);
+    void on_io_error(const std::shared_ptr<request> &req, const boost::system::error_code &ec);
+    void finish(const std::shared_ptr<request> &req, const std::string &reply, bool ok);
+    std::shared_ptr<connection> get_idle_connection(const std::string &key);
+    void release_connection(const std::string &key, const std::shared_ptr<connection> &conn);
+
+    boost::asio::io_context m_io_context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work;
+    tcp::resolver m_resolver;
+    // only touched from the io thread
+    std::map<std::string, dns_entry> m_dns_cache;
+    std::map<std::string, std::deque<std::shared_ptr<connection>>> m_idle_connections;
+    std::map<std::string, bool> m_no_keep_alive;
+    boost::thread m_thread;
+};
+
 void xcash_send_multi_msg_async(const std::vector<std::string> &servers, const std::string &message, std::vector<XcashResult> *results, const std::string &message_ender);
 std::vector<std::string> extract_block_verifiers_IP_address_list(const std::string &message);
 void get_block_hashes(std::size_t block_height, std::vector<std::string> &servers, std::vector<std::string> &hashes);
-}
\ No newline at end of file
+// Queries the block hash of every height from every server concurrently
+void get_block_hashes_batch(const std::vector<std::size_t> &block_heights, const std::vector<std::string> &servers, std::map<std::size_t, std::vector<std::string>> &hashes);
+}
@@ -31,22 +31,33 @@
 #include <cassert>
 #include <limits>
 #include <stdexcept>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "cryptonote_config.h"
 #include "common/util.h"
 
 static __thread int depth = 0;
 static __thread bool is_leaf = false;
+static __thread const tools::threadpool *worker_pool = NULL;
+static __thread size_t worker_index = 0;
+
+static const size_t no_queue = std::numeric_limits<size_t>::max();
 
 namespace tools
 {
-threadpool::threadpool(unsigned int max_threads) : running(true), active(0) {
+threadpool::threadpool(unsigned int max_threads) : active(0), sleeping(0), pending(0), next_queue(0), tasks(0), steals(0), total_latency_us(0), max_latency_us(0), running(true) {
   boost::thread::attributes attrs;
   attrs.set_stack_size(THREAD_STACK_SIZE);
   max = max_threads ? max_threads : tools::get_max_concurrency();
   size_t i = max ? max - 1 : 0;
-  while(i--) {
-    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, false)));
+  // with no worker, a single queue is drained by the waiters
+  for (size_t n = 0; n < std::max<size_t>(i, 1); ++n)
+    queues.emplace_back(new worker_queue());
+  for (size_t n = 0; n < i; ++n) {
+    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, n, false)));
   }
 }
 
@@ -62,25 +73,35 @@ threadpool::~threadpool() {
   }
 }
 
-void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf) {
+void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf, priority prio) {
   CHECK_AND_ASSERT_THROW_MES(!is_leaf, "A leaf routine is using a thread pool");
-  boost::unique_lock<boost::mutex> lock(mutex);
-  if (!leaf && ((active == max && !queue.empty()) || depth > 0)) {
+  CHECK_AND_ASSERT_THROW_MES(prio < NUM_PRIORITIES, "Invalid thread pool priority");
+  if (!leaf && ((active == max && pending > 0) || depth > 0)) {
     // if all available threads are already running
     // and there's work waiting, just run in current thread
-    lock.unlock();
     ++depth;
     is_leaf = leaf;
     f();
     --depth;
     is_leaf = false;
-  } else {
-    if (obj)
-      obj->inc();
+    return;
+  }
+
+  if (obj)
+    obj->inc();
+  // counted before it is queued so a worker going to sleep can't miss it
+  ++pending;
+  const size_t index = worker_pool == this ? worker_index : next_queue++ % queues.size();
+  worker_queue &wq = *queues[index];
+  {
+    const boost::unique_lock<boost::mutex> lock(wq.mutex);
     if (leaf)
-      queue.push_front({obj, f, leaf});
+      wq.queues[prio].push_front({obj, std::move(f), leaf, std::chrono::steady_clock::now()});
     else
-      queue.push_back({obj, f, leaf});
+      wq.queues[prio].push_back({obj, std::move(f), leaf, std::chrono::steady_clock::now()});
+  }
+  if (sleeping > 0) {
+    const boost::unique_lock<boost::mutex> lock(mutex);
     has_work.notify_one();
   }
 }
@@ -89,6 +110,38 @@ unsigned int threadpool::get_max_concurrency() const {
   return max;
 }
 
+void threadpool::set_affinity(bool pin) {
+#if defined(__linux__)
+  const unsigned int ncpus = std::max(boost::thread::hardware_concurrency(), 1u);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (pin)
+      CPU_SET((i + 1) % ncpus, &cpuset); // the first CPU is left to the threads waiting on them
+    else
+      for (unsigned int cpu = 0; cpu < ncpus; ++cpu)
+        CPU_SET(cpu, &cpuset);
+    const int err = pthread_setaffinity_np(threads[i].native_handle(), sizeof(cpuset), &cpuset);
+    if (err)
+      MWARNING("Failed to set the affinity of thread pool worker " << i << ": " << err);
+  }
+#else
+  if (pin)
+    MWARNING("Thread pool affinity is not supported on this platform");
+#endif
+}
+
+threadpool::stats threadpool::get_stats() const {
+  stats s;
+  s.threads = max;
+  s.queue_depth = pending;
+  s.tasks = tasks;
+  s.steals = steals;
+  s.average_latency_us = s.tasks ? total_latency_us / s.tasks : 0;
+  s.max_latency_us = max_latency_us;
+  return s;
+}
+
 threadpool::waiter::~waiter()
 {
   {
@@ -108,7 +161,7 @@ threadpool::waiter::~waiter()
 
 void threadpool::waiter::wait(threadpool *tpool) {
   if (tpool)
-    tpool->run(true);
+    tpool->run(tpool == worker_pool ? worker_index : no_queue, true);
   boost::unique_lock<boost::mutex> lock(mt);
   while(num)
     cv.wait(lock);
@@ -126,22 +179,66 @@ void threadpool::waiter::dec() {
     cv.notify_all();
 }
 
-void threadpool::run(bool flush) {
-  boost::unique_lock<boost::mutex> lock(mutex);
+bool threadpool::pop(size_t index, entry &e) {
+  for (size_t prio = 0; prio < NUM_PRIORITIES; ++prio) {
+    // our own queue first, each queue runs its tasks in order
+    if (index != no_queue) {
+      worker_queue &wq = *queues[index];
+      const boost::unique_lock<boost::mutex> lock(wq.mutex);
+      if (!wq.queues[prio].empty()) {
+        e = std::move(wq.queues[prio].front());
+        wq.queues[prio].pop_front();
+        --pending;
+        return true;
+      }
+    }
+    // then steal from another worker's queue
+    const size_t start = index == no_queue ? 0 : index + 1;
+    for (size_t n = 0; n < queues.size(); ++n) {
+      const size_t victim = (start + n) % queues.size();
+      if (victim == index)
+        continue;
+      worker_queue &wq = *queues[victim];
+      const boost::unique_lock<boost::mutex> lock(wq.mutex);
+      if (!wq.queues[prio].empty()) {
+        e = std::move(wq.queues[prio].front());
+        wq.queues[prio].pop_front();
+        --pending;
+        if (index != no_queue)
+          ++steals;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void threadpool::run(size_t index, bool flush) {
+  if (!flush) {
+    worker_pool = this;
+    worker_index = index;
+  }
   while (running) {
     entry e;
-    while(queue.empty() && running)
+    if (!pop(index, e))
     {
       if (flush)
         return;
-      has_work.wait(lock);
+      boost::unique_lock<boost::mutex> lock(mutex);
+      ++sleeping;
+      while (running && pending == 0)
+        has_work.wait(lock);
+      --sleeping;
+      continue;
     }
-    if (!running) break;
+
+    const uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - e.submitted).count();
+    ++tasks;
+    total_latency_us += latency;
+    uint64_t prev_max = max_latency_us;
+    while (latency > prev_max && !max_latency_us.compare_exchange_weak(prev_max, latency));
 
     active++;
-    e = queue.front();
-    queue.pop_front();
-    lock.unlock();
     ++depth;
     is_leaf = e.leaf;
     e.f();
@@ -150,7 +247,6 @@ void threadpool::run(bool flush) {
 
     if (e.wo)
       e.wo->dec();
-    lock.lock();
     active--;
   }
 }
@@ -30,8 +30,13 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <stdexcept>
@@ -39,6 +44,11 @@
 namespace tools
 {
 //! A global thread pool
+/*! Each worker has its own queues, one per priority. A task submitted from
+ *  a worker goes to that worker's queues, others are spread over all of
+ *  them, and an idle worker steals from the others, always taking the most
+ *  urgent task it can find.
+ */
 class threadpool
 {
 public:
@@ -50,6 +60,23 @@ public:
     return new threadpool(max_threads);
   }
 
+  //! Task priorities, tasks are taken from the highest one first
+  enum priority {
+    PRIORITY_HIGH = 0, //!< block sync and verification
+    PRIORITY_NORMAL,
+    PRIORITY_LOW, //!< work that can wait for the above
+    NUM_PRIORITIES
+  };
+
+  struct stats {
+    unsigned int threads;
+    uint64_t queue_depth; //!< tasks waiting to run
+    uint64_t tasks; //!< tasks run from the queues
+    uint64_t steals; //!< tasks a worker took from another worker's queues
+    uint64_t average_latency_us; //!< average time between submit and start
+    uint64_t max_latency_us;
+  };
+
   // The waiter lets the caller know when all of its
   // tasks are completed.
   class waiter {
@@ -67,10 +94,15 @@ public:
   // Submit a task to the pool. The waiter pointer may be
   // NULL if the caller doesn't care to wait for the
   // task to finish.
-  void submit(waiter *waiter, std::function<void()> f, bool leaf = false);
+  void submit(waiter *waiter, std::function<void()> f, bool leaf = false, priority prio = PRIORITY_NORMAL);
 
   unsigned int get_max_concurrency() const;
 
+  //! Pins each worker to its own CPU, or lets them float again
+  void set_affinity(bool pin);
+
+  stats get_stats() const;
+
   ~threadpool();
 
   private:
@@ -79,15 +111,28 @@ public:
       waiter *wo;
       std::function<void()> f;
       bool leaf;
+      std::chrono::steady_clock::time_point submitted;
     } entry;
-    std::deque<entry> queue;
+    struct worker_queue {
+      boost::mutex mutex;
+      std::deque<entry> queues[NUM_PRIORITIES];
+    };
+    std::vector<std::unique_ptr<worker_queue>> queues;
     boost::condition_variable has_work;
-    boost::mutex mutex;
+    boost::mutex mutex; // only guards sleeping and waking up
     std::vector<boost::thread> threads;
-    unsigned int active;
+    std::atomic<unsigned int> active;
+    std::atomic<unsigned int> sleeping;
+    std::atomic<uint64_t> pending;
+    std::atomic<unsigned int> next_queue;
+    std::atomic<uint64_t> tasks;
+    std::atomic<uint64_t> steals;
+    std::atomic<uint64_t> total_latency_us;
+    std::atomic<uint64_t> max_latency_us;
     unsigned int max;
-    bool running;
-    void run(bool flush = false);
+    std::atomic<bool> running;
+    bool pop(size_t index, entry &e);
+    void run(size_t index, bool flush = false);
 };
 
 }
@@ -245,6 +245,66 @@ namespace crypto {
     return true;
   }
 
+  void crypto_ops::generate_key_derivations(const std::vector<public_key> &keys, const secret_key &sec, std::vector<key_derivation> &derivations, std::vector<bool> &valid) {
+    const size_t n = keys.size();
+    std::vector<ge_p2> points(n);
+    std::unique_ptr<fe[]> tmp(new fe[n]);
+    assert(sc_check(&sec) == 0);
+    valid.assign(n, true);
+    for (size_t i = 0; i < n; ++i) {
+      ge_p3 point;
+      ge_p2 point2;
+      ge_p1p1 point3;
+      if (ge_frombytes_vartime(&point, &keys[i]) != 0) {
+        valid[i] = false;
+        ge_p3_to_p2(&points[i], &ge_p3_identity);
+        continue;
+      }
+      ge_scalarmult(&point2, &unwrap(sec), &point);
+      ge_mul8(&point3, &point2);
+      ge_p1p1_to_p2(&points[i], &point3);
+    }
+    derivations.resize(n);
+    if (n == 0)
+      return;
+    ge_p2_batch_tobytes(reinterpret_cast<unsigned char*>(derivations.data()), points.data(), tmp.get(), n);
+    for (size_t i = 0; i < n; ++i)
+      if (!valid[i])
+        memset(&derivations[i], 0, sizeof(key_derivation));
+  }
+
+  void crypto_ops::derive_subaddress_public_keys(const std::vector<public_key> &out_keys, const std::vector<key_derivation> &derivations, const std::vector<std::size_t> &output_indices, std::vector<public_key> &derived_keys, std::vector<bool> &valid) {
+    const size_t n = out_keys.size();
+    assert(derivations.size() == n && output_indices.size() == n);
+    std::vector<ge_p2> points(n);
+    std::unique_ptr<fe[]> tmp(new fe[n]);
+    valid.assign(n, true);
+    for (size_t i = 0; i < n; ++i) {
+      ec_scalar scalar;
+      ge_p3 point1;
+      ge_p3 point2;
+      ge_cached point3;
+      ge_p1p1 point4;
+      if (ge_frombytes_vartime(&point1, &out_keys[i]) != 0) {
+        valid[i] = false;
+        ge_p3_to_p2(&points[i], &ge_p3_identity);
+        continue;
+      }
+      derivation_to_scalar(derivations[i], output_indices[i], scalar);
+      ge_scalarmult_base(&point2, &scalar);
+      ge_p3_to_cached(&point3, &point2);
+      ge_sub(&point4, &point1, &point3);
+      ge_p1p1_to_p2(&points[i], &point4);
+    }
+    derived_keys.resize(n);
+    if (n == 0)
+      return;
+    ge_p2_batch_tobytes(reinterpret_cast<unsigned char*>(derived_keys.data()), points.data(), tmp.get(), n);
+    for (size_t i = 0; i < n; ++i)
+      if (!valid[i])
+        memset(&derived_keys[i], 0, sizeof(public_key));
+  }
+
   struct s_comm {
     hash h;
     ec_point key;
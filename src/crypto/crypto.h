@@ -128,6 +128,10 @@ namespace crypto {
     friend void derive_secret_key(const key_derivation &, std::size_t, const secret_key &, secret_key &);
     static bool derive_subaddress_public_key(const public_key &, const key_derivation &, std::size_t, public_key &);
     friend bool derive_subaddress_public_key(const public_key &, const key_derivation &, std::size_t, public_key &);
+    static void generate_key_derivations(const std::vector<public_key> &, const secret_key &, std::vector<key_derivation> &, std::vector<bool> &);
+    friend void generate_key_derivations(const std::vector<public_key> &, const secret_key &, std::vector<key_derivation> &, std::vector<bool> &);
+    static void derive_subaddress_public_keys(const std::vector<public_key> &, const std::vector<key_derivation> &, const std::vector<std::size_t> &, std::vector<public_key> &, std::vector<bool> &);
+    friend void derive_subaddress_public_keys(const std::vector<public_key> &, const std::vector<key_derivation> &, const std::vector<std::size_t> &, std::vector<public_key> &, std::vector<bool> &);
     static void generate_signature(const hash &, const public_key &, const secret_key &, signature &);
     friend void generate_signature(const hash &, const public_key &, const secret_key &, signature &);
     static bool check_signature(const hash &, const public_key &, const signature &);
@@ -207,6 +211,18 @@ namespace crypto {
     return crypto_ops::derive_subaddress_public_key(out_key, derivation, output_index, result);
   }
 
+  /* Batched versions of generate_key_derivation and derive_subaddress_public_key,
+   * giving the same results but sharing a single field inversion across the batch.
+   * valid[i] is set to false (and the i-th result left as null) when the i-th
+   * input key is not a valid point, where the single versions would return false.
+   */
+  inline void generate_key_derivations(const std::vector<public_key> &keys, const secret_key &sec, std::vector<key_derivation> &derivations, std::vector<bool> &valid) {
+    crypto_ops::generate_key_derivations(keys, sec, derivations, valid);
+  }
+  inline void derive_subaddress_public_keys(const std::vector<public_key> &out_keys, const std::vector<key_derivation> &derivations, const std::vector<std::size_t> &output_indices, std::vector<public_key> &results, std::vector<bool> &valid) {
+    crypto_ops::derive_subaddress_public_keys(out_keys, derivations, output_indices, results, valid);
+  }
+
   /* Generation and checking of a standard signature.
    */
   inline void generate_signature(const hash &prefix_hash, const public_key &pub, const secret_key &sec, signature &sig) {
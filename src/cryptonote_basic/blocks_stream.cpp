@@ -0,0 +1,225 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include <limits>
+
+#include "common/varint.h"
+#include "blocks_stream.h"
+
+namespace
+{
+  template<typename T>
+  bool read_varint(const char *&p, const char *end, T &value)
+  {
+    const char *start = p;
+    const int read = tools::read_varint<std::numeric_limits<T>::digits>(p, end, value);
+    // a truncated varint reads up to the end with the continuation bit set
+    return read > 0 && p > start && !(p[-1] & 0x80);
+  }
+
+  bool read_blob(const char *&p, const char *end, cryptonote::blobdata &blob)
+  {
+    uint64_t size;
+    if (!read_varint(p, end, size) || size > (uint64_t)(end - p))
+      return false;
+    blob.assign(p, size);
+    p += size;
+    return true;
+  }
+}
+
+namespace cryptonote
+{
+  //---------------------------------------------------------------
+  blocks_stream_writer::blocks_stream_writer(std::string &out):
+    m_out(out),
+    m_record_start(0)
+  {
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::begin_record()
+  {
+    m_record_start = m_out.size();
+    m_out.append(4, '\0');
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::end_record()
+  {
+    const uint32_t size = m_out.size() - m_record_start - 4;
+    for (int i = 0; i < 4; ++i)
+      m_out[m_record_start + i] = (char)((size >> (8 * i)) & 0xff);
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::write_blob(const blobdata &blob)
+  {
+    tools::write_varint(std::back_inserter(m_out), (uint64_t)blob.size());
+    m_out.append(blob);
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::write_header(uint64_t start_height, uint64_t current_height)
+  {
+    begin_record();
+    m_out.append(BLOCKS_STREAM_MAGIC, 4);
+    m_out.push_back((char)BLOCKS_STREAM_VERSION);
+    tools::write_varint(std::back_inserter(m_out), start_height);
+    tools::write_varint(std::back_inserter(m_out), current_height);
+    end_record();
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::begin_block(const blobdata &block, size_t n_txes)
+  {
+    begin_record();
+    write_blob(block);
+    tools::write_varint(std::back_inserter(m_out), (uint64_t)n_txes);
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::add_tx(const blobdata &tx)
+  {
+    write_blob(tx);
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::add_output_indices(const std::vector<uint64_t> &indices)
+  {
+    tools::write_varint(std::back_inserter(m_out), (uint64_t)indices.size());
+    for (uint64_t index: indices)
+      tools::write_varint(std::back_inserter(m_out), index);
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::end_block()
+  {
+    end_record();
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_writer::finish()
+  {
+    m_out.append(4, '\0');
+  }
+  //---------------------------------------------------------------
+  blocks_stream_reader::blocks_stream_reader():
+    m_offset(0),
+    m_has_header(false),
+    m_finished(false),
+    m_error(false),
+    m_start_height(0),
+    m_current_height(0)
+  {
+  }
+  //---------------------------------------------------------------
+  void blocks_stream_reader::update(const std::string &piece)
+  {
+    // drop what was already consumed once it dominates the buffer
+    if (m_offset > 0 && m_offset >= m_buffer.size() / 2)
+    {
+      m_buffer.erase(0, m_offset);
+      m_offset = 0;
+    }
+    m_buffer.append(piece);
+  }
+  //---------------------------------------------------------------
+  bool blocks_stream_reader::next_record(const char *&begin, const char *&end)
+  {
+    if (m_finished || m_error || m_buffer.size() - m_offset < 4)
+      return false;
+    const unsigned char *p = (const unsigned char*)m_buffer.data() + m_offset;
+    const uint32_t size = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    if (size == 0)
+    {
+      m_offset += 4;
+      m_finished = true;
+      return false;
+    }
+    if (size > BLOCKS_STREAM_MAX_RECORD_SIZE)
+    {
+      m_error = true;
+      return false;
+    }
+    if (m_buffer.size() - m_offset - 4 < size)
+      return false;
+    begin = m_buffer.data() + m_offset + 4;
+    end = begin + size;
+    m_offset += 4 + size;
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool blocks_stream_reader::parse_header(const char *begin, const char *end)
+  {
+    if (end - begin < 5 || memcmp(begin, BLOCKS_STREAM_MAGIC, 4) || (uint8_t)begin[4] != BLOCKS_STREAM_VERSION)
+      return false;
+    const char *p = begin + 5;
+    return read_varint(p, end, m_start_height) && read_varint(p, end, m_current_height) && p == end;
+  }
+  //---------------------------------------------------------------
+  bool blocks_stream_reader::parse_block(const char *begin, const char *end, blocks_stream_entry &entry) const
+  {
+    const char *p = begin;
+    uint64_t n_txes;
+    if (!read_blob(p, end, entry.block) || !read_varint(p, end, n_txes) || n_txes > (uint64_t)(end - p))
+      return false;
+    entry.txs.resize(n_txes);
+    for (auto &tx: entry.txs)
+      if (!read_blob(p, end, tx))
+        return false;
+    entry.output_indices.resize(n_txes + 1);
+    for (auto &indices: entry.output_indices)
+    {
+      uint64_t n_outs;
+      if (!read_varint(p, end, n_outs) || n_outs > (uint64_t)(end - p))
+        return false;
+      indices.resize(n_outs);
+      for (auto &index: indices)
+        if (!read_varint(p, end, index))
+          return false;
+    }
+    return p == end;
+  }
+  //---------------------------------------------------------------
+  bool blocks_stream_reader::next(blocks_stream_entry &entry)
+  {
+    const char *begin, *end;
+    if (!m_has_header)
+    {
+      if (!next_record(begin, end))
+        return false;
+      if (!parse_header(begin, end))
+      {
+        m_error = true;
+        return false;
+      }
+      m_has_header = true;
+    }
+    if (!next_record(begin, end))
+      return false;
+    if (!parse_block(begin, end, entry))
+    {
+      m_error = true;
+      return false;
+    }
+    return true;
+  }
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cryptonote_basic/blobdatatype.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief a flat, length-prefixed encoding of a run of blocks for wallet sync
+   *
+   * The stream is a sequence of records, each a 32 bit little endian length
+   * followed by that many bytes, and terminated by a zero length record:
+   *
+   *   header  := magic "XCBS" version:u8 start_height:varint current_height:varint
+   *   block   := block:blob n_txes:varint tx:blob{n_txes} indices{n_txes + 1}
+   *   indices := n:varint global_index:varint{n}
+   *   blob    := size:varint bytes
+   *
+   * The first record is the header, every other record is one block with its
+   * pruned txes and the amount-specific output indices of the miner tx then
+   * each tx.  Since a block is only ever split at record boundaries, a reader
+   * can hand complete blocks on as soon as their bytes have arrived.
+   */
+  static const char BLOCKS_STREAM_MAGIC[] = "XCBS";
+  static const uint8_t BLOCKS_STREAM_VERSION = 1;
+  static const uint32_t BLOCKS_STREAM_MAX_RECORD_SIZE = 128 * 1024 * 1024;
+
+  struct blocks_stream_entry
+  {
+    blobdata block;
+    std::vector<blobdata> txs;
+    std::vector<std::vector<uint64_t>> output_indices;
+  };
+
+  /**
+   * @brief appends a blocks stream to a buffer, one block at a time
+   *
+   * Blocks are written with begin_block(), n_txes calls to add_tx() and
+   * n_txes + 1 calls to add_output_indices(), then end_block().
+   */
+  class blocks_stream_writer
+  {
+  public:
+    explicit blocks_stream_writer(std::string &out);
+
+    void write_header(uint64_t start_height, uint64_t current_height);
+    void begin_block(const blobdata &block, size_t n_txes);
+    void add_tx(const blobdata &tx);
+    void add_output_indices(const std::vector<uint64_t> &indices);
+    void end_block();
+    void finish();
+
+  private:
+    void begin_record();
+    void end_record();
+    void write_blob(const blobdata &blob);
+
+    std::string &m_out;
+    size_t m_record_start;
+  };
+
+  /**
+   * @brief parses a blocks stream incrementally, as pieces of it arrive
+   */
+  class blocks_stream_reader
+  {
+  public:
+    blocks_stream_reader();
+
+    /**
+     * @brief appends the next piece of the stream
+     */
+    void update(const std::string &piece);
+
+    /**
+     * @brief pops the next complete block
+     *
+     * @return false if the next block has not fully arrived yet, the stream
+     * has ended, or it is malformed (see error())
+     */
+    bool next(blocks_stream_entry &entry);
+
+    bool has_header() const { return m_has_header; }
+    uint64_t start_height() const { return m_start_height; }
+    uint64_t current_height() const { return m_current_height; }
+    bool finished() const { return m_finished; }
+    bool error() const { return m_error; }
+
+  private:
+    bool next_record(const char *&begin, const char *&end);
+    bool parse_header(const char *begin, const char *end);
+    bool parse_block(const char *begin, const char *end, blocks_stream_entry &entry) const;
+
+    std::string m_buffer;
+    size_t m_offset;
+    bool m_has_header;
+    bool m_finished;
+    bool m_error;
+    uint64_t m_start_height;
+    uint64_t m_current_height;
+  };
+}
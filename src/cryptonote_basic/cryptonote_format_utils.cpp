@@ -41,6 +41,9 @@ using namespace epee;
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
 #include "ringct/rctSigs.h"
+extern "C" {
+#include "crypto/keccak.h"
+}
 
 #undef XCASH_DEFAULT_LOG_CATEGORY
 #define XCASH_DEFAULT_LOG_CATEGORY "cn"
@@ -215,7 +218,7 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
-  bool generate_key_image_helper(const account_keys& ack, const std::unordered_map<crypto::public_key, subaddress_index>& subaddresses, const crypto::public_key& out_key, const crypto::public_key& tx_public_key, const std::vector<crypto::public_key>& additional_tx_public_keys, size_t real_output_index, keypair& in_ephemeral, crypto::key_image& ki, hw::device &hwdev)
+  bool generate_key_image_helper(const account_keys& ack, const subaddress_table& subaddresses, const crypto::public_key& out_key, const crypto::public_key& tx_public_key, const std::vector<crypto::public_key>& additional_tx_public_keys, size_t real_output_index, keypair& in_ephemeral, crypto::key_image& ki, hw::device &hwdev)
   {
     crypto::key_derivation recv_derivation = AUTO_VAL_INIT(recv_derivation);
     bool r = hwdev.generate_key_derivation(tx_public_key, ack.m_view_secret_key, recv_derivation);
@@ -686,6 +689,268 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  namespace
+  {
+    // minimal in-place reader over a serialized block, no allocation
+    struct blob_cursor
+    {
+      const uint8_t *p;
+      const uint8_t *end;
+
+      bool skip(size_t n)
+      {
+        if (static_cast<size_t>(end - p) < n)
+          return false;
+        p += n;
+        return true;
+      }
+
+      bool byte(uint8_t &b)
+      {
+        if (p == end)
+          return false;
+        b = *p++;
+        return true;
+      }
+
+      template<typename T>
+      bool varint(T &v)
+      {
+        const int r = tools::read_varint<std::numeric_limits<T>::digits>(p, end, v);
+        // a truncated varint ends on a byte with the continuation bit set
+        return r > 0 && (p[-1] & 0x80) == 0;
+      }
+
+      bool varint_bytes(size_t &n)
+      {
+        uint64_t size;
+        if (!varint(size) || size > static_cast<uint64_t>(end - p))
+          return false;
+        n = size;
+        return true;
+      }
+    };
+
+    struct byte_range
+    {
+      size_t start;
+      size_t end;
+    };
+
+    // finds the byte ranges of the leader info fields in a tx extra, mirroring parse_tx_extra.
+    // n_ranges counts every field, only the first max_ranges are stored
+    bool find_leader_info_ranges(const uint8_t *extra, size_t size, byte_range *ranges, size_t max_ranges, size_t &n_ranges, size_t &skipped)
+    {
+      blob_cursor c{extra, extra + size};
+      n_ranges = 0;
+      skipped = 0;
+      while (c.p != c.end)
+      {
+        const size_t start = c.p - extra;
+        uint8_t tag;
+        size_t n;
+        c.byte(tag);
+        switch (tag)
+        {
+          case TX_EXTRA_TAG_PADDING:
+            if (size - start > TX_EXTRA_PADDING_MAX_COUNT)
+              return false;
+            for (; c.p != c.end; ++c.p)
+              if (*c.p)
+                return false;
+            break;
+          case TX_EXTRA_TAG_PUBKEY:
+            if (!c.skip(sizeof(crypto::public_key)))
+              return false;
+            break;
+          case TX_EXTRA_NONCE:
+            if (!c.varint_bytes(n) || n > TX_EXTRA_NONCE_MAX_COUNT || !c.skip(n))
+              return false;
+            break;
+          case TX_EXTRA_MERGE_MINING_TAG:
+          {
+            // a depth and a merkle root, with nothing past them
+            if (!c.varint_bytes(n))
+              return false;
+            blob_cursor mm{c.p, c.p + n};
+            size_t depth;
+            if (!mm.varint(depth) || !mm.skip(sizeof(crypto::hash)) || mm.p != mm.end)
+              return false;
+            c.p = mm.end;
+            break;
+          }
+          case TX_EXTRA_MYSTERIOUS_MINERGATE_TAG:
+            if (!c.varint_bytes(n) || !c.skip(n))
+              return false;
+            break;
+          case TX_EXTRA_TAG_ADDITIONAL_PUBKEYS:
+            if (!c.varint_bytes(n) || n > size || !c.skip(n * sizeof(crypto::public_key)))
+              return false;
+            break;
+          case TX_EXTRA_TAG_LEADER_INFO:
+            if (!c.varint_bytes(n) || !c.skip(n) || !c.skip(sizeof(crypto::signature)))
+              return false;
+            if (n_ranges < max_ranges)
+              ranges[n_ranges] = {start, static_cast<size_t>(c.p - extra)};
+            ++n_ranges;
+            skipped += c.p - extra - start;
+            break;
+          default:
+            return false;
+        }
+      }
+      return true;
+    }
+
+    void keccak_update_varint(KECCAK_CTX &ctx, uint64_t v)
+    {
+      uint8_t buf[(sizeof(uint64_t) * 8 + 6) / 7];
+      uint8_t *dest = buf;
+      tools::write_varint(dest, v);
+      keccak_update(&ctx, buf, dest - buf);
+    }
+  }
+  //---------------------------------------------------------------
+  bool get_block_hash_without_leader_info(const blobdata& block_blob, crypto::hash& res)
+  {
+    const uint8_t *begin = reinterpret_cast<const uint8_t*>(block_blob.data());
+    blob_cursor c{begin, begin + block_blob.size()};
+
+    // block header
+    uint64_t major_version, minor_version, timestamp;
+    if (!c.varint(major_version) || major_version > 0xff || !c.varint(minor_version) || minor_version > 0xff || !c.varint(timestamp))
+      return false;
+    if (!c.skip(sizeof(crypto::hash) + sizeof(uint32_t)))
+      return false;
+    const size_t header_size = c.p - begin;
+
+    // miner tx prefix, up to the extra field
+    const uint8_t *tx_begin = c.p;
+    uint64_t version, unlock_time, count;
+    if (!c.varint(version) || version == 0 || version > CURRENT_TRANSACTION_VERSION || !c.varint(unlock_time))
+      return false;
+    if (!c.varint(count) || count != 1)
+      return false;
+    uint8_t tag;
+    uint64_t height;
+    if (!c.byte(tag) || tag != 0xff || !c.varint(height))
+      return false;
+    if (!c.varint(count) || count > static_cast<uint64_t>(c.end - c.p))
+      return false;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+      uint64_t amount;
+      if (!c.varint(amount) || !c.byte(tag) || tag != 0x2 || !c.skip(sizeof(crypto::public_key)))
+        return false;
+    }
+    const uint8_t *extra_size_begin = c.p;
+    size_t extra_size;
+    if (!c.varint_bytes(extra_size))
+      return false;
+    const uint8_t *extra = c.p;
+    c.skip(extra_size);
+
+    // coinbase: no signatures for v1, an RCTTypeNull base for v2
+    if (version > 1)
+    {
+      uint8_t rct_type;
+      if (!c.byte(rct_type) || rct_type != rct::RCTTypeNull)
+        return false;
+    }
+
+    byte_range small_ranges[4];
+    std::vector<byte_range> large_ranges;
+    byte_range *ranges = small_ranges;
+    size_t n_ranges, skipped;
+    if (!find_leader_info_ranges(extra, extra_size, ranges, sizeof(small_ranges) / sizeof(small_ranges[0]), n_ranges, skipped))
+      return false;
+    if (n_ranges > sizeof(small_ranges) / sizeof(small_ranges[0]))
+    {
+      large_ranges.resize(n_ranges);
+      ranges = large_ranges.data();
+      if (!find_leader_info_ranges(extra, extra_size, ranges, n_ranges, n_ranges, skipped))
+        return false;
+    }
+
+    // hash the prefix as if the leader info fields had never been added
+    KECCAK_CTX ctx;
+    keccak_init(&ctx);
+    keccak_update(&ctx, tx_begin, extra_size_begin - tx_begin);
+    keccak_update_varint(ctx, extra_size - skipped);
+    size_t pos = 0;
+    for (size_t i = 0; i < n_ranges; ++i)
+    {
+      keccak_update(&ctx, extra + pos, ranges[i].start - pos);
+      pos = ranges[i].end;
+    }
+    keccak_update(&ctx, extra + pos, extra_size - pos);
+
+    crypto::hash miner_tx_hash;
+    if (version == 1)
+    {
+      // v1 transactions hash the entire blob, which is just the prefix for a coinbase
+      keccak_finish(&ctx, reinterpret_cast<uint8_t*>(&miner_tx_hash));
+    }
+    else
+    {
+      crypto::hash hashes[3];
+      keccak_finish(&ctx, reinterpret_cast<uint8_t*>(&hashes[0]));
+      const uint8_t rct_type = rct::RCTTypeNull;
+      cn_fast_hash(&rct_type, sizeof(rct_type), hashes[1]);
+      hashes[2] = crypto::null_hash;
+      cn_fast_hash(hashes, sizeof(hashes), miner_tx_hash);
+    }
+
+    // tx hashes, in place
+    size_t n_tx_hashes;
+    if (!c.varint_bytes(n_tx_hashes) || n_tx_hashes > static_cast<size_t>(c.end - c.p) / sizeof(crypto::hash))
+      return false;
+    const uint8_t *tx_hashes = c.p;
+
+    crypto::hash tree_root_hash;
+    if (n_tx_hashes == 0)
+    {
+      tree_root_hash = miner_tx_hash;
+    }
+    else
+    {
+      crypto::hash small_ids[64];
+      std::vector<crypto::hash> large_ids;
+      crypto::hash *ids = small_ids;
+      if (n_tx_hashes + 1 > sizeof(small_ids) / sizeof(small_ids[0]))
+      {
+        large_ids.resize(n_tx_hashes + 1);
+        ids = large_ids.data();
+      }
+      ids[0] = miner_tx_hash;
+      memcpy(ids + 1, tx_hashes, n_tx_hashes * sizeof(crypto::hash));
+      tree_hash(ids, n_tx_hashes + 1, tree_root_hash);
+    }
+
+    // same as get_object_hash(get_block_hashing_blob(b)): the hashing blob is
+    // itself serialized as a string, so it is prefixed with its size
+    uint8_t count_varint[(sizeof(uint64_t) * 8 + 6) / 7];
+    uint8_t *count_end = count_varint;
+    tools::write_varint(count_end, static_cast<uint64_t>(n_tx_hashes + 1));
+    const size_t count_size = count_end - count_varint;
+
+    keccak_init(&ctx);
+    keccak_update_varint(ctx, header_size + sizeof(tree_root_hash) + count_size);
+    keccak_update(&ctx, begin, header_size);
+    keccak_update(&ctx, reinterpret_cast<const uint8_t*>(&tree_root_hash), sizeof(tree_root_hash));
+    keccak_update(&ctx, count_varint, count_size);
+    keccak_finish(&ctx, reinterpret_cast<uint8_t*>(&res));
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool get_block_hash_without_leader_info(const block& b, crypto::hash& res)
+  {
+    blobdata blob;
+    if (!block_to_blob(b, blob))
+      return false;
+    return get_block_hash_without_leader_info(blob, res);
+  }
+  //---------------------------------------------------------------
   bool get_inputs_money_amount(const transaction& tx, uint64_t& money)
   {
     money = 0;
@@ -805,7 +1070,7 @@ namespace cryptonote
     return false;
   }
   //---------------------------------------------------------------
-  boost::optional<subaddress_receive_info> is_out_to_acc_precomp(const std::unordered_map<crypto::public_key, subaddress_index>& subaddresses, const crypto::public_key& out_key, const crypto::key_derivation& derivation, const std::vector<crypto::key_derivation>& additional_derivations, size_t output_index, hw::device &hwdev)
+  boost::optional<subaddress_receive_info> is_out_to_acc_precomp(const subaddress_table& subaddresses, const crypto::public_key& out_key, const crypto::key_derivation& derivation, const std::vector<crypto::key_derivation>& additional_derivations, size_t output_index, hw::device &hwdev)
   {
     // try the shared tx pubkey
     crypto::public_key subaddress_spendkey;
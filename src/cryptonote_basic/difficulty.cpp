@@ -510,4 +510,80 @@ difficulty_type next_difficulty_V13(std::vector<std::uint64_t> timestamps, std::
     return next_difficulty;
 }
 
+difficulty_window::difficulty_window(size_t capacity):
+  m_entries(std::max<size_t>(capacity, 1)),
+  m_head(0),
+  m_size(0),
+  m_end_height(0)
+{
+}
+
+void difficulty_window::clear()
+{
+  m_head = 0;
+  m_size = 0;
+  m_end_height = 0;
+}
+
+const crypto::hash &difficulty_window::top_hash() const
+{
+  assert(!empty());
+  return at(m_end_height - 1).hash;
+}
+
+void difficulty_window::push_back(uint64_t height, const crypto::hash &hash, uint64_t timestamp, difficulty_type cumulative_difficulty)
+{
+  if (empty() || height != m_end_height)
+  {
+    m_head = 0;
+    m_size = 0;
+  }
+  if (m_size == m_entries.size())
+  {
+    m_head = (m_head + 1) % m_entries.size();
+    --m_size;
+  }
+  entry &e = m_entries[(m_head + m_size) % m_entries.size()];
+  e.hash = hash;
+  e.timestamp = timestamp;
+  e.cumulative_difficulty = cumulative_difficulty;
+  ++m_size;
+  m_end_height = height + 1;
+}
+
+bool difficulty_window::push_front(uint64_t height, const crypto::hash &hash, uint64_t timestamp, difficulty_type cumulative_difficulty)
+{
+  if (empty() || m_size == m_entries.size() || height + 1 != start_height())
+    return false;
+  m_head = (m_head + m_entries.size() - 1) % m_entries.size();
+  entry &e = m_entries[m_head];
+  e.hash = hash;
+  e.timestamp = timestamp;
+  e.cumulative_difficulty = cumulative_difficulty;
+  ++m_size;
+  return true;
+}
+
+void difficulty_window::pop_back()
+{
+  assert(!empty());
+  --m_size;
+  --m_end_height;
+}
+
+bool difficulty_window::get(uint64_t start, uint64_t end, std::vector<uint64_t> &timestamps, std::vector<difficulty_type> &cumulative_difficulties) const
+{
+  if (start > end || start < start_height() || end > m_end_height)
+    return false;
+  timestamps.reserve(timestamps.size() + (end - start));
+  cumulative_difficulties.reserve(cumulative_difficulties.size() + (end - start));
+  for (uint64_t height = start; height < end; ++height)
+  {
+    const entry &e = at(height);
+    timestamps.push_back(e.timestamp);
+    cumulative_difficulties.push_back(e.cumulative_difficulty);
+  }
+  return true;
+}
+
 }
@@ -58,4 +58,70 @@ namespace cryptonote
     difficulty_type next_difficulty_V10(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
     difficulty_type next_difficulty_V12(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
     difficulty_type next_difficulty_V13(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
+
+    /**
+     * @brief the timestamps and cumulative difficulties of consecutive blocks
+     *
+     * A fixed capacity ring buffer over the heights [start_height(), end_height()).
+     * Every entry keeps its block hash, so a caller can find where the window
+     * leaves the chain after a pop or a reorg and reload only from there.
+     */
+    class difficulty_window
+    {
+    public:
+      explicit difficulty_window(size_t capacity);
+
+      void clear();
+      bool empty() const { return m_size == 0; }
+      size_t size() const { return m_size; }
+      size_t capacity() const { return m_entries.size(); }
+      std::uint64_t start_height() const { return m_end_height - m_size; }
+      std::uint64_t end_height() const { return m_end_height; }
+
+      /**
+       * @brief the hash of the newest block, the window must not be empty
+       */
+      const crypto::hash &top_hash() const;
+
+      /**
+       * @brief appends the block at end_height(), dropping the oldest one if full
+       *
+       * A block at any other height restarts the window from it.
+       */
+      void push_back(std::uint64_t height, const crypto::hash &hash, std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+
+      /**
+       * @brief prepends the block below start_height()
+       *
+       * @return false if the window is full or the height does not fit
+       */
+      bool push_front(std::uint64_t height, const crypto::hash &hash, std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+
+      /**
+       * @brief drops the newest block, the window must not be empty
+       */
+      void pop_back();
+
+      /**
+       * @brief appends the blocks of [start_height, end_height) to the vectors
+       *
+       * @return false if the range is not inside the window
+       */
+      bool get(std::uint64_t start_height, std::uint64_t end_height, std::vector<std::uint64_t> &timestamps, std::vector<difficulty_type> &cumulative_difficulties) const;
+
+    private:
+      struct entry
+      {
+        crypto::hash hash;
+        std::uint64_t timestamp;
+        difficulty_type cumulative_difficulty;
+      };
+
+      const entry &at(std::uint64_t height) const { return m_entries[(m_head + (height - start_height())) % m_entries.size()]; }
+
+      std::vector<entry> m_entries;
+      size_t m_head; // index of the oldest entry
+      size_t m_size;
+      std::uint64_t m_end_height;
+    };
 }
@@ -0,0 +1,288 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+
+#include "common/int-util.h"
+#include "misc_log_ex.h"
+#include "subaddress_table.h"
+
+#define SUBADDRESS_TABLE_MAGIC "XCST"
+#define SUBADDRESS_TABLE_VERSION 1
+#define SUBADDRESS_TABLE_MIN_CAPACITY 16
+#define SUBADDRESS_TABLE_ENTRY_SIZE (32 + 4 + 4)
+
+namespace
+{
+  // keeps at least a quarter of the slots empty, so probe runs stay short
+  // and every lookup is bound to reach an empty slot
+  bool over_loaded(size_t size, size_t capacity)
+  {
+    return size * 4 >= capacity * 3;
+  }
+
+  template<typename T>
+  void write_le(std::string &blob, T value)
+  {
+    for (size_t i = 0; i < sizeof(T); ++i)
+      blob.push_back((char)(value >> (8 * i)));
+  }
+
+  template<typename T>
+  T read_le(const char *p)
+  {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+      value |= (T)(uint8_t)p[i] << (8 * i);
+    return value;
+  }
+}
+
+namespace cryptonote
+{
+  //---------------------------------------------------------------
+  subaddress_table::subaddress_table():
+    m_size(0)
+  {
+  }
+  //---------------------------------------------------------------
+  subaddress_table::subaddress_table(const std::unordered_map<crypto::public_key, subaddress_index> &subaddresses):
+    m_size(0)
+  {
+    reserve(subaddresses.size());
+    for (const auto &e: subaddresses)
+    {
+      insert(e.first, e.second);
+      if (m_generated.size() <= e.second.major)
+        m_generated.resize(e.second.major + 1, 0);
+      m_generated[e.second.major] = std::max(m_generated[e.second.major], e.second.minor + 1);
+    }
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::clear()
+  {
+    std::vector<value_type>().swap(m_slots);
+    m_size = 0;
+    m_generated.clear();
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::reserve(size_t n)
+  {
+    size_t capacity = std::max<size_t>(m_slots.size(), SUBADDRESS_TABLE_MIN_CAPACITY);
+    while (over_loaded(n, capacity))
+      capacity *= 2;
+    if (capacity != m_slots.size())
+      rehash(capacity);
+  }
+  //---------------------------------------------------------------
+  size_t subaddress_table::home(const crypto::public_key &key) const
+  {
+    // keys are curve points, so their low bytes are already uniform
+    uint64_t h;
+    memcpy(&h, key.data, sizeof(h));
+    return (size_t)h & (m_slots.size() - 1);
+  }
+  //---------------------------------------------------------------
+  subaddress_table::const_iterator subaddress_table::find(const crypto::public_key &key) const
+  {
+    if (m_slots.empty() || key == crypto::null_pkey)
+      return end();
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = home(key); ; i = (i + 1) & mask)
+    {
+      const value_type &slot = m_slots[i];
+      if (slot.first == key)
+        return &slot;
+      if (slot.first == crypto::null_pkey)
+        return end();
+    }
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::insert_slot(const crypto::public_key &key, const subaddress_index &index)
+  {
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = home(key); ; i = (i + 1) & mask)
+    {
+      value_type &slot = m_slots[i];
+      if (slot.first == key)
+      {
+        slot.second = index;
+        return;
+      }
+      if (slot.first == crypto::null_pkey)
+      {
+        slot.first = key;
+        slot.second = index;
+        ++m_size;
+        return;
+      }
+    }
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::rehash(size_t capacity)
+  {
+    std::vector<value_type> slots(capacity);
+    slots.swap(m_slots);
+    m_size = 0;
+    for (const value_type &slot: slots)
+      if (slot.first != crypto::null_pkey)
+        insert_slot(slot.first, slot.second);
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::insert(const crypto::public_key &key, const subaddress_index &index)
+  {
+    CHECK_AND_ASSERT_THROW_MES(key != crypto::null_pkey, "null key can not be added to the subaddress table");
+    reserve(m_size + 1);
+    insert_slot(key, index);
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::insert(uint32_t major, uint32_t minor_begin, const std::vector<crypto::public_key> &keys)
+  {
+    CHECK_AND_ASSERT_THROW_MES(keys.size() <= (uint32_t)-1 - minor_begin, "subaddress minor index overflow");
+    reserve(m_size + keys.size());
+    subaddress_index index = {major, minor_begin};
+    for (const crypto::public_key &key: keys)
+    {
+      CHECK_AND_ASSERT_THROW_MES(key != crypto::null_pkey, "null key can not be added to the subaddress table");
+      insert_slot(key, index);
+      ++index.minor;
+    }
+    if (m_generated.size() <= major)
+      m_generated.resize(major + 1, 0);
+    m_generated[major] = std::max(m_generated[major], index.minor);
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::get_keys_since(const std::vector<uint32_t> &generated, std::vector<std::vector<crypto::public_key>> &keys) const
+  {
+    std::vector<uint32_t> begin(m_generated.size(), 0);
+    keys.clear();
+    keys.resize(m_generated.size());
+    size_t n_keys = 0;
+    for (size_t major = 0; major < m_generated.size(); ++major)
+    {
+      if (major < generated.size())
+        begin[major] = std::min(generated[major], m_generated[major]);
+      keys[major].resize(m_generated[major] - begin[major], crypto::null_pkey);
+      n_keys += keys[major].size();
+    }
+    if (n_keys == 0)
+      return;
+
+    size_t found = 0;
+    for (const value_type &slot: m_slots)
+    {
+      if (slot.first == crypto::null_pkey)
+        continue;
+      const subaddress_index &index = slot.second;
+      if (index.major < m_generated.size() && index.minor >= begin[index.major] && index.minor < m_generated[index.major])
+      {
+        keys[index.major][index.minor - begin[index.major]] = slot.first;
+        ++found;
+      }
+    }
+    CHECK_AND_ASSERT_THROW_MES(found == n_keys, "subaddress table is missing keys below its generated marks");
+  }
+  //---------------------------------------------------------------
+  void subaddress_table::store(std::string &blob) const
+  {
+    blob.clear();
+    blob.reserve(4 + 1 + 4 + 4 * m_generated.size() + 8 + SUBADDRESS_TABLE_ENTRY_SIZE * m_size);
+    blob.append(SUBADDRESS_TABLE_MAGIC, 4);
+    blob.push_back((char)SUBADDRESS_TABLE_VERSION);
+    write_le<uint32_t>(blob, m_generated.size());
+    for (uint32_t generated: m_generated)
+      write_le<uint32_t>(blob, generated);
+    write_le<uint64_t>(blob, m_size);
+    for (const value_type &slot: m_slots)
+    {
+      if (slot.first == crypto::null_pkey)
+        continue;
+      blob.append(slot.first.data, sizeof(slot.first.data));
+      write_le<uint32_t>(blob, slot.second.major);
+      write_le<uint32_t>(blob, slot.second.minor);
+    }
+  }
+  //---------------------------------------------------------------
+  bool subaddress_table::load(const std::string &blob)
+  {
+    clear();
+    const char *p = blob.data();
+    const char *end = p + blob.size();
+    if (end - p < 4 + 1 + 4 || memcmp(p, SUBADDRESS_TABLE_MAGIC, 4) || p[4] != SUBADDRESS_TABLE_VERSION)
+    {
+      MERROR("Bad subaddress table header");
+      return false;
+    }
+    p += 5;
+    const uint32_t n_accounts = read_le<uint32_t>(p);
+    p += 4;
+    if ((uint64_t)(end - p) < 4 * (uint64_t)n_accounts + 8)
+    {
+      MERROR("Bad subaddress table size");
+      return false;
+    }
+    std::vector<uint32_t> generated(n_accounts);
+    for (uint32_t &g: generated)
+    {
+      g = read_le<uint32_t>(p);
+      p += 4;
+    }
+    const uint64_t size = read_le<uint64_t>(p);
+    p += 8;
+    if ((uint64_t)(end - p) / SUBADDRESS_TABLE_ENTRY_SIZE != size || (uint64_t)(end - p) % SUBADDRESS_TABLE_ENTRY_SIZE)
+    {
+      MERROR("Bad subaddress table size");
+      return false;
+    }
+
+    reserve(size);
+    value_type entry;
+    for (uint64_t n = 0; n < size; ++n)
+    {
+      memcpy(entry.first.data, p, sizeof(entry.first.data));
+      entry.second.major = read_le<uint32_t>(p + 32);
+      entry.second.minor = read_le<uint32_t>(p + 36);
+      p += SUBADDRESS_TABLE_ENTRY_SIZE;
+      if (entry.first == crypto::null_pkey)
+      {
+        MERROR("Null key in subaddress table");
+        clear();
+        return false;
+      }
+      insert_slot(entry.first, entry.second);
+    }
+    if (m_size != size)
+    {
+      MERROR("Duplicate keys in subaddress table");
+      clear();
+      return false;
+    }
+    m_generated.swap(generated);
+    return true;
+  }
+}
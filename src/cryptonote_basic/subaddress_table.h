@@ -0,0 +1,154 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/serialization/serialization.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/version.hpp>
+
+#include "crypto/crypto.h"
+#include "serialization/serialization.h"
+#include "cryptonote_basic/subaddress_index.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief compact map from subaddress spend public key to subaddress index
+   *
+   * An open addressing table with linear probing over one flat array of
+   * (key, index) slots, so millions of subaddresses cost 40 bytes a slot and
+   * no allocation per entry.  Entries are only ever removed all at once, so
+   * there are no tombstones; the null public key marks an empty slot.
+   *
+   * The table also keeps, per account, how many minor indices have been
+   * derived so far, so lookahead expansion only derives the keys past that.
+   *
+   * The serialized form is a flat record of the entries:
+   *
+   *   magic "XCST" version:u8 n_accounts:u32 generated:u32{n_accounts}
+   *   size:u64 (key:32 major:u32 minor:u32){size}
+   *
+   * with all integers little endian, so loading sizes the slot array once
+   * and fills it, without the per entry archive overhead and allocations
+   * of a serialized std::unordered_map.
+   */
+  class subaddress_table
+  {
+  public:
+    typedef std::pair<crypto::public_key, subaddress_index> value_type;
+    typedef const value_type *const_iterator;
+
+    subaddress_table();
+    // for callers holding a plain map, eg a single {0,0} entry for the main address
+    subaddress_table(const std::unordered_map<crypto::public_key, subaddress_index> &subaddresses);
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    size_t capacity() const { return m_slots.size(); }
+    void clear();
+    void reserve(size_t n);
+
+    const_iterator find(const crypto::public_key &key) const;
+    const_iterator end() const { return nullptr; }
+    size_t count(const crypto::public_key &key) const { return find(key) != end() ? 1 : 0; }
+
+    /**
+     * @brief adds or replaces the index for a key
+     */
+    void insert(const crypto::public_key &key, const subaddress_index &index);
+
+    /**
+     * @brief adds the spend keys for minor indices [minor_begin, minor_begin + keys.size())
+     *
+     * Keys must be added in order from minor index 0 for the per account
+     * high water mark to be meaningful.
+     */
+    void insert(uint32_t major, uint32_t minor_begin, const std::vector<crypto::public_key> &keys);
+
+    /**
+     * @brief the number of minor indices derived so far for an account
+     */
+    uint32_t num_generated(uint32_t major) const { return major < m_generated.size() ? m_generated[major] : 0; }
+
+    /**
+     * @brief the number of minor indices derived so far, per account
+     */
+    const std::vector<uint32_t> &get_generated() const { return m_generated; }
+
+    /**
+     * @brief gets the keys derived past a per account mark, in index order
+     *
+     * Walks every slot, for callers which keep a copy of the table and only
+     * need what was derived since they last looked, eg the wallet cache
+     * journal.
+     *
+     * @param generated the number of minor indices already known, per account
+     * @param keys return-by-reference the keys from minor index generated[major] on, per account
+     */
+    void get_keys_since(const std::vector<uint32_t> &generated, std::vector<std::vector<crypto::public_key>> &keys) const;
+
+    void store(std::string &blob) const;
+    bool load(const std::string &blob);
+
+  private:
+    size_t home(const crypto::public_key &key) const;
+    void rehash(size_t capacity);
+    void insert_slot(const crypto::public_key &key, const subaddress_index &index);
+
+  private:
+    std::vector<value_type> m_slots;
+    size_t m_size;
+    std::vector<uint32_t> m_generated;
+  };
+}
+
+BOOST_CLASS_VERSION(cryptonote::subaddress_table, 0)
+
+namespace boost
+{
+  namespace serialization
+  {
+    template <class Archive>
+    inline void serialize(Archive &a, cryptonote::subaddress_table &x, const boost::serialization::version_type ver)
+    {
+      std::string blob;
+      if (!typename Archive::is_loading())
+        x.store(blob);
+      a & blob;
+      if (typename Archive::is_loading() && !x.load(blob))
+        throw std::runtime_error("Invalid subaddress table");
+    }
+  }
+}
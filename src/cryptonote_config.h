@@ -140,6 +140,10 @@
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4       100    //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              20     //by default, blocks count in blocks downloading
 
+#define CRYPTONOTE_PRUNING_STRIPE_SIZE                  4096   // the smaller, the smoother the increase
+#define CRYPTONOTE_PRUNING_LOG_STRIPES                  3      // the higher, the more space saved
+#define CRYPTONOTE_PRUNING_TIP_BLOCKS                   5500   // the smaller, the more space saved
+
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    (86400*3) //seconds, three days
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
 
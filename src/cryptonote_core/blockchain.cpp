@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <thread>
+#include <chrono>
 #include <vector>
 #include <algorithm>
 #include <cstdio>
@@ -68,6 +69,7 @@
 #include "serialization/container.h"
 #include "common/perf_timer.h"
 #include "common/notify.h"
+#include "cryptonote_basic/blocks_stream.h"
 #if defined(PER_BLOCK_CHECKPOINT)
 #include "blocks/blocks.h"
 #endif
@@ -103,6 +105,12 @@ DISABLE_VS_WARNINGS(4267)
 // used to overestimate the block reward when estimating a per kB to use
 #define BLOCK_REWARD_OVERESTIMATE (10 * 1000000000000)
 
+// how many miner txes (one per address and extra nonce) the block template cache keeps
+#define BLOCK_TEMPLATE_MAX_VARIANTS 16
+
+// upper bounds of the create_block_template latency buckets, in microseconds
+static const std::vector<uint64_t> block_template_latency_limits_us = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+
 static const struct {
   uint8_t version;
   uint64_t height;
@@ -198,7 +206,7 @@ static const struct {
 
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
-  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
+  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_difficulty_window(DIFFICULTY_BLOCKS_COUNT), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
   m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
   m_difficulty_for_next_block_top_hash(crypto::null_hash),
   m_difficulty_for_next_block(1),
@@ -206,6 +214,10 @@ Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_temp_consensus_validator(nullptr)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  m_btc_stats.bucket_limits_us = block_template_latency_limits_us;
+  m_btc_stats.cached.resize(block_template_latency_limits_us.size() + 1, 0);
+  m_btc_stats.shared.resize(block_template_latency_limits_us.size() + 1, 0);
+  m_btc_stats.filled.resize(block_template_latency_limits_us.size() + 1, 0);
 }
 //------------------------------------------------------------------
 bool Blockchain::have_tx(const crypto::hash &id) const
@@ -478,6 +490,8 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   MINFO("Blockchain initialized. last block: " << m_db->height() - 1 << ", " << epee::misc_utils::get_time_interval_string(timestamp_diff) << " time ago, current difficulty: " << get_difficulty_for_next_block());
   m_db->block_txn_stop();
 
+  init_block_validity(*m_db);
+
   uint64_t num_popped_blocks = 0;
   while (!m_db->is_read_only())
   {
@@ -520,7 +534,6 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   }
   if (num_popped_blocks > 0)
   {
-    m_timestamps_and_difficulties_height = 0;
     m_hardfork->reorganize_from_chain_height(get_current_blockchain_height());
     m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
   }
@@ -617,8 +630,6 @@ block Blockchain::pop_block_from_blockchain()
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   block popped_block;
   std::vector<transaction> popped_txs;
 
@@ -680,6 +691,10 @@ block Blockchain::pop_block_from_blockchain()
   m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
   invalidate_block_template_cache();
 
+  std::shared_ptr<i_core_event_listener> event_listener = std::atomic_load(&m_event_listener);
+  if (event_listener)
+    event_listener->on_block_popped(m_db->height(), get_block_hash(popped_block), popped_block);
+
   return popped_block;
 }
 //------------------------------------------------------------------
@@ -687,7 +702,7 @@ bool Blockchain::reset_and_set_genesis_block(const block& b)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
+  m_difficulty_window.clear();
   m_alternative_chains.clear();
   invalidate_block_template_cache();
   m_db->reset();
@@ -838,6 +853,69 @@ bool Blockchain::get_block_by_hash(const crypto::hash &h, block &blk, bool *orph
   return false;
 }
 //------------------------------------------------------------------
+static size_t get_difficulty_blocks_count(uint8_t version)
+{
+  if(version <= 7)
+    return DIFFICULTY_BLOCKS_COUNT;
+  if(version == 8)
+    return DIFFICULTY_BLOCKS_COUNT_V8;
+  if(version == 9)
+    return DIFFICULTY_BLOCKS_COUNT_V9;
+  if(version == 10 || version == 11)
+    return DIFFICULTY_BLOCKS_COUNT_V10;
+  if(version == 12)
+    return DIFFICULTY_BLOCKS_COUNT_V12;
+  return DIFFICULTY_BLOCKS_COUNT_V13;
+}
+//------------------------------------------------------------------
+static difficulty_type get_next_difficulty(uint8_t version, std::vector<uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, uint64_t block_height)
+{
+  if(version <= 7)
+    return next_difficulty(std::move(timestamps), std::move(cumulative_difficulties), DIFFICULTY_TARGET_V10);
+  if(version == 8)
+    return next_difficulty_V8(std::move(timestamps), std::move(cumulative_difficulties), block_height);
+  if(version == 9)
+    return next_difficulty_V9(std::move(timestamps), std::move(cumulative_difficulties), DIFFICULTY_TARGET_V10);
+  if(version == 10 || version == 11)
+    return next_difficulty_V10(std::move(timestamps), std::move(cumulative_difficulties), DIFFICULTY_TARGET_V10);
+  if(version == 12)
+    return next_difficulty_V12(std::move(timestamps), std::move(cumulative_difficulties), DIFFICULTY_TARGET_V12);
+  return next_difficulty_V13(std::move(timestamps), std::move(cumulative_difficulties), DIFFICULTY_TARGET_V13);
+}
+//------------------------------------------------------------------
+void Blockchain::sync_difficulty_window() const
+{
+  const uint64_t height = m_db->height();
+
+  // drop the blocks above the tip or no longer on the main chain
+  while (!m_difficulty_window.empty())
+  {
+    const uint64_t top = m_difficulty_window.end_height() - 1;
+    if (top < height && m_difficulty_window.top_hash() == m_db->get_block_hash_from_height(top))
+      break;
+    m_difficulty_window.pop_back();
+  }
+
+  // the genesis block is never part of the window
+  const uint64_t start = std::max<uint64_t>(1, height - std::min<uint64_t>(height, m_difficulty_window.capacity()));
+  if (m_difficulty_window.empty() || m_difficulty_window.end_height() < start)
+  {
+    m_difficulty_window.clear();
+  }
+  else
+  {
+    // refill below what is left after popping blocks
+    for (uint64_t h = m_difficulty_window.start_height(); h > start; --h)
+    {
+      if (!m_difficulty_window.push_front(h - 1, m_db->get_block_hash_from_height(h - 1), m_db->get_block_timestamp(h - 1), m_db->get_block_cumulative_difficulty(h - 1)))
+        break;
+    }
+  }
+
+  for (uint64_t h = m_difficulty_window.empty() ? start : m_difficulty_window.end_height(); h < height; ++h)
+    m_difficulty_window.push_back(h, m_db->get_block_hash_from_height(h), m_db->get_block_timestamp(h), m_db->get_block_cumulative_difficulty(h));
+}
+//------------------------------------------------------------------
 // This function aggregates the cumulative difficulties and timestamps of the
 // last DIFFICULTY_BLOCKS_COUNT blocks and passes them to next_difficulty,
 // returning the result of that call.  Ignores the genesis block, and can use
@@ -851,26 +929,7 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
 
   uint64_t block_height = m_db->height();
   uint8_t version = get_current_hard_fork_version();
-  size_t difficulty_blocks_count;
-
-  if(version <= 7){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT;
-  }
-  else if(version == 8){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V8;
-  }
-  else if(version == 9){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V9;
-  }
-  else if(version == 10 || version == 11){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V10;
-  }
-  else if(version == 12){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V12;
-  }
-  else{
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V13;
-  }
+  size_t difficulty_blocks_count = get_difficulty_blocks_count(version);
 
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -889,75 +948,16 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   std::vector<uint64_t> timestamps;
   std::vector<difficulty_type> difficulties;
   auto height = m_db->height();
-  // ND: Speedup
-  // 1. Keep a list of the last 735 (or less) blocks that is used to compute difficulty,
-  //    then when the next block difficulty is queried, push the latest height data and
-  //    pop the oldest one from the list. This only requires 1x read per height instead
-  //    of doing 735 (DIFFICULTY_BLOCKS_COUNT).
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1) && m_timestamps.size() >= difficulty_blocks_count)
-  {
-    uint64_t index = height - 1;
-    m_timestamps.push_back(m_db->get_block_timestamp(index));
-    m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
-    while (m_timestamps.size() > difficulty_blocks_count)
-      m_timestamps.erase(m_timestamps.begin());
-    while (m_difficulties.size() > difficulty_blocks_count)
-      m_difficulties.erase(m_difficulties.begin());
-
-    m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
-  }
-  else
-  {
-    size_t offset = height - std::min < size_t > (height, static_cast<size_t>(difficulty_blocks_count));
-    if (offset == 0)
-      ++offset;
-
-    timestamps.clear();
-    difficulties.clear();
-    if (height > offset)
-    {
-      timestamps.reserve(height - offset);
-      difficulties.reserve(height - offset);
-    }
-    for (; offset < height; offset++)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-    }
+  // The window keeps the last DIFFICULTY_BLOCKS_COUNT blocks of the main chain, so
+  // a new block, a pop or a reorg only reads the heights that changed
+  sync_difficulty_window();
+  size_t offset = height - std::min < size_t > (height, static_cast<size_t>(difficulty_blocks_count));
+  if (offset == 0)
+    ++offset;
+  if (height > offset)
+    m_difficulty_window.get(offset, height, timestamps, difficulties);
 
-    m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
-  }
-    size_t target;
-  difficulty_type diff;
-  if(version <= 7){
-    target = DIFFICULTY_TARGET_V10;
-    diff = next_difficulty(timestamps, difficulties, target);    
-  }
-  else if(version == 8){
-    target = DIFFICULTY_TARGET_V10;
-    diff = next_difficulty_V8(timestamps, difficulties, block_height);
-  }
-  else if(version == 9){
-    target = DIFFICULTY_TARGET_V10;
-    diff = next_difficulty_V9(timestamps, difficulties, target);
-  }
-  else if(version == 10 || version == 11){
-    target = DIFFICULTY_TARGET_V10;
-    diff = next_difficulty_V10(timestamps, difficulties, target);
-  }
-  else if(version == 12){
-    target = DIFFICULTY_TARGET_V12;
-    diff = next_difficulty_V12(timestamps, difficulties, target);
-  }
-  else{
-    target = DIFFICULTY_TARGET_V13;
-    diff = next_difficulty_V13(timestamps, difficulties, target);
-  }
+  difficulty_type diff = get_next_difficulty(version, std::move(timestamps), std::move(difficulties), block_height);
 
   CRITICAL_REGION_LOCAL1(m_difficulty_lock);
   m_difficulty_for_next_block_top_hash = top_hash;
@@ -979,8 +979,6 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
     return true;
   }
 
-  m_timestamps_and_difficulties_height = 0;
-
   // remove blocks from blockchain until we get back to where we should be.
   while (m_db->height() != rollback_height)
   {
@@ -1021,8 +1019,6 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   // if empty alt chain passed (not sure how that could happen), return false
   CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
 
@@ -1120,26 +1116,7 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
 
   uint8_t version = get_current_hard_fork_version();
   uint64_t block_height = m_db->height();
-  size_t difficulty_blocks_count;
-
-  if(version <= 7){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT;
-  }
-  else if(version == 8){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V8;
-  }
-  else if(version == 9){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V9;
-  }
-  else if(version == 10 || version == 11){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V10;
-  }
-  else if(version == 12){
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V12;
-  }
-  else{
-    difficulty_blocks_count = DIFFICULTY_BLOCKS_COUNT_V13;
-  }
+  size_t difficulty_blocks_count = get_difficulty_blocks_count(version);
 
   LOG_PRINT_L3("Blockchain::" << __func__);
   std::vector<uint64_t> timestamps;
@@ -1160,11 +1137,16 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     if(!main_chain_start_offset)
       ++main_chain_start_offset; //skip genesis block
 
-    // get difficulties and timestamps from relevant main chain blocks
-    for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+    // get difficulties and timestamps from relevant main chain blocks, the
+    // main chain's difficulty window normally has them all
+    sync_difficulty_window();
+    if (main_chain_start_offset < main_chain_stop_offset && !m_difficulty_window.get(main_chain_start_offset, main_chain_stop_offset, timestamps, cumulative_difficulties))
     {
-      timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+      {
+        timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
+        cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      }
     }
 
     // make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
@@ -1196,31 +1178,7 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
   }
 
   // FIXME: This will fail if fork activation heights are subject to voting
-  size_t target;
-  if(version <= 7){
-    target = DIFFICULTY_TARGET_V10;
-    return next_difficulty(timestamps, cumulative_difficulties, target);
-  }
-  else if(version == 8){
-    target = DIFFICULTY_TARGET_V10;
-    return next_difficulty_V8(timestamps, cumulative_difficulties, block_height);
-  }
-  else if(version == 9){
-    target = DIFFICULTY_TARGET_V10;
-    return next_difficulty_V9(timestamps, cumulative_difficulties, target);
-  }
-  else if(version == 10 || version == 11){
-    target = DIFFICULTY_TARGET_V10;
-    return next_difficulty_V10(timestamps, cumulative_difficulties, target);
-  }
-  else if(version == 12){
-    target = DIFFICULTY_TARGET_V12;
-    return next_difficulty_V12(timestamps, cumulative_difficulties, target);
-  }
-  else{
-    target = DIFFICULTY_TARGET_V13;
-    return next_difficulty_V13(timestamps, cumulative_difficulties, target);
-  }
+  return get_next_difficulty(version, std::move(timestamps), std::move(cumulative_difficulties), block_height);
 }
 //------------------------------------------------------------------
 // This function does a sanity check on basic things that all miner
@@ -1355,55 +1313,90 @@ uint64_t Blockchain::get_current_cumulative_block_weight_median() const
 bool Blockchain::create_block_template(block& b, const account_public_address& miner_address, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  block_template_source source = BTS_FILLED;
+  const bool r = build_block_template(b, miner_address, diffic, height, expected_reward, ex_nonce, source);
+  const uint64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  const size_t bucket = std::lower_bound(block_template_latency_limits_us.begin(), block_template_latency_limits_us.end(), latency_us) - block_template_latency_limits_us.begin();
+  CRITICAL_REGION_LOCAL(m_btc_stats_lock);
+  std::vector<uint64_t> &histogram = source == BTS_CACHED ? m_btc_stats.cached : source == BTS_SHARED ? m_btc_stats.shared : m_btc_stats.filled;
+  ++histogram[bucket];
+  return r;
+}
+//------------------------------------------------------------------
+bool Blockchain::build_block_template(block& b, const account_public_address& miner_address, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, block_template_source &source)
+{
   size_t median_weight;
   uint64_t already_generated_coins;
   uint64_t pool_cookie;
+  const std::string variant = std::string((const char*)&miner_address, sizeof(miner_address)) + ex_nonce;
 
   CRITICAL_REGION_BEGIN(m_blockchain_lock);
   height = m_db->height();
+  // The pool cookie is atomic. The lack of locking is OK, as if it changes
+  // just after we read it, we'll just use a slightly old template, but
+  // this would be the case anyway if we'd lock, and the change happened
+  // just after the block template was created
+  pool_cookie = m_tx_pool.cookie();
   if (m_btc_valid) {
-    // The pool cookie is atomic. The lack of locking is OK, as if it changes
-    // just as we compare it, we'll just use a slightly old template, but
-    // this would be the case anyway if we'd lock, and the change happened
-    // just after the block template was created
-    if (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address)) && m_btc_nonce == ex_nonce && m_btc_pool_cookie == m_tx_pool.cookie()) {
-      MDEBUG("Using cached template");
-      m_btc.timestamp = time(NULL); // update timestamp unconditionally
-      b = m_btc;
-      diffic = m_btc_difficulty;
+    // the header, difficulty and reward parameters hold until the chain changes
+    b = m_btc;
+    b.timestamp = time(NULL); // update timestamp unconditionally
+    diffic = m_btc_difficulty;
+    median_weight = m_btc_median_weight;
+    already_generated_coins = m_btc_already_generated_coins;
+    if (m_btc_pool_cookie == pool_cookie) {
       expected_reward = m_btc_expected_reward;
+      const auto it = m_btc_miner_txes.find(variant);
+      if (it != m_btc_miner_txes.end()) {
+        MDEBUG("Using cached template");
+        source = BTS_CACHED;
+        b.miner_tx = it->second;
+        return true;
+      }
+      MDEBUG("Using cached template transactions for a new address or extra nonce");
+      source = BTS_SHARED;
+      if (!construct_block_template_miner_tx(b, height, median_weight, already_generated_coins, m_btc_txs_weight, m_btc_fee, miner_address, ex_nonce))
+        return false;
+      if (m_btc_miner_txes.size() >= BLOCK_TEMPLATE_MAX_VARIANTS)
+        m_btc_miner_txes.clear();
+      m_btc_miner_txes[variant] = b.miner_tx;
       return true;
     }
-    MDEBUG("Not using cached template: address " << (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address))) << ", nonce " << (m_btc_nonce == ex_nonce) << ", cookie " << (m_btc_pool_cookie == m_tx_pool.cookie()));
-    invalidate_block_template_cache();
+    MDEBUG("Pool changed since the cached template, refreshing its transactions");
+    b.tx_hashes.clear();
   }
-
-  b.major_version = m_hardfork->get_current_version();
-  b.minor_version = m_hardfork->get_ideal_version();
-  b.prev_id = get_tail_id();
-  b.timestamp = time(NULL);
-
-  uint64_t median_ts;
-  if (!check_block_timestamp(b, median_ts))
+  else
   {
-    b.timestamp = median_ts;
-  }
+    b.major_version = m_hardfork->get_current_version();
+    b.minor_version = m_hardfork->get_ideal_version();
+    b.prev_id = get_tail_id();
+    b.timestamp = time(NULL);
+    b.tx_hashes.clear();
 
-  diffic = get_difficulty_for_next_block();
-  CHECK_AND_ASSERT_MES(diffic, false, "difficulty overhead.");
+    uint64_t median_ts;
+    if (!check_block_timestamp(b, median_ts))
+    {
+      b.timestamp = median_ts;
+    }
 
-  median_weight = m_current_block_cumul_weight_limit / 2;
-  already_generated_coins = m_db->get_block_already_generated_coins(height - 1);
+    diffic = get_difficulty_for_next_block();
+    CHECK_AND_ASSERT_MES(diffic, false, "difficulty overhead.");
+
+    median_weight = m_current_block_cumul_weight_limit / 2;
+    already_generated_coins = m_db->get_block_already_generated_coins(height - 1);
+  }
 
   CRITICAL_REGION_END();
 
+  // the pool keeps its selection up to date as txes come and go, so this is
+  // only a full fill after the chain changed
   size_t txs_weight;
   uint64_t fee;
-  if (!m_tx_pool.fill_block_template(b, median_weight, already_generated_coins, txs_weight, fee, expected_reward, m_hardfork->get_current_version(), m_db->height()))
+  if (!m_tx_pool.fill_block_template(b, median_weight, already_generated_coins, txs_weight, fee, expected_reward, m_hardfork->get_current_version(), height))
   {
     return false;
   }
-  pool_cookie = m_tx_pool.cookie();
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
   size_t real_txs_weight = 0;
   uint64_t real_fee = 0;
@@ -1459,6 +1452,30 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
       ", fee " << fee);
 #endif
 
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  // with the same transactions as the cached template, its miner txes still apply
+  if (m_btc_valid && m_btc.prev_id == b.prev_id && m_btc.tx_hashes == b.tx_hashes)
+  {
+    m_btc_pool_cookie = pool_cookie;
+    const auto it = m_btc_miner_txes.find(variant);
+    if (it != m_btc_miner_txes.end())
+    {
+      MDEBUG("Pool changes left the template transactions as they were");
+      source = BTS_CACHED;
+      b.miner_tx = it->second;
+      return true;
+    }
+  }
+  if (!construct_block_template_miner_tx(b, height, median_weight, already_generated_coins, txs_weight, fee, miner_address, ex_nonce))
+    return false;
+  // don't cache a template built on a tip that went away while filling
+  if (m_db->height() == height && get_tail_id() == b.prev_id)
+    cache_block_template(b, variant, diffic, expected_reward, pool_cookie, median_weight, already_generated_coins, txs_weight, fee);
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::construct_block_template_miner_tx(block& b, uint64_t height, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee, const account_public_address& miner_address, const blobdata& ex_nonce)
+{
   /*
    two-phase miner transaction generation: we don't know exact block weight until we prepare block, but we don't know reward until we know
    block weight, so first miner transaction generated with fake amount of money, and with phase we know think we know expected block weight
@@ -1519,7 +1536,6 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
         ", cumulative weight " << cumulative_weight << " is now good");
 #endif
 
-    cache_block_template(b, miner_address, ex_nonce, diffic, expected_reward, pool_cookie);
     return true;
   }
   LOG_ERROR("Failed to create_block_template with " << 10 << " tries");
@@ -1565,7 +1581,6 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
   uint64_t block_height = get_block_height(b);
   if(0 == block_height)
   {
@@ -2193,7 +2208,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
 // find split point between ours and foreign blockchain (or start at
 // blockchain height <req_start_block>), and return up to max_count FULL
 // blocks by reference.
-bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const
+bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -2218,7 +2233,8 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
 
   m_db->block_txn_start(true);
   total_height = get_current_blockchain_height();
-  size_t count = 0, size = 0;
+  size_t count = 0, size = 0, n_txes = 0;
+  crypto::hash first_miner_tx_hash = crypto::null_hash;
   blocks.reserve(std::min(std::min(max_count, (size_t)10000), (size_t)(total_height - start_height)));
   for(uint64_t i = start_height; i < total_height && count < max_count && (size < FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE || count < 3); i++, count++)
   {
@@ -2226,6 +2242,9 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
     blocks.back().first.first = m_db->get_block_blob_from_height(i);
     block b;
     CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(blocks.back().first.first, b), false, "internal error, invalid block");
+    if (count == 0 && output_indices)
+      first_miner_tx_hash = cryptonote::get_transaction_hash(b.miner_tx);
+    n_txes += 1 + b.tx_hashes.size();
     blocks.back().first.second = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
     std::vector<crypto::hash> mis;
     std::vector<cryptonote::blobdata> txs;
@@ -2242,7 +2261,116 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
       blocks.back().second.push_back(std::make_pair(b.tx_hashes[i], std::move(txs[i])));
     }
   }
+
+  if (output_indices && !blocks.empty())
+  {
+    // the txes of consecutive blocks have consecutive tx ids, so all the
+    // indices come from one walk over tx_outputs starting at the first miner tx
+    std::vector<std::vector<uint64_t>> indices;
+    if (!get_tx_outputs_gindexs(first_miner_tx_hash, n_txes, indices))
+    {
+      m_db->block_txn_stop();
+      return false;
+    }
+    output_indices->clear();
+    output_indices->reserve(blocks.size());
+    auto it = indices.begin();
+    for (const auto &bd: blocks)
+    {
+      const size_t block_txes = 1 + bd.second.size();
+      output_indices->push_back(std::vector<std::vector<uint64_t>>(std::make_move_iterator(it), std::make_move_iterator(it + block_txes)));
+      it += block_txes;
+    }
+  }
+  m_db->block_txn_stop();
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::get_blocks_stream(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, bool get_miner_tx_indices, size_t max_count, std::string &stream) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  uint64_t start_height;
+  if(req_start_block > 0)
+  {
+    if (req_start_block >= m_db->height())
+      return false;
+    start_height = req_start_block;
+  }
+  else
+  {
+    if(!find_blockchain_supplement(qblock_ids, start_height))
+      return false;
+  }
+
+  m_db->block_txn_start(true);
+  const uint64_t total_height = get_current_blockchain_height();
+  const size_t stream_start = stream.size();
+  blocks_stream_writer writer(stream);
+  writer.write_header(start_height, total_height);
+
+  bool r = true;
+  try
+  {
+    // the txes of consecutive blocks have consecutive tx ids, so once the
+    // first miner tx is found each block's indices are one cursor walk
+    uint64_t tx_id = 0;
+    blobdata tx_blob;
+    const std::vector<uint64_t> no_indices;
+    size_t count = 0;
+    for(uint64_t i = start_height; i < total_height && count < max_count && (stream.size() - stream_start < FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE || count < 3); i++, count++)
+    {
+      const blobdata block_blob = m_db->get_block_blob_from_height(i);
+      block b;
+      if (!parse_and_validate_block_from_blob(block_blob, b))
+      {
+        MERROR("Internal error, invalid block at height " << i);
+        r = false;
+        break;
+      }
+      if (count == 0 && !m_db->tx_exists(get_transaction_hash(b.miner_tx), tx_id))
+      {
+        MERROR("Internal error, miner tx of block at height " << i << " not found");
+        r = false;
+        break;
+      }
+
+      writer.begin_block(block_blob, b.tx_hashes.size());
+      for (const crypto::hash &tx_hash: b.tx_hashes)
+      {
+        if (!m_db->get_pruned_tx_blob(tx_hash, tx_blob))
+        {
+          MERROR("Internal error, transaction " << tx_hash << " from block at height " << i << " not found");
+          r = false;
+          break;
+        }
+        writer.add_tx(tx_blob);
+      }
+      if (!r)
+        break;
+
+      const std::vector<std::vector<uint64_t>> indices = m_db->get_tx_amount_output_indices(tx_id, 1 + b.tx_hashes.size());
+      writer.add_output_indices(get_miner_tx_indices ? indices[0] : no_indices);
+      for (size_t n = 1; n < indices.size(); ++n)
+        writer.add_output_indices(indices[n]);
+      writer.end_block();
+      tx_id += indices.size();
+    }
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to write blocks stream: " << e.what());
+    r = false;
+  }
   m_db->block_txn_stop();
+
+  if (!r)
+  {
+    stream.resize(stream_start);
+    return false;
+  }
+  writer.finish();
   return true;
 }
 //------------------------------------------------------------------
@@ -2396,6 +2524,30 @@ bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<u
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes, std::vector<std::vector<uint64_t>>& indexs) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  uint64_t tx_index;
+  if (!m_db->tx_exists(tx_id, tx_index))
+  {
+    MERROR_VER("get_tx_outputs_gindexs failed to find transaction with id = " << tx_id);
+    return false;
+  }
+
+  try
+  {
+    indexs = m_db->get_tx_amount_output_indices(tx_index, n_txes);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to get output indices for " << n_txes << " txes starting at " << tx_id << ": " << e.what());
+    return false;
+  }
+  CHECK_AND_ASSERT_MES(indexs.size() == n_txes, false, "internal error: got " << indexs.size() << " index lists for " << n_txes << " txes");
+  return true;
+}
+//------------------------------------------------------------------
 void Blockchain::on_new_tx_from_block(const cryptonote::transaction &tx)
 {
 #if defined(PER_BLOCK_CHECKPOINT)
@@ -2422,7 +2574,7 @@ void Blockchain::on_new_tx_from_block(const cryptonote::transaction &tx)
 // This function overloads its sister function with
 // an extra value (hash of highest block that holds an output used as input)
 // as a return-by-reference.
-bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block)
+bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block, bool verify_rct_signatures)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -2438,7 +2590,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
 #endif
 
   TIME_MEASURE_START(a);
-  bool res = check_tx_inputs(tx, tvc, &max_used_block_height);
+  bool res = check_tx_inputs(tx, tvc, &max_used_block_height, verify_rct_signatures, kept_by_block);
   TIME_MEASURE_FINISH(a);
   if(m_show_time_stats)
   {
@@ -2453,6 +2605,28 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::check_tx_rct_signatures(const transaction& tx)
+{
+  const rct::rctSig &rv = tx.rct_signatures;
+  bool res;
+  switch (rv.type)
+  {
+  case rct::RCTTypeSimple:
+  case rct::RCTTypeBulletproof:
+    res = rct::verRctNonSemanticsSimple(rv);
+    break;
+  case rct::RCTTypeFull:
+    res = rct::verRct(rv, false);
+    break;
+  default:
+    MERROR_VER("Unsupported rct type: " << rv.type);
+    return false;
+  }
+  if (!res)
+    MERROR_VER("Failed to check ringct signatures!");
+  return res;
+}
+//------------------------------------------------------------------
 bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2614,7 +2788,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height)
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, bool verify_rct_signatures, bool kept_by_block)
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2736,6 +2910,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
   tools::threadpool::waiter waiter;
   const auto waiter_guard = epee::misc_utils::create_scope_leave_handler([&]() { waiter.wait(&tpool); });
   int threads = tpool.get_max_concurrency();
+  const tools::threadpool::priority prio = kept_by_block ? tools::threadpool::PRIORITY_HIGH : tools::threadpool::PRIORITY_NORMAL;
 
   for (const auto& txin : tx.vin)
   {
@@ -2796,7 +2971,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       {
         // ND: Speedup
         // 1. Thread ring signature verification if possible.
-        tpool.submit(&waiter, boost::bind(&Blockchain::check_ring_signature, this, std::cref(tx_prefix_hash), std::cref(in_to_key.k_image), std::cref(pubkeys[sig_index]), std::cref(tx.signatures[sig_index]), std::ref(results[sig_index])), true);
+        tpool.submit(&waiter, boost::bind(&Blockchain::check_ring_signature, this, std::cref(tx_prefix_hash), std::cref(in_to_key.k_image), std::cref(pubkeys[sig_index]), std::cref(tx.signatures[sig_index]), std::ref(results[sig_index])), true, prio);
       }
       else
       {
@@ -2913,7 +3088,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRctNonSemanticsSimple(rv))
+      if (verify_rct_signatures && !rct::verRctNonSemanticsSimple(rv))
       {
         MERROR_VER("Failed to check ringct signatures!");
         return false;
@@ -2972,7 +3147,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRct(rv, false))
+      if (verify_rct_signatures && !rct::verRct(rv, false))
       {
         MERROR_VER("Failed to check ringct signatures!");
         return false;
@@ -3359,7 +3534,7 @@ bool Blockchain::flush_txes_from_pool(const std::vector<crypto::hash> &txids)
     uint64_t fee;
     bool relayed, do_not_relay, double_spend_seen;
     MINFO("Removing txid " << txid << " from the pool");
-    if(m_tx_pool.have_tx(txid) && !m_tx_pool.take_tx(txid, tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen))
+    if(m_tx_pool.have_tx(txid) && !m_tx_pool.take_tx(txid, tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen, txpool_remove_reason::flushed))
     {
       MERROR("Failed to remove txid " << txid << " from the pool");
       res = false;
@@ -3368,6 +3543,50 @@ bool Blockchain::flush_txes_from_pool(const std::vector<crypto::hash> &txids)
   return res;
 }
 //------------------------------------------------------------------
+uint32_t Blockchain::get_blockchain_pruning_seed() const
+{
+  return m_db->get_blockchain_pruning_seed();
+}
+//------------------------------------------------------------------
+bool Blockchain::prune_blockchain(uint32_t pruning_seed)
+{
+  try
+  {
+    return m_db->prune_blockchain(pruning_seed, &m_blockchain_lock);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to prune blockchain: " << e.what());
+    return false;
+  }
+}
+//------------------------------------------------------------------
+bool Blockchain::update_blockchain_pruning()
+{
+  try
+  {
+    return m_db->update_pruning(&m_blockchain_lock);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to update blockchain pruning: " << e.what());
+    return false;
+  }
+}
+//------------------------------------------------------------------
+bool Blockchain::check_blockchain_pruning()
+{
+  try
+  {
+    return m_db->check_pruning(&m_blockchain_lock);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to check blockchain pruning: " << e.what());
+    return false;
+  }
+}
+//------------------------------------------------------------------
 //      Needs to validate the block and acquire each transaction from the
 //      transaction mem_pool, then pass the block and transactions to
 //      m_db->add_block()
@@ -3584,8 +3803,9 @@ leave:
     t_exists += aa;
     TIME_MEASURE_START(bb);
 
-    // get transaction with hash <tx_id> from tx_pool
-    if(!m_tx_pool.take_tx(tx_id, tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen))
+    // get transaction with hash <tx_id> from tx_pool, it's only reported as
+    // mined once the block is added, as it goes back to the pool otherwise
+    if(!m_tx_pool.take_tx(tx_id, tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen, boost::none))
     {
       MERROR_VER("Block with id: " << id  << " has at least one unknown transaction with id: " << tx_id);
       bvc.m_verifivation_failed = true;
@@ -3723,6 +3943,10 @@ leave:
 
   TIME_MEASURE_FINISH(addblock);
 
+  // keep the seed nodes' verdict so this height is verified locally from now on
+  if (!bvc.m_verifivation_failed)
+    record_block_validity(bl, new_height, *m_db);
+
   // do this after updating the hard fork state since the weight limit may change due to fork
   update_next_cumulative_weight_limit();
 
@@ -3748,6 +3972,13 @@ leave:
   if (block_notify)
     block_notify->notify(epee::string_tools::pod_to_hex(id).c_str());
 
+  for (const crypto::hash &tx_id : bl.tx_hashes)
+    m_tx_pool.notify_tx_removed(tx_id, txpool_remove_reason::mined);
+
+  std::shared_ptr<i_core_event_listener> event_listener = std::atomic_load(&m_event_listener);
+  if (event_listener)
+    event_listener->on_block_added(new_height - 1, id, bl);
+
   return true;
 }
 //------------------------------------------------------------------
@@ -3824,7 +4055,7 @@ bool Blockchain::add_new_block(const block& bl_, block_verification_context& bvc
     MINFO("=== DEBUG: Still inside if (valid) block ===");
   }
   // check if the block is valid in the X-CASH proof of stake (external module)
-  else if (version >= HF_VERSION_PROOF_OF_STAKE && !check_block_validity(bl, (std::size_t)m_db->height()))
+  else if (version >= HF_VERSION_PROOF_OF_STAKE && !check_block_validity(bl, (std::size_t)m_db->height(), *m_db))
   {
     bvc.m_added_to_main_chain = false;
     m_db->block_txn_stop();
@@ -4118,6 +4349,35 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
   return usable;
 }
 
+//------------------------------------------------------------------
+void Blockchain::prevalidate_pos_blocks(const std::vector<block_complete_entry> &blocks_entry) const
+{
+  MTRACE("Blockchain::" << __func__);
+
+  const bool temp_consensus = m_temp_consensus_validator && m_temp_consensus_validator->is_enabled();
+  if (!temp_consensus && get_current_hard_fork_version() < HF_VERSION_PROOF_OF_STAKE)
+    return;
+
+  std::vector<block> blocks;
+  blocks.reserve(blocks_entry.size());
+  for (const auto &entry : blocks_entry)
+  {
+    block b;
+    if (parse_and_validate_block_from_blob(entry.block, b))
+      blocks.push_back(std::move(b));
+  }
+
+  TIME_MEASURE_START(t);
+  // leader blocks are checked by the temporary consensus validator instead
+  if (temp_consensus)
+    m_temp_consensus_validator->prevalidate_leader_blocks(blocks);
+  else
+    prevalidate_block_validity(blocks, *m_db);
+  TIME_MEASURE_FINISH(t);
+  if (m_show_time_stats)
+    MDEBUG("Prevalidating " << blocks.size() << " blocks took: " << t << " ms");
+}
+
 //------------------------------------------------------------------
 // ND: Speedups:
 // 1. Thread long_hash computations if possible (m_max_prepare_blocks_threads = nthreads, default = 4)
@@ -4253,7 +4513,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       tools::threadpool::waiter waiter;
       for (uint64_t i = 0; i < threads; i++)
       {
-        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, thread_height, std::cref(blocks[i]), std::ref(maps[i])), true);
+        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, thread_height, std::cref(blocks[i]), std::ref(maps[i])), true, tools::threadpool::PRIORITY_HIGH);
         thread_height += blocks[i].size();
       }
 
@@ -4397,7 +4657,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     for (size_t i = 0; i < amounts.size(); i++)
     {
       uint64_t amount = amounts[i];
-      tpool.submit(&waiter, boost::bind(&Blockchain::output_scan_worker, this, amount, std::cref(offset_map[amount]), std::ref(tx_map[amount]), std::ref(transactions[i])), true);
+      tpool.submit(&waiter, boost::bind(&Blockchain::output_scan_worker, this, amount, std::cref(offset_map[amount]), std::ref(tx_map[amount]), std::ref(transactions[i])), true, tools::threadpool::PRIORITY_HIGH);
     }
     waiter.wait(&tpool);
   }
@@ -4707,7 +4967,7 @@ void Blockchain::load_compiled_in_block_hashes()
         for(const transaction &tx : txs)
         {
           crypto::hash tx_hash = get_transaction_hash(tx);
-          m_tx_pool.take_tx(tx_hash, pool_tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen);
+          m_tx_pool.take_tx(tx_hash, pool_tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen, txpool_remove_reason::flushed);
         }
       }
     }
@@ -4763,20 +5023,35 @@ void Blockchain::invalidate_block_template_cache()
 {
   MDEBUG("Invalidating block template cache");
   m_btc_valid = false;
+  m_btc_miner_txes.clear();
 }
 
-void Blockchain::cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t expected_reward, uint64_t pool_cookie)
+void Blockchain::cache_block_template(const block &b, const std::string &variant, const difficulty_type &diff, uint64_t expected_reward, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee)
 {
   MDEBUG("Setting block template cache");
+  // miner txes built for other transactions pay the wrong reward
+  if (!m_btc_valid || m_btc.prev_id != b.prev_id || m_btc.tx_hashes != b.tx_hashes)
+    m_btc_miner_txes.clear();
+  else if (m_btc_miner_txes.size() >= BLOCK_TEMPLATE_MAX_VARIANTS)
+    m_btc_miner_txes.clear();
   m_btc = b;
-  m_btc_address = address;
-  m_btc_nonce = nonce;
+  m_btc_miner_txes[variant] = b.miner_tx;
   m_btc_difficulty = diff;
   m_btc_expected_reward = expected_reward;
   m_btc_pool_cookie = pool_cookie;
+  m_btc_median_weight = median_weight;
+  m_btc_already_generated_coins = already_generated_coins;
+  m_btc_txs_weight = txs_weight;
+  m_btc_fee = fee;
   m_btc_valid = true;
 }
 
+Blockchain::block_template_stats Blockchain::get_block_template_stats() const
+{
+  CRITICAL_REGION_LOCAL(m_btc_stats_lock);
+  return m_btc_stats;
+}
+
 namespace cryptonote {
 template bool Blockchain::get_transactions(const std::vector<crypto::hash>&, std::vector<transaction>&, std::vector<crypto::hash>&) const;
 template bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>&, std::vector<cryptonote::blobdata>&, std::vector<crypto::hash>&, bool) const;
@@ -57,6 +57,7 @@
 #include "checkpoints/checkpoints.h"
 #include "cryptonote_basic/hardfork.h"
 #include "blockchain_db/blockchain_db.h"
+#include "cryptonote_core/core_event_listener.h"
 
 namespace tools { class Notify; }
 
@@ -224,6 +225,18 @@ namespace cryptonote
      */
     bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks);
 
+    /**
+     * @brief verifies the PoS blocks of an incoming batch ahead of add_new_block
+     *
+     * Leader signatures are checked in parallel when temporary consensus is
+     * enabled, otherwise the seed nodes are queried. This must be called
+     * before the blockchain lock is taken. The verdicts are cached, so
+     * add_new_block only does a lookup.
+     *
+     * @param blocks a list of incoming blocks
+     */
+    void prevalidate_pos_blocks(const std::vector<block_complete_entry> &blocks) const;
+
     /**
      * @brief incoming blocks post-processing, cleanup, and disk sync
      *
@@ -333,6 +346,27 @@ namespace cryptonote
      */
     bool create_block_template(block& b, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce);
 
+    /**
+     * @brief latency histograms of create_block_template, by how the template was served
+     *
+     * Bucket i counts calls which took at most bucket_limits_us[i], the
+     * extra last bucket counts the slower ones.
+     */
+    struct block_template_stats
+    {
+      std::vector<uint64_t> bucket_limits_us;
+      std::vector<uint64_t> cached; //!< served from the cache as is
+      std::vector<uint64_t> shared; //!< a new miner tx on the cached transactions
+      std::vector<uint64_t> filled; //!< transactions taken from the pool
+    };
+
+    /**
+     * @brief gets the create_block_template latency histograms
+     *
+     * @return a copy of the histograms
+     */
+    block_template_stats get_block_template_stats() const;
+
     /**
      * @brief checks if a block is known about with a given hash
      *
@@ -426,10 +460,13 @@ namespace cryptonote
      * @param start_height return-by-reference the height of the first block returned
      * @param pruned whether to return full or pruned tx blobs
      * @param max_count the max number of blocks to get
+     * @param output_indices if not NULL, return-by-reference the global indices
+     *        of every returned transaction's outputs, one list per block with
+     *        the miner tx first, read in bulk under the same read transaction
      *
      * @return true if a block found in common or req_start_block specified, else false
      */
-    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const;
+    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices = NULL) const;
 
     /**
      * @brief retrieves a set of blocks and their transactions, and possibly other transactions
@@ -490,6 +527,25 @@ namespace cryptonote
      */
     void get_output_key_mask_unlocked(const uint64_t& amount, const uint64_t& index, crypto::public_key& key, rct::key& mask, bool& unlocked) const;
 
+    /**
+     * @brief get recent blocks for a foreign chain as a blocks stream
+     *
+     * Selects blocks like find_blockchain_supplement() and appends them to
+     * stream as a header and one record per block (see blocks_stream.h):
+     * the block blob, its pruned txes and the global output indices of the
+     * miner tx and each tx.  Everything is copied straight out of the db
+     * under a single read transaction, without building per-block objects.
+     *
+     * @param req_start_block if non-zero, specifies a start point (otherwise find most recent commonality)
+     * @param qblock_ids the foreign chain's "short history" (see get_short_chain_history)
+     * @param get_miner_tx_indices whether to include the miner tx's output indices
+     * @param max_count the max number of blocks to get
+     * @param stream return-by-reference the stream, appended to
+     *
+     * @return true if a block found in common or req_start_block specified, else false
+     */
+    bool get_blocks_stream(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, bool get_miner_tx_indices, size_t max_count, std::string &stream) const;
+
     /**
      * @brief gets per block distribution of outputs of a given amount
      *
@@ -515,6 +571,22 @@ namespace cryptonote
      */
     bool get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs) const;
 
+    /**
+     * @brief gets the global indices for outputs from a run of transactions
+     *
+     * Transactions are numbered in the order they were added to the chain,
+     * so this fetches the indices for n_txes transactions starting with the
+     * given one (e.g. a miner tx followed by the rest of its block and the
+     * blocks after it) in a single sequential read.
+     *
+     * @param tx_id the hash of the first transaction to fetch indices for
+     * @param n_txes the number of transactions to fetch indices for
+     * @param indexs return-by-reference the global indices, one list per transaction
+     *
+     * @return false if the first transaction does not exist or the run cannot be read, otherwise true
+     */
+    bool get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes, std::vector<std::vector<uint64_t>>& indexs) const;
+
     /**
      * @brief stores the blockchain
      *
@@ -538,10 +610,24 @@ namespace cryptonote
      * @param max_used_block_id return-by-reference block hash of most recent input
      * @param tvc returned information about tx verification
      * @param kept_by_block whether or not the transaction is from a previously-verified block
+     * @param verify_rct_signatures false to leave the rct ring signatures to check_tx_rct_signatures
      *
      * @return false if any input is invalid, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false);
+    bool check_tx_inputs(transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false, bool verify_rct_signatures = true);
+
+    /**
+     * @brief verifies the ring signatures of an rct transaction
+     *
+     * Only reads the transaction, so it does not need the blockchain lock and
+     * can run on the threadpool once check_tx_inputs has expanded the rct
+     * signatures with verify_rct_signatures set to false.
+     *
+     * @param tx the transaction to verify
+     *
+     * @return false if the signatures are invalid, otherwise true
+     */
+    static bool check_tx_rct_signatures(const transaction& tx);
 
     /**
      * @brief get fee quantization mask
@@ -720,6 +806,13 @@ namespace cryptonote
      */
     void set_block_notify(const std::shared_ptr<tools::Notify> &notify) { m_block_notify = notify; }
 
+    /**
+     * @brief sets a listener to tell about blocks added to and popped from the main chain
+     *
+     * @param listener the listener, or an empty pointer to stop notifying
+     */
+    void set_event_listener(const std::shared_ptr<i_core_event_listener> &listener) { std::atomic_store(&m_event_listener, listener); }
+
     /**
      * @brief Put DB in safe sync mode
      */
@@ -830,6 +923,36 @@ namespace cryptonote
      */
     bool flush_txes_from_pool(const std::vector<crypto::hash> &txids);
 
+    /**
+     * @brief gets the pruning seed of the blockchain
+     *
+     * @return the pruning seed, or 0 if the blockchain is not pruned
+     */
+    uint32_t get_blockchain_pruning_seed() const;
+
+    /**
+     * @brief prunes the blockchain, keeping one stripe and the tip
+     *
+     * @param pruning_seed the seed to prune with, 0 to pick one at random
+     *
+     * @return true on success, false otherwise
+     */
+    bool prune_blockchain(uint32_t pruning_seed = 0);
+
+    /**
+     * @brief prunes the transactions which left the unpruned tip
+     *
+     * @return true on success or if the blockchain is not pruned, false otherwise
+     */
+    bool update_blockchain_pruning();
+
+    /**
+     * @brief checks the pruned data matches the pruning seed
+     *
+     * @return true if consistent, false otherwise
+     */
+    bool check_blockchain_pruning();
+
     /**
      * @brief return a histogram of outputs on the blockchain
      *
@@ -1018,9 +1141,8 @@ namespace cryptonote
     temp_consensus_validator* m_temp_consensus_validator;
     uint64_t m_sync_counter;
     uint64_t m_bytes_to_sync;
-    std::vector<uint64_t> m_timestamps;
-    std::vector<difficulty_type> m_difficulties;
-    uint64_t m_timestamps_and_difficulties_height;
+    // the last blocks of the main chain, for the difficulty calculations
+    mutable difficulty_window m_difficulty_window;
 
     epee::critical_section m_difficulty_lock;
     crypto::hash m_difficulty_for_next_block_top_hash;
@@ -1048,16 +1170,32 @@ namespace cryptonote
 
     std::atomic<bool> m_cancel;
 
-    // block template cache
+    // block template cache: the header and transactions are shared, the
+    // miner txes are kept per address and extra nonce
     block m_btc;
-    account_public_address m_btc_address;
-    blobdata m_btc_nonce;
+    std::unordered_map<std::string, transaction> m_btc_miner_txes;
     difficulty_type m_btc_difficulty;
     uint64_t m_btc_pool_cookie;
     uint64_t m_btc_expected_reward;
+    size_t m_btc_median_weight;
+    uint64_t m_btc_already_generated_coins;
+    size_t m_btc_txs_weight;
+    uint64_t m_btc_fee;
     bool m_btc_valid;
 
+    mutable epee::critical_section m_btc_stats_lock;
+    block_template_stats m_btc_stats;
+
+    //! how a block template was served, for the latency histograms
+    enum block_template_source
+    {
+      BTS_CACHED,
+      BTS_SHARED,
+      BTS_FILLED,
+    };
+
     std::shared_ptr<tools::Notify> m_block_notify;
+    std::shared_ptr<i_core_event_listener> m_event_listener;
 
     /**
      * @brief collects the keys for all outputs being "spent" as an input
@@ -1120,10 +1258,12 @@ namespace cryptonote
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param verify_rct_signatures false to skip the rct ring signature verification
+     * @param kept_by_block false for a relayed tx, whose ring checks then queue behind block sync
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, bool verify_rct_signatures = true, bool kept_by_block = true);
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1200,6 +1340,15 @@ namespace cryptonote
      */
     difficulty_type get_next_difficulty_for_alternative_chain(const std::list<blocks_ext_by_hash::iterator>& alt_chain, block_extended_info& bei) const;
 
+    /**
+     * @brief brings the difficulty window in line with the main chain
+     *
+     * Drops the blocks which were popped or reorganized away and loads the
+     * missing ones, so only the heights that changed are read from the db.
+     * Must be called with the blockchain lock held.
+     */
+    void sync_difficulty_window() const;
+
     /**
      * @brief sanity checks a miner transaction before validating an entire block
      *
@@ -1406,7 +1555,23 @@ namespace cryptonote
      * @brief stores a new cached block template
      *
      * At some point, may be used to push an update to miners
+     *
+     * @param variant the miner address and extra nonce the miner tx was built for
+     */
+    void cache_block_template(const block &b, const std::string &variant, const difficulty_type &diff, uint64_t expected_reward, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee);
+
+    /**
+     * @brief does the work of create_block_template
+     *
+     * @param source return-by-reference how the template was served
+     */
+    bool build_block_template(block& b, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, block_template_source &source);
+
+    /**
+     * @brief builds the miner tx of a block template, padding it so the block weight is stable
+     *
+     * @return true on success, false otherwise
      */
-    void cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t expected_reward, uint64_t pool_cookie);
+    bool construct_block_template_miner_tx(block& b, uint64_t height, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee, const account_public_address& miner_address, const blobdata& ex_nonce);
   };
 }  // namespace cryptonote
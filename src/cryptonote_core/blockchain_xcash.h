@@ -18,6 +18,10 @@ namespace cryptonote
 #define DATA_HASH_LENGTH 128 // The length of the SHA2-512 hash
 #define BUFFER_SIZE 200000
 
+#define BLOCK_VALIDITY_PREFETCH_BATCH_SIZE 16 // The amount of heights queried from the seed nodes at once
+#define BLOCK_VALIDITY_CACHE_SIZE 4096 // The amount of block validity verdicts to keep
+#define BLOCK_VALIDITY_REJECTED_CACHE_TIME 30 // The time in seconds a rejected verdict is kept, since the seed nodes might have been unreachable
+
 #define VRF_PUBLIC_KEY_LENGTH 64
 #define VRF_SECRET_KEY_LENGTH 128
 #define VRF_PROOF_LENGTH 160
@@ -29,5 +33,39 @@ pointer = NULL;
 
 // bool check_block_verifier_node_signed_block(const block bl, const std::size_t current_block_height);
 
-bool check_block_validity(const block bl, const std::size_t block_height);
+/**
+ * @brief gets the reserve bytes data hash of a PoS block
+ *
+ * @return the data hash, or an empty string if the block has no reserve bytes
+ */
+std::string get_block_data_hash(const block &bl, const std::size_t block_height);
+
+/**
+ * @brief records the known history data hashes in the database
+ *
+ * Some history blocks carry a corrupted data hash the seed nodes would not
+ * confirm, these are stored as verified up front.
+ */
+void init_block_validity(BlockchainDB &db);
+
+/**
+ * @brief stores the seed nodes' confirmation of a block added to the chain
+ *
+ * Must be called once the block is in the database, check_block_validity then
+ * verifies this height locally, e.g. after a pop or when importing.
+ */
+void record_block_validity(const block &bl, const std::size_t block_height, BlockchainDB &db);
+
+/**
+ * @brief queries the seed nodes for a batch of incoming blocks concurrently
+ *
+ * The verdicts are cached, so this is meant to run before the blockchain
+ * lock is taken and check_block_validity then only does a lookup.
+ *
+ * @param blocks the incoming blocks
+ * @param db heights already verified in the database are not queried
+ */
+void prevalidate_block_validity(const std::vector<block> &blocks, const BlockchainDB &db);
+
+bool check_block_validity(const block &bl, const std::size_t block_height, const BlockchainDB &db);
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief why a transaction left the pool
+   */
+  enum class txpool_remove_reason
+  {
+    mined,    //!< included in a block added to the main chain
+    pruned,   //!< evicted to keep the pool under its maximum weight
+    expired,  //!< stayed in the pool longer than its allowed lifetime
+    invalid,  //!< no longer valid (too big after a fork, already on chain)
+    flushed   //!< flushed from the pool on request, without being mined
+  };
+
+  const char *txpool_remove_reason_to_string(txpool_remove_reason reason);
+
+  /**
+   * @brief receives chain and pool changes as they happen
+   *
+   * Callbacks are made from inside the Blockchain and tx_memory_pool, with
+   * their locks held, so implementations must not call back into either of
+   * them and should do no more than queue the event for another thread.
+   */
+  struct i_core_event_listener
+  {
+    virtual ~i_core_event_listener() {}
+
+    /**
+     * @brief a block was added to the top of the main chain
+     *
+     * @param height the height of the block
+     * @param id the block's hash
+     * @param b the block
+     */
+    virtual void on_block_added(uint64_t height, const crypto::hash &id, const block &b) = 0;
+
+    /**
+     * @brief the top block was popped off the main chain (reorg or rollback)
+     *
+     * @param height the height the block had
+     * @param id the popped block's hash
+     * @param b the popped block
+     */
+    virtual void on_block_popped(uint64_t height, const crypto::hash &id, const block &b) = 0;
+
+    /**
+     * @brief a transaction was added to the pool
+     *
+     * @param id the transaction's hash
+     * @param tx the transaction
+     * @param weight the transaction's weight
+     * @param fee the transaction's fee
+     */
+    virtual void on_txpool_add(const crypto::hash &id, const transaction &tx, uint64_t weight, uint64_t fee) = 0;
+
+    /**
+     * @brief a transaction was removed from the pool
+     *
+     * @param id the transaction's hash
+     * @param reason why it was removed
+     */
+    virtual void on_txpool_remove(const crypto::hash &id, txpool_remove_reason reason) = 0;
+  };
+}
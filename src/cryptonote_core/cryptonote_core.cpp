@@ -197,6 +197,11 @@ namespace cryptonote
   , "Relay blocks as normal blocks"
   , false
   };
+  static const command_line::arg_descriptor<bool> arg_prune_blockchain  = {
+    "prune-blockchain"
+  , "Prune blockchain"
+  , false
+  };
   static const command_line::arg_descriptor<size_t> arg_max_txpool_weight  = {
     "max-txpool-weight"
   , "Set maximum txpool weight in bytes."
@@ -240,6 +245,12 @@ namespace cryptonote
     m_blockchain_storage.set_temp_consensus_validator(validator);
   }
   //-----------------------------------------------------------------------------------
+  void core::set_event_listener(const std::shared_ptr<i_core_event_listener> &listener)
+  {
+    m_mempool.set_event_listener(listener);
+    m_blockchain_storage.set_event_listener(listener);
+  }
+  //-----------------------------------------------------------------------------------
   void core::set_checkpoints(checkpoints&& chk_pts)
   {
     m_blockchain_storage.set_checkpoints(std::move(chk_pts));
@@ -329,6 +340,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_disable_dns_checkpoints);
     command_line::add_arg(desc, arg_max_txpool_weight);
     command_line::add_arg(desc, arg_block_notify);
+    command_line::add_arg(desc, arg_prune_blockchain);
 
     miner::init_options(desc);
     BlockchainDB::init_options(desc);
@@ -634,6 +646,12 @@ namespace cryptonote
 
     block_sync_size = command_line::get_arg(vm, arg_block_sync_size);
 
+    if (command_line::get_arg(vm, arg_prune_blockchain))
+    {
+      MGINFO("Pruning blockchain...");
+      CHECK_AND_ASSERT_MES(m_blockchain_storage.prune_blockchain(), false, "Failed to prune blockchain");
+    }
+
     MGINFO("Loading checkpoints");
 
     // load json & DNS checkpoints, and verify them
@@ -797,67 +815,80 @@ namespace cryptonote
       return true;
     }
 
-    std::vector<const rct::rctSig*> rvv;
+    // the per tx checks run on the threadpool, bulletproofs are then verified
+    // in a single batch
+    std::vector<uint8_t> delayed(tx_info.size(), 0);
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    const tools::threadpool::priority prio = keeped_by_block ? tools::threadpool::PRIORITY_HIGH : tools::threadpool::PRIORITY_LOW;
+    tools::threadpool::waiter waiter;
     for (size_t n = 0; n < tx_info.size(); ++n)
     {
-      if (!check_tx_semantic(*tx_info[n].tx, keeped_by_block))
-      {
-        set_semantics_failed(tx_info[n].tx_hash);
-        tx_info[n].tvc.m_verifivation_failed = true;
-        tx_info[n].result = false;
-        continue;
-      }
-
-      if (tx_info[n].tx->version < 2)
-        continue;
-      const rct::rctSig &rv = tx_info[n].tx->rct_signatures;
-      switch (rv.type) {
-        case rct::RCTTypeNull:
-          // coinbase should not come here, so we reject for all other types
-          MERROR_VER("Unexpected Null rctSig type");
+      tpool.submit(&waiter, [&, n] {
+        if (!check_tx_semantic(*tx_info[n].tx, keeped_by_block))
+        {
           set_semantics_failed(tx_info[n].tx_hash);
           tx_info[n].tvc.m_verifivation_failed = true;
           tx_info[n].result = false;
-          break;
-        case rct::RCTTypeSimple:
-          if (!rct::verRctSemanticsSimple(rv))
-          {
-            MERROR_VER("rct signature semantics check failed");
+          return;
+        }
+
+        if (tx_info[n].tx->version < 2)
+          return;
+        const rct::rctSig &rv = tx_info[n].tx->rct_signatures;
+        switch (rv.type) {
+          case rct::RCTTypeNull:
+            // coinbase should not come here, so we reject for all other types
+            MERROR_VER("Unexpected Null rctSig type");
             set_semantics_failed(tx_info[n].tx_hash);
             tx_info[n].tvc.m_verifivation_failed = true;
             tx_info[n].result = false;
             break;
-          }
-          break;
-        case rct::RCTTypeFull:
-          if (!rct::verRct(rv, true))
-          {
-            MERROR_VER("rct signature semantics check failed");
-            set_semantics_failed(tx_info[n].tx_hash);
-            tx_info[n].tvc.m_verifivation_failed = true;
-            tx_info[n].result = false;
+          case rct::RCTTypeSimple:
+            if (!rct::verRctSemanticsSimple(rv))
+            {
+              MERROR_VER("rct signature semantics check failed");
+              set_semantics_failed(tx_info[n].tx_hash);
+              tx_info[n].tvc.m_verifivation_failed = true;
+              tx_info[n].result = false;
+              break;
+            }
             break;
-          }
-          break;
-        case rct::RCTTypeBulletproof:
-          if (!is_canonical_bulletproof_layout(rv.p.bulletproofs))
-          {
-            MERROR_VER("Bulletproof does not have canonical form");
+          case rct::RCTTypeFull:
+            if (!rct::verRct(rv, true))
+            {
+              MERROR_VER("rct signature semantics check failed");
+              set_semantics_failed(tx_info[n].tx_hash);
+              tx_info[n].tvc.m_verifivation_failed = true;
+              tx_info[n].result = false;
+              break;
+            }
+            break;
+          case rct::RCTTypeBulletproof:
+            if (!is_canonical_bulletproof_layout(rv.p.bulletproofs))
+            {
+              MERROR_VER("Bulletproof does not have canonical form");
+              set_semantics_failed(tx_info[n].tx_hash);
+              tx_info[n].tvc.m_verifivation_failed = true;
+              tx_info[n].result = false;
+              break;
+            }
+            delayed[n] = 1; // delayed batch verification
+            break;
+          default:
+            MERROR_VER("Unknown rct type: " << rv.type);
             set_semantics_failed(tx_info[n].tx_hash);
             tx_info[n].tvc.m_verifivation_failed = true;
             tx_info[n].result = false;
             break;
-          }
-          rvv.push_back(&rv); // delayed batch verification
-          break;
-        default:
-          MERROR_VER("Unknown rct type: " << rv.type);
-          set_semantics_failed(tx_info[n].tx_hash);
-          tx_info[n].tvc.m_verifivation_failed = true;
-          tx_info[n].result = false;
-          break;
-      }
+        }
+      }, false, prio);
     }
+    waiter.wait(&tpool);
+
+    std::vector<const rct::rctSig*> rvv;
+    for (size_t n = 0; n < tx_info.size(); ++n)
+      if (delayed[n])
+        rvv.push_back(&tx_info[n].tx->rct_signatures);
     if (!rvv.empty() && !rct::verRctSemanticsSimple(rvv))
     {
       LOG_PRINT_L1("One transaction among this group has bad semantics, verifying one at a time");
@@ -891,6 +922,8 @@ namespace cryptonote
 
     tvc.resize(tx_blobs.size());
     tools::threadpool& tpool = tools::threadpool::getInstance();
+    // txes from blocks are part of the sync, relayed ones can wait
+    const tools::threadpool::priority prio = keeped_by_block ? tools::threadpool::PRIORITY_HIGH : tools::threadpool::PRIORITY_LOW;
     tools::threadpool::waiter waiter;
     std::vector<blobdata>::const_iterator it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
@@ -904,7 +937,7 @@ namespace cryptonote
           MERROR_VER("Exception in handle_incoming_tx_pre: " << e.what());
           results[i].res = false;
         }
-      });
+      }, false, prio);
     }
     waiter.wait(&tpool);
     it = tx_blobs.begin();
@@ -934,7 +967,7 @@ namespace cryptonote
             MERROR_VER("Exception in handle_incoming_tx_post: " << e.what());
             results[i].res = false;
           }
-        });
+        }, false, prio);
       }
     }
     waiter.wait(&tpool);
@@ -949,6 +982,30 @@ namespace cryptonote
     if (!tx_info.empty())
       handle_incoming_tx_accumulated_batch(tx_info, keeped_by_block);
 
+    // verify the inputs of the batch before add_new_tx takes the pool lock,
+    // a tx spending a key image already spent earlier in the batch is left to
+    // the pool, which flags the double spend
+    if (!keeped_by_block)
+    {
+      std::unordered_set<crypto::key_image> key_images;
+      std::vector<std::pair<transaction*, crypto::hash>> txs;
+      txs.reserve(tx_blobs.size());
+      for (size_t i = 0; i < tx_blobs.size(); i++) {
+        if (!results[i].res || already_have[i])
+          continue;
+        bool conflict = false;
+        for (const auto &in: results[i].tx.vin)
+        {
+          if (in.type() == typeid(txin_to_key) && !key_images.insert(boost::get<txin_to_key>(in).k_image).second)
+            conflict = true;
+        }
+        if (!conflict)
+          txs.push_back(std::make_pair(&results[i].tx, results[i].hash));
+      }
+      if (!txs.empty())
+        m_mempool.prevalidate_tx_inputs(txs);
+    }
+
     bool ok = true;
     it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
@@ -1251,9 +1308,14 @@ namespace cryptonote
     return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const
+  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices) const
+  {
+    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, pruned, get_miner_tx_hash, max_count, output_indices);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_blocks_stream(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, bool get_miner_tx_indices, size_t max_count, std::string &stream) const
   {
-    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, pruned, get_miner_tx_hash, max_count);
+    return m_blockchain_storage.get_blocks_stream(req_start_block, qblock_ids, get_miner_tx_indices, max_count, stream);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
@@ -1271,6 +1333,11 @@ namespace cryptonote
     return m_blockchain_storage.get_tx_outputs_gindexs(tx_id, indexs);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes, std::vector<std::vector<uint64_t>>& indexs) const
+  {
+    return m_blockchain_storage.get_tx_outputs_gindexs(tx_id, n_txes, indexs);
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::pause_mine()
   {
     m_miner.pause();
@@ -1361,6 +1428,8 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks)
   {
+    // network bound, so done before any lock is taken
+    m_blockchain_storage.prevalidate_pos_blocks(blocks);
     m_incoming_tx_lock.lock();
     m_blockchain_storage.prepare_handle_incoming_blocks(blocks);
     return true;
@@ -1547,6 +1616,7 @@ namespace cryptonote
     m_txpool_auto_relayer.do_call(boost::bind(&core::relay_txpool_transactions, this));
     // m_check_updates_interval.do_call(boost::bind(&core::check_updates, this));
     m_check_disk_space_interval.do_call(boost::bind(&core::check_disk_space, this));
+    m_blockchain_pruning_interval.do_call(boost::bind(&core::update_blockchain_pruning, this));
     m_miner.on_idle();
     m_mempool.on_idle();
     return true;
@@ -1737,6 +1807,26 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  uint32_t core::get_blockchain_pruning_seed() const
+  {
+    return get_blockchain_storage().get_blockchain_pruning_seed();
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::prune_blockchain(uint32_t pruning_seed)
+  {
+    return get_blockchain_storage().prune_blockchain(pruning_seed);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::update_blockchain_pruning()
+  {
+    return get_blockchain_storage().update_blockchain_pruning();
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::check_blockchain_pruning()
+  {
+    return get_blockchain_storage().check_blockchain_pruning();
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::set_target_blockchain_height(uint64_t target_blockchain_height)
   {
     m_target_blockchain_height = target_blockchain_height;
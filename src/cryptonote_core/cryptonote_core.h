@@ -401,6 +401,13 @@ namespace cryptonote
       */
      void set_temp_consensus_validator(temp_consensus_validator* validator);
 
+     /**
+      * @brief set a listener for main chain and tx pool changes
+      *
+      * @param listener the listener, or an empty pointer to stop notifying
+      */
+     void set_event_listener(const std::shared_ptr<i_core_event_listener> &listener);
+
      /**
       * @copydoc Blockchain::set_checkpoints
       *
@@ -529,7 +536,14 @@ namespace cryptonote
       *
       * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<cryptonote::blobdata, std::vector<transaction> > >&, uint64_t&, uint64_t&, size_t) const
       */
-     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const;
+     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices = NULL) const;
+
+     /**
+      * @copydoc Blockchain::get_blocks_stream
+      *
+      * @note see Blockchain::get_blocks_stream
+      */
+     bool get_blocks_stream(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, bool get_miner_tx_indices, size_t max_count, std::string &stream) const;
 
      /**
       * @brief gets some stats about the daemon
@@ -547,6 +561,13 @@ namespace cryptonote
       */
      bool get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs) const;
 
+     /**
+      * @copydoc Blockchain::get_tx_outputs_gindexs(const crypto::hash&, size_t, std::vector<std::vector<uint64_t>>&) const
+      *
+      * @note see Blockchain::get_tx_outputs_gindexs(const crypto::hash&, size_t, std::vector<std::vector<uint64_t>>&) const
+      */
+     bool get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes, std::vector<std::vector<uint64_t>>& indexs) const;
+
      /**
       * @copydoc Blockchain::get_tail_id
       *
@@ -603,6 +624,20 @@ namespace cryptonote
       */
      const Blockchain& get_blockchain_storage()const{return m_blockchain_storage;}
 
+     /**
+      * @brief gets the tx pool instance
+      *
+      * @return a reference to the tx pool instance
+      */
+     tx_memory_pool& get_pool(){return m_mempool;}
+
+     /**
+      * @brief gets the tx pool instance (const)
+      *
+      * @return a const reference to the tx pool instance
+      */
+     const tx_memory_pool& get_pool()const{return m_mempool;}
+
      /**
       * @copydoc tx_memory_pool::print_pool
       *
@@ -780,6 +815,36 @@ namespace cryptonote
       */
      uint64_t get_free_space() const;
 
+     /**
+      * @brief get the blockchain pruning seed
+      *
+      * @return the pruning seed, or 0 if the blockchain is not pruned
+      */
+     uint32_t get_blockchain_pruning_seed() const;
+
+     /**
+      * @brief prune the blockchain
+      *
+      * @param pruning_seed the seed to use to prune the chain (0 for default, highly recommended)
+      *
+      * @return true iff success
+      */
+     bool prune_blockchain(uint32_t pruning_seed = 0);
+
+     /**
+      * @brief incrementally prunes blockchain
+      *
+      * @return true on success, false otherwise
+      */
+     bool update_blockchain_pruning();
+
+     /**
+      * @brief checks the blockchain pruning if enabled
+      *
+      * @return true on success, false otherwise
+      */
+     bool check_blockchain_pruning();
+
      /**
       * @brief get whether the core is running offline
       *
@@ -980,6 +1045,7 @@ namespace cryptonote
      epee::math_helper::once_a_time_seconds<60*2, false> m_txpool_auto_relayer; //!< interval for checking re-relaying txpool transactions
      epee::math_helper::once_a_time_seconds<60*60*12, true> m_check_updates_interval; //!< interval for checking for new versions
      epee::math_helper::once_a_time_seconds<60*10, true> m_check_disk_space_interval; //!< interval for checking for disk space
+     epee::math_helper::once_a_time_seconds<60*60*5, true> m_blockchain_pruning_interval; //!< interval for incremental blockchain pruning
 
      std::atomic<bool> m_starter_message_showed; //!< has the "daemon will sync now" message been shown?
 
@@ -42,6 +42,12 @@
 namespace cryptonote
 {
 
+namespace
+{
+  // How often a pre-assembled block is checked against the chain tip and tx pool
+  const std::chrono::milliseconds CANDIDATE_REFRESH_INTERVAL(250);
+}
+
 temp_consensus_leader_service::temp_consensus_leader_service(cryptonote_core& core, const config& cfg)
   : m_core(core)
   , m_config(cfg)
@@ -53,6 +59,13 @@ temp_consensus_leader_service::temp_consensus_leader_service(cryptonote_core& co
   MINFO("Leader ID: " << m_config.leader_id);
   MINFO("Slot duration: " << m_config.slot_duration_seconds << " seconds");
   MINFO("PoW enabled: " << (m_config.enable_pow ? "yes" : "no"));
+
+  if (m_config.preassemble_seconds >= m_config.slot_duration_seconds)
+  {
+    MWARNING("Pre-assembly of " << m_config.preassemble_seconds << " seconds does not fit in the slot, using " << m_config.slot_duration_seconds - 1);
+    m_config.preassemble_seconds = m_config.slot_duration_seconds - 1;
+  }
+  MINFO("Block pre-assembly: " << m_config.preassemble_seconds << " seconds before the slot");
 }
 
 temp_consensus_leader_service::~temp_consensus_leader_service()
@@ -84,7 +97,11 @@ void temp_consensus_leader_service::stop()
     return;
 
   MINFO("Stopping temporary leader service...");
-  m_stop_requested.store(true);
+  {
+    std::lock_guard<std::mutex> lock(m_wait_lock);
+    m_stop_requested.store(true);
+  }
+  m_wait_cv.notify_all();
   
   if (m_service_thread && m_service_thread->joinable())
   {
@@ -110,6 +127,12 @@ bool temp_consensus_leader_service::is_slot_boundary(uint64_t timestamp) const
   return (timestamp % m_config.slot_duration_seconds) == 0;
 }
 
+bool temp_consensus_leader_service::wait_until(const std::chrono::system_clock::time_point& time)
+{
+  std::unique_lock<std::mutex> lock(m_wait_lock);
+  return !m_wait_cv.wait_until(lock, time, [this]() { return m_stop_requested.load(); });
+}
+
 void temp_consensus_leader_service::service_loop()
 {
   MINFO("Leader service loop started");
@@ -123,47 +146,60 @@ void temp_consensus_leader_service::service_loop()
         std::chrono::system_clock::now().time_since_epoch()
       ).count();
       
-      // Calculate next slot
+      // Calculate next slot, skipping any we already generated
       uint64_t next_slot = next_slot_timestamp(now);
-      
-      // Check if we've already generated for this slot
       if (next_slot <= m_last_generated_slot)
+        next_slot = next_slot_timestamp(m_last_generated_slot + 1);
+
+      const std::chrono::system_clock::time_point slot_time{std::chrono::seconds(next_slot)};
+      const std::chrono::system_clock::time_point assemble_time = slot_time - std::chrono::seconds(m_config.preassemble_seconds);
+      MINFO("Next slot at " << next_slot << ", assembling block " << m_config.preassemble_seconds << " seconds ahead");
+
+      if (!wait_until(assemble_time))
+        break;
+
+      // Build and sign ahead of the slot, then keep the candidate current until the
+      // boundary so only a rebuild caused by a late chain or pool change is paid after it
+      bool success = false;
+      try
       {
-        // Wait a bit before checking again
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        continue;
-      }
-      
-      // Wait until slot time
-      if (now < next_slot)
-      {
-        uint64_t wait_seconds = next_slot - now;
-        MINFO("Next slot in " << wait_seconds << " seconds (slot time: " << next_slot << ")");
-        MINFO("=== DEBUG: Starting sleep loop, m_stop_requested=" << m_stop_requested.load());
-        
-        // Sleep in small increments to check stop flag
-        for (uint64_t i = 0; i < wait_seconds && !m_stop_requested.load(); ++i)
+        candidate_block candidate;
+        bool assembled = assemble_block(next_slot, candidate);
+        bool stopped = false;
+        for (;;)
         {
-          std::this_thread::sleep_for(std::chrono::seconds(1));
+          const std::chrono::system_clock::time_point now_time = std::chrono::system_clock::now();
+          if (now_time >= slot_time)
+            break;
+          if (!wait_until(std::min(slot_time, now_time + CANDIDATE_REFRESH_INTERVAL)))
+          {
+            stopped = true;
+            break;
+          }
+          if (std::chrono::system_clock::now() >= slot_time)
+            break;
+          if (!assembled || is_stale(candidate))
+          {
+            MINFO("Chain tip or tx pool changed, re-assembling block for slot " << next_slot);
+            assembled = assemble_block(next_slot, candidate);
+          }
         }
-        
-        MINFO("=== DEBUG: Sleep loop finished, m_stop_requested=" << m_stop_requested.load());
-        
-        if (m_stop_requested.load())
+        if (stopped)
           break;
-      }
-      
-      MINFO("=== DEBUG: About to generate block for slot " << next_slot);
-      // Generate block for this slot
-      MINFO("Generating block for slot timestamp: " << next_slot);
-      bool success = false;
-      try
-      {
-        success = generate_block(next_slot);
+
+        // At the boundary, check the candidate against the chain tip and pool it was built from
+        if (!assembled || is_stale(candidate))
+        {
+          MINFO("Chain tip or tx pool changed before the slot boundary, re-assembling block for slot " << next_slot);
+          assembled = assemble_block(next_slot, candidate);
+        }
+
+        MINFO("Submitting block for slot timestamp: " << next_slot);
+        success = assembled && submit_block(candidate);
       }
       catch (const std::exception& e)
       {
-        MERROR("Exception in generate_block(): " << e.what());
+        MERROR("Exception while generating block: " << e.what());
         success = false;
       }
       
@@ -171,29 +207,32 @@ void temp_consensus_leader_service::service_loop()
       {
         MINFO("Block generated successfully for slot " << next_slot);
         m_last_generated_slot = next_slot;
-        MINFO("=== Continuing to next iteration ===");
       }
       else
       {
         MWARNING("Failed to generate block for slot " << next_slot);
+        // Do not spin on a persistent failure while still inside the slot's second
+        if (!wait_until(std::chrono::system_clock::now() + std::chrono::seconds(1)))
+          break;
       }
-      
-      // Small delay before next iteration
-      MINFO("=== Sleeping 1 second before next loop iteration ===");
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      MINFO("=== Woke up, checking stop flag: m_stop_requested=" << m_stop_requested << " ===");
     }
     catch (const std::exception& e)
     {
       MERROR("Exception in leader service loop: " << e.what());
-      std::this_thread::sleep_for(std::chrono::seconds(5));
+      if (!wait_until(std::chrono::system_clock::now() + std::chrono::seconds(5)))
+        break;
     }
   }
   
   MINFO("Leader service loop stopped");
 }
 
-bool temp_consensus_leader_service::generate_block(uint64_t slot_timestamp)
+bool temp_consensus_leader_service::is_stale(const candidate_block& candidate) const
+{
+  return m_core.get_tail_id() != candidate.prev_id || m_core.get_pool().cookie() != candidate.pool_cookie;
+}
+
+bool temp_consensus_leader_service::assemble_block(uint64_t slot_timestamp, candidate_block& candidate)
 {
   // Phase 3 implementation: Full block generation with leader metadata
   
@@ -214,6 +253,9 @@ bool temp_consensus_leader_service::generate_block(uint64_t slot_timestamp)
   // Total: ~165 bytes, use 170 to be safe
   const size_t LEADER_INFO_RESERVED_SIZE = 170;
   
+  // Read before the template is built so a pool change during assembly marks the block stale
+  const uint64_t pool_cookie = m_core.get_pool().cookie();
+
   // Step 1: Get block template from core
   // We pass extra_nonce with reserved space for leader_info to ensure
   // correct weight calculation for block reward
@@ -278,25 +320,21 @@ bool temp_consensus_leader_service::generate_block(uint64_t slot_timestamp)
   MINFO("DEBUG: miner_tx.extra size after removing padding: " << extra_size_without_placeholder);
   MINFO("DEBUG: Removed " << (extra_size_with_placeholder - extra_size_without_placeholder) << " bytes total (nonce + padding)");
   
-  // Step 6: Serialize block to blob BEFORE signing (to ensure consistent state)
+  // Step 6: Calculate block hash for signing (WITHOUT leader metadata AND without placeholder)
+  // Hashed straight from the serialized block with the same routine the validator uses, so
+  // there is no need to reparse the blob, and stale cached tx hashes cannot leak in
   blobdata blockblob_unsigned = t_serializable_object_to_blob(bl);
   MINFO("DEBUG: Serialized unsigned block to blob, size: " << blockblob_unsigned.size() << " bytes");
-  
-  // Step 7: Parse block from blob to get consistent block representation
-  block bl_unsigned = AUTO_VAL_INIT(bl_unsigned);
-  if (!parse_and_validate_block_from_blob(blockblob_unsigned, bl_unsigned))
+
+  crypto::hash block_hash;
+  if (!get_block_hash_without_leader_info(blockblob_unsigned, block_hash))
   {
-    MERROR("Failed to parse unsigned block from blob");
+    MERROR("Failed to calculate block hash for signing");
     return false;
   }
-  MINFO("DEBUG: Unsigned block parsed from blob");
-  
-  // Step 8: Calculate block hash for signing (WITHOUT leader metadata AND without placeholder)
-  // This hash will match what the verifier calculates after removing leader_info
-  crypto::hash block_hash = get_block_hash(bl_unsigned);
   MINFO("Block hash (without leader metadata): " << block_hash);
   
-  // Step 9: Sign block hash with Ed25519 secret key using libsodium
+  // Step 7: Sign block hash with Ed25519 secret key using libsodium
   // DPoS keys are in libsodium format, so we must use libsodium for signing
   unsigned char sig_bytes[64];
   unsigned long long sig_len = 64;
@@ -318,31 +356,31 @@ bool temp_consensus_leader_service::generate_block(uint64_t slot_timestamp)
   MINFO("Generated signature: " << epee::string_tools::pod_to_hex(sig));
   MINFO("Block signed with Ed25519 key (libsodium)");
   
-  // Step 10: Add leader metadata to block
+  // Step 8: Add leader metadata to block
   // Padding and nonce were already removed in Step 5, so extra should only contain pubkey
-  size_t extra_size_before = bl_unsigned.miner_tx.extra.size();
+  size_t extra_size_before = bl.miner_tx.extra.size();
   MINFO("DEBUG: miner_tx.extra size BEFORE adding leader metadata: " << extra_size_before);
   
-  if (!add_leader_info_to_tx_extra(bl_unsigned.miner_tx.extra, m_config.leader_id, sig))
+  if (!add_leader_info_to_tx_extra(bl.miner_tx.extra, m_config.leader_id, sig))
   {
     MERROR("Failed to add leader metadata to miner tx extra");
     return false;
   }
   
-  size_t extra_size_after = bl_unsigned.miner_tx.extra.size();
+  size_t extra_size_after = bl.miner_tx.extra.size();
   MINFO("DEBUG: miner_tx.extra size AFTER adding leader metadata: " << extra_size_after);
   MINFO("DEBUG: Added " << (extra_size_after - extra_size_before) << " bytes of leader metadata");
   
-  // Step 11: Invalidate cached block hash (critical - hash changed!)
-  MINFO("DEBUG: About to call bl_unsigned.invalidate_hashes()");
-  bl_unsigned.invalidate_hashes();
-  MINFO("DEBUG: After bl_unsigned.invalidate_hashes() - hash_valid should be false now");
+  // Step 9: Invalidate cached block hash (critical - hash changed!)
+  MINFO("DEBUG: About to call bl.invalidate_hashes()");
+  bl.invalidate_hashes();
+  MINFO("DEBUG: After bl.invalidate_hashes() - hash_valid should be false now");
   
-  // Step 13: Serialize final block to blob (with leader metadata)
-  blobdata blockblob = t_serializable_object_to_blob(bl_unsigned);
+  // Step 10: Serialize final block to blob (with leader metadata)
+  blobdata blockblob = t_serializable_object_to_blob(bl);
   MINFO("DEBUG: Serialized final block to blob, size: " << blockblob.size() << " bytes");
   
-  // Step 12: Parse block from blob (recreate block object like RPC does)
+  // Step 11: Parse block from blob (recreate block object like RPC does)
   block b_parsed = AUTO_VAL_INIT(b_parsed);
   if (!parse_and_validate_block_from_blob(blockblob, b_parsed))
   {
@@ -373,7 +411,7 @@ bool temp_consensus_leader_service::generate_block(uint64_t slot_timestamp)
     MINFO("DEBUG: leader_info FOUND in b_parsed, leader_id = " << test_leader_id);
   }
   
-  // Step 13: Check block size (like RPC submitblock does)
+  // Step 12: Check block size (like RPC submitblock does)
   if (!m_core.check_incoming_block_size(blockblob))
   {
     MERROR("Block size too big, rejecting block");
@@ -381,12 +419,24 @@ bool temp_consensus_leader_service::generate_block(uint64_t slot_timestamp)
   }
   MINFO("DEBUG: Block size check passed");
   
-  // Step 14: Submit block to core using proper batch handling (same as RPC submitblock)
+  candidate.bl = b_parsed;
+  candidate.hash = block_hash;
+  candidate.height = height;
+  candidate.slot_timestamp = slot_timestamp;
+  candidate.prev_id = b_parsed.prev_id;
+  candidate.pool_cookie = pool_cookie;
+  return true;
+}
+
+bool temp_consensus_leader_service::submit_block(const candidate_block& candidate)
+{
+  // Step 13: Submit block to core using proper batch handling (same as RPC submitblock)
   MINFO("=== About to call handle_block_found() ===");
   
   bool result = false;
   try {
-    result = m_core.handle_block_found(b_parsed);
+    block b = candidate.bl;
+    result = m_core.handle_block_found(b);
   } catch (const std::exception& e) {
     MERROR("EXCEPTION in handle_block_found(): " << e.what());
     return false;
@@ -404,9 +454,9 @@ bool temp_consensus_leader_service::generate_block(uint64_t slot_timestamp)
   }
   
   MINFO("✓ Block generated and submitted successfully");
-  MINFO("  Height: " << height);
-  MINFO("  Hash: " << block_hash);
-  MINFO("  Timestamp: " << slot_timestamp);
+  MINFO("  Height: " << candidate.height);
+  MINFO("  Hash: " << candidate.hash);
+  MINFO("  Timestamp: " << candidate.slot_timestamp);
   
   return true;
 }
@@ -31,6 +31,9 @@
 #include <atomic>
 #include <thread>
 #include <memory>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
 #include "cryptonote_basic/cryptonote_basic.h"
 
 namespace cryptonote
@@ -66,10 +69,12 @@ namespace cryptonote
       account_public_address miner_address;     // Address to receive block rewards
       bool enable_pow;                          // Whether to perform PoW (default: false)
       uint64_t slot_duration_seconds;           // Time slot duration (30 seconds for testing)
+      uint64_t preassemble_seconds;             // Build and sign the block this long before the slot (0: at the slot)
       
       config() 
         : enable_pow(false)
         , slot_duration_seconds(30)  // 30 seconds for testing (was 300)
+        , preassemble_seconds(5)
       {}
     };
 
@@ -116,17 +121,48 @@ namespace cryptonote
     bool is_slot_boundary(uint64_t timestamp) const;
 
   private:
+    /**
+     * @brief A signed block waiting for its slot, with the chain and pool state it was built on
+     */
+    struct candidate_block
+    {
+      block bl;
+      crypto::hash hash;
+      uint64_t height;
+      uint64_t slot_timestamp;
+      crypto::hash prev_id;
+      uint64_t pool_cookie;
+    };
+
     /**
      * @brief Main service loop (runs in separate thread)
      */
     void service_loop();
 
     /**
-     * @brief Generate and submit a block for the current slot
+     * @brief Build and sign the block for a slot without submitting it
      * @param slot_timestamp The slot timestamp for this block
-     * @return true if block was generated and submitted successfully
+     * @param candidate Receives the signed block
+     * @return true if the block was built and signed
+     */
+    bool assemble_block(uint64_t slot_timestamp, candidate_block& candidate);
+
+    /**
+     * @brief Check whether the chain tip or the tx pool changed since the candidate was built
+     */
+    bool is_stale(const candidate_block& candidate) const;
+
+    /**
+     * @brief Submit a signed block to core
+     * @return true if core accepted the block
+     */
+    bool submit_block(const candidate_block& candidate);
+
+    /**
+     * @brief Sleep until the given time, waking early if the service is stopped
+     * @return false if the service was stopped
      */
-    bool generate_block(uint64_t slot_timestamp);
+    bool wait_until(const std::chrono::system_clock::time_point& time);
 
     /**
      * @brief Generate deterministic nonce for block (when PoW disabled)
@@ -142,6 +178,8 @@ namespace cryptonote
     std::atomic<bool> m_running;
     std::atomic<bool> m_stop_requested;
     std::unique_ptr<std::thread> m_service_thread;
+    std::mutex m_wait_lock;
+    std::condition_variable m_wait_cv;
     
     uint64_t m_last_generated_slot;  // Track last slot we generated to avoid duplicates
   };
@@ -30,6 +30,9 @@
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_config.h"  // For NETWORK_DATA_NODE_PUBLIC_ADDRESS_*
 #include "string_tools.h"  // For parse_hexstr_to_binbuff, pod_to_hex
+#include "common/threadpool.h"
+#include "profile_tools.h"
+#include <boost/bind.hpp>
 #include <sodium.h>
 
 #undef XCASH_DEFAULT_LOG_CATEGORY
@@ -38,64 +41,90 @@
 namespace cryptonote
 {
 
-temp_consensus_validator::temp_consensus_validator(const config& cfg)
-  : m_config(cfg)
-  , m_enabled(false)
-{
-  MINFO("Temporary consensus validator initialized");
-  MINFO("Expected leader ID: " << m_config.expected_leader_id);
-}
-
-bool temp_consensus_validator::validate_leader_block(const block& bl, uint64_t height)
+namespace
 {
-  if (!m_enabled)
-  {
-    MWARNING("Validator called but not enabled");
-    return false;
-  }
+  const size_t VERIFIED_BLOCKS_CACHE_SIZE = 10000;
 
-  // Special case: allow genesis block (height 0)
-  if (height == 0)
+  void verify_leader_signatures_worker(const std::vector<block>& blocks, const std::vector<crypto::public_key>& leader_pubkeys, std::vector<uint8_t>& valid, size_t start, size_t end)
   {
-    MINFO("=== Genesis block (height 0) - ALLOWED ===");
-    return true;
+    for (size_t i = start; i < end; ++i)
+      valid[i] = verify_leader_signature(blocks[i], leader_pubkeys[i]) ? 1 : 0;
   }
+}
 
-  // Check if block is below temporary consensus activation height
-  if (height < TEMPORARY_CONSENSUS_ACTIVATION_HEIGHT)
+bool get_leader_signed_block_hash(const block& bl, crypto::hash& hash)
+{
+  if (!get_block_hash_without_leader_info(bl, hash))
   {
-    MINFO("Block height " << height << " is below activation height " << TEMPORARY_CONSENSUS_ACTIVATION_HEIGHT << " - ALLOWED");
-    return true;
+    MERROR("Failed to hash block without leader metadata for signature verification");
+    return false;
   }
+  return true;
+}
 
-  // Phase 3: Full validation implementation
-  MINFO("=== Validating leader block (Phase 3) ===");
-  MINFO("Block height: " << height);
-  MINFO("DEBUG validator: miner_tx.extra size = " << bl.miner_tx.extra.size());
-  
-  // Step 1: Extract leader metadata from miner_tx.extra
+bool verify_leader_signature(const block& bl, const crypto::public_key& leader_pubkey)
+{
   std::string leader_id;
   crypto::signature sig;
-  
   if (!cryptonote::get_leader_info_from_tx_extra(bl.miner_tx.extra, leader_id, sig))
+    return false;
+
+  crypto::hash block_hash_without_metadata;
+  if (!get_leader_signed_block_hash(bl, block_hash_without_metadata))
+    return false;
+
+  // DPoS keys are in libsodium format
+  const unsigned char* sig_bytes = reinterpret_cast<const unsigned char*>(&sig);
+  const unsigned char* hash_bytes = reinterpret_cast<const unsigned char*>(&block_hash_without_metadata);
+  const unsigned char* pubkey_bytes = reinterpret_cast<const unsigned char*>(&leader_pubkey);
+
+  if (crypto_sign_verify_detached(sig_bytes, hash_bytes, 32, pubkey_bytes) != 0)
   {
-    // No leader metadata after activation height - REJECT
-    MERROR("REJECT: No leader metadata found for block at height " << height << " (after activation)");
-    // Dump first 50 bytes of extra for debugging
-    std::string extra_hex;
-    for (size_t i = 0; i < std::min<size_t>(50, bl.miner_tx.extra.size()); i++)
-    {
-      char buf[4];
-      snprintf(buf, sizeof(buf), "%02x", bl.miner_tx.extra[i]);
-      extra_hex += buf;
-    }
-    MERROR("DEBUG: First 50 bytes of extra: " << extra_hex);
+    MERROR("Invalid signature (libsodium verification failed)");
+    MERROR("  Block hash (no metadata): " << block_hash_without_metadata);
+    MERROR("  Signature: " << epee::string_tools::pod_to_hex(sig));
+    MERROR("  Leader pubkey: " << epee::string_tools::pod_to_hex(leader_pubkey));
     return false;
   }
-  
-  MINFO("Extracted leader_id: " << leader_id);
-  
-  // Step 2: Security check - verify leader_id is one of the authorized seed nodes (first 4 only)
+  return true;
+}
+
+void verify_leader_signatures(const std::vector<block>& blocks, const std::vector<crypto::public_key>& leader_pubkeys, std::vector<uint8_t>& valid)
+{
+  CHECK_AND_ASSERT_THROW_MES(blocks.size() == leader_pubkeys.size(), "Mismatched blocks and leader pubkeys");
+  valid.assign(blocks.size(), 0);
+  if (blocks.empty())
+    return;
+
+  // libsodium has no batch Ed25519 verification, so split the work in
+  // contiguous ranges, one per thread
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), blocks.size()));
+  const size_t per_thread = blocks.size() / threads;
+  const size_t extra = blocks.size() % threads;
+
+  tools::threadpool::waiter waiter;
+  size_t start = 0;
+  for (size_t i = 0; i < threads; ++i)
+  {
+    const size_t end = start + per_thread + (i < extra ? 1 : 0);
+    tpool.submit(&waiter, boost::bind(&verify_leader_signatures_worker, std::cref(blocks), std::cref(leader_pubkeys), std::ref(valid), start, end), true, tools::threadpool::PRIORITY_HIGH);
+    start = end;
+  }
+  waiter.wait(&tpool);
+}
+
+temp_consensus_validator::temp_consensus_validator(const config& cfg)
+  : m_config(cfg)
+  , m_enabled(false)
+{
+  MINFO("Temporary consensus validator initialized");
+  MINFO("Expected leader ID: " << m_config.expected_leader_id);
+}
+
+bool temp_consensus_validator::get_authorized_leader_pubkey(const std::string& leader_id, crypto::public_key& pubkey) const
+{
+  // Security check - verify leader_id is one of the authorized seed nodes (first 4 only)
   const std::string authorized_seeds[4] = {
     NETWORK_DATA_NODE_PUBLIC_ADDRESS_1,
     NETWORK_DATA_NODE_PUBLIC_ADDRESS_2,
@@ -110,20 +139,17 @@ bool temp_consensus_validator::validate_leader_block(const block& bl, uint64_t h
     NETWORK_DATA_NODE_ED25519_PUBKEY_4
   };
   
-  bool is_authorized = false;
   int leader_index = -1;
   for (size_t i = 0; i < 4; i++)
   {
     if (leader_id == authorized_seeds[i])
     {
-      is_authorized = true;
       leader_index = i;
-      MINFO("✓ Leader is authorized seed node #" << (i+1));
       break;
     }
   }
   
-  if (!is_authorized)
+  if (leader_index < 0)
   {
     MERROR("REJECT: Leader ID is NOT one of the authorized seed nodes!");
     MERROR("Block signed by unauthorized address: " << leader_id);
@@ -138,7 +164,6 @@ bool temp_consensus_validator::validate_leader_block(const block& bl, uint64_t h
     return false;
   }
   
-  crypto::public_key leader_pubkey;
   std::string pubkey_binary;
   if (!epee::string_tools::parse_hexstr_to_binbuff(expected_pubkey_hex, pubkey_binary) || 
       pubkey_binary.size() != 32)
@@ -146,55 +171,141 @@ bool temp_consensus_validator::validate_leader_block(const block& bl, uint64_t h
     MERROR("REJECT: Invalid Ed25519 pubkey hex for seed node #" << (leader_index+1));
     return false;
   }
-  memcpy(&leader_pubkey, pubkey_binary.data(), 32);
+  memcpy(&pubkey, pubkey_binary.data(), 32);
   
-  MINFO("Using Ed25519 pubkey for seed #" << (leader_index+1) << ": " << expected_pubkey_hex);
-  MINFO("✓ Leader ID verified as authorized seed node");
-  
-  // Step 3: Calculate block hash WITHOUT leader metadata (same as leader signed)
-  // Make a copy of miner_tx.extra without leader metadata
-  std::vector<uint8_t> extra_without_leader = bl.miner_tx.extra;
-  MINFO("DEBUG validator: extra size BEFORE removing leader_info: " << extra_without_leader.size());
-  
-  if (!cryptonote::remove_leader_info_from_tx_extra(extra_without_leader))
+  MDEBUG("Leader is authorized seed node #" << (leader_index+1) << ", pubkey " << expected_pubkey_hex);
+  return true;
+}
+
+bool temp_consensus_validator::get_verified_block(const crypto::hash& id, bool& valid)
+{
+  std::lock_guard<std::mutex> lock(m_verified_blocks_lock);
+  auto it = m_verified_blocks.find(id);
+  if (it == m_verified_blocks.end())
+    return false;
+  valid = it->second;
+  m_verified_blocks.erase(it);
+  return true;
+}
+
+void temp_consensus_validator::prevalidate_leader_blocks(const std::vector<block>& blocks)
+{
+  if (!m_enabled)
+    return;
+
+  std::vector<block> to_verify;
+  std::vector<crypto::public_key> leader_pubkeys;
+  std::vector<crypto::hash> ids;
+  std::vector<crypto::hash> rejected;
+  to_verify.reserve(blocks.size());
+  leader_pubkeys.reserve(blocks.size());
+  ids.reserve(blocks.size());
+
+  for (const auto& bl : blocks)
   {
-    MERROR("REJECT: Failed to remove leader metadata for signature verification");
+    if (get_block_height(bl) < TEMPORARY_CONSENSUS_ACTIVATION_HEIGHT)
+      continue;
+
+    std::string leader_id;
+    crypto::signature sig;
+    crypto::public_key leader_pubkey;
+    if (!cryptonote::get_leader_info_from_tx_extra(bl.miner_tx.extra, leader_id, sig) ||
+        !get_authorized_leader_pubkey(leader_id, leader_pubkey))
+    {
+      rejected.push_back(get_block_hash(bl));
+      continue;
+    }
+
+    to_verify.push_back(bl);
+    leader_pubkeys.push_back(leader_pubkey);
+    ids.push_back(get_block_hash(bl));
+  }
+
+  TIME_MEASURE_START(t);
+  std::vector<uint8_t> valid;
+  verify_leader_signatures(to_verify, leader_pubkeys, valid);
+  TIME_MEASURE_FINISH(t);
+
+  std::lock_guard<std::mutex> lock(m_verified_blocks_lock);
+  if (m_verified_blocks.size() + ids.size() + rejected.size() > VERIFIED_BLOCKS_CACHE_SIZE)
+    m_verified_blocks.clear();
+  for (size_t i = 0; i < ids.size(); ++i)
+    m_verified_blocks[ids[i]] = valid[i] != 0;
+  for (const auto& id : rejected)
+    m_verified_blocks[id] = false;
+
+  if (!to_verify.empty())
+    MDEBUG("Verified " << to_verify.size() << " leader signatures in " << t << " ms");
+}
+
+bool temp_consensus_validator::validate_leader_block(const block& bl, uint64_t height)
+{
+  if (!m_enabled)
+  {
+    MWARNING("Validator called but not enabled");
     return false;
   }
+
+  // Special case: allow genesis block (height 0)
+  if (height == 0)
+  {
+    MINFO("=== Genesis block (height 0) - ALLOWED ===");
+    return true;
+  }
+
+  // Check if block is below temporary consensus activation height
+  if (height < TEMPORARY_CONSENSUS_ACTIVATION_HEIGHT)
+  {
+    MINFO("Block height " << height << " is below activation height " << TEMPORARY_CONSENSUS_ACTIVATION_HEIGHT << " - ALLOWED");
+    return true;
+  }
+
+  // Blocks received in a batch were already checked by prevalidate_leader_blocks
+  bool valid;
+  if (get_verified_block(get_block_hash(bl), valid))
+  {
+    MDEBUG("Using prevalidated leader signature verdict for height " << height << ": " << (valid ? "ACCEPTED" : "REJECTED"));
+    return valid;
+  }
+
+  // Phase 3: Full validation implementation
+  MINFO("=== Validating leader block (Phase 3) ===");
+  MINFO("Block height: " << height);
+  MINFO("DEBUG validator: miner_tx.extra size = " << bl.miner_tx.extra.size());
   
-  MINFO("DEBUG validator: extra size AFTER removing leader_info: " << extra_without_leader.size());
-  
-  // Create temporary block with original extra (without leader metadata)
-  // Use serialize/deserialize approach to ensure consistent representation
-  block temp_bl = bl;
-  temp_bl.miner_tx.extra = extra_without_leader;
+  // Step 1: Extract leader metadata from miner_tx.extra
+  std::string leader_id;
+  crypto::signature sig;
   
-  // Serialize and reparse to get consistent block state
-  blobdata temp_blob = t_serializable_object_to_blob(temp_bl);
-  block temp_bl_parsed = AUTO_VAL_INIT(temp_bl_parsed);
-  if (!parse_and_validate_block_from_blob(temp_blob, temp_bl_parsed))
+  if (!cryptonote::get_leader_info_from_tx_extra(bl.miner_tx.extra, leader_id, sig))
   {
-    MERROR("REJECT: Failed to parse temp block for verification");
+    // No leader metadata after activation height - REJECT
+    MERROR("REJECT: No leader metadata found for block at height " << height << " (after activation)");
+    // Dump first 50 bytes of extra for debugging
+    std::string extra_hex;
+    for (size_t i = 0; i < std::min<size_t>(50, bl.miner_tx.extra.size()); i++)
+    {
+      char buf[4];
+      snprintf(buf, sizeof(buf), "%02x", bl.miner_tx.extra[i]);
+      extra_hex += buf;
+    }
+    MERROR("DEBUG: First 50 bytes of extra: " << extra_hex);
     return false;
   }
   
-  crypto::hash block_hash_without_metadata = get_block_hash(temp_bl_parsed);
-  
-  MINFO("Block hash (without metadata): " << block_hash_without_metadata);
-  MINFO("Signature to verify: " << epee::string_tools::pod_to_hex(sig));
-  MINFO("Using pubkey: " << epee::string_tools::pod_to_hex(leader_pubkey));
+  MINFO("Extracted leader_id: " << leader_id);
   
-  // Step 4: Verify signature using libsodium (DPoS keys are in libsodium format)
-  unsigned char* sig_bytes = reinterpret_cast<unsigned char*>(&sig);
-  unsigned char* hash_bytes = reinterpret_cast<unsigned char*>(&block_hash_without_metadata);
-  unsigned char* pubkey_bytes = reinterpret_cast<unsigned char*>(&leader_pubkey);
+  // Step 2: Security check - verify leader_id is one of the authorized seed nodes
+  crypto::public_key leader_pubkey;
+  if (!get_authorized_leader_pubkey(leader_id, leader_pubkey))
+    return false;
+
+  MINFO("✓ Leader ID verified as authorized seed node");
   
-  if (crypto_sign_verify_detached(sig_bytes, hash_bytes, 32, pubkey_bytes) != 0)
+  // Step 3: Verify signature over the block hash WITHOUT leader metadata (same as leader signed)
+  if (!verify_leader_signature(bl, leader_pubkey))
   {
-    MERROR("REJECT: Invalid signature (libsodium verification failed)");
-    MERROR("  Block hash (no metadata): " << block_hash_without_metadata);
-    MERROR("  Signature: " << epee::string_tools::pod_to_hex(sig));
-    MERROR("  Leader pubkey: " << epee::string_tools::pod_to_hex(leader_pubkey));
+    MERROR("REJECT: Invalid leader signature for block at height " << height);
     return false;
   }
   
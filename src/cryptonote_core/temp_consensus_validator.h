@@ -28,11 +28,39 @@
 
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "crypto/crypto.h"
 
 namespace cryptonote
 {
+  /**
+   * @brief Compute the hash signed by the leader (block hash without leader metadata)
+   * @param bl Block carrying leader metadata
+   * @param hash Set to the signed hash
+   * @return true on success
+   */
+  bool get_leader_signed_block_hash(const block& bl, crypto::hash& hash);
+
+  /**
+   * @brief Verify the Ed25519 leader signature of a block
+   * @param bl Block carrying leader metadata
+   * @param leader_pubkey Ed25519 public key of the leader (libsodium format)
+   * @return true if the signature is valid
+   */
+  bool verify_leader_signature(const block& bl, const crypto::public_key& leader_pubkey);
+
+  /**
+   * @brief Verify the leader signatures of many blocks in parallel on tools::threadpool
+   * @param blocks Blocks carrying leader metadata
+   * @param leader_pubkeys Ed25519 public key of the leader of each block
+   * @param valid Set to 1 for each block with a valid signature, 0 otherwise
+   */
+  void verify_leader_signatures(const std::vector<block>& blocks, const std::vector<crypto::public_key>& leader_pubkeys, std::vector<uint8_t>& valid);
+
   /**
    * @brief Temporary consensus validator (Phase 2 stub)
    * 
@@ -77,6 +105,17 @@ namespace cryptonote
      */
     bool validate_leader_block(const block& bl, uint64_t height);
 
+    /**
+     * @brief Verify the leader signatures of a batch of incoming blocks ahead of time
+     *
+     * Signatures are checked in parallel and the verdicts are memoized by block
+     * hash, so validate_leader_block only does a lookup for these blocks.
+     * Must not be called with the blockchain lock held.
+     *
+     * @param blocks Incoming blocks
+     */
+    void prevalidate_leader_blocks(const std::vector<block>& blocks);
+
     /**
      * @brief Check if temporary consensus is enabled for this validator
      * @return true if enabled
@@ -89,8 +128,19 @@ namespace cryptonote
     void set_enabled(bool enabled) { m_enabled = enabled; }
 
   private:
+    /**
+     * @brief Look up the Ed25519 pubkey of an authorized seed node
+     * @return false if leader_id is not an authorized seed node
+     */
+    bool get_authorized_leader_pubkey(const std::string& leader_id, crypto::public_key& pubkey) const;
+
+    bool get_verified_block(const crypto::hash& id, bool& valid);
+
     config m_config;
     bool m_enabled;
+
+    std::mutex m_verified_blocks_lock;
+    std::unordered_map<crypto::hash, bool> m_verified_blocks;
   };
 
 } // namespace cryptonote
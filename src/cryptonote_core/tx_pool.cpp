@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <algorithm>
+#include <limits>
 #include <boost/filesystem.hpp>
 #include <unordered_set>
 #include <vector>
@@ -44,6 +45,7 @@
 #include "misc_language.h"
 #include "warnings.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "crypto/hash.h"
 
 #undef XCASH_DEFAULT_LOG_CATEGORY
@@ -102,9 +104,22 @@ namespace cryptonote
     };
   }
   //---------------------------------------------------------------------------------
+  const char *txpool_remove_reason_to_string(txpool_remove_reason reason)
+  {
+    switch (reason)
+    {
+      case txpool_remove_reason::mined: return "mined";
+      case txpool_remove_reason::pruned: return "pruned";
+      case txpool_remove_reason::expired: return "expired";
+      case txpool_remove_reason::invalid: return "invalid";
+      case txpool_remove_reason::flushed: return "flushed";
+    }
+    return "unknown";
+  }
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0), m_input_cache_generation(0)
   {
+    m_template.valid = false;
 
   }
   //---------------------------------------------------------------------------------
@@ -247,9 +262,11 @@ namespace cryptonote
           CRITICAL_REGION_LOCAL1(m_blockchain);
           LockedTXN lock(m_blockchain);
           m_blockchain.add_txpool_tx(tx, meta);
+          index_tx(id, tx, meta);
           if (!insert_key_images(tx, kept_by_block))
             return false;
           m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+          add_tx_to_template(id);
         }
         catch (const std::exception &e)
         {
@@ -289,9 +306,11 @@ namespace cryptonote
         LockedTXN lock(m_blockchain);
         m_blockchain.remove_txpool_tx(get_transaction_hash(tx));
         m_blockchain.add_txpool_tx(tx, meta);
+        index_tx(id, tx, meta);
         if (!insert_key_images(tx, kept_by_block))
           return false;
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+        add_tx_to_template(id);
       }
       catch (const std::exception &e)
       {
@@ -311,6 +330,10 @@ namespace cryptonote
 
     MINFO("Transaction added to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)tx_weight));
 
+    std::shared_ptr<i_core_event_listener> event_listener = std::atomic_load(&m_event_listener);
+    if (event_listener)
+      event_listener->on_txpool_add(id, tx, tx_weight, fee);
+
     prune(m_txpool_max_weight);
 
     return true;
@@ -325,6 +348,58 @@ namespace cryptonote
     return add_tx(tx, h, get_transaction_weight(tx, blob_size), tvc, keeped_by_block, relayed, do_not_relay, version);
   }
   //---------------------------------------------------------------------------------
+  size_t tx_memory_pool::prevalidate_tx_inputs(const std::vector<std::pair<transaction*, crypto::hash>> &txs)
+  {
+    PERF_TIMER(prevalidate_tx_inputs);
+    uint64_t generation;
+    {
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      generation = m_input_cache_generation;
+    }
+
+    struct input_check { bool res; tx_verification_context tvc; uint64_t max_used_block_height; crypto::hash max_used_block_id; };
+    std::vector<input_check> checks(txs.size());
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      input_check &check = checks[n];
+      // add_tx caches its results with the failure flag already set
+      check.tvc = boost::value_initialized<tx_verification_context>();
+      check.tvc.m_verifivation_failed = true;
+      check.max_used_block_height = 0;
+      check.max_used_block_id = null_hash;
+      check.res = m_blockchain.check_tx_inputs(*txs[n].first, check.max_used_block_height, check.max_used_block_id, check.tvc, false, false);
+    }
+
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      if (!checks[n].res || txs[n].first->version < 2)
+        continue;
+      tpool.submit(&waiter, [&, n] {
+        checks[n].res = Blockchain::check_tx_rct_signatures(*txs[n].first);
+      }, false, tools::threadpool::PRIORITY_LOW);
+    }
+    waiter.wait(&tpool);
+
+    size_t n_valid = 0;
+    for (const input_check &check: checks)
+      n_valid += check.res;
+
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (generation != m_input_cache_generation)
+    {
+      MDEBUG("Chain changed while checking inputs, discarding results");
+      return n_valid;
+    }
+    for (size_t n = 0; n < txs.size(); ++n)
+    {
+      const input_check &check = checks[n];
+      m_input_cache.insert(std::make_pair(txs[n].second, std::make_tuple(check.res, check.tvc, check.max_used_block_height, check.max_used_block_id)));
+    }
+    return n_valid;
+  }
+  //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_txpool_weight() const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -377,9 +452,11 @@ namespace cryptonote
         // remove first, in case this throws, so key images aren't removed
         MINFO("Pruning tx " << txid << " from txpool: weight: " << it->first.second << ", fee/byte: " << it->first.first);
         m_blockchain.remove_txpool_tx(txid);
+        unindex_tx(txid);
         m_txpool_weight -= it->first.second;
         remove_transaction_keyimages(tx);
         MINFO("Pruned tx " << txid << " from txpool: weight: " << it->first.second << ", fee/byte: " << it->first.first);
+        notify_tx_removed(txid, txpool_remove_reason::pruned);
         m_txs_by_fee_and_receive_time.erase(it--);
         changed = true;
       }
@@ -447,7 +524,7 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::take_tx(const crypto::hash &id, transaction &tx, size_t& tx_weight, uint64_t& fee, bool &relayed, bool &do_not_relay, bool &double_spend_seen)
+  bool tx_memory_pool::take_tx(const crypto::hash &id, transaction &tx, size_t& tx_weight, uint64_t& fee, bool &relayed, bool &do_not_relay, bool &double_spend_seen, boost::optional<txpool_remove_reason> reason)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
@@ -459,18 +536,14 @@ namespace cryptonote
     try
     {
       LockedTXN lock(m_blockchain);
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(id, meta))
+      const auto i = m_pool_index.find(id);
+      if (i == m_pool_index.end())
       {
         MERROR("Failed to find tx in txpool");
         return false;
       }
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(id);
-      if (!parse_and_validate_tx_from_blob(txblob, tx))
-      {
-        MERROR("Failed to parse tx from txpool");
-        return false;
-      }
+      const txpool_tx_meta_t meta = i->second.meta;
+      tx = i->second.tx;
       tx_weight = meta.weight;
       fee = meta.fee;
       relayed = meta.relayed;
@@ -479,6 +552,7 @@ namespace cryptonote
 
       // remove first, in case this throws, so key images aren't removed
       m_blockchain.remove_txpool_tx(id);
+      unindex_tx(id);
       m_txpool_weight -= tx_weight;
       remove_transaction_keyimages(tx);
     }
@@ -490,6 +564,8 @@ namespace cryptonote
 
     m_txs_by_fee_and_receive_time.erase(sorted_it);
     ++m_cookie;
+    if (reason)
+      notify_tx_removed(id, *reason);
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -553,8 +629,10 @@ namespace cryptonote
           {
             // remove first, so we only remove key images if the tx removal succeeds
             m_blockchain.remove_txpool_tx(txid);
+            unindex_tx(txid);
             m_txpool_weight -= get_transaction_weight(tx, bd.size());
             remove_transaction_keyimages(tx);
+            notify_tx_removed(txid, txpool_remove_reason::expired);
           }
         }
         catch (const std::exception &e)
@@ -612,12 +690,13 @@ namespace cryptonote
     {
       try
       {
-        txpool_tx_meta_t meta;
-        if (m_blockchain.get_txpool_tx_meta(it->first, meta))
+        const auto i = m_pool_index.find(it->first);
+        if (i != m_pool_index.end())
         {
+          txpool_tx_meta_t meta = i->second.meta;
           meta.relayed = true;
           meta.last_relayed_time = now;
-          m_blockchain.update_txpool_tx(it->first, meta);
+          update_tx_meta(it->first, meta);
         }
       }
       catch (const std::exception &e)
@@ -907,14 +986,18 @@ namespace cryptonote
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    // also invalidates the readiness cached in m_pool_index, and the template selection
     m_input_cache.clear();
+    ++m_input_cache_generation;
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    // also invalidates the readiness cached in m_pool_index, and the template selection
     m_input_cache.clear();
+    ++m_input_cache_generation;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -973,26 +1056,26 @@ namespace cryptonote
     return ret;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction &tx) const
+  void tx_memory_pool::index_tx(const crypto::hash &txid, const transaction &tx, const txpool_tx_meta_t &meta)
+  {
+    pool_tx_entry &entry = m_pool_index[txid];
+    entry.meta = meta;
+    entry.tx = tx;
+    entry.ready_generation = std::numeric_limits<uint64_t>::max();
+    entry.ready = false;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::update_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+  {
+    // db first, so the index never holds a meta the db does not
+    m_blockchain.update_txpool_tx(txid, meta);
+    const auto i = m_pool_index.find(txid);
+    if (i != m_pool_index.end())
+      i->second.meta = meta;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, transaction &tx) const
   {
-    struct transction_parser
-    {
-      transction_parser(const cryptonote::blobdata &txblob, transaction &tx): txblob(txblob), tx(tx), parsed(false) {}
-      cryptonote::transaction &operator()()
-      {
-        if (!parsed)
-        {
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
-            throw std::runtime_error("failed to parse transaction blob");
-          parsed = true;
-        }
-        return tx;
-      }
-      const cryptonote::blobdata &txblob;
-      transaction &tx;
-      bool parsed;
-    } lazy_tx(txblob, tx);
-
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
     if(txd.max_used_block_id == null_hash)
@@ -1002,7 +1085,7 @@ namespace cryptonote
         return false;//we already sure that this tx is broken for this height
 
       tx_verification_context tvc;
-      if(!check_tx_inputs([&lazy_tx]()->cryptonote::transaction&{ return lazy_tx(); }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
+      if(!check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
       {
         txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
         txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
@@ -1019,7 +1102,7 @@ namespace cryptonote
           return false;
         //check ring signature again, it is possible (with very small chance) that this transaction become again valid
         tx_verification_context tvc;
-        if(!check_tx_inputs([&lazy_tx]()->cryptonote::transaction&{ return lazy_tx(); }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
+        if(!check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
         {
           txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
           txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
@@ -1028,7 +1111,7 @@ namespace cryptonote
       }
     }
     //if we here, transaction seems valid, but, anyway, check for key_images collisions with blockchain, just to be sure
-    if(m_blockchain.have_tx_keyimges_as_spent(lazy_tx()))
+    if(m_blockchain.have_tx_keyimges_as_spent(tx))
     {
       txd.double_spend_seen = true;
       return false;
@@ -1074,21 +1157,22 @@ namespace cryptonote
       {
         for (const crypto::hash &txid: it->second)
         {
-          txpool_tx_meta_t meta;
-          if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+          const auto i = m_pool_index.find(txid);
+          if (i == m_pool_index.end())
           {
             MERROR("Failed to find tx meta in txpool");
             // continue, not fatal
             continue;
           }
-          if (!meta.double_spend_seen)
+          if (!i->second.meta.double_spend_seen)
           {
             MDEBUG("Marking " << txid << " as double spending " << itk.k_image);
+            txpool_tx_meta_t meta = i->second.meta;
             meta.double_spend_seen = true;
             changed = true;
             try
             {
-              m_blockchain.update_txpool_tx(txid, meta);
+              update_tx_meta(txid, meta);
             }
             catch (const std::exception &e)
             {
@@ -1134,127 +1218,237 @@ namespace cryptonote
     return ss.str();
   }
   //---------------------------------------------------------------------------------
-  //TODO: investigate whether boolean return is appropriate
-  bool tx_memory_pool::fill_block_template(block &bl, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version, uint64_t height)
+  tx_memory_pool::template_fill_result tx_memory_pool::add_to_template(const crypto::hash &txid, pool_tx_entry &entry)
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-
-    uint64_t best_coinbase = 0, coinbase = 0;
-    total_weight = 0;
-    fee = 0;
-    
-    //baseline empty block
-    get_block_reward(median_weight, total_weight, already_generated_coins, best_coinbase, version, height);
-
-
-    size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight = version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
-    std::unordered_set<crypto::key_image> k_images;
-
-    LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
+    block_template_txes &t = m_template;
+    const txpool_tx_meta_t &meta = entry.meta;
+    LOG_PRINT_L2("Considering " << txid << ", weight " << meta.weight << ", current block weight " << t.total_weight << "/" << t.max_total_weight << ", current coinbase " << print_money(t.best_coinbase));
 
-    LockedTXN lock(m_blockchain);
-
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
+    // Can not exceed maximum block weight
+    if (t.max_total_weight < t.total_weight + meta.weight)
     {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
-      {
-        MERROR("  failed to find tx meta");
-        continue;
-      }
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
+      LOG_PRINT_L2("  would exceed maximum block weight");
+      return TEMPLATE_NO_ROOM;
+    }
 
-      // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
+    uint64_t coinbase = 0;
+    // start using the optimal filling algorithm from v5
+    if (t.version >= 5)
+    {
+      // If we're getting lower coinbase tx,
+      // stop including more tx
+      uint64_t block_reward;
+      if(!get_block_reward(t.median_weight, t.total_weight + meta.weight, t.already_generated_coins, block_reward, t.version, t.height))
       {
         LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
+        return TEMPLATE_NO_ROOM;
       }
-
-      // start using the optimal filling algorithm from v5
-      if (version >= 5)
+      coinbase = block_reward + t.fee + meta.fee;
+      if (coinbase < template_accept_threshold(t.best_coinbase))
       {
-        // If we're getting lower coinbase tx,
-        // stop including more tx
-        uint64_t block_reward;
-        if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, block_reward, version, height))
-        {
-          LOG_PRINT_L2("  would exceed maximum block weight");
-          continue;
-        }
-        coinbase = block_reward + fee + meta.fee;
-        if (coinbase < template_accept_threshold(best_coinbase))
-        {
-          LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
-          continue;
-        }
+        LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+        return TEMPLATE_NO_ROOM;
       }
-      else
+    }
+    else
+    {
+      // If we've exceeded the penalty free weight,
+      // stop including more tx
+      if (t.total_weight > t.median_weight)
       {
-        // If we've exceeded the penalty free weight,
-        // stop including more tx
-        if (total_weight > median_weight)
-        {
-          LOG_PRINT_L2("  would exceed median block weight");
-          break;
-        }
+        LOG_PRINT_L2("  would exceed median block weight");
+        return TEMPLATE_FULL;
       }
+    }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
-
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
+    // Skip transactions that are not ready to be
+    // included into the blockchain or that are
+    // missing key images. Readiness only changes
+    // with the chain, so it is checked once per
+    // generation
+    if (entry.ready_generation != m_input_cache_generation)
+    {
+      txpool_tx_meta_t new_meta = meta;
       bool ready = false;
       try
       {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
+        ready = is_transaction_ready_to_go(new_meta, txid, entry.tx);
       }
       catch (const std::exception &e)
       {
         MERROR("Failed to check transaction readiness: " << e.what());
         // continue, not fatal
       }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
+      if (memcmp(&new_meta, &meta, sizeof(meta)))
       {
         try
-	{
-	  m_blockchain.update_txpool_tx(sorted_it->second, meta);
-	}
+        {
+          update_tx_meta(txid, new_meta);
+        }
         catch (const std::exception &e)
-	{
-	  MERROR("Failed to update tx meta: " << e.what());
-	  // continue, not fatal
-	}
+        {
+          MERROR("Failed to update tx meta: " << e.what());
+          // continue, not fatal
+        }
       }
-      if (!ready)
+      entry.ready = ready;
+      entry.ready_generation = m_input_cache_generation;
+    }
+    if (!entry.ready)
+    {
+      LOG_PRINT_L2("  not ready to go");
+      return TEMPLATE_SKIPPED;
+    }
+    if (have_key_images(t.k_images, entry.tx))
+    {
+      LOG_PRINT_L2("  key images already seen");
+      return TEMPLATE_SKIPPED;
+    }
+
+    t.tx_hashes.push_back(txid);
+    t.total_weight += meta.weight;
+    t.fee += meta.fee;
+    t.best_coinbase = coinbase;
+    append_key_images(t.k_images, entry.tx);
+    LOG_PRINT_L2("  added, new block weight " << t.total_weight << "/" << t.max_total_weight << ", coinbase " << print_money(t.best_coinbase));
+    return TEMPLATE_ADDED;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_tx_to_template(const crypto::hash &txid)
+  {
+    // a stale selection is rebuilt by the next fill_block_template
+    if (!m_template.valid || m_template.generation != m_input_cache_generation)
+      return;
+    const auto i = m_pool_index.find(txid);
+    if (i == m_pool_index.end())
+      return;
+    const template_fill_result result = add_to_template(txid, i->second);
+    if (result == TEMPLATE_ADDED)
+    {
+      MDEBUG("Added " << txid << " to the block template, now " << m_template.tx_hashes.size() << " txes");
+      return;
+    }
+    if (result != TEMPLATE_NO_ROOM && result != TEMPLATE_FULL)
+      return;
+
+    // the fee ordered fill would have taken it ahead of any cheaper tx
+    const double fee_per_byte = i->second.meta.fee / (double)i->second.meta.weight;
+    for (const crypto::hash &selected: m_template.tx_hashes)
+    {
+      const auto j = m_pool_index.find(selected);
+      if (j == m_pool_index.end() || j->second.meta.fee / (double)j->second.meta.weight < fee_per_byte)
       {
-        LOG_PRINT_L2("  not ready to go");
-        continue;
+        MDEBUG(txid << " outbids " << selected << " in the block template, rebuilding it");
+        m_template.valid = false;
+        return;
       }
-      if (have_key_images(k_images, tx))
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_tx_from_template(const crypto::hash &txid)
+  {
+    if (!m_template.valid)
+      return;
+    const auto it = std::find(m_template.tx_hashes.begin(), m_template.tx_hashes.end(), txid);
+    if (it == m_template.tx_hashes.end())
+      return;
+
+    // before v5 the fill stops at the median, so only a rebuild gets the same selection
+    const auto i = m_pool_index.find(txid);
+    if (i == m_pool_index.end() || m_template.version < 5)
+    {
+      m_template.valid = false;
+      return;
+    }
+
+    const txpool_tx_meta_t &meta = i->second.meta;
+    m_template.tx_hashes.erase(it);
+    m_template.total_weight -= meta.weight;
+    m_template.fee -= meta.fee;
+    for (const txin_v &in: i->second.tx.vin)
+    {
+      if (in.type() == typeid(txin_to_key))
+        m_template.k_images.erase(boost::get<txin_to_key>(in).k_image);
+    }
+    uint64_t block_reward;
+    if (!get_block_reward(m_template.median_weight, m_template.total_weight, m_template.already_generated_coins, block_reward, m_template.version, m_template.height))
+    {
+      m_template.valid = false;
+      return;
+    }
+    m_template.best_coinbase = block_reward + m_template.fee;
+    MDEBUG("Removed " << txid << " from the block template, now " << m_template.tx_hashes.size() << " txes");
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::unindex_tx(const crypto::hash &txid)
+  {
+    remove_tx_from_template(txid);
+    m_pool_index.erase(txid);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::notify_tx_removed(const crypto::hash &txid, txpool_remove_reason reason) const
+  {
+    std::shared_ptr<i_core_event_listener> event_listener = std::atomic_load(&m_event_listener);
+    if (event_listener)
+      event_listener->on_txpool_remove(txid, reason);
+  }
+  //---------------------------------------------------------------------------------
+  //TODO: investigate whether boolean return is appropriate
+  bool tx_memory_pool::fill_block_template(block &bl, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version, uint64_t height)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+
+    block_template_txes &t = m_template;
+    if (t.valid && t.generation == m_input_cache_generation && t.median_weight == median_weight &&
+        t.already_generated_coins == already_generated_coins && t.version == version && t.height == height)
+    {
+      LOG_PRINT_L2("Using the maintained block template selection, " << t.tx_hashes.size() << " txes");
+    }
+    else
+    {
+      t.valid = false;
+      t.median_weight = median_weight;
+      t.already_generated_coins = already_generated_coins;
+      t.version = version;
+      t.height = height;
+      t.generation = m_input_cache_generation;
+      t.tx_hashes.clear();
+      t.k_images.clear();
+      t.total_weight = 0;
+      t.fee = 0;
+
+      //baseline empty block
+      get_block_reward(median_weight, t.total_weight, already_generated_coins, t.best_coinbase, version, height);
+
+      size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+      size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+      t.max_total_weight = version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
+
+      LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
+
+      LockedTXN lock(m_blockchain);
+
+      for (auto sorted_it = m_txs_by_fee_and_receive_time.begin(); sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
       {
-        LOG_PRINT_L2("  key images already seen");
-        continue;
+        const auto entry_it = m_pool_index.find(sorted_it->second);
+        if (entry_it == m_pool_index.end())
+        {
+          MERROR("  failed to find tx meta");
+          continue;
+        }
+        if (add_to_template(sorted_it->second, entry_it->second) == TEMPLATE_FULL)
+          break;
       }
-
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-      fee += meta.fee;
-      best_coinbase = coinbase;
-      append_key_images(k_images, tx);
-      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+      t.valid = true;
     }
 
-    expected_reward = best_coinbase;
-    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
-        << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
+    bl.tx_hashes.insert(bl.tx_hashes.end(), t.tx_hashes.begin(), t.tx_hashes.end());
+    total_weight = t.total_weight;
+    fee = t.fee;
+    expected_reward = t.best_coinbase;
+    LOG_PRINT_L2("Block template filled with " << t.tx_hashes.size() << " txes, weight "
+        << total_weight << "/" << t.max_total_weight << ", coinbase " << print_money(expected_reward)
         << " (including " << print_money(fee) << " in fees)");
     return true;
   }
@@ -1297,6 +1491,7 @@ namespace cryptonote
           }
           // remove tx from db first
           m_blockchain.remove_txpool_tx(txid);
+          unindex_tx(txid);
           m_txpool_weight -= get_transaction_weight(tx, txblob.size());
           remove_transaction_keyimages(tx);
           auto sorted_it = find_tx_in_sorted_container(txid);
@@ -1309,6 +1504,7 @@ namespace cryptonote
             m_txs_by_fee_and_receive_time.erase(sorted_it);
           }
           ++n_removed;
+          notify_tx_removed(txid, txpool_remove_reason::invalid);
         }
         catch (const std::exception &e)
         {
@@ -1330,6 +1526,8 @@ namespace cryptonote
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
     m_txs_by_fee_and_receive_time.clear();
     m_spent_key_images.clear();
+    m_pool_index.clear();
+    m_template.valid = false;
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
 
@@ -1355,6 +1553,7 @@ namespace cryptonote
         }
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.weight, meta.receive_time), txid);
         m_txpool_weight += meta.weight;
+        index_tx(txid, tx, meta);
         return true;
       }, true);
       if (!r)
@@ -31,10 +31,12 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <memory>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <boost/optional/optional.hpp>
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
 
@@ -45,6 +47,7 @@
 #include "cryptonote_basic/verification_context.h"
 #include "blockchain_db/blockchain_db.h"
 #include "crypto/hash.h"
+#include "cryptonote_core/core_event_listener.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "rpc/message_data_structs.h"
 
@@ -128,6 +131,21 @@ namespace cryptonote
      */
     bool add_tx(transaction &tx, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version);
 
+    /**
+     * @brief checks the inputs of incoming transactions ahead of add_tx
+     *
+     * The ring members of each transaction are looked up under the blockchain
+     * lock, then the ring signatures of all of them are verified together on
+     * the threadpool.  The results go to the input cache add_tx looks at, so
+     * the pool lock is only taken to store them, and they are dropped if the
+     * chain changed meanwhile.
+     *
+     * @param txs the transactions to check, with their hashes
+     *
+     * @return the number of transactions whose inputs passed the checks
+     */
+    size_t prevalidate_tx_inputs(const std::vector<std::pair<transaction*, crypto::hash>> &txs);
+
     /**
      * @brief takes a transaction with the given hash from the pool
      *
@@ -138,10 +156,20 @@ namespace cryptonote
      * @param relayed return-by-reference was transaction relayed to us by the network?
      * @param do_not_relay return-by-reference is transaction not to be relayed to the network?
      * @param double_spend_seen return-by-reference was a double spend seen for that transaction?
+     * @param reason why the transaction is taken, for the event listener, or boost::none
+     *        if the caller calls notify_tx_removed itself once the removal is final
      *
      * @return true unless the transaction cannot be found in the pool
      */
-    bool take_tx(const crypto::hash &id, transaction &tx, size_t& tx_weight, uint64_t& fee, bool &relayed, bool &do_not_relay, bool &double_spend_seen);
+    bool take_tx(const crypto::hash &id, transaction &tx, size_t& tx_weight, uint64_t& fee, bool &relayed, bool &do_not_relay, bool &double_spend_seen, boost::optional<txpool_remove_reason> reason);
+
+    /**
+     * @brief tell the event listener, if any, that a transaction left the pool
+     *
+     * @param txid the txid of the transaction
+     * @param reason why it was removed
+     */
+    void notify_tx_removed(const crypto::hash &txid, txpool_remove_reason reason) const;
 
     /**
      * @brief checks if the pool has a transaction with the given hash
@@ -218,6 +246,10 @@ namespace cryptonote
     /**
      * @brief Chooses transactions for a block to include
      *
+     * The selection is kept between calls, and pool additions and removals
+     * are applied to it as they happen. It is only rebuilt from the whole
+     * pool when the chain or the parameters below change.
+     *
      * @param bl return-by-reference the block to fill in with transactions
      * @param median_weight the current median block weight
      * @param already_generated_coins the current total number of coins "minted"
@@ -369,6 +401,13 @@ namespace cryptonote
       */
     uint64_t cookie() const { return m_cookie; }
 
+    /**
+     * @brief sets a listener to tell about transactions entering and leaving the pool
+     *
+     * @param listener the listener, or an empty pointer to stop notifying
+     */
+    void set_event_listener(const std::shared_ptr<i_core_event_listener> &listener) { std::atomic_store(&m_event_listener, listener); }
+
     /**
      * @brief get the cumulative txpool weight in bytes
      *
@@ -506,14 +545,79 @@ namespace cryptonote
     /**
      * @brief check if a transaction is a valid candidate for inclusion in a block
      *
-     * @param txd the transaction to check (and info about it)
+     * @param txd info about the transaction, updated on a failed check
      * @param txid the txid of the transaction to check
-     * @param txblob the transaction blob to check
-     * @param tx the parsed transaction, if successful
+     * @param tx the parsed transaction
      *
      * @return true if the transaction is good to go, otherwise false
      */
-    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction &tx) const;
+    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, transaction &tx) const;
+
+    //! in-RAM copy of a pool transaction's db entry, plus its cached readiness
+    struct pool_tx_entry
+    {
+      txpool_tx_meta_t meta; //!< the meta as last written to the db
+      transaction tx; //!< the parsed transaction
+      uint64_t ready_generation; //!< m_input_cache_generation when ready was computed
+      bool ready; //!< cached is_transaction_ready_to_go result
+    };
+
+    /**
+     * @brief add a transaction to the in-RAM pool index
+     *
+     * @param txid the txid of the transaction
+     * @param tx the parsed transaction
+     * @param meta the meta as written to the db
+     */
+    void index_tx(const crypto::hash &txid, const transaction &tx, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief write a transaction's changed meta to the db, then to the in-RAM pool index
+     *
+     * @param txid the txid of the transaction
+     * @param meta the new meta
+     */
+    void update_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief remove a transaction from the in-RAM pool index and the template selection
+     *
+     * @param txid the txid of the transaction
+     */
+    void unindex_tx(const crypto::hash &txid);
+
+    //! outcome of offering a transaction to the template selection
+    enum template_fill_result
+    {
+      TEMPLATE_ADDED,
+      TEMPLATE_SKIPPED,
+      TEMPLATE_NO_ROOM, //!< skipped for the weight or reward it would add
+      TEMPLATE_FULL, //!< no later transaction will be taken either
+    };
+
+    /**
+     * @brief offer a transaction to the template selection, as the fee ordered fill would
+     *
+     * @param txid the txid of the transaction
+     * @param entry the transaction's in-RAM index entry
+     *
+     * @return whether the transaction was added
+     */
+    template_fill_result add_to_template(const crypto::hash &txid, pool_tx_entry &entry);
+
+    /**
+     * @brief add a new pool transaction to a current template selection, if it fits
+     *
+     * A transaction which does not fit, but pays more per byte than the
+     * cheapest one selected, would have been taken ahead of it by the fee
+     * ordered fill, so the selection is dropped to be rebuilt.
+     */
+    void add_tx_to_template(const crypto::hash &txid);
+
+    /**
+     * @brief take a leaving pool transaction out of the template selection, adjusting weight and reward
+     */
+    void remove_tx_from_template(const crypto::hash &txid);
 
     /**
      * @brief mark all transactions double spending the one passed
@@ -583,6 +687,33 @@ private:
     size_t m_txpool_weight;
 
     mutable std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>> m_input_cache;
+    uint64_t m_input_cache_generation; //!< incremented each time m_input_cache is invalidated
+
+    //! mirror of the db's txpool tables, which are only written through for persistence
+    /*! Readiness is cached per generation, so a block template can be built
+     *  without touching the db until the chain changes.
+     */
+    std::unordered_map<crypto::hash, pool_tx_entry> m_pool_index;
+
+    std::shared_ptr<i_core_event_listener> m_event_listener;
+
+    //! the transactions chosen for the last block template, and the state of that fill
+    struct block_template_txes
+    {
+      bool valid;
+      size_t median_weight;
+      uint64_t already_generated_coins;
+      uint8_t version;
+      uint64_t height;
+      uint64_t generation; //!< m_input_cache_generation the selection was built at
+      size_t max_total_weight;
+      std::vector<crypto::hash> tx_hashes;
+      std::unordered_set<crypto::key_image> k_images;
+      size_t total_weight;
+      uint64_t fee;
+      uint64_t best_coinbase;
+    };
+    block_template_txes m_template;
   };
 }
 
@@ -32,6 +32,7 @@
 #include <unordered_map>
 #include <boost/uuid/nil_generator.hpp>
 #include "string_tools.h"
+#include "common/pruning.h"
 #include "cryptonote_protocol_defs.h"
 #include "block_queue.h"
 
@@ -183,7 +184,7 @@ bool block_queue::requested(const crypto::hash &hash) const
   return requested_internal(hash);
 }
 
-std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_height, uint64_t last_block_height, uint64_t max_blocks, const boost::uuids::uuid &connection_id, const std::vector<crypto::hash> &block_hashes, boost::posix_time::ptime time)
+std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_height, uint64_t last_block_height, uint64_t max_blocks, const boost::uuids::uuid &connection_id, uint32_t pruning_seed, uint64_t blockchain_height, const std::vector<crypto::hash> &block_hashes, boost::posix_time::ptime time)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
 
@@ -200,9 +201,30 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
     ++i;
     ++span_start_height;
   }
+
+  // a pruned peer only has full blocks in its stripe and the tip, skip ahead to the next ones it has
+  const uint64_t next_unpruned_height = tools::get_next_unpruned_block_height(span_start_height, blockchain_height, pruning_seed);
+  if (next_unpruned_height > span_start_height)
+  {
+    const uint64_t skip = next_unpruned_height - span_start_height;
+    if (skip >= (uint64_t)(block_hashes.end() - i))
+    {
+      MDEBUG("reserve_span: peer with pruning seed " << pruning_seed << " has none of the blocks from " << span_start_height);
+      return std::make_pair(0, 0);
+    }
+    MDEBUG("reserve_span: skipping " << skip << " blocks the peer has pruned");
+    i += skip;
+    span_start_height = next_unpruned_height;
+    while (i != block_hashes.end() && requested_internal(*i))
+    {
+      ++i;
+      ++span_start_height;
+    }
+  }
+
   uint64_t span_length = 0;
   std::vector<crypto::hash> hashes;
-  while (i != block_hashes.end() && span_length < max_blocks)
+  while (i != block_hashes.end() && span_length < max_blocks && tools::has_unpruned_block(span_start_height + span_length, blockchain_height, pruning_seed))
   {
     hashes.push_back(*i);
     ++i;
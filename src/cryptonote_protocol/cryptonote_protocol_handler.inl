@@ -40,6 +40,7 @@
 #include <ctime>
 
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "common/pruning.h"
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
 
@@ -247,6 +248,7 @@ namespace cryptonote
       cnx.connection_id = epee::string_tools::pod_to_hex(cntxt.m_connection_id);
 
       cnx.height = cntxt.m_remote_blockchain_height;
+      cnx.pruning_seed = cntxt.m_pruning_seed;
 
       connections.push_back(cnx);
 
@@ -279,7 +281,14 @@ namespace cryptonote
       }
     }
  
+    if (hshd.pruning_seed != 0 && tools::get_pruning_log_stripes(hshd.pruning_seed) != CRYPTONOTE_PRUNING_LOG_STRIPES)
+    {
+      MWARNING(context << " peer advertised an invalid pruning seed " << hshd.pruning_seed << ", dropping connection");
+      return false;
+    }
+
     context.m_remote_blockchain_height = hshd.current_height;
+    context.m_pruning_seed = hshd.pruning_seed;
  
     uint64_t target = m_core.get_target_blockchain_height();
     if (target == 0)
@@ -393,6 +402,7 @@ namespace cryptonote
     hshd.top_version = m_core.get_ideal_hard_fork_version(hshd.current_height);
     hshd.cumulative_difficulty = m_core.get_block_cumulative_difficulty(hshd.current_height);
     hshd.current_height +=1;
+    hshd.pruning_seed = m_core.get_blockchain_pruning_seed();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -1419,6 +1429,12 @@ skip:
     });
     m_block_queue.flush_stale_spans(live_connections);
 
+    // a pruned peer can only send full blocks from its stripe and the tip
+    const auto peer_has_span = [&context](const std::pair<uint64_t, uint64_t> &span) {
+      return tools::has_unpruned_block(span.first, context.m_remote_blockchain_height, context.m_pruning_seed) &&
+          tools::has_unpruned_block(span.first + span.second - 1, context.m_remote_blockchain_height, context.m_pruning_seed);
+    };
+
     // if we don't need to get next span, and the block queue is full enough, wait a bit
     bool start_from_current_chain = false;
     if (!force_next_span)
@@ -1509,6 +1525,11 @@ skip:
             goto skip;
           }
           MDEBUG(context << " we have the hashes for this gap");
+          if (!peer_has_span(std::make_pair(first_block_height_needed, last_block_height_needed - first_block_height_needed + 1)))
+          {
+            MDEBUG(context << " peer has pruned this gap, leaving it to another peer");
+            span = std::make_pair(0, 0);
+          }
         }
       }
       if (force_next_span)
@@ -1519,6 +1540,8 @@ skip:
           boost::uuids::uuid span_connection_id;
           boost::posix_time::ptime time;
           span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
+          if (span.second > 0 && !peer_has_span(span))
+            span = std::make_pair(0, 0);
           if (span.second > 0)
           {
             is_next = true;
@@ -1554,7 +1577,7 @@ skip:
           context.m_needed_objects = std::vector<crypto::hash>(context.m_needed_objects.begin() + skip, context.m_needed_objects.end());
 
         const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
-        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_needed_objects);
+        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_pruning_seed, context.m_remote_blockchain_height, context.m_needed_objects);
         MDEBUG(context << " span from " << first_block_height << ": " << span.first << "/" << span.second);
       }
       if (span.second == 0 && !force_next_span)
@@ -1564,6 +1587,8 @@ skip:
         boost::uuids::uuid span_connection_id;
         boost::posix_time::ptime time;
         span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
+        if (span.second > 0 && !peer_has_span(span))
+          span = std::make_pair(0, 0);
         if (span.second > 0)
         {
           is_next = true;
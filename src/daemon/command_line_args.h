@@ -96,6 +96,11 @@ namespace daemon_args
   , "Max number of threads to use for a parallel job"
   , 0
   };
+  const command_line::arg_descriptor<bool> arg_threadpool_affinity = {
+    "threadpool-affinity"
+  , "Pin each thread pool worker to its own CPU"
+  , false
+  };
 
   const command_line::arg_descriptor<std::string> arg_zmq_rpc_bind_ip   = {
     "zmq-rpc-bind-ip"
@@ -117,6 +122,18 @@ namespace daemon_args
     }
   };
 
+  const command_line::arg_descriptor<std::string> arg_zmq_pub_bind_ip   = {
+    "zmq-pub-bind-ip"
+      , "IP for the ZMQ chain and txpool event publisher to listen on"
+      , "127.0.0.1"
+  };
+
+  const command_line::arg_descriptor<std::string> arg_zmq_pub_bind_port   = {
+    "zmq-pub-bind-port"
+      , "Port for the ZMQ chain and txpool event publisher to listen on, disabled if empty"
+      , ""
+  };
+
   // Temporary consensus flags (Phase 2)
   // Uses existing DPoS parameters: arg_xcash_dpops_delegates_public_address and arg_xcash_dpops_delegates_secret_key
   const command_line::arg_descriptor<bool> arg_temp_consensus_enabled = {
@@ -131,6 +148,12 @@ namespace daemon_args
   , false
   };
 
+  const command_line::arg_descriptor<uint64_t> arg_temp_consensus_preassemble_seconds = {
+    "temp-consensus-preassemble-seconds"
+  , "Seconds before the slot boundary at which the leader builds and signs its block"
+  , 5
+  };
+
 }  // namespace daemon_args
 
 #endif // DAEMON_COMMAND_LINE_ARGS_H
@@ -569,6 +569,29 @@ bool t_command_parser_executor::sync_info(const std::vector<std::string>& args)
   return m_executor.sync_info();
 }
 
+bool t_command_parser_executor::prune_blockchain(const std::vector<std::string>& args)
+{
+  if (args.size() > 1) return false;
+
+  if (args.empty() || args[0] != "confirm")
+  {
+    std::cout << "Warning: pruning will not shrink the database file. The pruned data is marked" << std::endl;
+    std::cout << "as free and reused, so the file will not grow until that space is used up." << std::endl;
+    std::cout << "Pruning cannot be undone short of a resync. Re-run this command with the" << std::endl;
+    std::cout << "\"confirm\" parameter to proceed." << std::endl;
+    return true;
+  }
+
+  return m_executor.prune_blockchain(false);
+}
+
+bool t_command_parser_executor::check_blockchain_pruning(const std::vector<std::string>& args)
+{
+  if (args.size() != 0) return false;
+
+  return m_executor.prune_blockchain(true);
+}
+
 bool t_command_parser_executor::version(const std::vector<std::string>& args)
 {
   std::cout << "X-CASH '" << XCASH_RELEASE_NAME << "' (v" << XCASH_VERSION_FULL << ")" << std::endl;
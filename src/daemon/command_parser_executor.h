@@ -135,6 +135,10 @@ public:
 
   bool sync_info(const std::vector<std::string>& args);
 
+  bool prune_blockchain(const std::vector<std::string>& args);
+
+  bool check_blockchain_pruning(const std::vector<std::string>& args);
+
   bool version(const std::vector<std::string>& args);
 };
 
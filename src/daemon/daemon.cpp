@@ -35,8 +35,10 @@
 #include "daemon/daemon.h"
 #include "rpc/daemon_handler.h"
 #include "rpc/zmq_server.h"
+#include "rpc/zmq_pub.h"
 
 #include "common/password.h"
+#include "common/threadpool.h"
 #include "common/util.h"
 #include "daemon/core.h"
 #include "daemon/p2p.h"
@@ -114,6 +116,12 @@ t_daemon::t_daemon(
 {
   zmq_rpc_bind_port = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_bind_port);
   zmq_rpc_bind_address = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_bind_ip);
+  zmq_pub_bind_port = command_line::get_arg(vm, daemon_args::arg_zmq_pub_bind_port);
+  zmq_pub_bind_address = command_line::get_arg(vm, daemon_args::arg_zmq_pub_bind_ip);
+
+  // not in main(), workers started before daemonizing would not survive the fork
+  if (command_line::get_arg(vm, daemon_args::arg_threadpool_affinity))
+    tools::threadpool::getInstance().set_affinity(true);
 }
 
 t_daemon::~t_daemon() = default;
@@ -207,6 +215,33 @@ bool t_daemon::run(bool interactive)
     MINFO(std::string("ZMQ server started at ") + zmq_rpc_bind_address
           + ":" + zmq_rpc_bind_port + ".");
 
+    std::shared_ptr<cryptonote::rpc::ZmqPub> zmq_pub;
+    if (!zmq_pub_bind_port.empty())
+    {
+      zmq_pub = std::make_shared<cryptonote::rpc::ZmqPub>();
+      if (!zmq_pub->addTCPSocket(zmq_pub_bind_address, zmq_pub_bind_port))
+      {
+        LOG_ERROR(std::string("Failed to add TCP Socket (") + zmq_pub_bind_address
+            + ":" + zmq_pub_bind_port + ") to ZMQ publisher");
+
+        if (rpc_commands)
+          rpc_commands->stop_handling();
+
+        zmq_server.stop();
+
+        for(auto& rpc : mp_internals->rpcs)
+          rpc->stop();
+
+        return false;
+      }
+
+      zmq_pub->run();
+      mp_internals->core.get().set_event_listener(zmq_pub);
+
+      MINFO(std::string("ZMQ publisher started at ") + zmq_pub_bind_address
+            + ":" + zmq_pub_bind_port + ".");
+    }
+
     mp_internals->p2p.run(); // blocks until p2p goes down
 
     if (rpc_commands)
@@ -214,6 +249,12 @@ bool t_daemon::run(bool interactive)
 
     zmq_server.stop();
 
+    if (zmq_pub)
+    {
+      mp_internals->core.get().set_event_listener(nullptr);
+      zmq_pub->stop();
+    }
+
     // Stop temporary consensus services
     mp_internals->temp_consensus.stop();
 
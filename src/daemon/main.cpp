@@ -89,12 +89,16 @@ int main(int argc, char const * argv[])
       command_line::add_arg(core_settings, daemon_args::arg_max_log_file_size);
       command_line::add_arg(core_settings, daemon_args::arg_max_log_files);
       command_line::add_arg(core_settings, daemon_args::arg_max_concurrency);
+      command_line::add_arg(core_settings, daemon_args::arg_threadpool_affinity);
       command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_bind_ip);
       command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_bind_port);
+      command_line::add_arg(core_settings, daemon_args::arg_zmq_pub_bind_ip);
+      command_line::add_arg(core_settings, daemon_args::arg_zmq_pub_bind_port);
 
       // Temporary consensus options (uses DPoS delegate parameters)
       command_line::add_arg(core_settings, daemon_args::arg_temp_consensus_enabled);
       command_line::add_arg(core_settings, daemon_args::arg_temp_consensus_leader);
+      command_line::add_arg(core_settings, daemon_args::arg_temp_consensus_preassemble_seconds);
 
       daemonizer::init_options(hidden_options, visible_options);
       daemonize::t_executor::init_options(core_settings);
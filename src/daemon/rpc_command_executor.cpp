@@ -36,6 +36,7 @@
 #include "common/boost_serialization_helper.h"
 #include "common/base58.h"
 #include "common/password.h"
+#include "common/pruning.h"
 #include "common/scoped_message_writer.h"
 #include "daemon/rpc_command_executor.h"
 #include "rpc/core_rpc_server_commands_defs.h"
@@ -1879,6 +1880,9 @@ bool t_rpc_command_executor::sync_info()
     for (const auto &p: res.peers)
       current_download += p.info.current_download;
     tools::success_msg_writer() << "Downloading at " << current_download << " kB/s";
+    tools::success_msg_writer() << "Thread pool: " << res.threadpool.threads << " threads, " << res.threadpool.queue_depth << " queued, "
+        << res.threadpool.tasks << " tasks, " << res.threadpool.steals << " steals, latency " << res.threadpool.average_latency_us << " us average, "
+        << res.threadpool.max_latency_us << " us max";
 
     tools::success_msg_writer() << std::to_string(res.peers.size()) << " peers";
     for (const auto &p: res.peers)
@@ -1888,7 +1892,8 @@ bool t_rpc_command_executor::sync_info()
       for (const auto &s: res.spans)
         if (s.rate > 0.0f && s.connection_id == p.info.connection_id)
           nblocks += s.nblocks, size += s.size;
-      tools::success_msg_writer() << address << "  " << epee::string_tools::pad_string(p.info.peer_id, 16, '0', true) << "  " << epee::string_tools::pad_string(p.info.state, 16) << "  " << p.info.height << "  "  << p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued";
+      const std::string pruning = p.info.pruning_seed ? "  stripe " + std::to_string(tools::get_pruning_stripe(p.info.pruning_seed)) : "";
+      tools::success_msg_writer() << address << "  " << epee::string_tools::pad_string(p.info.peer_id, 16, '0', true) << "  " << epee::string_tools::pad_string(p.info.state, 16) << "  " << p.info.height << "  "  << p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued" << pruning;
     }
 
     uint64_t total_size = 0;
@@ -1911,5 +1916,38 @@ bool t_rpc_command_executor::sync_info()
     return true;
 }
 
+bool t_rpc_command_executor::prune_blockchain(bool check)
+{
+    cryptonote::COMMAND_RPC_PRUNE_BLOCKCHAIN::request req;
+    cryptonote::COMMAND_RPC_PRUNE_BLOCKCHAIN::response res;
+    std::string fail_message = "Unsuccessful";
+    epee::json_rpc::error error_resp;
+
+    req.check = check;
+
+    if (m_is_rpc)
+    {
+        if (!m_rpc_client->json_rpc_request(req, res, "prune_blockchain", fail_message.c_str()))
+        {
+            return true;
+        }
+    }
+    else
+    {
+        if (!m_rpc_server->on_prune_blockchain(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+        {
+            tools::fail_msg_writer() << make_error(fail_message, res.status);
+            return true;
+        }
+    }
+
+    if (!res.pruned)
+      tools::success_msg_writer() << "Blockchain is not pruned";
+    else
+      tools::success_msg_writer() << "Blockchain " << (check ? "pruning is consistent" : "pruned") << ", keeping stripe " << tools::get_pruning_stripe(res.pruning_seed)
+          << " of " << (1u << tools::get_pruning_log_stripes(res.pruning_seed)) << " (seed " << res.pruning_seed << ")";
+    return true;
+}
+
 }// namespace daemonize
 
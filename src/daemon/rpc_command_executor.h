@@ -148,6 +148,8 @@ public:
   bool relay_tx(const std::string &txid);
 
   bool sync_info();
+
+  bool prune_blockchain(bool check);
 };
 
 } // namespace daemonize
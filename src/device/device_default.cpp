@@ -143,8 +143,7 @@ namespace hw {
         std::vector<crypto::public_key>  device_default::get_subaddress_spend_public_keys(const cryptonote::account_keys &keys, uint32_t account, uint32_t begin, uint32_t end) {
             CHECK_AND_ASSERT_THROW_MES(begin <= end, "begin > end");
 
-            std::vector<crypto::public_key> pkeys;
-            pkeys.reserve(end - begin);
+            std::vector<crypto::public_key> pkeys(end - begin);
             cryptonote::subaddress_index index = {account, begin};
 
             ge_p3 p3;
@@ -153,27 +152,31 @@ namespace hw {
                 "ge_frombytes_vartime failed to convert spend public key");
             ge_p3_to_cached(&cached, &p3);
 
-            for (uint32_t idx = begin; idx < end; ++idx)
+            // the main address is the only index whose key is not derived
+            const size_t first = (account == 0 && begin == 0 && end > 0) ? 1 : 0;
+            if (first)
+                pkeys[0] = keys.m_account_address.m_spend_public_key;
+
+            std::vector<ge_p2> points(pkeys.size() - first);
+            for (uint32_t idx = begin + first; idx < end; ++idx)
             {
                 index.minor = idx;
-                if (index.is_zero())
-                {
-                    pkeys.push_back(keys.m_account_address.m_spend_public_key);
-                    continue;
-                }
                 crypto::secret_key m = get_subaddress_secret_key(keys.m_view_secret_key, index);
 
                 // M = m*G
                 ge_scalarmult_base(&p3, (const unsigned char*)m.data);
 
                 // D = B + M
-                crypto::public_key D;
                 ge_p1p1 p1p1;
                 ge_add(&p1p1, &p3, &cached);
-                ge_p1p1_to_p3(&p3, &p1p1);
-                ge_p3_tobytes((unsigned char*)D.data, &p3);
+                ge_p1p1_to_p2(&points[idx - begin - first], &p1p1);
+            }
 
-                pkeys.push_back(D);
+            // encode all the D with a single shared field inversion
+            if (!points.empty())
+            {
+                std::unique_ptr<fe[]> tmp(new fe[points.size()]);
+                ge_p2_batch_tobytes((unsigned char*)pkeys[first].data, points.data(), tmp.get(), points.size());
             }
             return pkeys;
         }
@@ -1503,9 +1503,11 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid> &connections)
   {
+    // one copy of the payload, shared by every connection's send queue
+    const epee::net_utils::shared_buffer buffer = std::make_shared<const std::string>(data_buff);
     for(const auto& c_id: connections)
     {
-      m_net_server.get_config_object().notify(command, data_buff, c_id);
+      m_net_server.get_config_object().notify(command, buffer, c_id);
     }
     return true;
   }
@@ -1517,7 +1519,14 @@ namespace nodetool
     m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
     {
       if(cntxt.peer_id && context.m_connection_id != cntxt.m_connection_id)
-        connections.push_back(cntxt.m_connection_id);
+      {
+        // relayed data is sent again later, so don't pile it onto a peer which can't keep up
+        const uint64_t send_queue_bytes = cntxt.m_send_queue_bytes;
+        if (send_queue_bytes > ABSTRACT_SERVER_SEND_QUE_SOFT_BYTES)
+          MDEBUG(cntxt << "send queue backlogged (" << send_queue_bytes << " bytes), not relaying to it");
+        else
+          connections.push_back(cntxt.m_connection_id);
+      }
       return true;
     });
     return relay_notify_to_list(command, data_buff, connections);
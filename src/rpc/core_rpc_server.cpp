@@ -41,6 +41,7 @@ using namespace epee;
 #include "common/download.h"
 #include "common/util.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_basic/account.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
@@ -67,6 +68,26 @@ namespace
       reasons += ", ";
     reasons += reason;
   }
+
+  void fill_threadpool_stats(cryptonote::threadpool_stats &stats)
+  {
+    const tools::threadpool::stats s = tools::threadpool::getInstance().get_stats();
+    stats.threads = s.threads;
+    stats.queue_depth = s.queue_depth;
+    stats.tasks = s.tasks;
+    stats.steals = s.steals;
+    stats.average_latency_us = s.average_latency_us;
+    stats.max_latency_us = s.max_latency_us;
+  }
+
+  void fill_block_template_stats(const cryptonote::Blockchain &blockchain, cryptonote::block_template_stats &stats)
+  {
+    const cryptonote::Blockchain::block_template_stats s = blockchain.get_block_template_stats();
+    stats.bucket_limits_us = s.bucket_limits_us;
+    stats.cached = s.cached;
+    stats.shared = s.shared;
+    stats.filled = s.filled;
+  }
 }
 
 namespace cryptonote
@@ -215,6 +236,8 @@ namespace cryptonote
     }
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     res.update_available = m_core.is_update_available();
+    fill_threadpool_stats(res.threadpool);
+    fill_block_template_stats(m_core.get_blockchain_storage(), res.block_template);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -244,37 +267,41 @@ namespace cryptonote
       return r;
 
     std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > > bs;
+    std::vector<std::vector<std::vector<uint64_t>>> indices;
 
-    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, &indices))
     {
       res.status = "Failed";
       return false;
     }
+    if (indices.size() != bs.size())
+    {
+      LOG_ERROR("mismatched sizes of blocks and output indices");
+      res.status = "Failed";
+      return false;
+    }
 
     size_t pruned_size = 0, unpruned_size = 0, ntxes = 0;
     res.blocks.reserve(bs.size());
     res.output_indices.reserve(bs.size());
-    for(auto& bd: bs)
+    for(size_t n = 0; n < bs.size(); ++n)
     {
+      auto& bd = bs[n];
+      auto& block_indices = indices[n];
       res.blocks.resize(res.blocks.size()+1);
       res.blocks.back().block = bd.first.first;
       pruned_size += bd.first.first.size();
       unpruned_size += bd.first.first.size();
       res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
+      res.output_indices.back().indices.reserve(block_indices.size());
+      // the miner tx comes first; its entry stays empty when it was not asked for
       res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
       if (!req.no_miner_tx)
-      {
-        bool r = m_core.get_tx_outputs_gindexs(bd.first.second, res.output_indices.back().indices.back().indices);
-        if (!r)
-        {
-          res.status = "Failed";
-          return false;
-        }
-      }
+        res.output_indices.back().indices.back().indices = std::move(block_indices[0]);
       ntxes += bd.second.size();
       res.blocks.back().txs.reserve(bd.second.size());
-      res.output_indices.back().indices.reserve(bd.second.size());
-      for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
+      size_t tx_idx = 1;
+      for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i, ++tx_idx)
       {
         unpruned_size += i->second.size();
         res.blocks.back().txs.push_back(std::move(i->second));
@@ -283,18 +310,31 @@ namespace cryptonote
         pruned_size += res.blocks.back().txs.back().size();
 
         res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
-        bool r = m_core.get_tx_outputs_gindexs(i->first, res.output_indices.back().indices.back().indices);
-        if (!r)
-        {
-          res.status = "Failed";
-          return false;
-        }
+        res.output_indices.back().indices.back().indices = std::move(block_indices[tx_idx]);
       }
     }
 
     MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, pruned size " << pruned_size << ", unpruned size " << unpruned_size);
     res.status = CORE_RPC_STATUS_OK;
     return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_stream(const COMMAND_RPC_GET_BLOCKS_STREAM::request& req, std::string& stream)
+  {
+    PERF_TIMER(on_get_blocks_stream);
+    // the stream is not relayed from a bootstrap daemon, clients fall back to getblocks.bin
+    if (!m_bootstrap_daemon_address.empty())
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+      if (m_should_use_bootstrap_daemon)
+        return false;
+    }
+
+    if (!m_core.get_blocks_stream(req.start_height, req.block_ids, !req.no_miner_tx, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, stream))
+      return false;
+
+    MDEBUG("on_get_blocks_stream: " << stream.size() << " bytes");
+    return true;
   }
     bool core_rpc_server::on_get_alt_blocks_hashes(const COMMAND_RPC_GET_ALT_BLOCKS_HASHES::request& req, COMMAND_RPC_GET_ALT_BLOCKS_HASHES::response& res)
     {
@@ -1519,6 +1559,8 @@ namespace cryptonote
     }
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     res.update_available = m_core.is_update_available();
+    fill_threadpool_stats(res.threadpool);
+    fill_block_template_stats(m_core.get_blockchain_storage(), res.block_template);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -2001,6 +2043,7 @@ namespace cryptonote
       res.spans.push_back({span.start_block_height, span.nblocks, span_connection_id, (uint32_t)(span.rate + 0.5f), speed, span.size, address});
       return true;
     });
+    fill_threadpool_stats(res.threadpool);
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -2106,6 +2149,23 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_prune_blockchain(const COMMAND_RPC_PRUNE_BLOCKCHAIN::request& req, COMMAND_RPC_PRUNE_BLOCKCHAIN::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_prune_blockchain);
+
+    if (req.check ? !m_core.check_blockchain_pruning() : !m_core.prune_blockchain())
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = req.check ? "Failed to check blockchain pruning" : "Failed to prune blockchain";
+      return false;
+    }
+    res.pruning_seed = m_core.get_blockchain_pruning_seed();
+    res.pruned = res.pruning_seed != 0;
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
 
 
 
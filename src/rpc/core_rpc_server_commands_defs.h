@@ -49,7 +49,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 2
-#define CORE_RPC_VERSION_MINOR 1
+#define CORE_RPC_VERSION_MINOR 5
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -130,6 +130,24 @@ namespace cryptonote
     };
   };
 
+  // Same selection as COMMAND_RPC_GET_BLOCKS_FAST with pruned txes, but the
+  // response body is a raw blocks stream (see cryptonote_basic/blocks_stream.h)
+  // rather than a serialized response struct
+  struct COMMAND_RPC_GET_BLOCKS_STREAM
+  {
+    struct request
+    {
+      std::list<crypto::hash> block_ids;
+      uint64_t    start_height;
+      bool        no_miner_tx;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE_OPT(no_miner_tx, false)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_BLOCKS_BY_HEIGHT
   {
     struct request
@@ -851,6 +869,40 @@ namespace cryptonote
     };
   };
   //-----------------------------------------------
+  struct threadpool_stats
+  {
+    uint32_t threads;
+    uint64_t queue_depth;
+    uint64_t tasks;
+    uint64_t steals;
+    uint64_t average_latency_us;
+    uint64_t max_latency_us;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(threads)
+      KV_SERIALIZE(queue_depth)
+      KV_SERIALIZE(tasks)
+      KV_SERIALIZE(steals)
+      KV_SERIALIZE(average_latency_us)
+      KV_SERIALIZE(max_latency_us)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct block_template_stats
+  {
+    std::vector<uint64_t> bucket_limits_us;
+    std::vector<uint64_t> cached;
+    std::vector<uint64_t> shared;
+    std::vector<uint64_t> filled;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(bucket_limits_us)
+      KV_SERIALIZE(cached)
+      KV_SERIALIZE(shared)
+      KV_SERIALIZE(filled)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct COMMAND_RPC_GET_INFO
   {
     struct request
@@ -894,6 +946,8 @@ namespace cryptonote
       bool was_bootstrap_ever_used;
       uint64_t database_size;
       bool update_available;
+      threadpool_stats threadpool;
+      block_template_stats block_template;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -928,6 +982,8 @@ namespace cryptonote
         KV_SERIALIZE(was_bootstrap_ever_used)
         KV_SERIALIZE(database_size)
         KV_SERIALIZE(update_available)
+        KV_SERIALIZE(threadpool)
+        KV_SERIALIZE(block_template)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -2204,6 +2260,7 @@ namespace cryptonote
       uint64_t target_height;
       std::list<peer> peers;
       std::list<span> spans;
+      threadpool_stats threadpool;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -2211,6 +2268,7 @@ namespace cryptonote
         KV_SERIALIZE(target_height)
         KV_SERIALIZE(peers)
         KV_SERIALIZE(spans)
+        KV_SERIALIZE(threadpool)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -2268,6 +2326,31 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_PRUNE_BLOCKCHAIN
+  {
+    struct request
+    {
+      bool check;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(check, false)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      bool pruned;
+      uint32_t pruning_seed;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(pruned)
+        KV_SERIALIZE(pruning_seed)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_VERIFY_ROUND_STATISTICS
   {
     struct request
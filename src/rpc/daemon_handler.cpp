@@ -51,14 +51,22 @@ namespace rpc
   void DaemonHandler::handle(const GetBlocksFast::Request& req, GetBlocksFast::Response& res)
   {
     std::vector<std::pair<std::pair<blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, blobdata> > > > blocks;
+    std::vector<std::vector<std::vector<uint64_t>>> output_indices;
 
-    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, blocks, res.current_height, res.start_height, req.prune, true, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, blocks, res.current_height, res.start_height, req.prune, true, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, &output_indices))
     {
       res.status = Message::STATUS_FAILED;
       res.error_details = "core::find_blockchain_supplement() returned false";
       return;
     }
 
+    if (output_indices.size() != blocks.size())
+    {
+      res.status = Message::STATUS_FAILED;
+      res.error_details = "incorrect number of output indices retrieved";
+      return;
+    }
+
     res.blocks.resize(blocks.size());
     res.output_indices.resize(blocks.size());
 
@@ -87,21 +95,9 @@ namespace rpc
           return;
       }
 
-      cryptonote::rpc::block_output_indices& indices = res.output_indices[block_count];
-
-      // miner tx output indices
-      {
-        cryptonote::rpc::tx_output_indices tx_indices;
-        if (!m_core.get_tx_outputs_gindexs(get_transaction_hash(bwt.block.miner_tx), tx_indices))
-        {
-          res.status = Message::STATUS_FAILED;
-          res.error_details = "core::get_tx_outputs_gindexs() returned false";
-          return;
-        }
-        indices.push_back(std::move(tx_indices));
-      }
+      // miner tx output indices first, then one entry per tx, as returned
+      res.output_indices[block_count] = std::move(output_indices[block_count]);
 
-      auto hash_it = bwt.block.tx_hashes.begin();
       bwt.transactions.reserve(it->second.size());
       for (const auto& blob : it->second)
       {
@@ -114,17 +110,6 @@ namespace rpc
           res.error_details = "failed retrieving a requested transaction";
           return;
         }
-
-        cryptonote::rpc::tx_output_indices tx_indices;
-        if (!m_core.get_tx_outputs_gindexs(*hash_it, tx_indices))
-        {
-          res.status = Message::STATUS_FAILED;
-          res.error_details = "core::get_tx_outputs_gindexs() returned false";
-          return;
-        }
-
-        indices.push_back(std::move(tx_indices));
-        ++hash_it;
       }
 
       it++;
@@ -0,0 +1,509 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "zmq_pub.h"
+#include "zmq_server.h"
+
+#include <boost/chrono/chrono.hpp>
+#include <cstring>
+
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "serialization/json_object.h"
+#include "storages/portable_storage_template_helper.h"
+
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#undef XCASH_DEFAULT_LOG_CATEGORY
+#define XCASH_DEFAULT_LOG_CATEGORY "net.zmq.pub"
+
+namespace
+{
+  struct chain_main_minimal
+  {
+    uint64_t first_height;
+    crypto::hash first_prev_id;
+    std::vector<crypto::hash> ids;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(first_height)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(first_prev_id)
+      KV_SERIALIZE_CONTAINER_POD_AS_BLOB(ids)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct chain_main_full
+  {
+    uint64_t first_height;
+    std::vector<std::string> blocks;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(first_height)
+      KV_SERIALIZE(blocks)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct chain_rollback_entry
+  {
+    uint64_t height;
+    crypto::hash id;
+    crypto::hash prev_id;
+    std::string block;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(height)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(id)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(prev_id)
+      if (!this_ref.block.empty())
+        KV_SERIALIZE(block)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct txpool_add_entry
+  {
+    crypto::hash id;
+    uint64_t weight;
+    uint64_t fee;
+    std::string tx;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE_VAL_POD_AS_BLOB(id)
+      KV_SERIALIZE(weight)
+      KV_SERIALIZE(fee)
+      if (!this_ref.tx.empty())
+        KV_SERIALIZE(tx)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct txpool_remove_entry
+  {
+    crypto::hash id;
+    std::string reason;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE_VAL_POD_AS_BLOB(id)
+      KV_SERIALIZE(reason)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  template<typename T>
+  std::string to_binary(const T &t)
+  {
+    std::string blob;
+    epee::serialization::store_t_to_binary(t, blob);
+    return blob;
+  }
+
+  std::string to_json(const rapidjson::Document &doc)
+  {
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    doc.Accept(writer);
+    return std::string(buf.GetString(), buf.GetSize());
+  }
+}
+
+namespace cryptonote
+{
+
+namespace rpc
+{
+
+ZmqPub::ZmqPub() :
+    stop_signal(false),
+    running(false),
+    context(DEFAULT_NUM_ZMQ_THREADS),
+    m_dropped(0)
+{
+  for (auto &s: m_subscribed)
+    s = 0;
+}
+
+ZmqPub::~ZmqPub()
+{
+  stop();
+}
+
+const char *ZmqPub::topic_name(event_kind kind, event_format format)
+{
+  static const char *const names[EVENT_KIND_COUNT][FORMAT_COUNT] = {
+    { "json-minimal-chain_main", "json-full-chain_main", "bin-minimal-chain_main", "bin-full-chain_main" },
+    { "json-minimal-chain_rollback", "json-full-chain_rollback", "bin-minimal-chain_rollback", "bin-full-chain_rollback" },
+    { "json-minimal-txpool_add", "json-full-txpool_add", "bin-minimal-txpool_add", "bin-full-txpool_add" },
+    { "json-minimal-txpool_remove", nullptr, "bin-minimal-txpool_remove", nullptr },
+  };
+  return names[kind][format];
+}
+
+bool ZmqPub::addTCPSocket(std::string address, std::string port)
+{
+  try
+  {
+    std::string addr_prefix("tcp://");
+
+    pub_socket.reset(new zmq::socket_t(context, ZMQ_XPUB));
+
+    if (address.empty())
+      address = "*";
+    if (port.empty())
+      port = "*";
+    std::string bind_address = addr_prefix + address + std::string(":") + port;
+    pub_socket->bind(bind_address.c_str());
+  }
+  catch (const std::exception& e)
+  {
+    MERROR(std::string("Error creating ZMQ publisher socket: ") + e.what());
+    return false;
+  }
+  return true;
+}
+
+void ZmqPub::run()
+{
+  running = true;
+  run_thread = boost::thread(boost::bind(&ZmqPub::serve, this));
+}
+
+void ZmqPub::stop()
+{
+  if (!running) return;
+
+  {
+    boost::unique_lock<boost::mutex> lock(m_queue_lock);
+    stop_signal = true;
+  }
+  m_queue_cond.notify_all();
+
+  run_thread.join();
+
+  running = false;
+}
+
+void ZmqPub::on_block_added(uint64_t height, const crypto::hash &id, const block &b)
+{
+  if (!wants_any(EVENT_CHAIN_MAIN))
+    return;
+  event ev{EVENT_CHAIN_MAIN, height, id, b.prev_id, 0, 0, txpool_remove_reason::mined, nullptr, nullptr};
+  if (wants_full(EVENT_CHAIN_MAIN))
+    ev.b = std::make_shared<const block>(b);
+  push(std::move(ev));
+}
+
+void ZmqPub::on_block_popped(uint64_t height, const crypto::hash &id, const block &b)
+{
+  if (!wants_any(EVENT_CHAIN_ROLLBACK))
+    return;
+  event ev{EVENT_CHAIN_ROLLBACK, height, id, b.prev_id, 0, 0, txpool_remove_reason::mined, nullptr, nullptr};
+  if (wants_full(EVENT_CHAIN_ROLLBACK))
+    ev.b = std::make_shared<const block>(b);
+  push(std::move(ev));
+}
+
+void ZmqPub::on_txpool_add(const crypto::hash &id, const transaction &tx, uint64_t weight, uint64_t fee)
+{
+  if (!wants_any(EVENT_TXPOOL_ADD))
+    return;
+  event ev{EVENT_TXPOOL_ADD, 0, id, crypto::null_hash, weight, fee, txpool_remove_reason::mined, nullptr, nullptr};
+  if (wants_full(EVENT_TXPOOL_ADD))
+    ev.tx = std::make_shared<const transaction>(tx);
+  push(std::move(ev));
+}
+
+void ZmqPub::on_txpool_remove(const crypto::hash &id, txpool_remove_reason reason)
+{
+  if (!wants_any(EVENT_TXPOOL_REMOVE))
+    return;
+  push(event{EVENT_TXPOOL_REMOVE, 0, id, crypto::null_hash, 0, 0, reason, nullptr, nullptr});
+}
+
+void ZmqPub::push(event &&ev)
+{
+  {
+    boost::unique_lock<boost::mutex> lock(m_queue_lock);
+    if (stop_signal)
+      return;
+    if (m_queue.size() >= MAX_QUEUED_PUB_EVENTS)
+    {
+      m_queue.pop_front();
+      ++m_dropped;
+    }
+    m_queue.push_back(std::move(ev));
+  }
+  m_queue_cond.notify_one();
+}
+
+void ZmqPub::serve()
+{
+  std::vector<event> events;
+  while (1)
+  {
+    uint64_t dropped = 0;
+    {
+      boost::unique_lock<boost::mutex> lock(m_queue_lock);
+      if (m_queue.empty() && !stop_signal)
+        m_queue_cond.wait_for(lock, boost::chrono::milliseconds(PUB_SUBSCRIPTION_POLL_MS));
+      if (stop_signal)
+        break;
+      events.assign(std::make_move_iterator(m_queue.begin()), std::make_move_iterator(m_queue.end()));
+      m_queue.clear();
+      std::swap(dropped, m_dropped);
+    }
+
+    if (dropped)
+      MWARNING("ZMQ publisher fell behind, dropped " << dropped << " events");
+
+    try
+    {
+      read_subscriptions();
+      publish(events);
+    }
+    catch (const zmq::error_t& e)
+    {
+      MERROR(std::string("ZMQ error: ") + e.what());
+    }
+    catch (const std::exception& e)
+    {
+      MERROR(std::string("Failed to publish ZMQ event: ") + e.what());
+    }
+    events.clear();
+  }
+}
+
+void ZmqPub::read_subscriptions()
+{
+  bool changed = false;
+  zmq::message_t message;
+  while (pub_socket->recv(&message, ZMQ_DONTWAIT))
+  {
+    // XPUB reports the first subscriber to a prefix and the last one leaving it
+    if (message.size() == 0)
+      continue;
+    const char *data = static_cast<const char*>(message.data());
+    std::string prefix(data + 1, message.size() - 1);
+    if (data[0] == 1)
+      m_prefixes.insert(std::move(prefix));
+    else if (data[0] == 0)
+      m_prefixes.erase(prefix);
+    changed = true;
+  }
+  if (!changed)
+    return;
+
+  for (int k = 0; k < EVENT_KIND_COUNT; ++k)
+  {
+    unsigned mask = 0;
+    for (int f = 0; f < FORMAT_COUNT; ++f)
+    {
+      const char *name = topic_name(event_kind(k), event_format(f));
+      if (!name)
+        continue;
+      const std::string topic = std::string(name) + ":";
+      for (const std::string &prefix: m_prefixes)
+      {
+        const size_t n = std::min(prefix.size(), topic.size());
+        if (prefix.compare(0, n, topic, 0, n) == 0)
+        {
+          mask |= 1u << f;
+          break;
+        }
+      }
+    }
+    m_subscribed[k] = mask;
+  }
+  MDEBUG("ZMQ publisher now has " << m_prefixes.size() << " subscribed prefixes");
+}
+
+void ZmqPub::publish(const std::vector<event> &events)
+{
+  for (size_t i = 0; i < events.size(); )
+  {
+    const event &ev = events[i];
+    if (ev.kind == EVENT_CHAIN_MAIN)
+    {
+      // a run of blocks on top of each other goes out as a single message
+      size_t n = 1;
+      while (i + n < events.size() && events[i + n].kind == EVENT_CHAIN_MAIN && events[i + n].height == ev.height + n)
+        ++n;
+      publish_chain_main(&ev, n);
+      i += n;
+      continue;
+    }
+
+    switch (ev.kind)
+    {
+      case EVENT_CHAIN_ROLLBACK:
+        if (wants(ev.kind, FORMAT_JSON_MINIMAL) || (wants(ev.kind, FORMAT_JSON_FULL) && ev.b))
+        {
+          rapidjson::Document doc;
+          doc.SetObject();
+          INSERT_INTO_JSON_OBJECT(doc, doc, height, ev.height);
+          INSERT_INTO_JSON_OBJECT(doc, doc, id, ev.id);
+          INSERT_INTO_JSON_OBJECT(doc, doc, prev_id, ev.prev_id);
+          if (wants(ev.kind, FORMAT_JSON_MINIMAL))
+            send(ev.kind, FORMAT_JSON_MINIMAL, to_json(doc));
+          if (wants(ev.kind, FORMAT_JSON_FULL) && ev.b)
+          {
+            INSERT_INTO_JSON_OBJECT(doc, doc, block, *ev.b);
+            send(ev.kind, FORMAT_JSON_FULL, to_json(doc));
+          }
+        }
+        if (wants(ev.kind, FORMAT_BIN_MINIMAL) || (wants(ev.kind, FORMAT_BIN_FULL) && ev.b))
+        {
+          chain_rollback_entry e{ev.height, ev.id, ev.prev_id, std::string()};
+          if (wants(ev.kind, FORMAT_BIN_MINIMAL))
+            send(ev.kind, FORMAT_BIN_MINIMAL, to_binary(e));
+          if (wants(ev.kind, FORMAT_BIN_FULL) && ev.b)
+          {
+            e.block = block_to_blob(*ev.b);
+            send(ev.kind, FORMAT_BIN_FULL, to_binary(e));
+          }
+        }
+        break;
+      case EVENT_TXPOOL_ADD:
+        if (wants(ev.kind, FORMAT_JSON_MINIMAL) || (wants(ev.kind, FORMAT_JSON_FULL) && ev.tx))
+        {
+          rapidjson::Document doc;
+          doc.SetObject();
+          INSERT_INTO_JSON_OBJECT(doc, doc, id, ev.id);
+          INSERT_INTO_JSON_OBJECT(doc, doc, weight, ev.weight);
+          INSERT_INTO_JSON_OBJECT(doc, doc, fee, ev.fee);
+          if (wants(ev.kind, FORMAT_JSON_MINIMAL))
+            send(ev.kind, FORMAT_JSON_MINIMAL, to_json(doc));
+          if (wants(ev.kind, FORMAT_JSON_FULL) && ev.tx)
+          {
+            INSERT_INTO_JSON_OBJECT(doc, doc, tx, *ev.tx);
+            send(ev.kind, FORMAT_JSON_FULL, to_json(doc));
+          }
+        }
+        if (wants(ev.kind, FORMAT_BIN_MINIMAL) || (wants(ev.kind, FORMAT_BIN_FULL) && ev.tx))
+        {
+          txpool_add_entry e{ev.id, ev.weight, ev.fee, std::string()};
+          if (wants(ev.kind, FORMAT_BIN_MINIMAL))
+            send(ev.kind, FORMAT_BIN_MINIMAL, to_binary(e));
+          if (wants(ev.kind, FORMAT_BIN_FULL) && ev.tx)
+          {
+            e.tx = tx_to_blob(*ev.tx);
+            send(ev.kind, FORMAT_BIN_FULL, to_binary(e));
+          }
+        }
+        break;
+      case EVENT_TXPOOL_REMOVE:
+      {
+        const std::string reason = txpool_remove_reason_to_string(ev.reason);
+        if (wants(ev.kind, FORMAT_JSON_MINIMAL))
+        {
+          rapidjson::Document doc;
+          doc.SetObject();
+          INSERT_INTO_JSON_OBJECT(doc, doc, id, ev.id);
+          INSERT_INTO_JSON_OBJECT(doc, doc, reason, reason);
+          send(ev.kind, FORMAT_JSON_MINIMAL, to_json(doc));
+        }
+        if (wants(ev.kind, FORMAT_BIN_MINIMAL))
+          send(ev.kind, FORMAT_BIN_MINIMAL, to_binary(txpool_remove_entry{ev.id, reason}));
+        break;
+      }
+      default:
+        break;
+    }
+    ++i;
+  }
+}
+
+void ZmqPub::publish_chain_main(const event *first, size_t count)
+{
+  if (wants(EVENT_CHAIN_MAIN, FORMAT_JSON_MINIMAL) || wants(EVENT_CHAIN_MAIN, FORMAT_BIN_MINIMAL))
+  {
+    chain_main_minimal m;
+    m.first_height = first->height;
+    m.first_prev_id = first->prev_id;
+    m.ids.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+      m.ids.push_back(first[i].id);
+
+    if (wants(EVENT_CHAIN_MAIN, FORMAT_JSON_MINIMAL))
+    {
+      rapidjson::Document doc;
+      doc.SetObject();
+      INSERT_INTO_JSON_OBJECT(doc, doc, first_height, m.first_height);
+      INSERT_INTO_JSON_OBJECT(doc, doc, first_prev_id, m.first_prev_id);
+      INSERT_INTO_JSON_OBJECT(doc, doc, ids, m.ids);
+      send(EVENT_CHAIN_MAIN, FORMAT_JSON_MINIMAL, to_json(doc));
+    }
+    if (wants(EVENT_CHAIN_MAIN, FORMAT_BIN_MINIMAL))
+      send(EVENT_CHAIN_MAIN, FORMAT_BIN_MINIMAL, to_binary(m));
+  }
+
+  // blocks are only captured while a full topic is subscribed, so a run
+  // may straddle a subscription change; skip the full formats then
+  for (size_t i = 0; i < count; ++i)
+    if (!first[i].b)
+      return;
+
+  if (wants(EVENT_CHAIN_MAIN, FORMAT_JSON_FULL))
+  {
+    rapidjson::Document doc;
+    doc.SetObject();
+    INSERT_INTO_JSON_OBJECT(doc, doc, first_height, first->height);
+    rapidjson::Value blocks(rapidjson::kArrayType);
+    for (size_t i = 0; i < count; ++i)
+    {
+      rapidjson::Value val;
+      cryptonote::json::toJsonValue(doc, *first[i].b, val);
+      blocks.PushBack(val, doc.GetAllocator());
+    }
+    doc.AddMember("blocks", blocks, doc.GetAllocator());
+    send(EVENT_CHAIN_MAIN, FORMAT_JSON_FULL, to_json(doc));
+  }
+  if (wants(EVENT_CHAIN_MAIN, FORMAT_BIN_FULL))
+  {
+    chain_main_full m;
+    m.first_height = first->height;
+    m.blocks.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+      m.blocks.push_back(block_to_blob(*first[i].b));
+    send(EVENT_CHAIN_MAIN, FORMAT_BIN_FULL, to_binary(m));
+  }
+}
+
+void ZmqPub::send(event_kind kind, event_format format, const std::string &payload)
+{
+  const char *name = topic_name(kind, format);
+  const size_t name_len = strlen(name);
+  zmq::message_t message(name_len + 1 + payload.size());
+  char *data = static_cast<char*>(message.data());
+  memcpy(data, name, name_len);
+  data[name_len] = ':';
+  memcpy(data + name_len + 1, payload.data(), payload.size());
+  pub_socket->send(message);
+}
+
+
+}  // namespace cryptonote
+
+}  // namespace rpc
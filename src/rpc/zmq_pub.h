@@ -0,0 +1,161 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <zmq.hpp>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cryptonote_core/core_event_listener.h"
+
+namespace cryptonote
+{
+
+namespace rpc
+{
+
+static constexpr size_t MAX_QUEUED_PUB_EVENTS = 10000;
+static constexpr int PUB_SUBSCRIPTION_POLL_MS = 100;
+
+/**
+ * @brief publishes main chain and tx pool changes on a ZMQ XPUB socket
+ *
+ * Each message is a single frame, "<topic>:<payload>", where the topic is
+ * one of "<format>-<event>":
+ *
+ *   format: json-minimal, json-full, bin-minimal, bin-full
+ *   event:  chain_main, chain_rollback, txpool_add, txpool_remove
+ *
+ * The bin formats are epee portable storage binary. txpool_remove has no
+ * full formats, the minimal ones already carry all there is.
+ *
+ * The i_core_event_listener callbacks only queue the event; formatting and
+ * sending happen on the publisher's own thread, so publishing never holds
+ * the blockchain or pool locks. Only topics someone is subscribed to are
+ * formatted, and events nobody is subscribed to are not even queued.
+ */
+class ZmqPub : public i_core_event_listener
+{
+  public:
+
+    ZmqPub();
+
+    ~ZmqPub();
+
+    bool addTCPSocket(std::string address, std::string port);
+
+    void run();
+    void stop();
+
+    // i_core_event_listener
+    void on_block_added(uint64_t height, const crypto::hash &id, const block &b) override;
+    void on_block_popped(uint64_t height, const crypto::hash &id, const block &b) override;
+    void on_txpool_add(const crypto::hash &id, const transaction &tx, uint64_t weight, uint64_t fee) override;
+    void on_txpool_remove(const crypto::hash &id, txpool_remove_reason reason) override;
+
+  private:
+    enum event_kind
+    {
+      EVENT_CHAIN_MAIN,
+      EVENT_CHAIN_ROLLBACK,
+      EVENT_TXPOOL_ADD,
+      EVENT_TXPOOL_REMOVE,
+      EVENT_KIND_COUNT
+    };
+
+    enum event_format
+    {
+      FORMAT_JSON_MINIMAL,
+      FORMAT_JSON_FULL,
+      FORMAT_BIN_MINIMAL,
+      FORMAT_BIN_FULL,
+      FORMAT_COUNT
+    };
+
+    struct event
+    {
+      event_kind kind;
+      uint64_t height;
+      crypto::hash id;
+      crypto::hash prev_id;
+      uint64_t weight;
+      uint64_t fee;
+      txpool_remove_reason reason;
+      std::shared_ptr<const block> b;        //!< only set when a full topic is subscribed
+      std::shared_ptr<const transaction> tx; //!< only set when a full topic is subscribed
+    };
+
+    static const char *topic_name(event_kind kind, event_format format);
+
+    void serve();
+    void push(event &&ev);
+    void read_subscriptions();
+    void publish(const std::vector<event> &events);
+    void publish_chain_main(const event *first, size_t count);
+    void send(event_kind kind, event_format format, const std::string &payload);
+
+    bool wants(event_kind kind, event_format format) const
+    {
+      return m_subscribed[kind].load(std::memory_order_relaxed) & (1u << format);
+    }
+    bool wants_any(event_kind kind) const { return m_subscribed[kind].load(std::memory_order_relaxed) != 0; }
+    bool wants_full(event_kind kind) const { return wants(kind, FORMAT_JSON_FULL) || wants(kind, FORMAT_BIN_FULL); }
+
+    volatile bool stop_signal;
+    volatile bool running;
+
+    zmq::context_t context;
+
+    boost::thread run_thread;
+
+    std::unique_ptr<zmq::socket_t> pub_socket;
+
+    //! subscribed prefixes, as reported by the XPUB socket
+    std::set<std::string> m_prefixes;
+    //! per event kind, a bit per event_format with at least one subscriber
+    std::atomic<unsigned> m_subscribed[EVENT_KIND_COUNT];
+
+    boost::mutex m_queue_lock;
+    boost::condition_variable m_queue_cond;
+    std::deque<event> m_queue;
+    uint64_t m_dropped;
+};
+
+
+}  // namespace cryptonote
+
+}  // namespace rpc
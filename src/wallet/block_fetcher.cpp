@@ -0,0 +1,235 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <cmath>
+
+#include "misc_log_ex.h"
+#include "block_fetcher.h"
+
+#undef XCASH_DEFAULT_LOG_CATEGORY
+#define XCASH_DEFAULT_LOG_CATEGORY "wallet.fetcher"
+
+#define BLOCK_FETCHER_MAX_ATTEMPTS 3
+#define BLOCK_FETCHER_INITIAL_DEPTH 2
+#define BLOCK_FETCHER_MIN_CONSUME_TIME 1000 // microseconds
+
+namespace
+{
+  void update_average(double &average, double sample)
+  {
+    average = average == 0 ? sample : average * 0.75 + sample * 0.25;
+  }
+}
+
+namespace tools
+{
+//----------------------------------------------------------------------------------------------------
+block_fetcher::block_fetcher(fetch_t fetch, size_t workers, uint64_t start_height, uint64_t stop_height, uint64_t range_size):
+  m_fetch(std::move(fetch)),
+  m_stop_height(stop_height),
+  m_range_size(std::max<uint64_t>(range_size, 1)),
+  m_max_depth(std::max<size_t>(workers, 1)),
+  m_next_height(start_height),
+  m_next_request(start_height),
+  m_in_flight(0),
+  m_depth(std::min<size_t>(BLOCK_FETCHER_INITIAL_DEPTH, m_max_depth)),
+  m_stopped(false),
+  m_fetch_time(0),
+  m_consume_time(0),
+  m_returned(false)
+{
+  MDEBUG("Fetching blocks " << start_height << " to " << stop_height << " with " << m_max_depth << " workers");
+  m_threads.reserve(m_max_depth);
+  for (size_t n = 0; n < m_max_depth; ++n)
+    m_threads.push_back(boost::thread(boost::bind(&block_fetcher::run, this, n)));
+}
+//----------------------------------------------------------------------------------------------------
+block_fetcher::~block_fetcher()
+{
+  stop();
+}
+//----------------------------------------------------------------------------------------------------
+void block_fetcher::stop()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_stopped = true;
+    m_cond.notify_all();
+  }
+  for (boost::thread &thread: m_threads)
+    if (thread.joinable())
+      thread.join();
+}
+//----------------------------------------------------------------------------------------------------
+size_t block_fetcher::depth() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  return m_depth;
+}
+//----------------------------------------------------------------------------------------------------
+bool block_fetcher::finished() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  return m_stopped || m_next_height >= m_stop_height;
+}
+//----------------------------------------------------------------------------------------------------
+bool block_fetcher::take(uint64_t &start_height, pending &p)
+{
+  // the rest of a range which came back short, or failed, is needed before
+  // the ranges already fetched can be used, so it does not count against
+  // the depth
+  if (!m_retries.empty() && m_retries.begin()->first < m_stop_height)
+  {
+    auto i = m_retries.begin();
+    start_height = i->first;
+    p = i->second;
+    m_retries.erase(i);
+    return true;
+  }
+
+  if (m_next_request >= m_stop_height || m_in_flight + m_ready.size() >= m_depth)
+    return false;
+  start_height = m_next_request;
+  p.end_height = std::min(m_next_request + m_range_size, m_stop_height);
+  p.attempts = 0;
+  m_next_request = p.end_height;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void block_fetcher::run(size_t worker)
+{
+  while (true)
+  {
+    uint64_t start_height;
+    pending p;
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      while (!m_stopped && !take(start_height, p))
+        m_cond.wait(lock);
+      if (m_stopped)
+        return;
+      ++m_in_flight;
+    }
+
+    range r;
+    bool r_ok = false;
+    const auto start = std::chrono::steady_clock::now();
+    try
+    {
+      r_ok = m_fetch(worker, start_height, r);
+    }
+    catch (const std::exception &e)
+    {
+      MDEBUG("Worker " << worker << " failed to fetch blocks from " << start_height << ": " << e.what());
+    }
+    const double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (r_ok && (r.start_height != start_height || r.blocks.empty() || r.blocks.size() != r.o_indices.size()))
+    {
+      MDEBUG("Worker " << worker << " got an unexpected reply for blocks from " << start_height);
+      r_ok = false;
+    }
+    if (r_ok && r.blocks.size() > p.end_height - start_height)
+    {
+      r.blocks.resize(p.end_height - start_height);
+      r.o_indices.resize(p.end_height - start_height);
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    --m_in_flight;
+    if (r_ok)
+    {
+      update_average(m_fetch_time, elapsed);
+      r.worker = worker;
+      const uint64_t end_height = start_height + r.blocks.size();
+      if (end_height < p.end_height)
+        m_retries[end_height] = {p.end_height, 0};
+      m_ready[start_height] = std::move(r);
+    }
+    else if (++p.attempts < BLOCK_FETCHER_MAX_ATTEMPTS)
+    {
+      m_retries[start_height] = p;
+    }
+    else if (start_height < m_stop_height)
+    {
+      // the ranges before this one can still be used
+      MWARNING("Failed to fetch blocks from " << start_height << " after " << p.attempts << " attempts");
+      m_stop_height = start_height;
+    }
+    m_cond.notify_all();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void block_fetcher::update_depth()
+{
+  if (m_fetch_time == 0 || m_consume_time == 0)
+    return;
+
+  // enough ranges in flight that one arrives each time the caller is done
+  // with the previous one, plus one to absorb jitter
+  const double ratio = m_fetch_time / std::max<double>(m_consume_time, BLOCK_FETCHER_MIN_CONSUME_TIME);
+  const size_t depth = std::min<size_t>(m_max_depth, (size_t)std::ceil(ratio) + 1);
+  if (depth != m_depth)
+  {
+    MDEBUG("Block fetch depth " << m_depth << " -> " << depth << " (fetch " << m_fetch_time / 1000 << " ms, consume " << m_consume_time / 1000 << " ms)");
+    m_depth = depth;
+    m_cond.notify_all();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool block_fetcher::next(range &r)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+
+  // time the caller spent on the previous range
+  if (m_returned)
+    update_average(m_consume_time, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_last_returned).count());
+  update_depth();
+
+  std::map<uint64_t, range>::iterator i;
+  while (true)
+  {
+    if (m_stopped || m_next_height >= m_stop_height)
+      return false;
+    i = m_ready.find(m_next_height);
+    if (i != m_ready.end())
+      break;
+    m_cond.wait(lock);
+  }
+
+  r = std::move(i->second);
+  m_ready.erase(i);
+  m_next_height += r.blocks.size();
+  m_returned = true;
+  m_last_returned = std::chrono::steady_clock::now();
+  m_cond.notify_all();
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <vector>
+#include <functional>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "cryptonote_config.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+namespace tools
+{
+  /**
+   * @brief keeps several block range requests in flight, and hands the
+   *        ranges back in height order
+   *
+   * Heights from start to stop are split into ranges of range_size blocks,
+   * each fetched by one of the workers.  A daemon may return fewer blocks
+   * than asked for (the reply is size capped), in which case the rest of the
+   * range is queued again ahead of any new range.  A range which fails is
+   * retried, possibly by another worker, before the fetcher gives up on it
+   * and everything after it.
+   *
+   * The number of ranges in flight or waiting to be taken (the depth) is
+   * adapted to how long a fetch takes compared to how long the caller takes
+   * between two calls to next(), so that a slow link gets enough requests in
+   * flight to keep the caller busy, without buffering more than needed.
+   *
+   * The fetcher only checks that ranges join up by height; checking that
+   * the blocks themselves chain is left to the caller.
+   */
+  class block_fetcher
+  {
+  public:
+    struct range
+    {
+      uint64_t start_height;
+      size_t worker;                   // the worker which fetched it, set by the fetcher
+      std::vector<cryptonote::block_complete_entry> blocks;
+      std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+    };
+
+    /**
+     * @brief fetches blocks from start_height on, through a worker's connection
+     *
+     * Called concurrently from all workers, each with its own index.
+     *
+     * @return false on failure
+     */
+    typedef std::function<bool(size_t worker, uint64_t start_height, range &r)> fetch_t;
+
+    block_fetcher(fetch_t fetch, size_t workers, uint64_t start_height, uint64_t stop_height, uint64_t range_size = COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT);
+    ~block_fetcher();
+
+    /**
+     * @brief waits for the range following the last one returned
+     *
+     * @return false once stop_height is reached, or the start of a range
+     *         which could not be fetched
+     */
+    bool next(range &r);
+
+    void stop();
+    size_t depth() const;
+
+    /**
+     * @brief whether next() has nothing more to return
+     */
+    bool finished() const;
+
+  private:
+    struct pending
+    {
+      uint64_t end_height;
+      unsigned attempts;
+    };
+
+    void run(size_t worker);
+    bool take(uint64_t &start_height, pending &p);
+    void update_depth();
+
+    fetch_t m_fetch;
+    uint64_t m_stop_height;            // lowered to the first range which failed
+    const uint64_t m_range_size;
+    const size_t m_max_depth;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    std::vector<boost::thread> m_threads;
+    uint64_t m_next_height;            // first height next() returns
+    uint64_t m_next_request;           // first height no range was made for yet
+    std::map<uint64_t, pending> m_retries;
+    std::map<uint64_t, range> m_ready;
+    size_t m_in_flight;
+    size_t m_depth;
+    bool m_stopped;
+
+    // moving averages, in microseconds, 0 until first measured
+    double m_fetch_time;
+    double m_consume_time;
+    bool m_returned;
+    std::chrono::steady_clock::time_point m_last_returned;
+  };
+}
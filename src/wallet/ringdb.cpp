@@ -33,6 +33,7 @@
 #include "misc_log_ex.h"
 #include "misc_language.h"
 #include "wallet_errors.h"
+#include "common/threadpool.h"
 #include "ringdb.h"
 
 #undef XCASH_DEFAULT_LOG_CATEGORY
@@ -133,20 +134,22 @@ static std::string decrypt(const std::string &ciphertext, const crypto::key_imag
   return plaintext;
 }
 
-static void store_relative_ring(MDB_txn *txn, MDB_dbi &dbi, const crypto::key_image &key_image, const std::vector<uint64_t> &relative_ring, const crypto::chacha_key &chacha_key)
+static void put_encrypted_ring(MDB_txn *txn, MDB_dbi &dbi, const std::string &key_ciphertext, const std::string &data_ciphertext)
 {
   MDB_val key, data;
-  std::string key_ciphertext = encrypt(key_image, chacha_key);
   key.mv_data = (void*)key_ciphertext.data();
   key.mv_size = key_ciphertext.size();
-  std::string compressed_ring = compress_ring(relative_ring);
-  std::string data_ciphertext = encrypt(compressed_ring, key_image, chacha_key);
   data.mv_size = data_ciphertext.size();
   data.mv_data = (void*)data_ciphertext.c_str();
   int dbr = mdb_put(txn, dbi, &key, &data, 0);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set ring for key image in LMDB table: " + std::string(mdb_strerror(dbr)));
 }
 
+static void store_relative_ring(MDB_txn *txn, MDB_dbi &dbi, const crypto::key_image &key_image, const std::vector<uint64_t> &relative_ring, const crypto::chacha_key &chacha_key)
+{
+  put_encrypted_ring(txn, dbi, encrypt(key_image, chacha_key), encrypt(compress_ring(relative_ring), key_image, chacha_key));
+}
+
 static int resize_env(MDB_env *env, const char *db_path, size_t needed)
 {
   MDB_envinfo mei;
@@ -198,7 +201,8 @@ namespace tools
 
 ringdb::ringdb(std::string filename, const std::string &genesis):
   filename(filename),
-  env(NULL)
+  env(NULL),
+  batch_txn(NULL)
 {
   MDB_txn *txn;
   bool tx_active = false;
@@ -240,6 +244,8 @@ ringdb::~ringdb()
 
 void ringdb::close()
 {
+  if (batch_txn)
+    batch_abort();
   if (env)
   {
     mdb_dbi_close(env, dbi_rings);
@@ -249,18 +255,130 @@ void ringdb::close()
   }
 }
 
-bool ringdb::add_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx)
+MDB_txn *ringdb::begin_txn(size_t needed, bool &own)
 {
-  MDB_txn *txn;
-  int dbr;
-  bool tx_active = false;
+  if (batch_txn)
+  {
+    own = false;
+    return batch_txn;
+  }
 
-  dbr = resize_env(env, filename.c_str(), get_ring_data_size(tx.vin.size()));
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size");
+  MDB_txn *txn;
+  int dbr = resize_env(env, filename.c_str(), needed);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
   dbr = mdb_txn_begin(env, NULL, 0, &txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  own = true;
+  return txn;
+}
+
+void ringdb::commit_txn(MDB_txn *txn, bool &own, const char *what)
+{
+  if (!own)
+    return;
+  int dbr = mdb_txn_commit(txn);
+  own = false;
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, std::string("Failed to commit txn ") + what + ": " + std::string(mdb_strerror(dbr)));
+}
+
+void ringdb::queue_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, const std::vector<uint64_t> &relative_ring)
+{
+  // pending rings are all encrypted with the same key, write them out before switching
+  if (batch_key && memcmp(batch_key->data(), chacha_key.data(), sizeof(chacha_key)))
+    flush_pending_rings();
+  if (!batch_key)
+    batch_key = chacha_key;
+  pending_rings[key_image] = relative_ring;
+}
+
+void ringdb::flush_pending_rings()
+{
+  if (pending_rings.empty())
+  {
+    batch_key = boost::none;
+    return;
+  }
+
+  struct encrypted_ring
+  {
+    const crypto::key_image *key_image;
+    const std::vector<uint64_t> *ring;
+    std::string key_ciphertext;
+    std::string data_ciphertext;
+  };
+  std::vector<encrypted_ring> rings;
+  rings.reserve(pending_rings.size());
+  for (const auto &e: pending_rings)
+    rings.push_back({&e.first, &e.second, std::string(), std::string()});
+
+  const crypto::chacha_key &chacha_key = *batch_key;
+  auto encrypt_range = [&rings, &chacha_key](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+    {
+      rings[i].key_ciphertext = encrypt(*rings[i].key_image, chacha_key);
+      rings[i].data_ciphertext = encrypt(compress_ring(*rings[i].ring), *rings[i].key_image, chacha_key);
+    }
+  };
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t slice = 64;
+  if (rings.size() > slice && tpool.get_max_concurrency() > 1)
+  {
+    tools::threadpool::waiter waiter;
+    for (size_t begin = 0; begin < rings.size(); begin += slice)
+      tpool.submit(&waiter, [&encrypt_range, &rings, begin, slice](){ encrypt_range(begin, std::min(begin + slice, rings.size())); }, true);
+    waiter.wait(&tpool);
+  }
+  else
+  {
+    encrypt_range(0, rings.size());
+  }
+
+  // insert in table order, which keeps page splits down
+  std::sort(rings.begin(), rings.end(), [](const encrypted_ring &a, const encrypted_ring &b) {
+    const MDB_val va = { a.key_ciphertext.size(), (void*)a.key_ciphertext.data() };
+    const MDB_val vb = { b.key_ciphertext.size(), (void*)b.key_ciphertext.data() };
+    return compare_hash32(&va, &vb) < 0;
+  });
+  for (const auto &ring: rings)
+    put_encrypted_ring(batch_txn, dbi_rings, ring.key_ciphertext, ring.data_ciphertext);
+
+  MDEBUG("Stored " << rings.size() << " batched rings");
+  pending_rings.clear();
+  batch_key = boost::none;
+}
+
+void ringdb::batch_start(size_t n_entries)
+{
+  THROW_WALLET_EXCEPTION_IF(batch_txn, tools::error::wallet_internal_error, "ringdb batch already active");
+  bool own;
+  batch_txn = begin_txn(get_ring_data_size(n_entries), own);
+}
+
+void ringdb::batch_stop()
+{
+  THROW_WALLET_EXCEPTION_IF(!batch_txn, tools::error::wallet_internal_error, "ringdb batch not active");
+  epee::misc_utils::auto_scope_leave_caller batch_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (batch_txn) batch_abort();});
+  flush_pending_rings();
+  MDB_txn *txn = batch_txn;
+  batch_txn = NULL;
+  bool own = true;
+  commit_txn(txn, own, "writing ring batch to database");
+}
+
+void ringdb::batch_abort()
+{
+  THROW_WALLET_EXCEPTION_IF(!batch_txn, tools::error::wallet_internal_error, "ringdb batch not active");
+  mdb_txn_abort(batch_txn);
+  batch_txn = NULL;
+  pending_rings.clear();
+  batch_key = boost::none;
+}
+
+bool ringdb::add_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx)
+{
+  bool tx_active = false;
+  MDB_txn *txn = begin_txn(get_ring_data_size(tx.vin.size()), tx_active);
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
-  tx_active = true;
 
   for (const auto &in: tx.vin)
   {
@@ -271,27 +389,25 @@ bool ringdb::add_rings(const crypto::chacha_key &chacha_key, const cryptonote::t
     if (ring_size == 1)
       continue;
 
-    store_relative_ring(txn, dbi_rings, txin.k_image, txin.key_offsets, chacha_key);
+    if (batch_txn)
+      queue_ring(chacha_key, txin.k_image, txin.key_offsets);
+    else
+      store_relative_ring(txn, dbi_rings, txin.k_image, txin.key_offsets, chacha_key);
   }
 
-  dbr = mdb_txn_commit(txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn adding ring to database: " + std::string(mdb_strerror(dbr)));
-  tx_active = false;
+  commit_txn(txn, tx_active, "adding ring to database");
   return true;
 }
 
 bool ringdb::remove_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx)
 {
-  MDB_txn *txn;
   int dbr;
   bool tx_active = false;
 
-  dbr = resize_env(env, filename.c_str(), 0);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size");
-  dbr = mdb_txn_begin(env, NULL, 0, &txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  if (batch_txn)
+    flush_pending_rings();
+  MDB_txn *txn = begin_txn(0, tx_active);
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
-  tx_active = true;
 
   for (const auto &in: tx.vin)
   {
@@ -318,24 +434,19 @@ bool ringdb::remove_rings(const crypto::chacha_key &chacha_key, const cryptonote
     THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to remove ring to database: " + std::string(mdb_strerror(dbr)));
   }
 
-  dbr = mdb_txn_commit(txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn removing ring to database: " + std::string(mdb_strerror(dbr)));
-  tx_active = false;
+  commit_txn(txn, tx_active, "removing ring to database");
   return true;
 }
 
 bool ringdb::get_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, std::vector<uint64_t> &outs)
 {
-  MDB_txn *txn;
   int dbr;
   bool tx_active = false;
 
-  dbr = resize_env(env, filename.c_str(), 0);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
-  dbr = mdb_txn_begin(env, NULL, 0, &txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  if (batch_txn)
+    flush_pending_rings();
+  MDB_txn *txn = begin_txn(0, tx_active);
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
-  tx_active = true;
 
   MDB_val key, data;
   std::string key_ciphertext = encrypt(key_image, chacha_key);
@@ -354,36 +465,30 @@ bool ringdb::get_ring(const crypto::chacha_key &chacha_key, const crypto::key_im
   outs = cryptonote::relative_output_offsets_to_absolute(outs);
   MDEBUG("Absolute: " << boost::join(outs | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " "));
 
-  dbr = mdb_txn_commit(txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn getting ring from database: " + std::string(mdb_strerror(dbr)));
-  tx_active = false;
+  commit_txn(txn, tx_active, "getting ring from database");
   return true;
 }
 
 bool ringdb::set_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, const std::vector<uint64_t> &outs, bool relative)
 {
-  MDB_txn *txn;
-  int dbr;
-  bool tx_active = false;
+  if (batch_txn)
+  {
+    queue_ring(chacha_key, key_image, relative ? outs : cryptonote::absolute_output_offsets_to_relative(outs));
+    return true;
+  }
 
-  dbr = resize_env(env, filename.c_str(), outs.size() * 64);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
-  dbr = mdb_txn_begin(env, NULL, 0, &txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  bool tx_active = false;
+  MDB_txn *txn = begin_txn(outs.size() * 64, tx_active);
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
-  tx_active = true;
 
   store_relative_ring(txn, dbi_rings, key_image, relative ? outs : cryptonote::absolute_output_offsets_to_relative(outs), chacha_key);
 
-  dbr = mdb_txn_commit(txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn setting ring to database: " + std::string(mdb_strerror(dbr)));
-  tx_active = false;
+  commit_txn(txn, tx_active, "setting ring to database");
   return true;
 }
 
 bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &outputs, int op)
 {
-  MDB_txn *txn;
   MDB_cursor *cursor;
   int dbr;
   bool tx_active = false;
@@ -391,18 +496,24 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
 
   THROW_WALLET_EXCEPTION_IF(outputs.size() > 1 && op == BLACKBALL_QUERY, tools::error::wallet_internal_error, "Blackball query only makes sense for a single output");
 
-  dbr = resize_env(env, filename.c_str(), 32 * 2 * outputs.size()); // a pubkey, and some slack
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
-  dbr = mdb_txn_begin(env, NULL, 0, &txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  MDB_txn *txn = begin_txn(32 * 2 * outputs.size(), tx_active); // a pubkey, and some slack
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
-  tx_active = true;
 
   dbr = mdb_cursor_open(txn, dbi_blackballs, &cursor);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create cursor for blackballs table: " + std::string(mdb_strerror(dbr)));
 
+  // bulk loads go in key order, so most outputs can be appended
+  std::vector<std::pair<uint64_t, uint64_t>> sorted_outputs;
+  const std::vector<std::pair<uint64_t, uint64_t>> *ordered_outputs = &outputs;
+  if (op == BLACKBALL_BLACKBALL && outputs.size() > 1 && !std::is_sorted(outputs.begin(), outputs.end()))
+  {
+    sorted_outputs = outputs;
+    std::sort(sorted_outputs.begin(), sorted_outputs.end());
+    ordered_outputs = &sorted_outputs;
+  }
+
   MDB_val key, data;
-  for (const std::pair<uint64_t, uint64_t> &output: outputs)
+  for (const std::pair<uint64_t, uint64_t> &output: *ordered_outputs)
   {
     key.mv_data = (void*)&output.first;
     key.mv_size = sizeof(output.first);
@@ -415,7 +526,12 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
         MDEBUG("Marking output " << output.first << "/" << output.second << " as spent");
         dbr = mdb_cursor_put(cursor, &key, &data, MDB_APPENDDUP);
         if (dbr == MDB_KEYEXIST)
-          dbr = 0;
+        {
+          // either already there, or lower than the last one for this amount
+          dbr = mdb_cursor_put(cursor, &key, &data, MDB_NODUPDATA);
+          if (dbr == MDB_KEYEXIST)
+            dbr = 0;
+        }
         break;
       case BLACKBALL_UNBLACKBALL:
         MDEBUG("Marking output " << output.first << "/" << output.second << " as unspent");
@@ -446,9 +562,7 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
     THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to clear blackballs table: " + std::string(mdb_strerror(dbr)));
   }
 
-  dbr = mdb_txn_commit(txn);
-  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn blackballing output to database: " + std::string(mdb_strerror(dbr)));
-  tx_active = false;
+  commit_txn(txn, tx_active, "blackballing output to database");
   return ret;
 }
 
@@ -30,7 +30,9 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <lmdb.h>
+#include <boost/optional/optional.hpp>
 #include "wipeable_string.h"
 #include "crypto/crypto.h"
 #include "cryptonote_basic/cryptonote_basic.h"
@@ -55,13 +57,29 @@ namespace tools
     bool blackballed(const std::pair<uint64_t, uint64_t> &output);
     bool clear_blackballs();
 
+    // Rings added or set between batch_start and batch_stop are encrypted
+    // together and written in a single LMDB transaction when the batch stops.
+    // Other calls made while a batch is active run in the batch's transaction.
+    void batch_start(size_t n_entries = 0);
+    void batch_stop();
+    void batch_abort();
+    bool batch_active() const { return batch_txn != NULL; }
+
   private:
     bool blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &outputs, int op);
+    MDB_txn *begin_txn(size_t needed, bool &own);
+    void commit_txn(MDB_txn *txn, bool &own, const char *what);
+    void queue_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, const std::vector<uint64_t> &relative_ring);
+    void flush_pending_rings();
 
   private:
     std::string filename;
     MDB_env *env;
     MDB_dbi dbi_rings;
     MDB_dbi dbi_blackballs;
+
+    MDB_txn *batch_txn;
+    boost::optional<crypto::chacha_key> batch_key;
+    std::unordered_map<crypto::key_image, std::vector<uint64_t>> pending_rings;
   };
 }
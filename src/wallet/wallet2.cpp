@@ -28,6 +28,7 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <deque>
 #include <numeric>
 #include <random>
 #include <tuple>
@@ -37,6 +38,7 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/version.hpp>
 #include "include_base_utils.h"
 using namespace epee;
@@ -44,6 +46,7 @@ using namespace epee;
 #include "cryptonote_config.h"
 #include "wallet2.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/blocks_stream.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "misc_language.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
@@ -70,6 +73,7 @@ using namespace epee;
 #include "common/notify.h"
 #include "ringct/rctSigs.h"
 #include "ringdb.h"
+#include "wallet_cache_journal.h"
 
 extern "C"
 {
@@ -108,6 +112,7 @@ using namespace cryptonote;
 
 #define SUBADDRESS_LOOKAHEAD_MAJOR 50
 #define SUBADDRESS_LOOKAHEAD_MINOR 200
+#define SUBADDRESS_GENERATION_CHUNK 1024 // subaddresses per threadpool job when generating many at once
 
 #define KEY_IMAGE_EXPORT_FILE_MAGIC "X-CASH key image export\002"
 
@@ -122,8 +127,15 @@ using namespace cryptonote;
 
 #define FIRST_REFRESH_GRANULARITY     1024
 
+#define DEFAULT_MAX_REFRESH_REQUESTS 4
+#define REFRESH_FETCHER_MIN_BLOCKS (2 * COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT) // don't bother with fewer blocks to go
+#define REFRESH_FETCHER_TIP_DISTANCE 20 // blocks near the tip are pulled one range at a time, which handles reorgs
+#define REFRESH_FETCHER_MAX_STARTS 3 // a fetcher which keeps getting stopped is not worth restarting
+
 #define GAMMA_PICK_HALF_WINDOW 5
 
+#define OUTPUT_SCAN_BATCH_SIZE 256 // keys per batched derivation job when scanning with software keys
+
 static const std::string MULTISIG_SIGNATURE_MAGIC = "SigMultisigPkV1";
 static const std::string MULTISIG_EXTRA_INFO_MAGIC = "MultisigxV1";
 
@@ -173,6 +185,140 @@ namespace
 
     return public_keys;
   }
+
+  // sections of a cache journal record, each replacing one part of the
+  // wallet cache
+  enum cache_journal_section_type: uint8_t
+  {
+    CACHE_JOURNAL_TRANSFERS = 0,
+    CACHE_JOURNAL_HASHCHAIN = 1,
+    CACHE_JOURNAL_PAYMENTS = 2,
+    CACHE_JOURNAL_CONFIRMED_TXS = 3,
+    CACHE_JOURNAL_STATE = 4,
+    CACHE_JOURNAL_SUBADDRESSES = 5,
+    CACHE_JOURNAL_TX_KEYS = 6,
+  };
+
+  struct cache_journal_section
+  {
+    uint8_t type;
+    std::string data;
+
+    BEGIN_SERIALIZE_OBJECT()
+      FIELD(type)
+      FIELD(data)
+    END_SERIALIZE()
+  };
+
+  // one store's worth of changes, applied as a whole or not at all. The iv
+  // ties the record to the snapshot it applies on top of.
+  struct cache_journal_record
+  {
+    crypto::chacha_iv snapshot_iv;
+    std::vector<cache_journal_section> sections;
+
+    BEGIN_SERIALIZE_OBJECT()
+      FIELD(snapshot_iv)
+      FIELD(sections)
+    END_SERIALIZE()
+  };
+
+  // accumulates plain fields into a short fingerprint, used to spot which
+  // parts of the wallet changed since the cache was last stored
+  struct fingerprinter
+  {
+    std::string data;
+
+    template<typename T>
+    fingerprinter &add(const T &t)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "Only plain fields can be fingerprinted");
+      data.append((const char*)&t, sizeof(t));
+      return *this;
+    }
+
+    uint64_t get() const
+    {
+      crypto::hash hash;
+      crypto::cn_fast_hash(data.data(), data.size(), hash);
+      uint64_t fingerprint;
+      memcpy(&fingerprint, &hash, sizeof(fingerprint));
+      return fingerprint;
+    }
+  };
+
+  uint64_t transfer_fingerprint(const tools::wallet2::transfer_details &td)
+  {
+    fingerprinter f;
+    f.add(td.m_block_height).add(td.m_txid).add(td.m_internal_output_index).add(td.m_global_output_index)
+      .add(td.m_spent).add(td.m_spent_height).add(td.m_key_image).add(td.m_mask).add(td.m_amount).add(td.m_rct)
+      .add(td.m_key_image_known).add(td.m_pk_index).add(td.m_subaddr_index).add(td.m_key_image_partial);
+    for (const rct::key &k: td.m_multisig_k)
+      f.add(k);
+    for (const auto &info: td.m_multisig_info)
+    {
+      f.add(info.m_signer);
+      for (const auto &lr: info.m_LR)
+        f.add(lr.m_L).add(lr.m_R);
+      for (const crypto::key_image &ki: info.m_partial_key_images)
+        f.add(ki);
+    }
+    return f.get();
+  }
+
+  // (height, fingerprint) of every entry, sorted, so two states can be
+  // compared to find the lowest height at which they differ
+  std::vector<std::pair<uint64_t, uint64_t>> payment_fingerprints(const tools::wallet2::payment_container &payments)
+  {
+    std::vector<std::pair<uint64_t, uint64_t>> fingerprints;
+    fingerprints.reserve(payments.size());
+    for (const auto &p: payments)
+    {
+      const tools::wallet2::payment_details &pd = p.second;
+      fingerprinter f;
+      f.add(p.first).add(pd.m_tx_hash).add(pd.m_amount).add(pd.m_fee).add(pd.m_block_height).add(pd.m_unlock_time)
+        .add(pd.m_timestamp).add(pd.m_coinbase).add(pd.m_subaddr_index);
+      fingerprints.push_back({pd.m_block_height, f.get()});
+    }
+    std::sort(fingerprints.begin(), fingerprints.end());
+    return fingerprints;
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> confirmed_tx_fingerprints(const std::unordered_map<crypto::hash, tools::wallet2::confirmed_transfer_details> &txs)
+  {
+    std::vector<std::pair<uint64_t, uint64_t>> fingerprints;
+    fingerprints.reserve(txs.size());
+    for (const auto &tx: txs)
+    {
+      const tools::wallet2::confirmed_transfer_details &ctd = tx.second;
+      fingerprinter f;
+      f.add(tx.first).add(ctd.m_amount_in).add(ctd.m_amount_out).add(ctd.m_change).add(ctd.m_block_height)
+        .add(ctd.m_payment_id).add(ctd.m_timestamp).add(ctd.m_unlock_time).add(ctd.m_subaddr_account);
+      for (const auto &dest: ctd.m_dests)
+        f.add(dest.amount).add(dest.addr.m_spend_public_key).add(dest.addr.m_view_public_key).add(dest.is_subaddress);
+      for (uint32_t i: ctd.m_subaddr_indices)
+        f.add(i);
+      for (const auto &ring: ctd.m_rings)
+        f.add(ring.first).add(ring.second.size());
+      fingerprints.push_back({ctd.m_block_height, f.get()});
+    }
+    std::sort(fingerprints.begin(), fingerprints.end());
+    return fingerprints;
+  }
+
+  // the lowest height from which two sorted fingerprint lists differ, or
+  // none if they are the same
+  boost::optional<uint64_t> first_changed_height(const std::vector<std::pair<uint64_t, uint64_t>> &a, const std::vector<std::pair<uint64_t, uint64_t>> &b)
+  {
+    const auto mismatch = std::mismatch(a.begin(), a.begin() + std::min(a.size(), b.size()), b.begin());
+    if (mismatch.first != a.end() && mismatch.second != b.end())
+      return std::min(mismatch.first->first, mismatch.second->first);
+    if (mismatch.first != a.end())
+      return mismatch.first->first;
+    if (mismatch.second != b.end())
+      return mismatch.second->first;
+    return boost::none;
+  }
 }
 
 namespace
@@ -204,6 +350,8 @@ struct options {
   const command_line::arg_descriptor<uint64_t> kdf_rounds = {"kdf-rounds", tools::wallet2::tr("Number of rounds for the key derivation function"), 1};
   const command_line::arg_descriptor<std::string> hw_device = {"hw-device", tools::wallet2::tr("HW device to use"), ""};
   const command_line::arg_descriptor<std::string> tx_notify = { "tx-notify" , "Run a program for each new incoming transaction, '%s' will be replaced by the transaction hash" , "" };
+  const command_line::arg_descriptor<std::vector<std::string>> refresh_daemon = {"refresh-daemon", tools::wallet2::tr("Also fetch blocks from daemon instance at [http[s]://][<username>[:<password>]@]<host>:<port> when refreshing, may be repeated")};
+  const command_line::arg_descriptor<uint32_t> max_refresh_requests = {"max-refresh-requests", tools::wallet2::tr("Maximum number of block requests in flight when refreshing, 1 to fetch one at a time"), DEFAULT_MAX_REFRESH_REQUESTS};
 };
 
 void do_prepare_file_names(const std::string& file_path, std::string& keys_file, std::string& wallet_file)
@@ -305,11 +453,35 @@ std::unique_ptr<tools::wallet2> make_basic(const boost::program_options::variabl
     catch (const std::exception &e) { }
   }
 
+  std::vector<tools::wallet2::refresh_daemon> refresh_daemons;
+  for (const std::string &spec: command_line::get_arg(vm, opts.refresh_daemon))
+  {
+    tools::wallet2::refresh_daemon daemon{spec, boost::none, boost::starts_with(spec, "https://")};
+    const size_t scheme = daemon.address.find("://");
+    const size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+    const size_t at = daemon.address.rfind('@');
+    if (at != std::string::npos && at >= start)
+    {
+      auto parsed = tools::login::parse(
+        daemon.address.substr(start, at - start), false, [password_prompter](bool verify) {
+          return password_prompter("Refresh daemon client password", verify);
+        }
+      );
+      if (!parsed)
+        return nullptr;
+      daemon.login.emplace(std::move(parsed->username), std::move(parsed->password).password());
+      daemon.address.erase(start, at + 1 - start);
+    }
+    refresh_daemons.push_back(std::move(daemon));
+  }
+
   std::unique_ptr<tools::wallet2> wallet(new tools::wallet2(nettype, kdf_rounds, unattended));
   wallet->init(std::move(daemon_address), std::move(login), 0, false, *trusted_daemon);
   boost::filesystem::path ringdb_path = command_line::get_arg(vm, opts.shared_ringdb_dir);
   wallet->set_ring_database(ringdb_path.string());
   wallet->device_name(device_name);
+  wallet->set_refresh_daemons(std::move(refresh_daemons));
+  wallet->max_refresh_requests(command_line::get_arg(vm, opts.max_refresh_requests));
 
   try
   {
@@ -814,6 +986,7 @@ wallet_keys_unlocker::~wallet_keys_unlocker()
 }
 
 wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
+  m_daemon_ssl(false),
   m_multisig_rescan_info(NULL),
   m_multisig_rescan_k(NULL),
   m_run(true),
@@ -850,6 +1023,8 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_kdf_rounds(kdf_rounds),
   is_old_file_format(false),
   m_node_rpc_proxy(m_http_client, m_daemon_rpc_mutex),
+  m_refresh_hashes_start_height(0),
+  m_max_refresh_requests(DEFAULT_MAX_REFRESH_REQUESTS),
   m_subaddress_lookahead_major(SUBADDRESS_LOOKAHEAD_MAJOR),
   m_subaddress_lookahead_minor(SUBADDRESS_LOOKAHEAD_MINOR),
   m_light_wallet(false),
@@ -903,6 +1078,8 @@ void wallet2::init_options(boost::program_options::options_description& desc_par
   command_line::add_arg(desc_params, opts.kdf_rounds);
   command_line::add_arg(desc_params, opts.hw_device);
   command_line::add_arg(desc_params, opts.tx_notify);
+  command_line::add_arg(desc_params, opts.refresh_daemon);
+  command_line::add_arg(desc_params, opts.max_refresh_requests);
 }
 
 std::pair<std::unique_ptr<wallet2>, tools::password_container> wallet2::make_from_json(const boost::program_options::variables_map& vm, bool unattended, const std::string& json_file, const std::function<boost::optional<tools::password_container>(const char *, bool)> &password_prompter)
@@ -955,7 +1132,9 @@ bool wallet2::init(std::string daemon_address, boost::optional<epee::net_utils::
   m_upper_transaction_weight_limit = upper_transaction_weight_limit;
   m_daemon_address = std::move(daemon_address);
   m_daemon_login = std::move(daemon_login);
+  m_daemon_ssl = ssl;
   m_trusted_daemon = trusted_daemon;
+  m_refresh_connections.clear();
   // When switching from light wallet to full wallet, we need to reset the height we got from lw node.
   return m_http_client.set_server(get_daemon_address(), get_daemon_login(), ssl);
 }
@@ -1142,22 +1321,12 @@ void wallet2::add_subaddress(uint32_t index_major, const std::string& label)
 //----------------------------------------------------------------------------------------------------
 void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
 {
-  hw::device &hwdev = m_account.get_device();
   if (m_subaddress_labels.size() <= index.major)
   {
     // add new accounts
-    cryptonote::subaddress_index index2;
     const uint32_t major_end = get_subaddress_clamped_sum(index.major, m_subaddress_lookahead_major);
-    for (index2.major = m_subaddress_labels.size(); index2.major < major_end; ++index2.major)
-    {
-      const uint32_t end = get_subaddress_clamped_sum((index2.major == index.major ? index.minor : 0), m_subaddress_lookahead_minor);
-      const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, 0, end);
-      for (index2.minor = 0; index2.minor < end; ++index2.minor)
-      {
-         const crypto::public_key &D = pkeys[index2.minor];
-         m_subaddresses[D] = index2;
-      }
-    }
+    for (uint32_t major = m_subaddress_labels.size(); major < major_end; ++major)
+      generate_subaddresses(major, get_subaddress_clamped_sum((major == index.major ? index.minor : 0), m_subaddress_lookahead_minor));
     m_subaddress_labels.resize(index.major + 1, {"Untitled account"});
     m_subaddress_labels[index.major].resize(index.minor + 1);
     get_account_tags();
@@ -1165,19 +1334,49 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
   else if (m_subaddress_labels[index.major].size() <= index.minor)
   {
     // add new subaddresses
-    const uint32_t end = get_subaddress_clamped_sum(index.minor, m_subaddress_lookahead_minor);
-    const uint32_t begin = m_subaddress_labels[index.major].size();
-    cryptonote::subaddress_index index2 = {index.major, begin};
-    const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, index2.minor, end);
-    for (; index2.minor < end; ++index2.minor)
-    {
-       const crypto::public_key &D = pkeys[index2.minor - begin];
-       m_subaddresses[D] = index2;
-    }
+    generate_subaddresses(index.major, get_subaddress_clamped_sum(index.minor, m_subaddress_lookahead_minor));
     m_subaddress_labels[index.major].resize(index.minor + 1);
   }
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::generate_subaddresses(uint32_t index_major, uint32_t end)
+{
+  // keys below the table's high water mark were derived by an earlier
+  // expansion, so only the lookahead past it is new
+  const uint32_t begin = m_subaddresses.num_generated(index_major);
+  if (begin >= end)
+    return;
+
+  hw::device &hwdev = m_account.get_device();
+  const uint32_t n_chunks = (end - begin + SUBADDRESS_GENERATION_CHUNK - 1) / SUBADDRESS_GENERATION_CHUNK;
+  if (hwdev.get_type() != hw::device::SOFTWARE || n_chunks < 2)
+  {
+    m_subaddresses.insert(index_major, begin, hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index_major, begin, end));
+    return;
+  }
+
+  // software keys are stateless, so large ranges are derived on the threadpool
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  std::vector<std::vector<crypto::public_key>> pkeys(n_chunks);
+  std::atomic<bool> failed(false);
+  for (uint32_t c = 0; c < n_chunks; ++c)
+  {
+    const uint32_t chunk_begin = begin + c * SUBADDRESS_GENERATION_CHUNK;
+    const uint32_t chunk_end = std::min<uint64_t>((uint64_t)chunk_begin + SUBADDRESS_GENERATION_CHUNK, end);
+    tpool.submit(&waiter, [&, c, chunk_begin, chunk_end]() {
+      try { pkeys[c] = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index_major, chunk_begin, chunk_end); }
+      catch (const std::exception &e) { MERROR("Failed to generate subaddresses: " << e.what()); failed = true; }
+    });
+  }
+  waiter.wait(&tpool);
+  THROW_WALLET_EXCEPTION_IF(failed, error::wallet_internal_error, "Failed to generate subaddresses");
+
+  m_subaddresses.reserve(m_subaddresses.size() + (end - begin));
+  for (uint32_t c = 0; c < n_chunks; ++c)
+    m_subaddresses.insert(index_major, begin + c * SUBADDRESS_GENERATION_CHUNK, pkeys[c]);
+}
+//----------------------------------------------------------------------------------------------------
 std::string wallet2::get_subaddress_label(const cryptonote::subaddress_index& index) const
 {
   if (index.major >= m_subaddress_labels.size() || index.minor >= m_subaddress_labels[index.major].size())
@@ -1419,6 +1618,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
   std::vector<tx_scan_info_t> tx_scan_info(tx.vout.size());
   std::deque<bool> output_found(tx.vout.size(), false);
   uint64_t total_received_1 = 0;
+  std::vector<uint64_t> main_daemon_o_indices;
   while (!tx.vout.empty())
   {
     std::vector<size_t> outs;
@@ -1575,11 +1775,16 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
     {
       //good news - got money! take care about it
       //usually we have only one transfer for user in transaction
+      // blocks fetched from other refresh daemons come without output indices,
+      // process_parsed_blocks usually gets them beforehand
+      if (!pool && o_indices.empty() && tx_cache_data.o_indices.empty() && main_daemon_o_indices.empty())
+        get_tx_output_indices(txid, main_daemon_o_indices);
+      const std::vector<uint64_t> &out_indices = !o_indices.empty() ? o_indices : !tx_cache_data.o_indices.empty() ? tx_cache_data.o_indices : main_daemon_o_indices;
       if (!pool)
       {
-        THROW_WALLET_EXCEPTION_IF(tx.vout.size() != o_indices.size(), error::wallet_internal_error,
+        THROW_WALLET_EXCEPTION_IF(tx.vout.size() != out_indices.size(), error::wallet_internal_error,
             "transactions outputs size=" + std::to_string(tx.vout.size()) +
-            " not match with daemon response size=" + std::to_string(o_indices.size()));
+            " not match with daemon response size=" + std::to_string(out_indices.size()));
       }
 
       for(size_t o: outs)
@@ -1601,7 +1806,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 	    transfer_details& td = m_transfers.back();
 	    td.m_block_height = height;
 	    td.m_internal_output_index = o;
-	    td.m_global_output_index = o_indices[o];
+	    td.m_global_output_index = out_indices[o];
 	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
 	    td.m_txid = txid;
             td.m_key_image = tx_scan_info[o].ki;
@@ -1673,7 +1878,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
             transfer_details &td = m_transfers[kit->second];
 	    td.m_block_height = height;
 	    td.m_internal_output_index = o;
-	    td.m_global_output_index = o_indices[o];
+	    td.m_global_output_index = out_indices[o];
 	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
 	    td.m_txid = txid;
             td.m_amount = amount;
@@ -2021,17 +2226,22 @@ void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::bl
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+{
+  pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices, m_http_client, m_daemon_rpc_mutex);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, epee::net_utils::http::http_simple_client &http_client, boost::mutex &daemon_rpc_mutex, bool prune)
 {
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
   req.block_ids = short_chain_history;
 
-  req.prune = true;
+  req.prune = prune;
   req.start_height = start_height;
   req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
+  daemon_rpc_mutex.lock();
+  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, http_client, rpc_timeout);
+  daemon_rpc_mutex.unlock();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
@@ -2044,6 +2254,72 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
   o_indices = std::move(res.output_indices);
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::pull_blocks_stream(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error)
+{
+  cryptonote::COMMAND_RPC_GET_BLOCKS_STREAM::request req = AUTO_VAL_INIT(req);
+  req.block_ids = short_chain_history;
+  req.start_height = start_height;
+  req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
+
+  // blocks are parsed on the threadpool as soon as their record is complete,
+  // while the rest of the stream is still downloading; deques keep the
+  // entries the parsing jobs refer to in place as more arrive
+  std::deque<cryptonote::block_complete_entry> stream_blocks;
+  std::deque<parsed_block> stream_parsed_blocks;
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  auto waiter_guard = epee::misc_utils::create_scope_leave_handler([&](){ waiter.wait(&tpool); });
+  boost::mutex error_lock;
+  cryptonote::blocks_stream_reader reader;
+  auto body_handler = [&](std::string &piece)
+  {
+    reader.update(piece);
+    cryptonote::blocks_stream_entry entry;
+    while (reader.next(entry))
+    {
+      stream_blocks.push_back(cryptonote::block_complete_entry());
+      stream_parsed_blocks.push_back(parsed_block());
+      cryptonote::block_complete_entry &bce = stream_blocks.back();
+      parsed_block &pb = stream_parsed_blocks.back();
+      bce.block = std::move(entry.block);
+      bce.txs = std::move(entry.txs);
+      pb.o_indices.indices.resize(entry.output_indices.size());
+      for (size_t i = 0; i < entry.output_indices.size(); ++i)
+        pb.o_indices.indices[i].indices = std::move(entry.output_indices[i]);
+      const cryptonote::block_complete_entry *pbce = &bce;
+      parsed_block *ppb = &pb;
+      tpool.submit(&waiter, [this, pbce, ppb, &error, &error_lock](){
+        parse_block_round(pbce->block, ppb->block, ppb->hash, ppb->error);
+        ppb->txes.resize(pbce->txs.size());
+        for (size_t j = 0; j < pbce->txs.size() && !ppb->error; ++j)
+          ppb->error = !parse_and_validate_tx_base_from_blob(pbce->txs[j], ppb->txes[j]);
+        if (ppb->error)
+        {
+          boost::unique_lock<boost::mutex> lock(error_lock);
+          error = true;
+        }
+      }, true);
+    }
+    return !reader.error();
+  };
+
+  m_daemon_rpc_mutex.lock();
+  bool r = net_utils::invoke_http_bin_stream("/get_blocks_stream.bin", req, body_handler, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+  waiter.wait(&tpool);
+  if (!r && !reader.has_header())
+  {
+    MDEBUG("Failed to stream blocks from the daemon, falling back to getblocks.bin");
+    return false;
+  }
+  THROW_WALLET_EXCEPTION_IF(!r || reader.error() || !reader.finished(), error::get_blocks_error, "malformed or truncated blocks stream");
+
+  blocks_start_height = reader.start_height();
+  blocks.assign(std::make_move_iterator(stream_blocks.begin()), std::make_move_iterator(stream_blocks.end()));
+  parsed_blocks.assign(std::make_move_iterator(stream_parsed_blocks.begin()), std::make_move_iterator(stream_parsed_blocks.end()));
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes)
 {
   cryptonote::COMMAND_RPC_GET_HASHES_FAST::request req = AUTO_VAL_INIT(req);
@@ -2110,12 +2386,55 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     }
   };
 
-  for (auto &slot: tx_cache_data)
+  // software keys need no device lock, so derivations and subaddress spend keys
+  // are computed in batches which share a single field inversion per batch
+  const bool batch_scan = hwdev.get_type() == hw::device::SOFTWARE;
+
+  if (batch_scan)
+  {
+    std::vector<wallet2::is_out_data*> iods;
+    for (auto &slot: tx_cache_data)
+    {
+      for (auto &iod: slot.primary)
+        iods.push_back(&iod);
+      for (auto &iod: slot.additional)
+        iods.push_back(&iod);
+    }
+    for (size_t start = 0; start < iods.size(); start += OUTPUT_SCAN_BATCH_SIZE)
+    {
+      const size_t end = std::min<size_t>(start + OUTPUT_SCAN_BATCH_SIZE, iods.size());
+      tpool.submit(&waiter, [&, start, end]() {
+        std::vector<crypto::public_key> pkeys;
+        std::vector<crypto::key_derivation> derivations;
+        std::vector<bool> valid;
+        pkeys.reserve(end - start);
+        for (size_t n = start; n < end; ++n)
+          pkeys.push_back(iods[n]->pkey);
+        crypto::generate_key_derivations(pkeys, keys.m_view_secret_key, derivations, valid);
+        for (size_t n = start; n < end; ++n)
+        {
+          if (valid[n - start])
+          {
+            iods[n]->derivation = derivations[n - start];
+          }
+          else
+          {
+            MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+            memcpy(&iods[n]->derivation, rct::identity().bytes, sizeof(iods[n]->derivation));
+          }
+        }
+      }, true);
+    }
+  }
+  else
   {
-    for (auto &iod: slot.primary)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
-    for (auto &iod: slot.additional)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+    for (auto &slot: tx_cache_data)
+    {
+      for (auto &iod: slot.primary)
+        tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+      for (auto &iod: slot.additional)
+        tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+    }
   }
   waiter.wait(&tpool);
 
@@ -2140,6 +2459,86 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     }
   };
 
+  // batched equivalent of geniod: one entry per (tx, primary pubkey, output),
+  // checked the same way as is_out_to_acc_precomp
+  struct scan_entry
+  {
+    size_t txidx;
+    size_t l;
+    size_t k;
+    const crypto::public_key *key;
+  };
+  std::vector<scan_entry> scan_entries;
+
+  auto add_scan_entries = [&](const cryptonote::transaction &tx, size_t n_vouts, size_t txidx) {
+    for (size_t k = 0; k < n_vouts; ++k)
+    {
+      const auto &o = tx.vout[k];
+      if (o.target.type() == typeid(cryptonote::txout_to_key))
+      {
+        const auto &key = boost::get<txout_to_key>(o.target).key;
+        for (size_t l = 0; l < tx_cache_data[txidx].primary.size(); ++l)
+        {
+          THROW_WALLET_EXCEPTION_IF(tx_cache_data[txidx].primary[l].received.size() != n_vouts,
+              error::wallet_internal_error, "Unexpected received array size");
+          scan_entries.push_back({txidx, l, k, &key});
+        }
+      }
+    }
+  };
+
+  auto check_scan_entries = [&](size_t start, size_t end) {
+    std::vector<crypto::public_key> out_keys;
+    std::vector<crypto::key_derivation> derivations;
+    std::vector<size_t> output_indices;
+    std::vector<size_t> additional_slots(end - start, std::numeric_limits<size_t>::max());
+    for (size_t n = start; n < end; ++n)
+    {
+      const scan_entry &e = scan_entries[n];
+      const auto &cache = tx_cache_data[e.txidx];
+      out_keys.push_back(*e.key);
+      derivations.push_back(cache.primary[e.l].derivation);
+      output_indices.push_back(e.k);
+      // as in geniod, additional derivations are only tried along the first primary pubkey
+      if (e.l == 0 && e.k < cache.additional.size())
+      {
+        additional_slots[n - start] = out_keys.size();
+        out_keys.push_back(*e.key);
+        derivations.push_back(cache.additional[e.k].derivation);
+        output_indices.push_back(e.k);
+      }
+    }
+    std::vector<crypto::public_key> spend_keys;
+    std::vector<bool> valid;
+    crypto::derive_subaddress_public_keys(out_keys, derivations, output_indices, spend_keys, valid);
+    size_t slot = 0;
+    for (size_t n = start; n < end; ++n)
+    {
+      const scan_entry &e = scan_entries[n];
+      auto &cache = tx_cache_data[e.txidx];
+      boost::optional<cryptonote::subaddress_receive_info> &received = cache.primary[e.l].received[e.k];
+      received = boost::none;
+      auto found = valid[slot] ? m_subaddresses.find(spend_keys[slot]) : m_subaddresses.end();
+      if (found != m_subaddresses.end())
+        received = cryptonote::subaddress_receive_info{ found->second, derivations[slot] };
+      ++slot;
+      if (additional_slots[n - start] != std::numeric_limits<size_t>::max())
+      {
+        if (!received)
+        {
+          found = valid[slot] ? m_subaddresses.find(spend_keys[slot]) : m_subaddresses.end();
+          if (found != m_subaddresses.end())
+            received = cryptonote::subaddress_receive_info{ found->second, derivations[slot] };
+        }
+        ++slot;
+      }
+      else if (!received && e.l == 0 && !cache.additional.empty())
+      {
+        MERROR("wrong number of additional derivations");
+      }
+    }
+  };
+
   txidx = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
   {
@@ -2147,20 +2546,66 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     {
       THROW_WALLET_EXCEPTION_IF(txidx >= tx_cache_data.size(), error::wallet_internal_error, "txidx out of range");
       const size_t n_vouts = m_refresh_type == RefreshType::RefreshOptimizeCoinbase ? 1 : parsed_blocks[i].block.miner_tx.vout.size();
-      tpool.submit(&waiter, [&, i, txidx](){ geniod(parsed_blocks[i].block.miner_tx, n_vouts, txidx); }, true);
+      if (batch_scan)
+        add_scan_entries(parsed_blocks[i].block.miner_tx, n_vouts, txidx);
+      else
+        tpool.submit(&waiter, [&, i, txidx](){ geniod(parsed_blocks[i].block.miner_tx, n_vouts, txidx); }, true);
     }
     ++txidx;
     for (size_t j = 0; j < parsed_blocks[i].txes.size(); ++j)
     {
       THROW_WALLET_EXCEPTION_IF(txidx >= tx_cache_data.size(), error::wallet_internal_error, "txidx out of range");
-      tpool.submit(&waiter, [&, i, j, txidx](){ geniod(parsed_blocks[i].txes[j], parsed_blocks[i].txes[j].vout.size(), txidx); }, true);
+      if (batch_scan)
+        add_scan_entries(parsed_blocks[i].txes[j], parsed_blocks[i].txes[j].vout.size(), txidx);
+      else
+        tpool.submit(&waiter, [&, i, j, txidx](){ geniod(parsed_blocks[i].txes[j], parsed_blocks[i].txes[j].vout.size(), txidx); }, true);
       ++txidx;
     }
   }
   THROW_WALLET_EXCEPTION_IF(txidx != tx_cache_data.size(), error::wallet_internal_error, "txidx did not reach expected value");
+  for (size_t start = 0; start < scan_entries.size(); start += OUTPUT_SCAN_BATCH_SIZE)
+  {
+    const size_t end = std::min<size_t>(start + OUTPUT_SCAN_BATCH_SIZE, scan_entries.size());
+    tpool.submit(&waiter, [&check_scan_entries, start, end](){ check_scan_entries(start, end); }, true);
+  }
   waiter.wait(&tpool);
   hwdev.set_mode(hw::device::NONE);
 
+  // blocks fetched from other refresh daemons come without output indices;
+  // those of the txes paying us are got from the main daemon now, rather
+  // than with the ringdb batch open
+  auto pays_us = [](const struct tx_cache_data &cache) {
+    for (const std::vector<is_out_data> *outs: {&cache.primary, &cache.additional})
+      for (const is_out_data &out: *outs)
+        for (const boost::optional<cryptonote::subaddress_receive_info> &received: out.received)
+          if (received)
+            return true;
+    return false;
+  };
+  txidx = 0;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    const std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices> &indices = parsed_blocks[i].o_indices.indices;
+    for (size_t j = 0; j <= parsed_blocks[i].txes.size(); ++j, ++txidx)
+    {
+      if (j < indices.size() && !indices[j].indices.empty())
+        continue;
+      if (!pays_us(tx_cache_data[txidx]))
+        continue;
+      const crypto::hash txid = j == 0 ? get_transaction_hash(parsed_blocks[i].block.miner_tx) : parsed_blocks[i].block.tx_hashes[j - 1];
+      get_tx_output_indices(txid, tx_cache_data[txidx].o_indices);
+    }
+  }
+
+  // rings of our outgoing txes in these blocks go to the ringdb in one write,
+  // sized for the case where every input is ours
+  size_t ringdb_entries = 0;
+  for (const parsed_block &pb: parsed_blocks)
+    for (const cryptonote::transaction &tx: pb.txes)
+      ringdb_entries += tx.vin.size();
+  const bool ringdb_batch = start_ringdb_batch(ringdb_entries);
+  epee::misc_utils::auto_scope_leave_caller ringdb_batch_dtor = epee::misc_utils::create_scope_leave_handler([&](){ if (ringdb_batch) finish_ringdb_batch(); });
+
   size_t tx_cache_data_offset = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
   {
@@ -2190,6 +2635,8 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     ++current_index;
     tx_cache_data_offset += 1 + parsed_blocks[i].txes.size();
   }
+  if (ringdb_batch)
+    stop_ringdb_batch();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::refresh(bool trusted_daemon)
@@ -2204,7 +2651,258 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   refresh(trusted_daemon, start_height, blocks_fetched, received_money);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error)
+void wallet2::parse_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<parsed_block> &parsed_blocks, bool &error)
+{
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  parsed_blocks.resize(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
+      std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+  }
+  waiter.wait(&tpool);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (parsed_blocks[i].error)
+    {
+      error = true;
+      break;
+    }
+    parsed_blocks[i].o_indices = std::move(o_indices[i]);
+  }
+
+  boost::mutex error_lock;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    parsed_blocks[i].txes.resize(blocks[i].txs.size());
+    for (size_t j = 0; j < blocks[i].txs.size(); ++j)
+    {
+      tpool.submit(&waiter, [&, i, j](){
+        if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j], parsed_blocks[i].txes[j]))
+        {
+          boost::unique_lock<boost::mutex> lock(error_lock);
+          error = true;
+        }
+      }, true);
+    }
+  }
+  waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
+std::unique_ptr<block_fetcher> wallet2::start_block_fetcher(uint64_t start_height)
+{
+  if (m_max_refresh_requests <= 1)
+    return nullptr;
+
+  uint64_t daemon_height;
+  if (m_node_rpc_proxy.get_height(daemon_height) || daemon_height < start_height + REFRESH_FETCHER_MIN_BLOCKS)
+    return nullptr;
+
+  // workers are spread over the main daemon and any others, each with a
+  // connection of its own
+  if (m_refresh_connections.size() != m_max_refresh_requests)
+  {
+    m_refresh_connections.clear();
+    for (size_t n = 0; n < m_max_refresh_requests; ++n)
+    {
+      const size_t daemon = n % (m_refresh_daemons.size() + 1);
+      m_refresh_connections.emplace_back(new refresh_connection(daemon));
+      bool r;
+      if (daemon == 0)
+        r = m_refresh_connections.back()->http_client.set_server(m_daemon_address, m_daemon_login, m_daemon_ssl);
+      else
+        r = m_refresh_connections.back()->http_client.set_server(m_refresh_daemons[daemon - 1].address, m_refresh_daemons[daemon - 1].login, m_refresh_daemons[daemon - 1].ssl);
+      if (!r)
+      {
+        MERROR("Failed to set up connection to " << (daemon == 0 ? m_daemon_address : m_refresh_daemons[daemon - 1].address) << ", fetching blocks one range at a time");
+        m_refresh_connections.clear();
+        return nullptr;
+      }
+    }
+  }
+  m_refresh_hashes_start_height = 0;
+  m_refresh_hashes.clear();
+
+  auto fetch = [this](size_t worker, uint64_t start_height, block_fetcher::range &r)
+  {
+    refresh_connection &connection = *m_refresh_connections[worker];
+    uint64_t height;
+    if (connection.node_rpc_proxy.get_height(height) || height <= start_height)
+      return false;
+    // txes from other daemons come whole, so their hashes can be checked
+    pull_blocks(start_height, r.start_height, std::list<crypto::hash>(), r.blocks, r.o_indices, connection.http_client, connection.daemon_rpc_mutex, connection.daemon == 0);
+    return true;
+  };
+  return std::unique_ptr<block_fetcher>(new block_fetcher(fetch, m_refresh_connections.size(), start_height, daemon_height - REFRESH_FETCHER_TIP_DISTANCE));
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_tx_output_indices(const crypto::hash &txid, std::vector<uint64_t> &o_indices)
+{
+  cryptonote::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request req = AUTO_VAL_INIT(req);
+  cryptonote::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response res = AUTO_VAL_INIT(res);
+  req.txid = txid;
+  m_daemon_rpc_mutex.lock();
+  bool r = net_utils::invoke_http_bin("/get_o_indexes.bin", req, res, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_o_indexes.bin");
+  THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_o_indexes.bin");
+  THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_out_indices_error, res.status);
+  o_indices = std::move(res.o_indexes);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::check_fetched_txes(const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks)
+{
+  // the block hash only covers the tx hashes, so the txes themselves have
+  // to hash to what the block lists
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  boost::mutex error_lock;
+  bool valid = true;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (blocks[i].txs.size() != parsed_blocks[i].block.tx_hashes.size())
+    {
+      MWARNING("Fetched block " << parsed_blocks[i].hash << " has " << blocks[i].txs.size() << " txes, expected " << parsed_blocks[i].block.tx_hashes.size());
+      return false;
+    }
+    for (size_t j = 0; j < blocks[i].txs.size(); ++j)
+    {
+      tpool.submit(&waiter, [&, i, j](){
+        cryptonote::transaction tx;
+        crypto::hash tx_hash, tx_prefix_hash;
+        if (!parse_and_validate_tx_from_blob(blocks[i].txs[j], tx, tx_hash, tx_prefix_hash) || tx_hash != parsed_blocks[i].block.tx_hashes[j])
+        {
+          boost::unique_lock<boost::mutex> lock(error_lock);
+          valid = false;
+        }
+      }, true);
+    }
+  }
+  waiter.wait(&tpool);
+  if (!valid)
+    MWARNING("Fetched txes do not match their blocks' tx hashes");
+  return valid;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::check_fetched_hashes(uint64_t start_height, const std::vector<parsed_block> &prev_parsed_blocks, const std::vector<parsed_block> &parsed_blocks, bool &mismatch)
+{
+  mismatch = false;
+  if (prev_parsed_blocks.empty())
+    return false;
+
+  // get the main daemon's hashes for the range, a request covers many ranges
+  if (start_height < m_refresh_hashes_start_height || start_height + parsed_blocks.size() > m_refresh_hashes_start_height + m_refresh_hashes.size())
+  {
+    std::list<crypto::hash> short_chain_history;
+    short_chain_history.push_back(prev_parsed_blocks.back().hash);
+    short_chain_history.push_back(m_blockchain.genesis());
+    uint64_t hashes_start_height;
+    m_refresh_hashes.clear();
+    pull_hashes(start_height - 1, hashes_start_height, short_chain_history, m_refresh_hashes);
+    if (hashes_start_height != start_height - 1 || m_refresh_hashes.empty())
+    {
+      MDEBUG("Main daemon's hashes start at " << hashes_start_height << ", expected " << start_height - 1);
+      m_refresh_hashes.clear();
+      return false;
+    }
+    // the first one is the block we asked from
+    m_refresh_hashes.erase(m_refresh_hashes.begin());
+    m_refresh_hashes_start_height = start_height;
+    if (start_height + parsed_blocks.size() > m_refresh_hashes_start_height + m_refresh_hashes.size())
+    {
+      MDEBUG("Main daemon returned too few hashes to check fetched blocks against");
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
+  {
+    if (parsed_blocks[i].hash != m_refresh_hashes[start_height - m_refresh_hashes_start_height + i])
+    {
+      MWARNING("Fetched block " << parsed_blocks[i].hash << " at height " << start_height + i << " does not match the main daemon's "
+          << m_refresh_hashes[start_height - m_refresh_hashes_start_height + i]);
+      mismatch = true;
+      return false;
+    }
+  }
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::pull_fetched_blocks(block_fetcher &fetcher, uint64_t start_height, const std::vector<parsed_block> &prev_parsed_blocks, uint64_t &blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks)
+{
+  block_fetcher::range r;
+  if (!fetcher.next(r))
+    return false;
+  if (r.start_height != start_height)
+  {
+    MDEBUG("Fetched blocks start at " << r.start_height << ", expected " << start_height);
+    fetcher.stop();
+    return false;
+  }
+
+  bool error = false;
+  parse_blocks(r.blocks, r.o_indices, parsed_blocks, error);
+  if (error)
+  {
+    fetcher.stop();
+    return false;
+  }
+
+  // ranges were asked for by height, so check they carry on from the
+  // blocks before them; if not, the daemons disagree or the chain moved,
+  // and pulling by chain history sorts it out
+  const crypto::hash *prev_hash = prev_parsed_blocks.empty() ? NULL : &prev_parsed_blocks.back().hash;
+  for (const parsed_block &pb: parsed_blocks)
+  {
+    if (prev_hash && pb.block.prev_id != *prev_hash)
+    {
+      MINFO("Fetched block " << pb.hash << " does not chain on from " << *prev_hash << ", fetching blocks one range at a time");
+      fetcher.stop();
+      return false;
+    }
+    prev_hash = &pb.hash;
+  }
+
+  // blocks from other daemons have to match the main daemon's, and their
+  // txes the blocks' tx hashes; a daemon which sends anything else is not
+  // used again. Their output indices are not trusted: they are dropped, and
+  // the main daemon is asked for those of the txes which pay us
+  const size_t daemon = m_refresh_connections[r.worker]->daemon;
+  if (daemon != 0)
+  {
+    bool verified = false, mismatch = false;
+    try { verified = check_fetched_hashes(r.start_height, prev_parsed_blocks, parsed_blocks, mismatch); }
+    catch (const std::exception &e) { MDEBUG("Failed to check fetched blocks: " << e.what()); }
+    if (verified && !check_fetched_txes(r.blocks, parsed_blocks))
+    {
+      verified = false;
+      mismatch = true;
+    }
+    if (!verified)
+    {
+      fetcher.stop();
+      if (mismatch)
+      {
+        MWARNING("Not fetching blocks from " << m_refresh_daemons[daemon - 1].address << " anymore");
+        m_refresh_daemons.erase(m_refresh_daemons.begin() + (daemon - 1));
+        m_refresh_connections.clear();
+      }
+      return false;
+    }
+    for (parsed_block &pb: parsed_blocks)
+      for (cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices &indices: pb.o_indices.indices)
+        indices.indices.clear();
+  }
+
+  blocks_start_height = r.start_height;
+  blocks = std::move(r.blocks);
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, uint64_t prev_blocks_start_height, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error, block_fetcher *fetcher)
 {
   error = false;
 
@@ -2222,46 +2920,28 @@ void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks
       ++i;
     }
 
-    // pull the new blocks
-    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
-    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
-    THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
-
-    tools::threadpool& tpool = tools::threadpool::getInstance();
-    tools::threadpool::waiter waiter;
-    parsed_blocks.resize(blocks.size());
-    for (size_t i = 0; i < blocks.size(); ++i)
+    // take the next range from the parallel fetcher while it has one
+    if (fetcher && !prev_blocks.empty())
     {
-      tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
-        std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
-    }
-    waiter.wait(&tpool);
-    for (size_t i = 0; i < blocks.size(); ++i)
-    {
-      if (parsed_blocks[i].error)
-      {
-        error = true;
-        break;
-      }
-      parsed_blocks[i].o_indices = std::move(o_indices[i]);
+      if (pull_fetched_blocks(*fetcher, prev_blocks_start_height + prev_blocks.size(), prev_parsed_blocks, blocks_start_height, blocks, parsed_blocks))
+        return;
+      blocks.clear();
+      parsed_blocks.clear();
     }
 
-    boost::mutex error_lock;
-    for (size_t i = 0; i < blocks.size(); ++i)
+    // stream the new blocks if the daemon can, they come back already parsed
+    uint32_t rpc_version;
+    if (!m_node_rpc_proxy.get_rpc_version(rpc_version) && rpc_version >= MAKE_CORE_RPC_VERSION(2, 4))
     {
-      parsed_blocks[i].txes.resize(blocks[i].txs.size());
-      for (size_t j = 0; j < blocks[i].txs.size(); ++j)
-      {
-        tpool.submit(&waiter, [&, i, j](){
-          if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j], parsed_blocks[i].txes[j]))
-          {
-            boost::unique_lock<boost::mutex> lock(error_lock);
-            error = true;
-          }
-        }, true);
-      }
+      if (pull_blocks_stream(start_height, blocks_start_height, short_chain_history, blocks, parsed_blocks, error))
+        return;
+      error = false;
     }
-    waiter.wait(&tpool);
+
+    // pull the new blocks
+    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
+    parse_blocks(blocks, o_indices, parsed_blocks, error);
   }
   catch(...)
   {
@@ -2663,6 +3343,8 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   std::vector<cryptonote::block_complete_entry> blocks;
   std::vector<parsed_block> parsed_blocks;
   bool refreshed = false;
+  std::unique_ptr<block_fetcher> fetcher;
+  size_t fetcher_starts = 0;
 
   // pull the first set of blocks
   get_short_chain_history(short_chain_history, (m_first_refresh_done || trusted_daemon) ? 1 : FIRST_REFRESH_GRANULARITY);
@@ -2713,7 +3395,7 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
         refreshed = false;
         break;
       }
-      tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error);});
+      tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks_start_height, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error, fetcher.get());});
 
       if (!first)
       {
@@ -2766,6 +3448,21 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
       blocks_start_height = next_blocks_start_height;
       blocks = std::move(next_blocks);
       parsed_blocks = std::move(next_parsed_blocks);
+
+      // once we know where the chain carries on, fetch the ranges after it
+      // in parallel if there are many to go; when the fetcher is done or
+      // stopped, pulls go back to one range at a time, and a new fetcher is
+      // started if there are still many to go
+      if (fetcher && fetcher->finished())
+      {
+        fetcher.reset();
+      }
+      else if (!fetcher && fetcher_starts < REFRESH_FETCHER_MAX_STARTS && !blocks.empty())
+      {
+        fetcher = start_block_fetcher(blocks_start_height + blocks.size());
+        if (fetcher)
+          ++fetcher_starts;
+      }
     }
     catch (const tools::error::password_needed&)
     {
@@ -2777,6 +3474,7 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
     {
       blocks_fetched += added_blocks;
       waiter.wait(&tpool);
+      fetcher.reset();
       if(try_count < 3)
       {
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
@@ -2980,6 +3678,7 @@ bool wallet2::clear()
   m_subaddresses.clear();
   m_subaddress_labels.clear();
   m_multisig_rounds_passed = 0;
+  m_cache_journal.active = false;
   return true;
 }
 
@@ -4625,6 +5324,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
   {
     wallet2::cache_file_data cache_file_data;
     std::string buf;
+    bool journaled = false;
     bool r = epee::file_io_utils::load_file_to_string(m_wallet_file, buf, std::numeric_limits<size_t>::max());
     THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, m_wallet_file);
 
@@ -4644,6 +5344,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
         iss << cache_data;
         boost::archive::portable_binary_iarchive ar(iss);
         ar >> *this;
+        journaled = true;
       }
       catch(...)
       {
@@ -4712,6 +5413,10 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
       error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
+
+    // only caches stored with the current key have a journal
+    if (journaled)
+      replay_cache_journal(cache_file_data.iv, cache_file_data.cache_data.size());
   }
 
   cryptonote::block genesis;
@@ -4813,6 +5518,9 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     same_file = pos != std::string::npos;
   }
 
+  // small changes go to the journal next to the cache, instead of rewriting it whole
+  if (same_file && store_cache_journal())
+    return;
 
   if (!same_file)
   {
@@ -4875,6 +5583,8 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     if (!r) {
       LOG_ERROR("error removing file: " << old_address_file);
     }
+    cache_journal::remove(old_file + ".journal");
+    m_cache_journal.active = false;
   } else {
     // save to new file
 #ifdef WIN32
@@ -4899,7 +5609,400 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     // here we have "*.new" file, we need to rename it to be without ".new"
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
+
+    // the old journal's records are tied to the old snapshot's iv, so a
+    // crash before this removal leaves a journal which load ignores
+    cache_journal::remove(m_wallet_file + ".journal");
+    reset_cache_journal(cache_file_data.iv, cache_file_data.cache_data.size(), 0);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+std::string wallet2::dump_cache_journal_state() const
+{
+  // everything in the cache which is neither append only nor large enough
+  // to deserve its own section
+  std::stringstream oss;
+  {
+    boost::archive::portable_binary_oarchive ar(oss);
+    ar << m_account_public_address;
+    ar << m_unconfirmed_txs;
+    ar << m_tx_notes;
+    ar << m_unconfirmed_payments;
+    ar << m_address_book;
+    ar << m_scanned_pool_txs[0];
+    ar << m_scanned_pool_txs[1];
+    ar << m_subaddress_labels;
+    ar << m_attributes;
+    ar << m_account_tags;
+    ar << m_ring_history_saved;
+    ar << m_last_block_reward;
+  }
+  return oss.str();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_cache_journal_state(const std::string &data)
+{
+  std::stringstream iss;
+  iss << data;
+  boost::archive::portable_binary_iarchive ar(iss);
+  ar >> m_account_public_address;
+  ar >> m_unconfirmed_txs;
+  ar >> m_tx_notes;
+  ar >> m_unconfirmed_payments;
+  ar >> m_address_book;
+  ar >> m_scanned_pool_txs[0];
+  ar >> m_scanned_pool_txs[1];
+  ar >> m_subaddress_labels;
+  ar >> m_attributes;
+  ar >> m_account_tags;
+  ar >> m_ring_history_saved;
+  ar >> m_last_block_reward;
+}
+//----------------------------------------------------------------------------------------------------
+wallet2::cache_journal_state wallet2::get_cache_journal_state(std::string &state) const
+{
+  cache_journal_state cjs;
+  cjs.transfers.reserve(m_transfers.size());
+  for (const transfer_details &td: m_transfers)
+    cjs.transfers.push_back(transfer_fingerprint(td));
+  cjs.hashchain_size = m_blockchain.size();
+  cjs.hashchain_offset = m_blockchain.offset();
+  cjs.payments = payment_fingerprints(m_payments);
+  cjs.confirmed_txs = confirmed_tx_fingerprints(m_confirmed_txs);
+  cjs.subaddresses = m_subaddresses.get_generated();
+  cjs.tx_keys.reserve(m_tx_keys.size());
+  for (const auto &k: m_tx_keys)
+    cjs.tx_keys.insert(k.first);
+  state = dump_cache_journal_state();
+  crypto::cn_fast_hash(state.data(), state.size(), cjs.state);
+  return cjs;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::reset_cache_journal(const crypto::chacha_iv &snapshot_iv, uint64_t snapshot_size, uint64_t journal_size)
+{
+  std::string state;
+  m_cache_journal = get_cache_journal_state(state);
+  m_cache_journal.active = true;
+  m_cache_journal.snapshot_iv = snapshot_iv;
+  m_cache_journal.snapshot_size = snapshot_size;
+  m_cache_journal.journal_size = journal_size;
+  m_blockchain.reset_modified();
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::store_cache_journal()
+{
+  if (!m_cache_journal.active)
+    return false;
+
+  std::string state;
+  cache_journal_state cjs = get_cache_journal_state(state);
+  cache_journal_record record;
+  record.snapshot_iv = m_cache_journal.snapshot_iv;
+
+  if (cjs.transfers != m_cache_journal.transfers)
+  {
+    uint64_t size = m_transfers.size();
+    std::vector<std::pair<uint64_t, transfer_details>> changed;
+    for (size_t i = 0; i < cjs.transfers.size(); ++i)
+      if (i >= m_cache_journal.transfers.size() || cjs.transfers[i] != m_cache_journal.transfers[i])
+        changed.push_back(std::make_pair(i, m_transfers[i]));
+    std::stringstream oss;
+    {
+      boost::archive::portable_binary_oarchive ar(oss);
+      ar << size;
+      ar << changed;
+    }
+    record.sections.push_back({CACHE_JOURNAL_TRANSFERS, oss.str()});
+  }
+
+  uint64_t hashchain_start = std::min<uint64_t>(m_cache_journal.hashchain_size, m_blockchain.lowest_modified());
+  if (hashchain_start != cjs.hashchain_size || cjs.hashchain_offset != m_cache_journal.hashchain_offset)
+  {
+    // a refilled or rewound trimmed chain can only be rebuilt from a snapshot
+    if (cjs.hashchain_offset < m_cache_journal.hashchain_offset || hashchain_start < cjs.hashchain_offset)
+      return false;
+    std::vector<crypto::hash> hashes;
+    hashes.reserve(cjs.hashchain_size - hashchain_start);
+    for (uint64_t i = hashchain_start; i < cjs.hashchain_size; ++i)
+      hashes.push_back(m_blockchain[i]);
+    std::stringstream oss;
+    {
+      boost::archive::portable_binary_oarchive ar(oss);
+      ar << hashchain_start;
+      ar << cjs.hashchain_offset;
+      ar << hashes;
+    }
+    record.sections.push_back({CACHE_JOURNAL_HASHCHAIN, oss.str()});
+  }
+
+  boost::optional<uint64_t> payments_height = first_changed_height(m_cache_journal.payments, cjs.payments);
+  if (payments_height)
+  {
+    uint64_t height = *payments_height;
+    std::vector<std::pair<crypto::hash, payment_details>> payments;
+    for (const auto &p: m_payments)
+      if (p.second.m_block_height >= height)
+        payments.push_back(p);
+    std::stringstream oss;
+    {
+      boost::archive::portable_binary_oarchive ar(oss);
+      ar << height;
+      ar << payments;
+    }
+    record.sections.push_back({CACHE_JOURNAL_PAYMENTS, oss.str()});
+  }
+
+  boost::optional<uint64_t> confirmed_txs_height = first_changed_height(m_cache_journal.confirmed_txs, cjs.confirmed_txs);
+  if (confirmed_txs_height)
+  {
+    uint64_t height = *confirmed_txs_height;
+    std::vector<std::pair<crypto::hash, confirmed_transfer_details>> confirmed_txs;
+    for (const auto &tx: m_confirmed_txs)
+      if (tx.second.m_block_height >= height)
+        confirmed_txs.push_back(tx);
+    std::stringstream oss;
+    {
+      boost::archive::portable_binary_oarchive ar(oss);
+      ar << height;
+      ar << confirmed_txs;
+    }
+    record.sections.push_back({CACHE_JOURNAL_CONFIRMED_TXS, oss.str()});
+  }
+
+  // subaddresses are only ever derived past the last one, per account
+  if (cjs.subaddresses != m_cache_journal.subaddresses)
+  {
+    const std::vector<uint32_t> &begin = m_cache_journal.subaddresses;
+    if (cjs.subaddresses.size() < begin.size())
+      return false;
+    for (size_t major = 0; major < begin.size(); ++major)
+      if (cjs.subaddresses[major] < begin[major])
+        return false;
+    std::vector<std::vector<crypto::public_key>> keys;
+    m_subaddresses.get_keys_since(begin, keys);
+    std::stringstream oss;
+    {
+      boost::archive::portable_binary_oarchive ar(oss);
+      ar << begin;
+      ar << keys;
+    }
+    record.sections.push_back({CACHE_JOURNAL_SUBADDRESSES, oss.str()});
+  }
+
+  // tx keys are only ever added, a smaller map was cleared
+  if (cjs.tx_keys.size() != m_cache_journal.tx_keys.size())
+  {
+    if (cjs.tx_keys.size() < m_cache_journal.tx_keys.size())
+      return false;
+    std::vector<std::pair<crypto::hash, crypto::secret_key>> tx_keys;
+    std::vector<std::pair<crypto::hash, std::vector<crypto::secret_key>>> additional_tx_keys;
+    for (const auto &k: m_tx_keys)
+    {
+      if (m_cache_journal.tx_keys.count(k.first))
+        continue;
+      tx_keys.push_back(k);
+      const auto additional = m_additional_tx_keys.find(k.first);
+      if (additional != m_additional_tx_keys.end())
+        additional_tx_keys.push_back(*additional);
+    }
+    std::stringstream oss;
+    {
+      boost::archive::portable_binary_oarchive ar(oss);
+      ar << tx_keys;
+      ar << additional_tx_keys;
+    }
+    record.sections.push_back({CACHE_JOURNAL_TX_KEYS, oss.str()});
   }
+
+  if (cjs.state != m_cache_journal.state)
+    record.sections.push_back({CACHE_JOURNAL_STATE, state});
+
+  uint64_t journal_size = m_cache_journal.journal_size;
+  if (!record.sections.empty())
+  {
+    std::string blob;
+    CHECK_AND_ASSERT_THROW_MES(::serialization::dump_binary(record, blob), "Failed to serialize cache journal record");
+
+    // compact into a new snapshot once the journal stops paying for itself
+    if (blob.size() > m_cache_journal.snapshot_size / 2 || journal_size + blob.size() > m_cache_journal.snapshot_size)
+    {
+      MDEBUG("Cache journal would grow to " << journal_size + blob.size() << " bytes, storing a full snapshot");
+      return false;
+    }
+
+    const std::string journal_file = m_wallet_file + ".journal";
+    if (!cache_journal::append(journal_file, journal_size, m_cache_key, {blob}, journal_size))
+    {
+      MWARNING("Failed to append to " << journal_file << ", storing a full snapshot");
+      return false;
+    }
+    MDEBUG("Appended " << record.sections.size() << " sections, " << blob.size() << " bytes to the cache journal");
+  }
+
+  cjs.active = true;
+  cjs.snapshot_iv = m_cache_journal.snapshot_iv;
+  cjs.snapshot_size = m_cache_journal.snapshot_size;
+  cjs.journal_size = journal_size;
+  m_cache_journal = std::move(cjs);
+  m_blockchain.reset_modified();
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::apply_cache_journal_section(uint8_t type, const std::string &data)
+{
+  std::stringstream iss;
+  iss << data;
+  boost::archive::portable_binary_iarchive ar(iss);
+
+  switch (type)
+  {
+    case CACHE_JOURNAL_TRANSFERS:
+    {
+      uint64_t size;
+      std::vector<std::pair<uint64_t, transfer_details>> changed;
+      ar >> size;
+      ar >> changed;
+
+      // keep the key image and public key indices in step with the transfers they point to
+      auto unindex = [this](size_t idx) {
+        const transfer_details &td = m_transfers[idx];
+        auto pk = m_pub_keys.find(td.get_public_key());
+        if (pk != m_pub_keys.end() && pk->second == idx)
+          m_pub_keys.erase(pk);
+        if (td.m_key_image_known && !td.m_key_image_partial)
+        {
+          auto ki = m_key_images.find(td.m_key_image);
+          if (ki != m_key_images.end() && ki->second == idx)
+            m_key_images.erase(ki);
+        }
+      };
+      const size_t old_size = m_transfers.size();
+      for (size_t i = size; i < old_size; ++i)
+        unindex(i);
+      m_transfers.resize(size);
+      for (auto &c: changed)
+      {
+        THROW_WALLET_EXCEPTION_IF(c.first >= size, error::wallet_internal_error, "Bad transfer index in cache journal");
+        if (c.first < old_size)
+          unindex(c.first);
+        transfer_details &td = m_transfers[c.first];
+        td = std::move(c.second);
+        m_pub_keys[td.get_public_key()] = c.first;
+        if (td.m_key_image_known && !td.m_key_image_partial)
+          m_key_images[td.m_key_image] = c.first;
+      }
+      break;
+    }
+    case CACHE_JOURNAL_HASHCHAIN:
+    {
+      uint64_t start, offset;
+      std::vector<crypto::hash> hashes;
+      ar >> start;
+      ar >> offset;
+      ar >> hashes;
+      THROW_WALLET_EXCEPTION_IF(start < m_blockchain.offset() || start > m_blockchain.size(), error::wallet_internal_error, "Bad hashchain start in cache journal");
+      m_blockchain.crop(start);
+      for (const crypto::hash &hash: hashes)
+        m_blockchain.push_back(hash);
+      m_blockchain.trim(offset);
+      break;
+    }
+    case CACHE_JOURNAL_PAYMENTS:
+    {
+      uint64_t height;
+      std::vector<std::pair<crypto::hash, payment_details>> payments;
+      ar >> height;
+      ar >> payments;
+      for (auto i = m_payments.begin(); i != m_payments.end(); )
+      {
+        if (i->second.m_block_height >= height)
+          i = m_payments.erase(i);
+        else
+          ++i;
+      }
+      for (const auto &p: payments)
+        m_payments.insert(p);
+      break;
+    }
+    case CACHE_JOURNAL_CONFIRMED_TXS:
+    {
+      uint64_t height;
+      std::vector<std::pair<crypto::hash, confirmed_transfer_details>> confirmed_txs;
+      ar >> height;
+      ar >> confirmed_txs;
+      for (auto i = m_confirmed_txs.begin(); i != m_confirmed_txs.end(); )
+      {
+        if (i->second.m_block_height >= height)
+          i = m_confirmed_txs.erase(i);
+        else
+          ++i;
+      }
+      for (const auto &tx: confirmed_txs)
+        m_confirmed_txs.insert(tx);
+      break;
+    }
+    case CACHE_JOURNAL_STATE:
+      load_cache_journal_state(data);
+      break;
+    case CACHE_JOURNAL_SUBADDRESSES:
+    {
+      std::vector<uint32_t> begin;
+      std::vector<std::vector<crypto::public_key>> keys;
+      ar >> begin;
+      ar >> keys;
+      for (size_t major = 0; major < keys.size(); ++major)
+      {
+        if (keys[major].empty())
+          continue;
+        const uint32_t minor_begin = major < begin.size() ? begin[major] : 0;
+        THROW_WALLET_EXCEPTION_IF(m_subaddresses.num_generated(major) != minor_begin, error::wallet_internal_error, "Bad subaddress start in cache journal");
+        m_subaddresses.insert(major, minor_begin, keys[major]);
+      }
+      break;
+    }
+    case CACHE_JOURNAL_TX_KEYS:
+    {
+      std::vector<std::pair<crypto::hash, crypto::secret_key>> tx_keys;
+      std::vector<std::pair<crypto::hash, std::vector<crypto::secret_key>>> additional_tx_keys;
+      ar >> tx_keys;
+      ar >> additional_tx_keys;
+      m_tx_keys.insert(tx_keys.begin(), tx_keys.end());
+      m_additional_tx_keys.insert(additional_tx_keys.begin(), additional_tx_keys.end());
+      break;
+    }
+    default:
+      THROW_WALLET_EXCEPTION(error::wallet_internal_error, "Unknown cache journal section type " + std::to_string(type));
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::replay_cache_journal(const crypto::chacha_iv &snapshot_iv, uint64_t snapshot_size)
+{
+  const std::string journal_file = m_wallet_file + ".journal";
+  std::vector<std::string> payloads;
+  uint64_t journal_size;
+  bool r = cache_journal::read(journal_file, m_cache_key, payloads, journal_size);
+  THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, journal_file);
+
+  for (size_t n = 0; n < payloads.size(); ++n)
+  {
+    cache_journal_record record;
+    r = ::serialization::parse_binary(payloads[n], record);
+    THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to parse record " + std::to_string(n) + " of " + journal_file);
+    if (memcmp(&record.snapshot_iv, &snapshot_iv, sizeof(snapshot_iv)))
+    {
+      // left over from before the last snapshot, which was stored but the journal not removed
+      THROW_WALLET_EXCEPTION_IF(n > 0, error::wallet_internal_error, "Cache journal " + journal_file + " mixes records for different snapshots");
+      MINFO("Ignoring stale cache journal " << journal_file);
+      journal_size = 0;
+      break;
+    }
+    for (const cache_journal_section &section: record.sections)
+      apply_cache_journal_section(section.type, section.data);
+  }
+  if (!payloads.empty() && journal_size > 0)
+    MINFO("Replayed " << payloads.size() << " cache journal records");
+
+  reset_cache_journal(snapshot_iv, snapshot_size, journal_size);
 }
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::balance(uint32_t index_major) const
@@ -6372,6 +7475,29 @@ bool wallet2::add_rings(const cryptonote::transaction_prefix &tx)
   catch (const std::exception &e) { return false; }
 }
 
+bool wallet2::start_ringdb_batch(size_t n_entries)
+{
+  if (!m_ringdb || m_ringdb->batch_active())
+    return false;
+  try { m_ringdb->batch_start(n_entries); return true; }
+  catch (const std::exception &e) { MWARNING("Failed to start ringdb batch: " << e.what()); return false; }
+}
+
+void wallet2::stop_ringdb_batch()
+{
+  if (!m_ringdb || !m_ringdb->batch_active())
+    return;
+  try { m_ringdb->batch_stop(); }
+  catch (const std::exception &e) { THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Failed to write ringdb batch: ") + e.what()); }
+}
+
+void wallet2::finish_ringdb_batch()
+{
+  // on the way out of a failed scan, the rings added so far are still kept
+  try { stop_ringdb_batch(); }
+  catch (const std::exception &e) { MERROR(e.what()); }
+}
+
 bool wallet2::remove_rings(const cryptonote::transaction_prefix &tx)
 {
   if (!m_ringdb)
@@ -6474,6 +7600,8 @@ bool wallet2::find_and_save_rings(bool force)
 
     MDEBUG("Scanning " << res.txs.size() << " transactions");
     THROW_WALLET_EXCEPTION_IF(slice + res.txs.size() > txs_hashes.size(), error::wallet_internal_error, "Unexpected tx array size");
+    std::vector<cryptonote::transaction> txs(res.txs.size());
+    size_t ringdb_entries = 0;
     auto it = req.txs_hashes.begin();
     for (size_t i = 0; i < res.txs.size(); ++i, ++it)
     {
@@ -6482,12 +7610,20 @@ bool wallet2::find_and_save_rings(bool force)
     THROW_WALLET_EXCEPTION_IF(tx_info.tx_hash != *it, error::wallet_internal_error, "Wrong txid received");
     cryptonote::blobdata bd;
     THROW_WALLET_EXCEPTION_IF(!epee::string_tools::parse_hexstr_to_binbuff(tx_info.as_hex, bd), error::wallet_internal_error, "failed to parse tx from hexstr");
-    cryptonote::transaction tx;
     crypto::hash tx_hash, tx_prefix_hash;
-    THROW_WALLET_EXCEPTION_IF(!cryptonote::parse_and_validate_tx_from_blob(bd, tx, tx_hash, tx_prefix_hash), error::wallet_internal_error, "failed to parse tx from blob");
+    THROW_WALLET_EXCEPTION_IF(!cryptonote::parse_and_validate_tx_from_blob(bd, txs[i], tx_hash, tx_prefix_hash), error::wallet_internal_error, "failed to parse tx from blob");
     THROW_WALLET_EXCEPTION_IF(epee::string_tools::pod_to_hex(tx_hash) != tx_info.tx_hash, error::wallet_internal_error, "txid mismatch");
-    THROW_WALLET_EXCEPTION_IF(!add_rings(get_ringdb_key(), tx), error::wallet_internal_error, "Failed to save ring");
+    ringdb_entries += txs[i].vin.size();
     }
+
+    // the ringdb is shared with other wallets, so its write txn is only
+    // held for the slice's rings, not across the daemon requests
+    const bool ringdb_batch = start_ringdb_batch(ringdb_entries);
+    epee::misc_utils::auto_scope_leave_caller ringdb_batch_dtor = epee::misc_utils::create_scope_leave_handler([&](){ if (ringdb_batch) finish_ringdb_batch(); });
+    for (const cryptonote::transaction &tx: txs)
+      THROW_WALLET_EXCEPTION_IF(!add_rings(get_ringdb_key(), tx), error::wallet_internal_error, "Failed to save ring");
+    if (ringdb_batch)
+      stop_ringdb_batch();
   }
 
   MINFO("Found and saved rings for " << txs_hashes.size() << " transactions");
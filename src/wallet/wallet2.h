@@ -50,6 +50,7 @@
 #include "storages/http_abstract_invoke.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/subaddress_table.h"
 #include "cryptonote_core/cryptonote_tx_utils.h"
 #include "common/unordered_containers_boost_serialization.h"
 #include "crypto/chacha.h"
@@ -61,6 +62,7 @@
 #include "wallet_errors.h"
 #include "common/password.h"
 #include "node_rpc_proxy.h"
+#include "block_fetcher.h"
 
 #undef XCASH_DEFAULT_LOG_CATEGORY
 #define XCASH_DEFAULT_LOG_CATEGORY "wallet.wallet2"
@@ -122,7 +124,7 @@ namespace tools
   class hashchain
   {
   public:
-    hashchain(): m_genesis(crypto::null_hash), m_offset(0) {}
+    hashchain(): m_genesis(crypto::null_hash), m_offset(0), m_lowest_modified(std::numeric_limits<size_t>::max()) {}
 
     size_t size() const { return m_blockchain.size() + m_offset; }
     size_t offset() const { return m_offset; }
@@ -131,11 +133,14 @@ namespace tools
     bool is_in_bounds(size_t idx) const { return idx >= m_offset && idx < size(); }
     const crypto::hash &operator[](size_t idx) const { return m_blockchain[idx - m_offset]; }
     crypto::hash &operator[](size_t idx) { return m_blockchain[idx - m_offset]; }
-    void crop(size_t height) { m_blockchain.resize(height - m_offset); }
-    void clear() { m_offset = 0; m_blockchain.clear(); }
+    void crop(size_t height) { m_blockchain.resize(height - m_offset); m_lowest_modified = std::min(m_lowest_modified, height); }
+    void clear() { m_offset = 0; m_blockchain.clear(); m_lowest_modified = 0; }
     bool empty() const { return m_blockchain.empty() && m_offset == 0; }
     void trim(size_t height) { while (height > m_offset && m_blockchain.size() > 1) { m_blockchain.pop_front(); ++m_offset; } m_blockchain.shrink_to_fit(); }
     void refill(const crypto::hash &hash) { m_blockchain.push_back(hash); --m_offset; }
+    // lowest height dropped by crop or clear since the last reset_modified, not serialized
+    size_t lowest_modified() const { return m_lowest_modified; }
+    void reset_modified() { m_lowest_modified = std::numeric_limits<size_t>::max(); }
 
     template <class t_archive>
     inline void serialize(t_archive &a, const unsigned int ver)
@@ -149,6 +154,7 @@ namespace tools
     size_t m_offset;
     crypto::hash m_genesis;
     std::deque<crypto::hash> m_blockchain;
+    size_t m_lowest_modified;
   };
 
   class wallet_keys_unlocker;
@@ -504,6 +510,7 @@ namespace tools
       std::vector<cryptonote::tx_extra_field> tx_extra_fields;
       std::vector<is_out_data> primary;
       std::vector<is_out_data> additional;
+      std::vector<uint64_t> o_indices; // from the main daemon, when the tx's block came from another refresh daemon
     };
 
     /*!
@@ -716,6 +723,21 @@ namespace tools
 
     void set_refresh_type(RefreshType refresh_type) { m_refresh_type = refresh_type; }
     RefreshType get_refresh_type() const { return m_refresh_type; }
+    struct refresh_daemon
+    {
+      std::string address;
+      boost::optional<epee::net_utils::http::login> login;
+      bool ssl;
+    };
+    /*!
+     * \brief Other daemons to fetch blocks from while refreshing, along with
+     *        the main one. Blocks from them are only used if their hashes
+     *        match the main daemon's, a daemon which disagrees is dropped.
+     */
+    void set_refresh_daemons(std::vector<refresh_daemon> daemons) { m_refresh_daemons = std::move(daemons); m_refresh_connections.clear(); }
+    const std::vector<refresh_daemon> &get_refresh_daemons() const { return m_refresh_daemons; }
+    void max_refresh_requests(uint32_t n) { m_max_refresh_requests = n; }
+    uint32_t max_refresh_requests() const { return m_max_refresh_requests; }
 
     cryptonote::network_type nettype() const { return m_nettype; }
     bool watch_only() const { return m_watch_only; }
@@ -876,7 +898,17 @@ namespace tools
       a & m_scanned_pool_txs[1];
       if (ver < 20)
         return;
-      a & m_subaddresses;
+      if (ver < 26)
+      {
+        // we're loading an old version, where m_subaddresses was a std::unordered_map
+        std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddresses;
+        a & subaddresses;
+        m_subaddresses = cryptonote::subaddress_table(subaddresses);
+      }
+      else
+      {
+        a & m_subaddresses;
+      }
       std::unordered_map<cryptonote::subaddress_index, crypto::public_key> dummy_subaddresses_inv;
       a & dummy_subaddresses_inv;
       a & m_subaddress_labels;
@@ -1213,10 +1245,19 @@ namespace tools
     bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint64_t block_height) const;
     bool clear();
     void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
+    void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, epee::net_utils::http::http_simple_client &http_client, boost::mutex &daemon_rpc_mutex, bool prune = true);
+    bool pull_blocks_stream(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error);
     void pull_hashes(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes);
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, bool force = false);
-    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error);
+    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, uint64_t prev_blocks_start_height, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error, block_fetcher *fetcher);
+    void parse_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<parsed_block> &parsed_blocks, bool &error);
+    void get_tx_output_indices(const crypto::hash &txid, std::vector<uint64_t> &o_indices);
+    bool check_fetched_txes(const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks);
+    bool check_fetched_hashes(uint64_t start_height, const std::vector<parsed_block> &prev_parsed_blocks, const std::vector<parsed_block> &parsed_blocks, bool &mismatch);
+    bool pull_fetched_blocks(block_fetcher &fetcher, uint64_t start_height, const std::vector<parsed_block> &prev_parsed_blocks, uint64_t &blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks);
+    std::unique_ptr<block_fetcher> start_block_fetcher(uint64_t start_height);
     void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added);
+    void generate_subaddresses(uint32_t index_major, uint32_t end);
     uint64_t select_transfers(uint64_t needed_money, std::vector<size_t> unused_transfers_indices, std::vector<size_t>& selected_transfers) const;
     bool prepare_file_names(const std::string& file_path);
     void process_unconfirmed(const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t height);
@@ -1253,6 +1294,9 @@ namespace tools
     bool add_rings(const crypto::chacha_key &key, const cryptonote::transaction_prefix &tx);
     bool add_rings(const cryptonote::transaction_prefix &tx);
     bool remove_rings(const cryptonote::transaction_prefix &tx);
+    bool start_ringdb_batch(size_t n_entries);
+    void stop_ringdb_batch();
+    void finish_ringdb_batch();
     bool get_ring(const crypto::chacha_key &key, const crypto::key_image &key_image, std::vector<uint64_t> &outs);
     crypto::chacha_key get_ringdb_key();
     void setup_keys(const epee::wipeable_string &password);
@@ -1272,9 +1316,40 @@ namespace tools
     void setup_new_blockchain();
     void create_keys_file(const std::string &wallet_, bool watch_only, const epee::wipeable_string &password, bool create_address_file);
 
+    /*!
+     * \brief What the cache on disk (snapshot plus journal) holds, in enough
+     *        detail to write only the parts which changed on the next store
+     */
+    struct cache_journal_state
+    {
+      bool active;
+      crypto::chacha_iv snapshot_iv;
+      uint64_t snapshot_size;
+      uint64_t journal_size;
+      std::vector<uint64_t> transfers;
+      uint64_t hashchain_size;
+      uint64_t hashchain_offset;
+      std::vector<std::pair<uint64_t, uint64_t>> payments;
+      std::vector<std::pair<uint64_t, uint64_t>> confirmed_txs;
+      std::vector<uint32_t> subaddresses;
+      std::unordered_set<crypto::hash> tx_keys;
+      crypto::hash state;
+
+      cache_journal_state(): active(false), snapshot_size(0), journal_size(0), hashchain_size(0), hashchain_offset(0), state(crypto::null_hash) {}
+    };
+
+    cache_journal_state get_cache_journal_state(std::string &state) const;
+    void reset_cache_journal(const crypto::chacha_iv &snapshot_iv, uint64_t snapshot_size, uint64_t journal_size);
+    bool store_cache_journal();
+    void replay_cache_journal(const crypto::chacha_iv &snapshot_iv, uint64_t snapshot_size);
+    void apply_cache_journal_section(uint8_t type, const std::string &data);
+    std::string dump_cache_journal_state() const;
+    void load_cache_journal_state(const std::string &data);
+
     cryptonote::account_base m_account;
     boost::optional<epee::net_utils::http::login> m_daemon_login;
     std::string m_daemon_address;
+    bool m_daemon_ssl;
     std::string m_wallet_file;
     std::string m_keys_file;
     epee::net_utils::http::http_simple_client m_http_client;
@@ -1291,7 +1366,7 @@ namespace tools
     std::unordered_map<crypto::key_image, size_t> m_key_images;
     std::unordered_map<crypto::public_key, size_t> m_pub_keys;
     cryptonote::account_public_address m_account_public_address;
-    std::unordered_map<crypto::public_key, cryptonote::subaddress_index> m_subaddresses;
+    cryptonote::subaddress_table m_subaddresses;
     std::vector<std::vector<std::string>> m_subaddress_labels;
     std::unordered_map<crypto::hash, std::string> m_tx_notes;
     std::unordered_map<std::string, std::string> m_attributes;
@@ -1347,6 +1422,24 @@ namespace tools
     bool m_ignore_fractional_outputs;
     bool m_is_initialized;
     NodeRPCProxy m_node_rpc_proxy;
+
+    // one per block fetcher worker, kept between refreshes
+    struct refresh_connection
+    {
+      epee::net_utils::http::http_simple_client http_client;
+      boost::mutex daemon_rpc_mutex;
+      NodeRPCProxy node_rpc_proxy;
+
+      size_t daemon; // 0 for the main daemon, else 1 + index in m_refresh_daemons
+
+      refresh_connection(size_t daemon): node_rpc_proxy(http_client, daemon_rpc_mutex), daemon(daemon) {}
+    };
+    std::vector<refresh_daemon> m_refresh_daemons;
+    std::vector<std::unique_ptr<refresh_connection>> m_refresh_connections;
+    // the main daemon's hashes, used to check blocks fetched from other daemons
+    uint64_t m_refresh_hashes_start_height;
+    std::vector<crypto::hash> m_refresh_hashes;
+    uint32_t m_max_refresh_requests;
     std::unordered_set<crypto::hash> m_scanned_pool_txs[2];
     size_t m_subaddress_lookahead_major, m_subaddress_lookahead_minor;
     std::string m_device_name;
@@ -1374,6 +1467,7 @@ namespace tools
     std::unique_ptr<tools::file_locker> m_keys_file_locker;
 
     crypto::chacha_key m_cache_key;
+    cache_journal_state m_cache_journal;
     boost::optional<epee::wipeable_string> m_encrypt_keys_after_refresh;
 
     bool m_unattended;
@@ -1381,7 +1475,7 @@ namespace tools
     std::shared_ptr<tools::Notify> m_tx_notify;
   };
 }
-BOOST_CLASS_VERSION(tools::wallet2, 25)
+BOOST_CLASS_VERSION(tools::wallet2, 26)
 BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 9)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info, 1)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info::LR, 0)
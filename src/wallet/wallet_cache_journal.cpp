@@ -0,0 +1,167 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include "file_io_utils.h"
+#include "misc_log_ex.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "wallet_cache_journal.h"
+
+#undef XCASH_DEFAULT_LOG_CATEGORY
+#define XCASH_DEFAULT_LOG_CATEGORY "wallet.journal"
+
+#define CACHE_JOURNAL_MAX_RECORD_SIZE (1024 * 1024 * 1024)
+
+namespace
+{
+  uint32_t read_u32le(const char *p)
+  {
+    return (uint32_t)(uint8_t)p[0] | ((uint32_t)(uint8_t)p[1] << 8) | ((uint32_t)(uint8_t)p[2] << 16) | ((uint32_t)(uint8_t)p[3] << 24);
+  }
+
+  void write_u32le(std::string &s, uint32_t value)
+  {
+    for (int i = 0; i < 4; ++i)
+      s.push_back((char)(value >> (8 * i)));
+  }
+}
+
+namespace tools
+{
+namespace cache_journal
+{
+  //----------------------------------------------------------------------------------------------------
+  bool read(const std::string &path, const crypto::chacha_key &key, std::vector<std::string> &payloads, uint64_t &good_size)
+  {
+    payloads.clear();
+    good_size = 0;
+
+    boost::system::error_code e;
+    if (!boost::filesystem::exists(path, e) || e)
+      return true;
+
+    std::string buf;
+    if (!epee::file_io_utils::load_file_to_string(path, buf, std::numeric_limits<size_t>::max()))
+    {
+      MERROR("Failed to read cache journal " << path);
+      return false;
+    }
+
+    const char *p = buf.data();
+    const char *end = p + buf.size();
+    while (end - p >= 4)
+    {
+      const uint32_t size = read_u32le(p);
+      if (size < sizeof(crypto::chacha_iv) + sizeof(crypto::hash) || (uint64_t)(end - p - 4) < size)
+        break;
+      const char *record = p + 4;
+      crypto::chacha_iv iv;
+      memcpy(&iv, record, sizeof(iv));
+      std::string plain(size - sizeof(iv), '\0');
+      crypto::chacha20(record + sizeof(iv), plain.size(), key, iv, &plain[0]);
+      const size_t payload_size = plain.size() - sizeof(crypto::hash);
+      crypto::hash hash;
+      crypto::cn_fast_hash(plain.data(), payload_size, hash);
+      if (memcmp(&hash, plain.data() + payload_size, sizeof(hash)))
+        break;
+      plain.resize(payload_size);
+      payloads.push_back(std::move(plain));
+      p = record + size;
+    }
+    good_size = p - buf.data();
+    if (good_size != buf.size())
+      MWARNING("Ignoring " << (buf.size() - good_size) << " bytes of torn records at the end of cache journal " << path);
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool append(const std::string &path, uint64_t good_size, const crypto::chacha_key &key, const std::vector<std::string> &payloads, uint64_t &new_size)
+  {
+    std::string data;
+    for (const std::string &payload: payloads)
+    {
+      CHECK_AND_ASSERT_MES(payload.size() <= CACHE_JOURNAL_MAX_RECORD_SIZE, false, "Cache journal record too large");
+      std::string plain = payload;
+      crypto::hash hash;
+      crypto::cn_fast_hash(payload.data(), payload.size(), hash);
+      plain.append((const char*)&hash, sizeof(hash));
+      const crypto::chacha_iv iv = crypto::rand<crypto::chacha_iv>();
+      write_u32le(data, sizeof(iv) + plain.size());
+      data.append((const char*)&iv, sizeof(iv));
+      const size_t offset = data.size();
+      data.resize(offset + plain.size());
+      crypto::chacha20(plain.data(), plain.size(), key, iv, &data[offset]);
+    }
+
+    try
+    {
+      boost::system::error_code e;
+      if (boost::filesystem::exists(path, e) && !e && boost::filesystem::file_size(path) != good_size)
+        boost::filesystem::resize_file(path, good_size);
+      else if (good_size != 0 && !boost::filesystem::exists(path, e))
+      {
+        MERROR("Cache journal " << path << " disappeared");
+        return false;
+      }
+
+      boost::filesystem::ofstream ostr;
+      ostr.open(path, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+      ostr.write(data.data(), data.size());
+      ostr.close();
+      if (!ostr.good())
+      {
+        MERROR("Failed to write cache journal " << path);
+        return false;
+      }
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to write cache journal " << path << ": " << e.what());
+      return false;
+    }
+    new_size = good_size + data.size();
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool remove(const std::string &path)
+  {
+    boost::system::error_code e;
+    if (!boost::filesystem::exists(path, e))
+      return true;
+    boost::filesystem::remove(path, e);
+    if (e)
+    {
+      MERROR("Failed to remove cache journal " << path << ": " << e.message());
+      return false;
+    }
+    return true;
+  }
+}
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "crypto/chacha.h"
+
+namespace tools
+{
+  /**
+   * @brief append-only log of encrypted records kept next to a wallet cache
+   *
+   * Each record is a 32 bit little endian size followed by that many bytes:
+   *
+   *   record := size:u32 iv:8 chacha20(payload hash(payload))
+   *
+   * where hash is cn_fast_hash.  Records are only ever appended whole, and
+   * reading stops at the first record which is short or fails its hash, so
+   * a write torn by a crash loses that record only.  The reader reports how
+   * many bytes were good, and the next append first cuts the file back to
+   * that size.
+   */
+  namespace cache_journal
+  {
+    /**
+     * @brief reads the good records of a journal
+     *
+     * @param path the journal file, which may be missing
+     * @param key the key the records were encrypted with
+     * @param payloads return-by-reference the decrypted payloads, in order
+     * @param good_size return-by-reference the size of the good records
+     *
+     * @return false if the file exists but could not be read
+     */
+    bool read(const std::string &path, const crypto::chacha_key &key, std::vector<std::string> &payloads, uint64_t &good_size);
+
+    /**
+     * @brief appends records to a journal
+     *
+     * @param path the journal file, created if missing
+     * @param good_size the size of the good records already in the file
+     * @param key the key to encrypt the records with
+     * @param payloads the payloads to append, one record each
+     * @param new_size return-by-reference the size of the file after the append
+     *
+     * @return false on any I/O error
+     */
+    bool append(const std::string &path, uint64_t good_size, const crypto::chacha_key &key, const std::vector<std::string> &payloads, uint64_t &new_size);
+
+    /**
+     * @brief removes a journal, if it exists
+     */
+    bool remove(const std::string &path);
+  }
+}
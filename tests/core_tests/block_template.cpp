@@ -0,0 +1,138 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#include "chaingen.h"
+#include "block_template.h"
+
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  // the template fill is the same from v5 on, whatever the chain's version
+  const uint8_t template_version = 5;
+
+  bool fill_template(cryptonote::core& c, size_t median_weight, std::unordered_set<crypto::hash>& tx_hashes, size_t& weight, uint64_t& fee, uint64_t& reward)
+  {
+    Blockchain& bc = c.get_blockchain_storage();
+    const uint64_t height = bc.get_current_blockchain_height();
+    const uint64_t coins = bc.get_db().get_block_already_generated_coins(height - 1);
+    block b;
+    if (!c.get_pool().fill_block_template(b, median_weight, coins, weight, fee, reward, template_version, height))
+      return false;
+    tx_hashes = std::unordered_set<crypto::hash>(b.tx_hashes.begin(), b.tx_hashes.end());
+    return true;
+  }
+}
+
+gen_block_template_incremental::gen_block_template_incremental():
+  m_median_weight(0)
+{
+  REGISTER_CALLBACK_METHOD(gen_block_template_incremental, prime_template);
+  REGISTER_CALLBACK_METHOD(gen_block_template_incremental, check_template);
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_block_template_incremental::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+
+  GENERATE_ACCOUNT(miner_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);
+  MAKE_ACCOUNT(events, recipient_account);
+  REWIND_BLOCKS_N(events, blk_1, blk_0, miner_account, 12);
+  REWIND_BLOCKS(events, blk_1r, blk_1, miner_account);
+
+  // cheap txes, the template is built from them
+  for (uint64_t n = 1; n <= 3; ++n)
+    construct_tx_with_fee(events, blk_1r, miner_account, recipient_account, MK_COINS(1), TESTS_DEFAULT_FEE * n);
+  DO_CALLBACK(events, "prime_template");
+
+  // dearer txes, which the full fill would take ahead of the cheap ones
+  for (uint64_t n = 10; n <= 12; ++n)
+    construct_tx_with_fee(events, blk_1r, miner_account, recipient_account, MK_COINS(1), TESTS_DEFAULT_FEE * n);
+  DO_CALLBACK(events, "check_template");
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_block_template_incremental::prime_template(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_block_template_incremental::prime_template");
+
+  std::vector<transaction> txs;
+  CHECK_TEST_CONDITION(c.get_pool_transactions(txs));
+  CHECK_EQ(3, txs.size());
+
+  // room for three of the txes, so later ones only fit by displacing some
+  size_t max_tx_weight = 0;
+  for (const transaction& tx: txs)
+    max_tx_weight = std::max(max_tx_weight, get_transaction_weight(tx));
+  m_median_weight = (3 * max_tx_weight + max_tx_weight / 2 + CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE) / 2;
+
+  size_t weight;
+  uint64_t fee, reward;
+  CHECK_TEST_CONDITION(fill_template(c, m_median_weight, m_primed_hashes, weight, fee, reward));
+  CHECK_EQ(3, m_primed_hashes.size());
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_block_template_incremental::check_template(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_block_template_incremental::check_template");
+
+  CHECK_EQ(6, c.get_pool_transactions_count());
+
+  // the selection the pool kept up to date as the txes came in
+  std::unordered_set<crypto::hash> incremental_hashes;
+  size_t incremental_weight;
+  uint64_t incremental_fee, incremental_reward;
+  CHECK_TEST_CONDITION(fill_template(c, m_median_weight, incremental_hashes, incremental_weight, incremental_fee, incremental_reward));
+
+  // a chain event drops the selection, so this one is filled from scratch
+  c.get_pool().on_blockchain_inc(c.get_current_blockchain_height(), c.get_tail_id());
+  std::unordered_set<crypto::hash> full_hashes;
+  size_t full_weight;
+  uint64_t full_fee, full_reward;
+  CHECK_TEST_CONDITION(fill_template(c, m_median_weight, full_hashes, full_weight, full_fee, full_reward));
+
+  // the dearest tx is first in fee order, so it always makes it in
+  CHECK_TEST_CONDITION(full_hashes != m_primed_hashes);
+  CHECK_TEST_CONDITION(full_fee >= TESTS_DEFAULT_FEE * 12);
+  CHECK_TEST_CONDITION(incremental_hashes == full_hashes);
+  CHECK_EQ(full_weight, incremental_weight);
+  CHECK_EQ(full_fee, incremental_fee);
+  CHECK_EQ(full_reward, incremental_reward);
+
+  return true;
+}
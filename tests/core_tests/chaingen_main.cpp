@@ -169,6 +169,9 @@ int main(int argc, char* argv[])
 
     GENERATE_AND_PLAY(gen_block_reward);
 
+    GENERATE_AND_PLAY(gen_block_template_incremental);
+    GENERATE_AND_PLAY(gen_core_event_listener);
+
     GENERATE_AND_PLAY(gen_v2_tx_mixable_0_mixin);
     GENERATE_AND_PLAY(gen_v2_tx_mixable_low_mixin);
 //    GENERATE_AND_PLAY(gen_v2_tx_unmixable_only);
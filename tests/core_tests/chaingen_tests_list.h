@@ -32,9 +32,11 @@
 
 #include "chaingen.h"
 #include "block_reward.h"
+#include "block_template.h"
 #include "block_validation.h"
 #include "chain_split_1.h"
 #include "chain_switch_1.h"
+#include "core_event_listener.h"
 #include "double_spend.h"
 #include "integer_overflow.h"
 #include "ring_signature_1.h"
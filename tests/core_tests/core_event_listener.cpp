@@ -0,0 +1,208 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+
+#include "chaingen.h"
+#include "core_event_listener.h"
+
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  // the txes pushed as events so far, in order
+  std::vector<crypto::hash> get_event_tx_hashes(const std::vector<test_event_entry>& events, size_t ev_index)
+  {
+    std::vector<crypto::hash> hashes;
+    for (size_t i = 0; i < ev_index; ++i)
+      if (typeid(transaction) == events[i].type())
+        hashes.push_back(get_transaction_hash(boost::get<transaction>(events[i])));
+    return hashes;
+  }
+
+  gen_core_event_listener::recorder::block_entry get_event_block(const std::vector<test_event_entry>& events, size_t ev_index)
+  {
+    const block& b = boost::get<block>(events[ev_index]);
+    return gen_core_event_listener::recorder::block_entry(get_block_height(b), get_block_hash(b));
+  }
+}
+
+gen_core_event_listener::gen_core_event_listener():
+  m_invalid_block_index(0)
+{
+  REGISTER_CALLBACK_METHOD(gen_core_event_listener, mark_invalid_block);
+  REGISTER_CALLBACK_METHOD(gen_core_event_listener, set_listener);
+  REGISTER_CALLBACK_METHOD(gen_core_event_listener, check_txpool_add);
+  REGISTER_CALLBACK_METHOD(gen_core_event_listener, check_mined);
+  REGISTER_CALLBACK_METHOD(gen_core_event_listener, check_not_mined);
+  REGISTER_CALLBACK_METHOD(gen_core_event_listener, check_flushed);
+  REGISTER_CALLBACK_METHOD(gen_core_event_listener, check_reorg);
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+
+  GENERATE_ACCOUNT(miner_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);
+  MAKE_ACCOUNT(events, recipient_account);
+  REWIND_BLOCKS_N(events, blk_1, blk_0, miner_account, 2);
+  REWIND_BLOCKS(events, blk_1r, blk_1, miner_account);
+  DO_CALLBACK(events, "set_listener");
+
+  transaction tx_0 = construct_tx_with_fee(events, blk_1r, miner_account, recipient_account, MK_COINS(1), TESTS_DEFAULT_FEE);
+  transaction tx_1 = construct_tx_with_fee(events, blk_1r, miner_account, recipient_account, MK_COINS(1), TESTS_DEFAULT_FEE);
+  DO_CALLBACK(events, "check_txpool_add");
+
+  MAKE_NEXT_BLOCK_TX1(events, blk_2, blk_1r, miner_account, tx_0);
+  DO_CALLBACK(events, "check_mined");
+
+  // tx_1 is taken from the pool for this block, then goes back when the
+  // miner tx is found to claim more than the fees
+  transaction miner_tx;
+  CHECK_AND_ASSERT_MES(construct_miner_tx_manually(get_block_height(blk_2) + 1, generator.get_already_generated_coins(blk_2),
+    miner_account.get_keys().m_account_address, miner_tx, get_tx_fee(tx_1) + MK_COINS(1)), false, "Failed to construct miner tx");
+  block blk_3;
+  generator.construct_block_manually(blk_3, blk_2, miner_account, test_generator::bf_miner_tx | test_generator::bf_tx_hashes,
+    0, 0, 0, crypto::hash(), 0, miner_tx, std::vector<crypto::hash>(1, get_transaction_hash(tx_1)), get_transaction_weight(tx_1));
+  DO_CALLBACK(events, "mark_invalid_block");
+  events.push_back(blk_3);
+  DO_CALLBACK(events, "check_not_mined");
+
+  DO_CALLBACK(events, "check_flushed");
+
+  // a longer chain without tx_0 pops blk_2
+  MAKE_NEXT_BLOCK(events, blk_2a, blk_1r, miner_account);
+  MAKE_NEXT_BLOCK(events, blk_3a, blk_2a, miner_account);
+  DO_CALLBACK(events, "check_reorg");
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::mark_invalid_block(cryptonote::core& /*c*/, size_t ev_index, const std::vector<test_event_entry>& /*events*/)
+{
+  m_invalid_block_index = ev_index + 1;
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::set_listener(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  m_recorder = std::make_shared<recorder>();
+  c.set_event_listener(m_recorder);
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::check_txpool_add(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_core_event_listener::check_txpool_add");
+
+  const std::vector<crypto::hash> tx_hashes = get_event_tx_hashes(events, ev_index);
+  CHECK_EQ(2, tx_hashes.size());
+  CHECK_EQ(2, c.get_pool_transactions_count());
+
+  CHECK_TEST_CONDITION(m_recorder->added_txes == tx_hashes);
+  CHECK_TEST_CONDITION(m_recorder->removed_txes.empty());
+  CHECK_TEST_CONDITION(m_recorder->added_blocks.empty());
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::check_mined(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_core_event_listener::check_mined");
+
+  const std::vector<crypto::hash> tx_hashes = get_event_tx_hashes(events, ev_index);
+  m_mined_block = get_event_block(events, ev_index - 1);
+
+  CHECK_EQ(1, m_recorder->added_blocks.size());
+  CHECK_TEST_CONDITION(m_recorder->added_blocks[0] == m_mined_block);
+  CHECK_EQ(1, m_recorder->removed_txes.size());
+  CHECK_TEST_CONDITION(m_recorder->removed_txes[0] == recorder::tx_remove_entry(tx_hashes[0], txpool_remove_reason::mined));
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::check_not_mined(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_core_event_listener::check_not_mined");
+
+  const std::vector<crypto::hash> tx_hashes = get_event_tx_hashes(events, ev_index);
+
+  // the failed block's tx went back to the pool without being reported as mined
+  CHECK_EQ(m_mined_block.first + 1, c.get_current_blockchain_height());
+  CHECK_TEST_CONDITION(c.pool_has_tx(tx_hashes[1]));
+  CHECK_EQ(1, m_recorder->added_blocks.size());
+  CHECK_EQ(1, m_recorder->removed_txes.size());
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::check_flushed(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_core_event_listener::check_flushed");
+
+  const std::vector<crypto::hash> tx_hashes = get_event_tx_hashes(events, ev_index);
+
+  CHECK_TEST_CONDITION(c.get_blockchain_storage().flush_txes_from_pool(std::vector<crypto::hash>(1, tx_hashes[1])));
+  CHECK_EQ(0, c.get_pool_transactions_count());
+  CHECK_EQ(2, m_recorder->removed_txes.size());
+  CHECK_TEST_CONDITION(m_recorder->removed_txes[1] == recorder::tx_remove_entry(tx_hashes[1], txpool_remove_reason::flushed));
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_core_event_listener::check_reorg(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_core_event_listener::check_reorg");
+
+  const std::vector<crypto::hash> tx_hashes = get_event_tx_hashes(events, ev_index);
+
+  CHECK_EQ(1, m_recorder->popped_blocks.size());
+  CHECK_TEST_CONDITION(m_recorder->popped_blocks[0] == m_mined_block);
+
+  CHECK_EQ(3, m_recorder->added_blocks.size());
+  CHECK_TEST_CONDITION(m_recorder->added_blocks[1] == get_event_block(events, ev_index - 2));
+  CHECK_TEST_CONDITION(m_recorder->added_blocks[2] == get_event_block(events, ev_index - 1));
+
+  // the popped block's tx is back in the pool
+  CHECK_TEST_CONDITION(c.pool_has_tx(tx_hashes[0]));
+  CHECK_TEST_CONDITION(!m_recorder->added_txes.empty() && m_recorder->added_txes.back() == tx_hashes[0]);
+  CHECK_EQ(2, m_recorder->removed_txes.size());
+
+  return true;
+}
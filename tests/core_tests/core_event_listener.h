@@ -0,0 +1,83 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+
+#pragma once 
+#include "chaingen.h"
+
+/************************************************************************/
+/*                                                                      */
+/************************************************************************/
+// what the core tells its event listener as txes come and go and the chain
+// grows, fails to grow and reorganizes
+class gen_core_event_listener : public test_chain_unit_base
+{
+public: 
+  gen_core_event_listener();
+
+  bool generate(std::vector<test_event_entry>& events) const;
+
+  bool check_block_verification_context(const cryptonote::block_verification_context& bvc, size_t event_idx, const cryptonote::block& /*blk*/)
+  {
+    if (m_invalid_block_index == event_idx)
+      return bvc.m_verifivation_failed;
+    else
+      return !bvc.m_verifivation_failed;
+  }
+
+  bool mark_invalid_block(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool set_listener(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_txpool_add(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_mined(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_not_mined(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_flushed(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_reorg(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+
+  struct recorder : public cryptonote::i_core_event_listener
+  {
+    typedef std::pair<uint64_t, crypto::hash> block_entry;
+    typedef std::pair<crypto::hash, cryptonote::txpool_remove_reason> tx_remove_entry;
+
+    virtual void on_block_added(uint64_t height, const crypto::hash &id, const cryptonote::block &b) { added_blocks.push_back(block_entry(height, id)); }
+    virtual void on_block_popped(uint64_t height, const crypto::hash &id, const cryptonote::block &b) { popped_blocks.push_back(block_entry(height, id)); }
+    virtual void on_txpool_add(const crypto::hash &id, const cryptonote::transaction &tx, uint64_t weight, uint64_t fee) { added_txes.push_back(id); }
+    virtual void on_txpool_remove(const crypto::hash &id, cryptonote::txpool_remove_reason reason) { removed_txes.push_back(tx_remove_entry(id, reason)); }
+
+    std::vector<block_entry> added_blocks;
+    std::vector<block_entry> popped_blocks;
+    std::vector<crypto::hash> added_txes;
+    std::vector<tx_remove_entry> removed_txes;
+  };
+
+private:
+  size_t m_invalid_block_index;
+  std::shared_ptr<recorder> m_recorder;
+  recorder::block_entry m_mined_block;
+};
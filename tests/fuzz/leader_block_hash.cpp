@@ -0,0 +1,126 @@
+// Copyright (c) 2017-2018, The X-CASH Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "include_base_utils.h"
+#include "file_io_utils.h"
+#include "cryptonote_basic/blobdatatype.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "fuzzer.h"
+
+// Checks the streaming leader block hash against the reference
+// remove/serialize/reparse path it replaces
+class LeaderBlockHashFuzzer: public Fuzzer
+{
+public:
+  virtual int run(const std::string &filename);
+
+private:
+};
+
+static bool is_coinbase_shaped(const cryptonote::transaction &tx)
+{
+  if (tx.vin.size() != 1 || tx.vin[0].type() != typeid(cryptonote::txin_gen))
+    return false;
+  for (const auto &o: tx.vout)
+    if (o.target.type() != typeid(cryptonote::txout_to_key))
+      return false;
+  return tx.version == 1 || tx.rct_signatures.type == rct::RCTTypeNull;
+}
+
+static bool is_canonical_extra(const std::vector<uint8_t> &extra)
+{
+  std::vector<cryptonote::tx_extra_field> fields;
+  if (!cryptonote::parse_tx_extra(extra, fields))
+    return false;
+  std::ostringstream oss;
+  binary_archive<true> ar(oss);
+  for (auto &field: fields)
+    if (!::do_serialize(ar, field))
+      return false;
+  const std::string blob = oss.str();
+  return blob.size() == extra.size() && std::equal(blob.begin(), blob.end(), extra.begin());
+}
+
+int LeaderBlockHashFuzzer::run(const std::string &filename)
+{
+  std::string s;
+
+  if (!epee::file_io_utils::load_file_to_string(filename, s))
+  {
+    std::cout << "Error: failed to load file " << filename << std::endl;
+    return 1;
+  }
+  cryptonote::block b = AUTO_VAL_INIT(b);
+  if(!parse_and_validate_block_from_blob(s, b))
+  {
+    std::cout << "Error: failed to parse block from file  " << filename << std::endl;
+    return 1;
+  }
+
+  crypto::hash fast_hash;
+  const bool fast_ok = cryptonote::get_block_hash_without_leader_info(s, fast_hash);
+
+  // the streaming path only handles a coinbase shaped miner tx, which any
+  // block that can be added has, and hashes the bytes as they are. The
+  // parser ignores some varint errors, and a block it reads that way does
+  // not serialize back to the same bytes; the two are not comparable there
+  if (!is_coinbase_shaped(b.miner_tx) || t_serializable_object_to_blob(b) != s)
+    return 0;
+
+  cryptonote::block ref = b;
+  // the reference rebuilds the extra from its parsed fields, so it only
+  // hashes the signed bytes when they are in canonical form
+  bool ref_ok = is_canonical_extra(b.miner_tx.extra) && cryptonote::remove_leader_info_from_tx_extra(ref.miner_tx.extra);
+  crypto::hash ref_hash = crypto::null_hash;
+  if (ref_ok)
+  {
+    cryptonote::block ref_parsed = AUTO_VAL_INIT(ref_parsed);
+    ref_ok = parse_and_validate_block_from_blob(t_serializable_object_to_blob(ref), ref_parsed);
+    if (ref_ok)
+      ref_hash = get_block_hash(ref_parsed);
+  }
+
+  if (fast_ok != ref_ok)
+  {
+    std::cout << "Error: leader block hash accepted by " << (fast_ok ? "the streaming path" : "the reference path") << " only" << std::endl;
+    abort();
+  }
+  if (fast_ok && fast_hash != ref_hash)
+  {
+    std::cout << "Error: leader block hash mismatch: " << fast_hash << " != " << ref_hash << std::endl;
+    abort();
+  }
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  LeaderBlockHashFuzzer fuzzer;
+  return run_fuzzer(argc, argv, fuzzer);
+}
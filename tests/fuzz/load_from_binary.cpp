@@ -59,6 +59,8 @@ int PortableStorageFuzzer::run(const std::string &filename)
   {
     epee::serialization::portable_storage ps;
     ps.load_from_binary(s);
+    epee::serialization::portable_storage_flat flat;
+    flat.load_from_binary(s);
   }
   catch (const std::exception &e)
   {
@@ -0,0 +1,160 @@
+// Copyright (c) 2025 X-CASH Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+
+// Looks up the global output indices of every tx in a 1000 block range, as
+// getblocks.bin does when answering one request: either one tx at a time by
+// hash, or with a single bulk walk over the contiguous tx ids of the range
+template<bool bulk>
+class test_get_blocks_output_indices
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t n_blocks = 1000;
+  static const size_t txes_per_block = 4;
+  static const size_t outs_per_tx = 2;
+
+  test_get_blocks_output_indices(): m_db(new cryptonote::BlockchainLMDB()), m_hardfork(*m_db, 1, 0) {}
+
+  ~test_get_blocks_output_indices()
+  {
+    try { m_db->close(); }
+    catch (...) {}
+    delete m_db;
+    if (!m_path.empty())
+      boost::filesystem::remove_all(m_path);
+  }
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    m_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    try
+    {
+      m_db->open(m_path, DBF_FASTEST);
+      m_hardfork.init();
+      m_db->set_hard_fork(&m_hardfork);
+
+      m_db->batch_start(n_blocks);
+      crypto::hash prev_id = crypto::null_hash;
+      for (uint64_t height = 0; height < n_blocks; ++height)
+      {
+        block b;
+        b.major_version = 1;
+        b.minor_version = 1;
+        b.timestamp = height;
+        b.prev_id = prev_id;
+        b.miner_tx.version = 1;
+        b.miner_tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+        b.miner_tx.vin.push_back(txin_gen{height});
+        add_outputs(b.miner_tx);
+        m_tx_hashes.push_back(get_transaction_hash(b.miner_tx));
+
+        std::vector<transaction> txs(txes_per_block);
+        for (auto &tx: txs)
+        {
+          tx.version = 1;
+          txin_to_key in;
+          in.amount = 1;
+          in.key_offsets.push_back(0);
+          in.k_image = crypto::rand<crypto::key_image>();
+          tx.vin.push_back(in);
+          tx.signatures.push_back(std::vector<crypto::signature>(1));
+          add_outputs(tx);
+          b.tx_hashes.push_back(get_transaction_hash(tx));
+          m_tx_hashes.push_back(b.tx_hashes.back());
+        }
+
+        m_db->add_block(b, 1000, height + 1, 1, txs);
+        prev_id = get_block_hash(b);
+      }
+      m_db->batch_stop();
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "Failed to create test database: " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    size_t n_outputs = 0;
+    if (bulk)
+    {
+      m_db->block_txn_start(true);
+      uint64_t tx_id;
+      if (!m_db->tx_exists(m_tx_hashes.front(), tx_id))
+        return false;
+      const std::vector<std::vector<uint64_t>> indices = m_db->get_tx_amount_output_indices(tx_id, m_tx_hashes.size());
+      for (const auto &i: indices)
+        n_outputs += i.size();
+      m_db->block_txn_stop();
+    }
+    else
+    {
+      for (const crypto::hash &h: m_tx_hashes)
+      {
+        uint64_t tx_id;
+        if (!m_db->tx_exists(h, tx_id))
+          return false;
+        n_outputs += m_db->get_tx_amount_output_indices(tx_id).size();
+      }
+    }
+    return n_outputs == m_tx_hashes.size() * outs_per_tx;
+  }
+
+private:
+  static void add_outputs(cryptonote::transaction &tx)
+  {
+    for (size_t n = 0; n < outs_per_tx; ++n)
+    {
+      cryptonote::txout_to_key out;
+      out.key = crypto::rand<crypto::public_key>();
+      tx.vout.push_back(cryptonote::tx_out{1 + n, out});
+    }
+  }
+
+  cryptonote::BlockchainDB *m_db;
+  cryptonote::HardFork m_hardfork;
+  std::string m_path;
+  std::vector<crypto::hash> m_tx_hashes;
+};
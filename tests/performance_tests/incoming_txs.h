@@ -0,0 +1,217 @@
+// Copyright (c) 2025 X-CASH Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "cryptonote_core/tx_pool.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+
+#include "multi_tx_test_base.h"
+
+// Checks the inputs of a fluffy relay of bulletproof txes against a fake
+// chain holding the ring members, either one tx at a time through
+// Blockchain::check_tx_inputs as add_tx does, or as one batch through
+// tx_memory_pool::prevalidate_tx_inputs as core::handle_incoming_txs does
+// before taking the pool lock
+template<size_t a_ring_size, size_t a_num_txes, bool a_batched>
+class test_incoming_txs : private multi_tx_test_base<a_ring_size>
+{
+  static_assert(0 < a_ring_size, "ring_size must be greater than 0");
+
+public:
+  static const size_t loop_count = 5;
+
+  typedef multi_tx_test_base<a_ring_size> base_class;
+
+  test_incoming_txs(): m_pool(m_blockchain), m_blockchain(m_pool) {}
+
+  ~test_incoming_txs()
+  {
+    if (m_db_open)
+    {
+      try { m_blockchain.deinit(); }
+      catch (...) {}
+    }
+    if (!m_path.empty())
+      boost::filesystem::remove_all(m_path);
+  }
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    if (!base_class::init())
+      return false;
+
+    if (!init_chain())
+      return false;
+
+    m_alice.generate();
+
+    std::vector<tx_destination_entry> destinations;
+    destinations.push_back(tx_destination_entry(this->m_source_amount - 1, m_alice.get_keys().m_account_address, false));
+    destinations.push_back(tx_destination_entry(1, m_alice.get_keys().m_account_address, false));
+
+    crypto::secret_key tx_key;
+    std::vector<crypto::secret_key> additional_tx_keys;
+    std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddresses;
+    subaddresses[this->m_miners[this->real_source_idx].get_keys().m_account_address.m_spend_public_key] = {0,0};
+
+    for (size_t n = 0; n < a_num_txes; ++n)
+    {
+      transaction tx;
+      if (!construct_tx_and_get_tx_key(this->m_miners[this->real_source_idx].get_keys(), subaddresses, this->m_sources, destinations, cryptonote::account_public_address{}, std::vector<uint8_t>(), tx, 0, "private", 0, tx_key, additional_tx_keys, true, rct::RangeProofPaddedBulletproof))
+        return false;
+      m_blobs.push_back(tx_to_blob(tx));
+
+      // make sure the timed loop runs the accepting path
+      uint64_t max_used_block_height = 0;
+      crypto::hash max_used_block_id = crypto::null_hash;
+      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      if (!m_blockchain.check_tx_inputs(tx, max_used_block_height, max_used_block_id, tvc))
+        return false;
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    std::vector<cryptonote::transaction> txes(m_blobs.size());
+    std::vector<std::pair<cryptonote::transaction*, crypto::hash>> txs;
+    for (size_t n = 0; n < m_blobs.size(); ++n)
+    {
+      crypto::hash tx_hash, tx_prefix_hash;
+      if (!cryptonote::parse_and_validate_tx_from_blob(m_blobs[n], txes[n], tx_hash, tx_prefix_hash))
+        return false;
+      txs.push_back(std::make_pair(&txes[n], tx_hash));
+    }
+
+    if (a_batched)
+      return m_pool.prevalidate_tx_inputs(txs) == txs.size();
+
+    for (auto &tx: txes)
+    {
+      uint64_t max_used_block_height = 0;
+      crypto::hash max_used_block_id = crypto::null_hash;
+      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      if (!m_blockchain.check_tx_inputs(tx, max_used_block_height, max_used_block_id, tvc))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  // a genesis block, one block per ring member mining its output, then
+  // enough empty blocks for the ring members to unlock
+  bool init_chain()
+  {
+    using namespace cryptonote;
+
+    static const std::pair<uint8_t, uint64_t> hard_forks[] = { std::make_pair(1, 0), std::make_pair(HF_VERSION_PER_BYTE_FEE, 1), std::make_pair(0, 0) };
+    const test_options options = { hard_forks };
+
+    m_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    BlockchainDB *db = new BlockchainLMDB();
+    try
+    {
+      db->open(m_path, DBF_FASTEST);
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "Failed to create test database: " << e.what() << std::endl;
+      delete db;
+      return false;
+    }
+    m_db_open = true;
+    if (!m_blockchain.init(db, FAKECHAIN, true, &options))
+      return false;
+
+    try
+    {
+      const size_t n_blocks = a_ring_size + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+      BlockchainDB &chain_db = m_blockchain.get_db();
+      chain_db.set_batch_transactions(true);
+      chain_db.batch_start(n_blocks);
+      for (size_t n = 0; n < n_blocks; ++n)
+      {
+        const uint64_t height = chain_db.height();
+        block b;
+        b.major_version = HF_VERSION_PER_BYTE_FEE;
+        b.minor_version = HF_VERSION_PER_BYTE_FEE;
+        b.timestamp = height;
+        b.prev_id = chain_db.top_block_hash();
+        if (n < a_ring_size)
+        {
+          b.miner_tx = this->m_miner_txs[n];
+        }
+        else
+        {
+          b.miner_tx.version = 1;
+          b.miner_tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+          b.miner_tx.vin.push_back(txin_gen{height});
+        }
+        chain_db.add_block(b, 1000, height + 1, 1, std::vector<transaction>());
+      }
+      chain_db.batch_stop();
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "Failed to fill test database: " << e.what() << std::endl;
+      return false;
+    }
+
+    // the genesis block may pay out the same amount, so point the ring at
+    // the global indices the outputs actually landed on
+    for (size_t n = 0; n < a_ring_size; ++n)
+    {
+      std::vector<uint64_t> indices;
+      if (!m_blockchain.get_tx_outputs_gindexs(get_transaction_hash(this->m_miner_txs[n]), indices) || indices.empty())
+        return false;
+      this->m_sources[0].outputs[n].first = indices[0];
+    }
+    return true;
+  }
+
+  cryptonote::tx_memory_pool m_pool;
+  cryptonote::Blockchain m_blockchain;
+  bool m_db_open = false;
+  std::string m_path;
+  cryptonote::account_base m_alice;
+  std::vector<cryptonote::blobdata> m_blobs;
+};
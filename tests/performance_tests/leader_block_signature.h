@@ -0,0 +1,100 @@
+// Copyright (c) 2025 X-CASH Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <sodium.h>
+
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/temp_consensus_validator.h"
+
+// Verifies the leader signatures of a span of leader blocks, either one block
+// at a time as add_new_block used to, or through the threaded batch API
+template<bool batch, size_t n_blocks>
+class test_leader_block_signature
+{
+public:
+  static const size_t loop_count = 10;
+
+  bool init()
+  {
+    unsigned char seed[crypto_sign_SEEDBYTES];
+    unsigned char seckey[crypto_sign_SECRETKEYBYTES];
+    crypto::rand(sizeof(seed), seed);
+    if (crypto_sign_seed_keypair(reinterpret_cast<unsigned char*>(&m_pubkey), seckey, seed) != 0)
+      return false;
+
+    const std::string leader_id(97, 'X');
+    m_blocks.resize(n_blocks);
+    for (size_t i = 0; i < n_blocks; ++i)
+    {
+      cryptonote::block &b = m_blocks[i];
+      b.major_version = 13;
+      b.minor_version = 13;
+      b.timestamp = 1700000000 + i * 60;
+      b.prev_id = crypto::rand<crypto::hash>();
+      b.miner_tx.version = 2;
+      b.miner_tx.unlock_time = i + 60;
+      b.miner_tx.vin.push_back(cryptonote::txin_gen{i});
+      cryptonote::add_tx_pub_key_to_extra(b.miner_tx.extra, crypto::rand<crypto::public_key>());
+
+      crypto::hash signed_hash;
+      if (!cryptonote::get_leader_signed_block_hash(b, signed_hash))
+        return false;
+      crypto::signature sig;
+      if (crypto_sign_detached(reinterpret_cast<unsigned char*>(&sig), NULL, reinterpret_cast<const unsigned char*>(&signed_hash), sizeof(signed_hash), seckey) != 0)
+        return false;
+      if (!cryptonote::add_leader_info_to_tx_extra(b.miner_tx.extra, leader_id, sig))
+        return false;
+      b.invalidate_hashes();
+    }
+    m_pubkeys.assign(n_blocks, m_pubkey);
+    return true;
+  }
+
+  bool test()
+  {
+    if (batch)
+    {
+      std::vector<uint8_t> valid;
+      cryptonote::verify_leader_signatures(m_blocks, m_pubkeys, valid);
+      return std::find(valid.begin(), valid.end(), 0) == valid.end();
+    }
+    for (const auto &b: m_blocks)
+      if (!cryptonote::verify_leader_signature(b, m_pubkey))
+        return false;
+    return true;
+  }
+
+private:
+  crypto::public_key m_pubkey;
+  std::vector<cryptonote::block> m_blocks;
+  std::vector<crypto::public_key> m_pubkeys;
+};
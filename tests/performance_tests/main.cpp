@@ -58,6 +58,12 @@
 #include "bulletproof.h"
 #include "crypto_ops.h"
 #include "multiexp.h"
+#include "leader_block_signature.h"
+#include "next_difficulty.h"
+#include "incoming_txs.h"
+#include "get_blocks_output_indices.h"
+#include "scan_outputs.h"
+#include "portable_storage.h"
 
 namespace po = boost::program_options;
 
@@ -164,6 +170,17 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE4(filter, p, test_check_tx_signature, 2, 10, true, rct::RangeProofPaddedBulletproof);
   TEST_PERFORMANCE4(filter, p, test_check_tx_signature, 2, 10, true, rct::RangeProofMultiOutputBulletproof);
 
+  TEST_PERFORMANCE3(filter, p, test_incoming_txs, 21, 32, false);
+  TEST_PERFORMANCE3(filter, p, test_incoming_txs, 21, 32, true);
+
+  TEST_PERFORMANCE1(filter, p, test_get_blocks_output_indices, false);
+  TEST_PERFORMANCE1(filter, p, test_get_blocks_output_indices, true);
+
+  TEST_PERFORMANCE2(filter, p, test_portable_storage, epee::serialization::portable_storage, false);
+  TEST_PERFORMANCE2(filter, p, test_portable_storage, epee::serialization::portable_storage_flat, false);
+  TEST_PERFORMANCE2(filter, p, test_portable_storage, epee::serialization::portable_storage, true);
+  TEST_PERFORMANCE2(filter, p, test_portable_storage, epee::serialization::portable_storage_flat, true);
+
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature_aggregated_bulletproofs, 2, 2, 64);
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature_aggregated_bulletproofs, 10, 2, 64);
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature_aggregated_bulletproofs, 100, 2, 64);
@@ -176,6 +193,8 @@ int main(int argc, char** argv)
 
   TEST_PERFORMANCE0(filter, p, test_is_out_to_acc);
   TEST_PERFORMANCE0(filter, p, test_is_out_to_acc_precomp);
+  TEST_PERFORMANCE2(filter, p, test_scan_outputs, 256, false);
+  TEST_PERFORMANCE2(filter, p, test_scan_outputs, 256, true);
   TEST_PERFORMANCE0(filter, p, test_generate_key_image_helper);
   TEST_PERFORMANCE0(filter, p, test_generate_key_derivation);
   TEST_PERFORMANCE0(filter, p, test_generate_key_image);
@@ -189,6 +208,15 @@ int main(int argc, char** argv)
 
   TEST_PERFORMANCE2(filter, p, test_wallet2_expand_subaddresses, 50, 200);
 
+  TEST_PERFORMANCE2(filter, p, test_leader_block_signature, false, 1000);
+  TEST_PERFORMANCE2(filter, p, test_leader_block_signature, true, 1000);
+
+  TEST_PERFORMANCE1(filter, p, test_next_difficulty, 8);
+  TEST_PERFORMANCE1(filter, p, test_next_difficulty, 9);
+  TEST_PERFORMANCE1(filter, p, test_next_difficulty, 10);
+  TEST_PERFORMANCE1(filter, p, test_next_difficulty, 12);
+  TEST_PERFORMANCE1(filter, p, test_next_difficulty, 13);
+
   TEST_PERFORMANCE0(filter, p, test_cn_slow_hash);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 16384);
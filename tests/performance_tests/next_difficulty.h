@@ -0,0 +1,79 @@
+// Copyright (c) 2025 X-CASH Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+
+#include "cryptonote_config.h"
+#include "crypto/crypto.h"
+#include "cryptonote_basic/difficulty.h"
+
+// Runs one difficulty calculator over a full window of blocks with a jittered
+// solve time, copying the inputs in on every call as the blockchain does
+template<uint8_t version>
+class test_next_difficulty
+{
+public:
+  static const size_t loop_count = 10000;
+
+  bool init()
+  {
+    const size_t n_blocks = version <= 7 ? DIFFICULTY_BLOCKS_COUNT : DIFFICULTY_BLOCKS_COUNT_V8;
+    const uint64_t target = version >= 13 ? DIFFICULTY_TARGET_V13 : version == 12 ? DIFFICULTY_TARGET_V12 : DIFFICULTY_TARGET_V10;
+    uint64_t timestamp = 1700000000;
+    cryptonote::difficulty_type cumulative_difficulty = 0;
+    for (size_t i = 0; i < n_blocks; ++i)
+    {
+      timestamp += target / 2 + crypto::rand<uint64_t>() % target;
+      cumulative_difficulty += 1000000 + crypto::rand<uint64_t>() % 100000;
+      m_timestamps.push_back(timestamp);
+      m_cumulative_difficulties.push_back(cumulative_difficulty);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    cryptonote::difficulty_type diff;
+    switch (version)
+    {
+      case 8: diff = cryptonote::next_difficulty_V8(m_timestamps, m_cumulative_difficulties, HF_VERSION_LWMA_DIFFICULTY_BLOCK_HEIGHT + 1000); break;
+      case 9: diff = cryptonote::next_difficulty_V9(m_timestamps, m_cumulative_difficulties, DIFFICULTY_TARGET_V10); break;
+      case 10: diff = cryptonote::next_difficulty_V10(m_timestamps, m_cumulative_difficulties, DIFFICULTY_TARGET_V10); break;
+      case 12: diff = cryptonote::next_difficulty_V12(m_timestamps, m_cumulative_difficulties, DIFFICULTY_TARGET_V12); break;
+      case 13: diff = cryptonote::next_difficulty_V13(m_timestamps, m_cumulative_difficulties, DIFFICULTY_TARGET_V13); break;
+      default: diff = cryptonote::next_difficulty(m_timestamps, m_cumulative_difficulties, DIFFICULTY_TARGET_V10); break;
+    }
+    return diff != 0;
+  }
+
+private:
+  std::vector<uint64_t> m_timestamps;
+  std::vector<cryptonote::difficulty_type> m_cumulative_difficulties;
+};
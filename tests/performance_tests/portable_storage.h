@@ -0,0 +1,123 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <string>
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage.h"
+#include "storages/portable_storage_flat.h"
+
+// Parses (or serializes) a NOTIFY_RESPONSE_GET_OBJECTS payload of 1000
+// blocks, as a syncing node receives it, with the given epee storage backend
+template<typename storage, bool store>
+class test_portable_storage
+{
+public:
+  static const size_t loop_count = 20;
+  static const size_t n_blocks = 1000;
+  static const size_t txes_per_block = 4;
+  static const size_t tx_extra_size = 2000;
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    crypto::hash prev_id = crypto::null_hash;
+    for (uint64_t height = 0; height < n_blocks; ++height)
+    {
+      block b;
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = height;
+      b.prev_id = prev_id;
+      b.miner_tx.version = 1;
+      b.miner_tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+      b.miner_tx.vin.push_back(txin_gen{height});
+      add_output(b.miner_tx);
+
+      block_complete_entry bce;
+      for (size_t n = 0; n < txes_per_block; ++n)
+      {
+        transaction tx;
+        tx.version = 1;
+        txin_to_key in;
+        in.amount = 1;
+        in.key_offsets.push_back(0);
+        in.k_image = crypto::rand<crypto::key_image>();
+        tx.vin.push_back(in);
+        tx.signatures.push_back(std::vector<crypto::signature>(1));
+        add_output(tx);
+        // pad to the size of a typical ringct tx
+        tx.extra.resize(tx_extra_size);
+        crypto::rand(tx.extra.size(), tx.extra.data());
+        b.tx_hashes.push_back(get_transaction_hash(tx));
+        bce.txs.push_back(tx_to_blob(tx));
+      }
+      bce.block = block_to_blob(b);
+      m_objects.blocks.push_back(bce);
+      prev_id = get_block_hash(b);
+    }
+    m_objects.current_blockchain_height = n_blocks;
+
+    epee::serialization::portable_storage ps;
+    m_objects.store(ps);
+    return ps.store_to_binary(m_blob);
+  }
+
+  bool test()
+  {
+    storage stg;
+    if (store)
+    {
+      std::string blob;
+      m_objects.store(stg);
+      return stg.store_to_binary(blob) && blob.size() == m_blob.size();
+    }
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request objects;
+    if (!stg.load_from_binary(m_blob) || !objects.load(stg))
+      return false;
+    return objects.blocks.size() == n_blocks && objects.blocks.back().txs.size() == txes_per_block;
+  }
+
+private:
+  static void add_output(cryptonote::transaction &tx)
+  {
+    cryptonote::txout_to_key out;
+    out.key = crypto::rand<crypto::public_key>();
+    tx.vout.push_back(cryptonote::tx_out{1, out});
+  }
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request m_objects;
+  std::string m_blob;
+};
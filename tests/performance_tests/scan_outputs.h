@@ -0,0 +1,84 @@
+// Copyright (c) 2025 X-CASH Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+
+template<size_t n_outputs, bool batched>
+class test_scan_outputs
+{
+public:
+  static const size_t loop_count = 100;
+
+  bool init()
+  {
+    m_view = cryptonote::keypair::generate(hw::get_device("default"));
+    for (size_t n = 0; n < n_outputs; ++n)
+    {
+      m_tx_keys.push_back(cryptonote::keypair::generate(hw::get_device("default")).pub);
+      m_out_keys.push_back(cryptonote::keypair::generate(hw::get_device("default")).pub);
+      m_output_indices.push_back(n % 16);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    std::vector<crypto::key_derivation> derivations;
+    std::vector<crypto::public_key> spend_keys;
+    if (batched)
+    {
+      std::vector<bool> valid;
+      crypto::generate_key_derivations(m_tx_keys, m_view.sec, derivations, valid);
+      crypto::derive_subaddress_public_keys(m_out_keys, derivations, m_output_indices, spend_keys, valid);
+    }
+    else
+    {
+      derivations.resize(n_outputs);
+      spend_keys.resize(n_outputs);
+      for (size_t n = 0; n < n_outputs; ++n)
+      {
+        if (!crypto::generate_key_derivation(m_tx_keys[n], m_view.sec, derivations[n]))
+          return false;
+        if (!crypto::derive_subaddress_public_key(m_out_keys[n], derivations[n], m_output_indices[n], spend_keys[n]))
+          return false;
+      }
+    }
+    return spend_keys.size() == n_outputs;
+  }
+
+private:
+  cryptonote::keypair m_view;
+  std::vector<crypto::public_key> m_tx_keys;
+  std::vector<crypto::public_key> m_out_keys;
+  std::vector<size_t> m_output_indices;
+};
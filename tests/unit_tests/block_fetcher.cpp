@@ -0,0 +1,166 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <atomic>
+#include "gtest/gtest.h"
+
+#include "wallet/block_fetcher.h"
+
+namespace
+{
+  // a chain where each daemon reply is capped at max_reply blocks, takes
+  // delay ms, and replies from start_height in fail_heights fail fail_count
+  // times
+  struct fake_daemon
+  {
+    uint64_t height;
+    uint64_t max_reply;
+    unsigned delay;
+    std::map<uint64_t, unsigned> failures;
+    boost::mutex mutex;
+    std::atomic<unsigned> in_flight;
+    std::atomic<unsigned> max_in_flight;
+
+    fake_daemon(uint64_t height, uint64_t max_reply, unsigned delay = 1): height(height), max_reply(max_reply), delay(delay), in_flight(0), max_in_flight(0) {}
+
+    bool fetch(size_t worker, uint64_t start_height, tools::block_fetcher::range &r)
+    {
+      const unsigned n = ++in_flight;
+      unsigned m = max_in_flight;
+      while (n > m && !max_in_flight.compare_exchange_weak(m, n));
+      {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        auto i = failures.find(start_height);
+        if (i != failures.end() && i->second > 0)
+        {
+          --i->second;
+          --in_flight;
+          return false;
+        }
+      }
+      r.start_height = start_height;
+      for (uint64_t h = start_height; h < height && h < start_height + max_reply; ++h)
+      {
+        r.blocks.push_back(cryptonote::block_complete_entry());
+        r.blocks.back().block = std::to_string(h);
+        r.o_indices.push_back(cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(delay));
+      --in_flight;
+      return true;
+    }
+
+    tools::block_fetcher::fetch_t fetcher()
+    {
+      return [this](size_t worker, uint64_t start_height, tools::block_fetcher::range &r) { return fetch(worker, start_height, r); };
+    }
+  };
+
+  // takes ranges as they come, spending consume_delay ms on each
+  uint64_t drain(tools::block_fetcher &fetcher, uint64_t start_height, unsigned consume_delay = 0)
+  {
+    uint64_t height = start_height;
+    tools::block_fetcher::range r;
+    while (fetcher.next(r))
+    {
+      EXPECT_EQ(r.start_height, height);
+      for (const auto &bce: r.blocks)
+        EXPECT_EQ(bce.block, std::to_string(height++));
+      if (consume_delay)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(consume_delay));
+    }
+    return height;
+  }
+}
+
+TEST(block_fetcher, in_order)
+{
+  fake_daemon daemon(1000, 100);
+  tools::block_fetcher fetcher(daemon.fetcher(), 4, 10, 990, 100);
+  ASSERT_EQ(drain(fetcher, 10), 990);
+  ASSERT_TRUE(fetcher.finished());
+  ASSERT_LE(daemon.max_in_flight, 4);
+}
+
+TEST(block_fetcher, short_replies)
+{
+  // replies come back with fewer blocks than asked for, the rest is fetched again
+  fake_daemon daemon(1000, 7);
+  tools::block_fetcher fetcher(daemon.fetcher(), 3, 1, 500, 50);
+  ASSERT_EQ(drain(fetcher, 1), 500);
+}
+
+TEST(block_fetcher, retries)
+{
+  fake_daemon daemon(1000, 100);
+  daemon.failures[100] = 2;
+  tools::block_fetcher fetcher(daemon.fetcher(), 2, 0, 300, 100);
+  ASSERT_EQ(drain(fetcher, 0), 300);
+}
+
+TEST(block_fetcher, gives_up)
+{
+  fake_daemon daemon(1000, 100);
+  daemon.failures[200] = 100;
+  tools::block_fetcher fetcher(daemon.fetcher(), 2, 0, 500, 100);
+  ASSERT_EQ(drain(fetcher, 0), 200);
+  ASSERT_TRUE(fetcher.finished());
+}
+
+TEST(block_fetcher, stop)
+{
+  fake_daemon daemon(1000000, 10);
+  tools::block_fetcher fetcher(daemon.fetcher(), 4, 0, 1000000, 10);
+  tools::block_fetcher::range r;
+  ASSERT_TRUE(fetcher.next(r));
+  fetcher.stop();
+  ASSERT_FALSE(fetcher.next(r));
+  ASSERT_TRUE(fetcher.finished());
+}
+
+TEST(block_fetcher, deepens_for_slow_link)
+{
+  // fetches take much longer than the caller takes, so more get in flight
+  fake_daemon daemon(1000, 10, 20);
+  tools::block_fetcher fetcher(daemon.fetcher(), 8, 0, 400, 10);
+  ASSERT_EQ(drain(fetcher, 0), 400);
+  ASSERT_EQ(fetcher.depth(), 8);
+  ASSERT_GT(daemon.max_in_flight, 2);
+  ASSERT_LE(daemon.max_in_flight, 8);
+}
+
+TEST(block_fetcher, stays_shallow_for_slow_caller)
+{
+  // the caller takes much longer than fetches, so nothing more is buffered
+  fake_daemon daemon(1000, 10, 1);
+  tools::block_fetcher fetcher(daemon.fetcher(), 8, 0, 200, 10);
+  ASSERT_EQ(drain(fetcher, 0, 20), 200);
+  ASSERT_EQ(fetcher.depth(), 2);
+  ASSERT_LE(daemon.max_in_flight, 2);
+}
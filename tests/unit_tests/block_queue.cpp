@@ -31,6 +31,7 @@
 #include "crypto/crypto.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "cryptonote_protocol/block_queue.h"
+#include "common/pruning.h"
 
 static const boost::uuids::uuid &uuid1()
 {
@@ -85,3 +86,38 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, reserve_span_pruned)
+{
+  const uint64_t blockchain_height = 100000;
+  const uint32_t seed1 = tools::make_pruning_seed(1, CRYPTONOTE_PRUNING_LOG_STRIPES);
+  const uint32_t seed2 = tools::make_pruning_seed(2, CRYPTONOTE_PRUNING_LOG_STRIPES);
+  std::vector<crypto::hash> hashes(16);
+  for (auto &h: hashes)
+    h = crypto::rand<crypto::hash>();
+  const uint64_t first = CRYPTONOTE_PRUNING_STRIPE_SIZE - 6, last = first + hashes.size() - 1;
+
+  // an unpruned peer has everything
+  {
+    cryptonote::block_queue bq;
+    ASSERT_EQ(bq.reserve_span(first, last, 10, uuid1(), 0, blockchain_height, hashes), std::make_pair(first, (uint64_t)10));
+  }
+  // a peer keeping the first stripe stops at its end
+  {
+    cryptonote::block_queue bq;
+    ASSERT_EQ(bq.reserve_span(first, last, 10, uuid1(), seed1, blockchain_height, hashes), std::make_pair(first, (uint64_t)6));
+  }
+  // a peer keeping the second stripe starts at its beginning
+  {
+    cryptonote::block_queue bq;
+    ASSERT_EQ(bq.reserve_span(first, last, 5, uuid1(), seed2, blockchain_height, hashes), std::make_pair((uint64_t)CRYPTONOTE_PRUNING_STRIPE_SIZE, (uint64_t)5));
+    // and a second request continues after what is already reserved
+    ASSERT_EQ(bq.reserve_span(first, last, 10, uuid2(), seed2, blockchain_height, hashes), std::make_pair((uint64_t)CRYPTONOTE_PRUNING_STRIPE_SIZE + 5, (uint64_t)5));
+  }
+  // a peer keeping none of these blocks gets nothing
+  {
+    cryptonote::block_queue bq;
+    const uint32_t seed3 = tools::make_pruning_seed(3, CRYPTONOTE_PRUNING_LOG_STRIPES);
+    ASSERT_EQ(bq.reserve_span(first, last, 10, uuid1(), seed3, blockchain_height, hashes).second, 0);
+  }
+}
@@ -42,6 +42,7 @@
 #include "blockchain_db/berkeleydb/db_bdb.h"
 #endif
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "common/pruning.h"
 
 using namespace cryptonote;
 using epee::string_tools::pod_to_hex;
@@ -344,4 +345,111 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, VerifiedBlockDataHash)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+
+  std::string data_hash;
+  ASSERT_FALSE(this->m_db->get_verified_block_data_hash(910000, data_hash));
+
+  ASSERT_NO_THROW(this->m_db->set_verified_block_data_hash(910000, std::string(128, 'a')));
+  ASSERT_TRUE(this->m_db->get_verified_block_data_hash(910000, data_hash));
+  ASSERT_EQ(std::string(128, 'a'), data_hash);
+  ASSERT_FALSE(this->m_db->get_verified_block_data_hash(910001, data_hash));
+
+  // a later confirmation for the same height replaces the earlier one
+  ASSERT_NO_THROW(this->m_db->set_verified_block_data_hash(910000, std::string(128, 'b')));
+  ASSERT_TRUE(this->m_db->get_verified_block_data_hash(910000, data_hash));
+  ASSERT_EQ(std::string(128, 'b'), data_hash);
+
+  // verdicts do not depend on the local chain, so they survive a reset
+  ASSERT_NO_THROW(this->m_db->reset());
+  ASSERT_TRUE(this->m_db->get_verified_block_data_hash(910000, data_hash));
+}
+
+TYPED_TEST(BlockchainDBTest, Pruning)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_EQ(0, this->m_db->get_blockchain_pruning_seed());
+  ASSERT_TRUE(this->m_db->update_pruning());
+
+  const uint32_t pruning_seed = tools::make_pruning_seed(3, CRYPTONOTE_PRUNING_LOG_STRIPES);
+  ASSERT_TRUE(this->m_db->prune_blockchain(pruning_seed));
+  ASSERT_EQ(pruning_seed, this->m_db->get_blockchain_pruning_seed());
+  ASSERT_TRUE(this->m_db->check_pruning());
+
+  // pruning again keeps the seed, another seed is refused
+  ASSERT_TRUE(this->m_db->prune_blockchain());
+  ASSERT_EQ(pruning_seed, this->m_db->get_blockchain_pruning_seed());
+  ASSERT_FALSE(this->m_db->prune_blockchain(tools::make_pruning_seed(4, CRYPTONOTE_PRUNING_LOG_STRIPES)));
+
+  // blocks added after pruning, and all txes in the tip, are kept whole
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_TRUE(this->m_db->update_pruning());
+  ASSERT_TRUE(this->m_db->check_pruning());
+  for (const auto &tx: this->m_txs[0])
+  {
+    cryptonote::blobdata bd;
+    ASSERT_TRUE(this->m_db->get_tx_blob(get_transaction_hash(tx), bd));
+  }
+
+  ASSERT_NO_THROW(this->m_db->reset());
+  ASSERT_EQ(0, this->m_db->get_blockchain_pruning_seed());
+}
+
+TYPED_TEST(BlockchainDBTest, BulkOutputIndices)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // both blocks in chain order, miner tx first
+  std::vector<crypto::hash> hashes;
+  for (size_t n = 0; n < 2; ++n)
+  {
+    hashes.push_back(get_transaction_hash(this->m_blocks[n].miner_tx));
+    for (const auto &tx: this->m_txs[n])
+      hashes.push_back(get_transaction_hash(tx));
+  }
+
+  uint64_t first_tx_id;
+  ASSERT_TRUE(this->m_db->tx_exists(hashes[0], first_tx_id));
+  std::vector<std::vector<uint64_t>> indices;
+  ASSERT_NO_THROW(indices = this->m_db->get_tx_amount_output_indices(first_tx_id, hashes.size()));
+  ASSERT_EQ(hashes.size(), indices.size());
+  for (size_t n = 0; n < hashes.size(); ++n)
+  {
+    uint64_t tx_id;
+    ASSERT_TRUE(this->m_db->tx_exists(hashes[n], tx_id));
+    ASSERT_EQ(first_tx_id + n, tx_id);
+    ASSERT_EQ(this->m_db->get_tx_amount_output_indices(tx_id), indices[n]);
+  }
+
+  ASSERT_TRUE(this->m_db->get_tx_amount_output_indices(first_tx_id, 0).empty());
+  ASSERT_THROW(this->m_db->get_tx_amount_output_indices(first_tx_id, hashes.size() + 1), TX_DNE);
+}
+
 }  // anonymous namespace
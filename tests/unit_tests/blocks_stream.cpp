@@ -0,0 +1,149 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "cryptonote_basic/blocks_stream.h"
+
+namespace
+{
+  std::string make_stream(size_t n_blocks)
+  {
+    std::string stream;
+    cryptonote::blocks_stream_writer writer(stream);
+    writer.write_header(1000, 1000 + n_blocks);
+    for (size_t b = 0; b < n_blocks; ++b)
+    {
+      writer.begin_block(std::string(80 + b, 'b'), b);
+      for (size_t t = 0; t < b; ++t)
+        writer.add_tx(std::string(200 + t, 't'));
+      for (size_t t = 0; t < b + 1; ++t)
+        writer.add_output_indices(std::vector<uint64_t>(t, 1000000 * b + t));
+      writer.end_block();
+    }
+    writer.finish();
+    return stream;
+  }
+
+  void check_entry(const cryptonote::blocks_stream_entry &entry, size_t b)
+  {
+    ASSERT_EQ(std::string(80 + b, 'b'), entry.block);
+    ASSERT_EQ(b, entry.txs.size());
+    for (size_t t = 0; t < b; ++t)
+      ASSERT_EQ(std::string(200 + t, 't'), entry.txs[t]);
+    ASSERT_EQ(b + 1, entry.output_indices.size());
+    for (size_t t = 0; t < b + 1; ++t)
+      ASSERT_EQ(std::vector<uint64_t>(t, 1000000 * b + t), entry.output_indices[t]);
+  }
+}
+
+TEST(blocks_stream, round_trip)
+{
+  cryptonote::blocks_stream_reader reader;
+  reader.update(make_stream(5));
+  cryptonote::blocks_stream_entry entry;
+  for (size_t b = 0; b < 5; ++b)
+  {
+    ASSERT_TRUE(reader.next(entry));
+    check_entry(entry, b);
+  }
+  ASSERT_FALSE(reader.next(entry));
+  ASSERT_TRUE(reader.has_header());
+  ASSERT_EQ(1000, reader.start_height());
+  ASSERT_EQ(1005, reader.current_height());
+  ASSERT_TRUE(reader.finished());
+  ASSERT_FALSE(reader.error());
+}
+
+TEST(blocks_stream, byte_by_byte)
+{
+  const std::string stream = make_stream(4);
+  cryptonote::blocks_stream_reader reader;
+  cryptonote::blocks_stream_entry entry;
+  size_t b = 0;
+  for (char c: stream)
+  {
+    reader.update(std::string(1, c));
+    while (reader.next(entry))
+      check_entry(entry, b++);
+    ASSERT_FALSE(reader.error());
+  }
+  ASSERT_EQ(4, b);
+  ASSERT_TRUE(reader.finished());
+}
+
+TEST(blocks_stream, empty)
+{
+  std::string stream;
+  cryptonote::blocks_stream_writer writer(stream);
+  writer.write_header(7, 7);
+  writer.finish();
+
+  cryptonote::blocks_stream_reader reader;
+  reader.update(stream);
+  cryptonote::blocks_stream_entry entry;
+  ASSERT_FALSE(reader.next(entry));
+  ASSERT_TRUE(reader.has_header());
+  ASSERT_EQ(7, reader.start_height());
+  ASSERT_TRUE(reader.finished());
+  ASSERT_FALSE(reader.error());
+}
+
+TEST(blocks_stream, truncated)
+{
+  const std::string stream = make_stream(3);
+  cryptonote::blocks_stream_reader reader;
+  reader.update(stream.substr(0, stream.size() - 10));
+  cryptonote::blocks_stream_entry entry;
+  while (reader.next(entry));
+  ASSERT_FALSE(reader.finished());
+  ASSERT_FALSE(reader.error());
+}
+
+TEST(blocks_stream, malformed)
+{
+  std::string stream = make_stream(2);
+  stream[4] = 'Y'; // magic
+  cryptonote::blocks_stream_reader reader;
+  reader.update(stream);
+  cryptonote::blocks_stream_entry entry;
+  ASSERT_FALSE(reader.next(entry));
+  ASSERT_TRUE(reader.error());
+
+  // a block record whose tx count runs past its end
+  std::string bad;
+  cryptonote::blocks_stream_writer writer(bad);
+  writer.write_header(0, 1);
+  writer.begin_block(std::string(80, 'b'), 3);
+  writer.add_tx(std::string(10, 't'));
+  writer.end_block();
+  writer.finish();
+  cryptonote::blocks_stream_reader bad_reader;
+  bad_reader.update(bad);
+  ASSERT_FALSE(bad_reader.next(entry));
+  ASSERT_TRUE(bad_reader.error());
+}
@@ -0,0 +1,143 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+
+#include "blockchain_utilities/bootstrap_file.h"
+
+namespace
+{
+  // writes chunks of arbitrary data, as the exporter would write blocks
+  struct test_writer: public BootstrapFile
+  {
+    bool open(const boost::filesystem::path &path) { return open_writer(path, true); }
+    void add_chunk(const std::string &data) { m_output_stream->write(data.data(), data.size()); flush_chunk(); }
+    bool finish() { return close(); }
+    void abandon() { delete m_output_stream; delete m_raw_data_file; }
+  };
+
+  std::string chunk_data(uint64_t height)
+  {
+    return "chunk for height " + std::to_string(height);
+  }
+
+  class bootstrap_file_index: public ::testing::Test
+  {
+  protected:
+    boost::filesystem::path path;
+
+    bootstrap_file_index(): path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()) {}
+    ~bootstrap_file_index() { boost::filesystem::remove(path); }
+
+    void write(uint64_t first, uint64_t count, bool finish = true)
+    {
+      test_writer writer;
+      ASSERT_TRUE(writer.open(path));
+      for (uint64_t h = first; h < first + count; ++h)
+        writer.add_chunk(chunk_data(h));
+      if (finish)
+        ASSERT_TRUE(writer.finish());
+      else
+        writer.abandon();
+    }
+
+    void check_indexed(uint64_t count)
+    {
+      BootstrapFile reader;
+      ASSERT_EQ(reader.count_blocks(path.string()), count);
+      ASSERT_TRUE(reader.map_indexed(path.string()));
+      ASSERT_EQ(reader.indexed_block_first(), 0);
+      ASSERT_EQ(reader.indexed_block_count(), count);
+      std::string chunk;
+      for (uint64_t h = 0; h < count; ++h)
+      {
+        ASSERT_TRUE(reader.get_chunk(h, chunk));
+        ASSERT_EQ(chunk, chunk_data(h));
+      }
+      ASSERT_FALSE(reader.get_chunk(count, chunk));
+
+      BootstrapFile sequential;
+      ASSERT_TRUE(sequential.load_index(path.string()));
+      for (uint64_t h = 0; h < count; ++h)
+        ASSERT_TRUE(sequential.check_chunk(h, chunk_data(h)));
+      ASSERT_FALSE(sequential.check_chunk(0, chunk_data(1)));
+      ASSERT_FALSE(sequential.check_chunk(count, chunk_data(count)));
+    }
+  };
+}
+
+TEST_F(bootstrap_file_index, round_trip)
+{
+  write(0, 5);
+  check_indexed(5);
+}
+
+TEST_F(bootstrap_file_index, append)
+{
+  write(0, 5);
+  write(5, 3);
+  check_indexed(8);
+}
+
+TEST_F(bootstrap_file_index, interrupted_append)
+{
+  // the index is dropped when appending starts, and the file is not marked
+  // as indexed until it is written again, so it reads sequentially
+  write(0, 5);
+  write(5, 3, false);
+  BootstrapFile reader;
+  ASSERT_FALSE(reader.map_indexed(path.string()));
+  ASSERT_FALSE(reader.load_index(path.string()));
+  ASSERT_TRUE(reader.check_chunk(0, chunk_data(0)));
+  ASSERT_EQ(reader.count_blocks(path.string()), 8);
+}
+
+TEST_F(bootstrap_file_index, corrupt_chunk)
+{
+  write(0, 5);
+  uint64_t offset;
+  {
+    std::ifstream file(path.string(), std::ios_base::binary);
+    file.seekg(0, std::ios_base::end);
+    offset = file.tellg();
+  }
+  // the last chunk's data ends right before the index and trailer
+  offset -= 5 * 16 + 32 + 1;
+  {
+    std::fstream file(path.string(), std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+    file.seekp(offset);
+    file.put('X');
+  }
+  BootstrapFile reader;
+  ASSERT_TRUE(reader.map_indexed(path.string()));
+  std::string chunk;
+  ASSERT_TRUE(reader.get_chunk(3, chunk));
+  ASSERT_FALSE(reader.get_chunk(4, chunk));
+}
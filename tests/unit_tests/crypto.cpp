@@ -96,3 +96,46 @@ TEST(Crypto, verify_32)
     }
   }
 }
+
+TEST(Crypto, batch_derivations)
+{
+  cryptonote::keypair view = cryptonote::keypair::generate(hw::get_device("default"));
+  std::vector<crypto::public_key> tx_keys;
+  for (size_t n = 0; n < 37; ++n)
+    tx_keys.push_back(cryptonote::keypair::generate(hw::get_device("default")).pub);
+  // not a point on the curve
+  crypto::public_key bad_key;
+  memset(bad_key.data, 0xff, sizeof(bad_key.data));
+  tx_keys.insert(tx_keys.begin() + 5, bad_key);
+
+  std::vector<crypto::key_derivation> derivations;
+  std::vector<bool> valid;
+  crypto::generate_key_derivations(tx_keys, view.sec, derivations, valid);
+  ASSERT_EQ(derivations.size(), tx_keys.size());
+  ASSERT_EQ(valid.size(), tx_keys.size());
+  for (size_t n = 0; n < tx_keys.size(); ++n)
+  {
+    crypto::key_derivation derivation;
+    ASSERT_EQ(valid[n], crypto::generate_key_derivation(tx_keys[n], view.sec, derivation));
+    if (valid[n])
+      ASSERT_EQ(memcmp(&derivations[n], &derivation, sizeof(derivation)), 0);
+  }
+
+  std::vector<crypto::public_key> out_keys = tx_keys;
+  std::vector<size_t> output_indices;
+  for (size_t n = 0; n < out_keys.size(); ++n)
+    output_indices.push_back(n % 4);
+  std::vector<crypto::public_key> spend_keys;
+  crypto::derive_subaddress_public_keys(out_keys, derivations, output_indices, spend_keys, valid);
+  ASSERT_EQ(spend_keys.size(), out_keys.size());
+  for (size_t n = 0; n < out_keys.size(); ++n)
+  {
+    crypto::public_key spend_key;
+    ASSERT_EQ(valid[n], crypto::derive_subaddress_public_key(out_keys[n], derivations[n], output_indices[n], spend_key));
+    if (valid[n])
+      ASSERT_EQ(spend_keys[n], spend_key);
+  }
+
+  crypto::generate_key_derivations({}, view.sec, derivations, valid);
+  ASSERT_TRUE(derivations.empty());
+}
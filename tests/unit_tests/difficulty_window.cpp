@@ -0,0 +1,106 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_basic/difficulty.h"
+
+static crypto::hash make_hash(uint64_t n)
+{
+  crypto::hash hash = crypto::null_hash;
+  memcpy(&hash, &n, sizeof(n));
+  return hash;
+}
+
+static void push_blocks(cryptonote::difficulty_window &window, uint64_t start, uint64_t end)
+{
+  for (uint64_t height = start; height < end; ++height)
+    window.push_back(height, make_hash(height), 1000 + height, 10 * height);
+}
+
+TEST(difficulty_window, empty)
+{
+  cryptonote::difficulty_window window(4);
+  std::vector<uint64_t> timestamps;
+  std::vector<cryptonote::difficulty_type> difficulties;
+  ASSERT_TRUE(window.empty());
+  ASSERT_EQ(window.capacity(), 4);
+  ASSERT_TRUE(window.get(0, 0, timestamps, difficulties));
+  ASSERT_FALSE(window.get(0, 1, timestamps, difficulties));
+  ASSERT_FALSE(window.push_front(0, make_hash(0), 0, 0));
+}
+
+TEST(difficulty_window, wraps)
+{
+  cryptonote::difficulty_window window(4);
+  push_blocks(window, 1, 11);
+  ASSERT_EQ(window.size(), 4);
+  ASSERT_EQ(window.start_height(), 7);
+  ASSERT_EQ(window.end_height(), 11);
+  ASSERT_EQ(window.top_hash(), make_hash(10));
+
+  std::vector<uint64_t> timestamps;
+  std::vector<cryptonote::difficulty_type> difficulties;
+  ASSERT_FALSE(window.get(6, 11, timestamps, difficulties));
+  ASSERT_TRUE(window.get(7, 11, timestamps, difficulties));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({1007, 1008, 1009, 1010}));
+  ASSERT_EQ(difficulties, std::vector<cryptonote::difficulty_type>({70, 80, 90, 100}));
+}
+
+TEST(difficulty_window, pop_and_refill)
+{
+  cryptonote::difficulty_window window(4);
+  push_blocks(window, 1, 11);
+  window.pop_back();
+  window.pop_back();
+  ASSERT_EQ(window.end_height(), 9);
+  ASSERT_EQ(window.top_hash(), make_hash(8));
+
+  ASSERT_TRUE(window.push_front(6, make_hash(6), 1006, 60));
+  ASSERT_TRUE(window.push_front(5, make_hash(5), 1005, 50));
+  ASSERT_FALSE(window.push_front(4, make_hash(4), 1004, 40));
+  ASSERT_EQ(window.start_height(), 5);
+
+  window.push_back(9, make_hash(9), 1009, 90);
+  std::vector<uint64_t> timestamps;
+  std::vector<cryptonote::difficulty_type> difficulties;
+  ASSERT_TRUE(window.get(6, 10, timestamps, difficulties));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({1006, 1007, 1008, 1009}));
+}
+
+TEST(difficulty_window, restarts_on_gap)
+{
+  cryptonote::difficulty_window window(4);
+  push_blocks(window, 1, 4);
+  window.push_back(20, make_hash(20), 1020, 200);
+  ASSERT_EQ(window.size(), 1);
+  ASSERT_EQ(window.start_height(), 20);
+  ASSERT_EQ(window.end_height(), 21);
+  window.clear();
+  ASSERT_TRUE(window.empty());
+}
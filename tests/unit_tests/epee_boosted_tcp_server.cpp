@@ -31,12 +31,14 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "gtest/gtest.h"
 
 #include "include_base_utils.h"
 #include "string_tools.h"
 #include "net/abstract_tcp_server2.h"
+#include "net/network_throttle.hpp"
 
 namespace
 {
@@ -49,6 +51,12 @@ namespace
 
   struct test_protocol_handler_config
   {
+    test_protocol_handler_config(): m_endpoint(NULL), m_context(NULL) {}
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    epee::net_utils::i_service_endpoint* m_endpoint;
+    test_connection_context* m_context;
   };
 
   struct test_protocol_handler
@@ -56,12 +64,19 @@ namespace
     typedef test_connection_context connection_context;
     typedef test_protocol_handler_config config_type;
 
-    test_protocol_handler(epee::net_utils::i_service_endpoint* /*psnd_hndlr*/, config_type& /*config*/, connection_context& /*conn_context*/)
+    test_protocol_handler(epee::net_utils::i_service_endpoint* psnd_hndlr, config_type& config, connection_context& conn_context)
+      : m_psnd_hndlr(psnd_hndlr)
+      , m_config(config)
+      , m_conn_context(conn_context)
     {
     }
 
     void after_init_connection()
     {
+      boost::unique_lock<boost::mutex> lock(m_config.m_mutex);
+      m_config.m_endpoint = m_psnd_hndlr;
+      m_config.m_context = &m_conn_context;
+      m_config.m_cond.notify_all();
     }
 
     void handle_qued_callback()
@@ -77,9 +92,55 @@ namespace
     {
       return false;
     }
+
+  private:
+    epee::net_utils::i_service_endpoint* m_psnd_hndlr;
+    config_type& m_config;
+    connection_context& m_conn_context;
   };
 
   typedef epee::net_utils::boosted_tcp_server<test_protocol_handler> test_tcp_server;
+
+  // connects a client to the server and waits for the server side of the connection,
+  // which is referenced so it stays valid until released
+  bool connect_to_test_server(test_tcp_server& srv, boost::asio::ip::tcp::socket& client, epee::net_utils::i_service_endpoint*& endpoint, test_connection_context*& context)
+  {
+    boost::system::error_code ec;
+    client.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(test_server_host), test_server_port), ec);
+    if (ec)
+      return false;
+
+    test_protocol_handler_config& config = srv.get_config_object();
+    boost::unique_lock<boost::mutex> lock(config.m_mutex);
+    while (!config.m_endpoint)
+    {
+      if (boost::cv_status::timeout == config.m_cond.wait_for(lock, boost::chrono::seconds(5)))
+        return false;
+    }
+    endpoint = config.m_endpoint;
+    context = config.m_context;
+    return endpoint->add_ref();
+  }
+
+  // waits for the connection to write out everything it has queued
+  bool wait_for_empty_send_queue(const test_connection_context& context)
+  {
+    for (int i = 0; i < 500; ++i)
+    {
+      if (0 == context.m_send_queue_bytes)
+        return true;
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  std::string make_test_data(size_t size, size_t seed)
+  {
+    std::string data(size, 0);
+    for (size_t i = 0; i < size; ++i)
+      data[i] = (char)((seed + i) % 251);
+    return data;
+  }
 }
 
 TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
@@ -132,3 +193,105 @@ TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
   ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
   ASSERT_TRUE(srv.deinit_server());
 }
+
+TEST(boosted_tcp_server, big_send_is_sliced_without_losing_data)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_P2P); // P2P so big sends get sliced
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(2, false));
+
+  // P2P writes go through the global throttle, which would crawl at its default speed
+  double target_speed;
+  {
+    CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_out);
+    target_speed = epee::net_utils::network_throttle_manager::get_global_throttle_out().get_target_speed();
+    epee::net_utils::network_throttle_manager::get_global_throttle_out().set_target_speed(1024 * 1024);
+  }
+  auto restore_speed = epee::misc_utils::create_scope_leave_handler([target_speed]() {
+    CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_out);
+    epee::net_utils::network_throttle_manager::get_global_throttle_out().set_target_speed(target_speed);
+  });
+
+  boost::asio::io_service io_service;
+  boost::asio::ip::tcp::socket client(io_service);
+  epee::net_utils::i_service_endpoint* endpoint = NULL;
+  test_connection_context* context = NULL;
+  ASSERT_TRUE(connect_to_test_server(srv, client, endpoint, context));
+
+  // many slices of the same buffer, with a short one at the end
+  const std::string data = make_test_data(1024 * 1024 + 123, 0);
+  ASSERT_TRUE(endpoint->do_send(std::make_shared<const std::string>(data)));
+
+  std::string received(data.size(), 0);
+  ASSERT_EQ(data.size(), boost::asio::read(client, boost::asio::buffer(&received[0], received.size())));
+  ASSERT_TRUE(data == received);
+  ASSERT_TRUE(wait_for_empty_send_queue(*context));
+
+  ASSERT_TRUE(endpoint->release());
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
+
+TEST(boosted_tcp_server, queued_sends_are_gathered_in_order)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC); // RPC disables network limit, so writes gather
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(2, false));
+
+  boost::asio::io_service io_service;
+  boost::asio::ip::tcp::socket client(io_service);
+  epee::net_utils::i_service_endpoint* endpoint = NULL;
+  test_connection_context* context = NULL;
+  ASSERT_TRUE(connect_to_test_server(srv, client, endpoint, context));
+
+  // sends made while a write is in flight queue up behind it, more of them than one write gathers
+  std::string expected;
+  for (size_t i = 0; i < ABSTRACT_SERVER_SEND_GATHER_MAX * 3; ++i)
+  {
+    const std::string data = make_test_data(1000 + i, i);
+    expected += data;
+    if (i % 2)
+      ASSERT_TRUE(endpoint->do_send(data.data(), data.size()));
+    else
+      ASSERT_TRUE(endpoint->do_send(std::make_shared<const std::string>(data)));
+  }
+
+  std::string received(expected.size(), 0);
+  ASSERT_EQ(expected.size(), boost::asio::read(client, boost::asio::buffer(&received[0], received.size())));
+  ASSERT_TRUE(expected == received);
+  ASSERT_TRUE(wait_for_empty_send_queue(*context));
+
+  ASSERT_TRUE(endpoint->release());
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
+
+TEST(boosted_tcp_server, connection_is_dropped_past_send_queue_limit)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC);
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(2, false));
+
+  boost::asio::io_service io_service;
+  boost::asio::ip::tcp::socket client(io_service);
+  epee::net_utils::i_service_endpoint* endpoint = NULL;
+  test_connection_context* context = NULL;
+  ASSERT_TRUE(connect_to_test_server(srv, client, endpoint, context));
+
+  // the client never reads, so the first write can't complete and everything stays queued;
+  // the same buffer is queued over and over, it's never copied
+  const epee::net_utils::shared_buffer data = std::make_shared<const std::string>(ABSTRACT_SERVER_SEND_QUE_MAX_BYTES / 4, 'x');
+  for (size_t i = 0; i < 4; ++i)
+    ASSERT_TRUE(endpoint->do_send(data));
+  ASSERT_EQ(ABSTRACT_SERVER_SEND_QUE_MAX_BYTES, context->m_send_queue_bytes);
+
+  ASSERT_FALSE(endpoint->do_send(data));
+  ASSERT_FALSE(endpoint->do_send("x", 1));
+
+  ASSERT_TRUE(endpoint->release());
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
@@ -149,6 +149,15 @@ namespace
       return m_send_return;
     }
 
+    virtual bool do_send(const epee::net_utils::shared_buffer& buffer)
+    {
+      {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_last_shared_buffer = buffer;
+      }
+      return do_send(buffer->data(), buffer->size());
+    }
+
     virtual bool close()                              { /*std::cout << "test_connection::close()" << std::endl; */return true; }
     virtual bool send_done()                          { /*std::cout << "test_connection::send_done()" << std::endl; */return true; }
     virtual bool call_run_once_service_io()           { std::cout << "test_connection::call_run_once_service_io()" << std::endl; return true; }
@@ -162,6 +171,8 @@ namespace
     const std::string& last_send_data() const { return m_last_send_data; }
     void reset_last_send_data() { boost::unique_lock<boost::mutex> lock(m_mutex); m_last_send_data.clear(); }
 
+    const epee::net_utils::shared_buffer& last_shared_buffer() const { return m_last_shared_buffer; }
+
     bool send_return() const { return m_send_return; }
     void send_return(bool v) { m_send_return = v; }
 
@@ -176,6 +187,7 @@ namespace
     boost::mutex m_mutex;
 
     std::string m_last_send_data;
+    epee::net_utils::shared_buffer m_last_shared_buffer;
 
     bool m_send_return;
   };
@@ -414,6 +426,60 @@ TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_process
   ASSERT_TRUE(conn->last_send_data().empty());
 }
 
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_sends_invoke_response_body_as_shared_buffer)
+{
+  const int expected_command = 2634982;
+  const std::string expected_out_data(128, 'r');
+
+  test_connection_ptr conn = create_connection();
+
+  std::string in_data(64, 'q');
+
+  epee::levin::bucket_head2 req_head;
+  req_head.m_signature = LEVIN_SIGNATURE;
+  req_head.m_cb = in_data.size();
+  req_head.m_have_to_return_data = true;
+  req_head.m_command = expected_command;
+  req_head.m_flags = LEVIN_PACKET_REQUEST;
+  req_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+
+  std::string buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  buf += in_data;
+
+  m_commands_handler.invoke_out_buf(expected_out_data);
+
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+
+  // The head is sent on its own, the body is handed over without being appended to it
+  ASSERT_EQ(2, conn->send_counter());
+  ASSERT_TRUE(!!conn->last_shared_buffer());
+  ASSERT_EQ(expected_out_data, *conn->last_shared_buffer());
+  ASSERT_EQ(sizeof(epee::levin::bucket_head2) + expected_out_data.size(), conn->last_send_data().size());
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_sends_notify_body_without_copy)
+{
+  const int expected_command = 4673262;
+  const epee::net_utils::shared_buffer body = std::make_shared<const std::string>(256, 'n');
+
+  test_connection_ptr conn = create_connection();
+
+  ASSERT_EQ(1, m_handler_config.notify(expected_command, body, conn->m_protocol_handler.get_connection_id()));
+
+  // The connection gets the caller's buffer itself, not a copy of it
+  ASSERT_EQ(2, conn->send_counter());
+  ASSERT_EQ(body.get(), conn->last_shared_buffer().get());
+
+  std::string send_data = conn->last_send_data();
+  ASSERT_EQ(sizeof(epee::levin::bucket_head2) + body->size(), send_data.size());
+  epee::levin::bucket_head2 head = *reinterpret_cast<const epee::levin::bucket_head2*>(send_data.data());
+  ASSERT_EQ(LEVIN_SIGNATURE, head.m_signature);
+  ASSERT_EQ(expected_command, head.m_command);
+  ASSERT_EQ(body->size(), head.m_cb);
+  ASSERT_FALSE(head.m_have_to_return_data);
+  ASSERT_EQ(*body, send_data.substr(sizeof(head)));
+}
+
 TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_processes_qued_callback)
 {
   test_connection_ptr conn = create_connection();
@@ -100,6 +100,7 @@ public:
   virtual bool can_thread_bulk_indices() const { return false; }
   virtual std::vector<uint64_t> get_tx_output_indices(const crypto::hash& h) const { return std::vector<uint64_t>(); }
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_index) const { return std::vector<uint64_t>(); }
+  virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_index, size_t n_txes) const { return std::vector<std::vector<uint64_t>>(); }
   virtual bool has_key_image(const crypto::key_image& img) const { return false; }
   virtual void remove_block() { blocks.pop_back(); }
   virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash) {return 0;}
@@ -150,6 +151,12 @@ public:
     return versions.at(height);
   }
   virtual void check_hard_fork_info() {}
+  virtual void set_verified_block_data_hash(uint64_t height, const std::string& data_hash) {}
+  virtual bool get_verified_block_data_hash(uint64_t height, std::string& data_hash) const { return false; }
+  virtual uint32_t get_blockchain_pruning_seed() const { return 0; }
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0, epee::critical_section *lock = NULL) { return true; }
+  virtual bool update_pruning(epee::critical_section *lock = NULL) { return true; }
+  virtual bool check_pruning(epee::critical_section *lock = NULL) { return true; }
 
 private:
   std::vector<block> blocks;
@@ -127,3 +127,20 @@ TEST(hashchain, trim)
   ASSERT_FALSE(hashchain.empty());
   ASSERT_EQ(hashchain.genesis(), make_hash(1));
 }
+
+TEST(hashchain, lowest_modified)
+{
+  tools::hashchain hashchain;
+  hashchain.push_back(make_hash(1));
+  hashchain.push_back(make_hash(2));
+  hashchain.push_back(make_hash(3));
+  ASSERT_EQ(hashchain.lowest_modified(), std::numeric_limits<size_t>::max());
+  hashchain.crop(2);
+  hashchain.push_back(make_hash(4));
+  hashchain.crop(3);
+  ASSERT_EQ(hashchain.lowest_modified(), 2);
+  hashchain.reset_modified();
+  ASSERT_EQ(hashchain.lowest_modified(), std::numeric_limits<size_t>::max());
+  hashchain.clear();
+  ASSERT_EQ(hashchain.lowest_modified(), 0);
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include <stdexcept>
+#include "cryptonote_config.h"
+#include "common/pruning.h"
+
+#define ASSERT_EX(x) do { bool ex = false; try { x; } catch(...) { ex = true; } ASSERT_TRUE(ex); } while(0)
+
+static const uint32_t LOG_STRIPES = CRYPTONOTE_PRUNING_LOG_STRIPES;
+
+TEST(pruning, seed)
+{
+  ASSERT_EQ(tools::get_pruning_stripe(0), 0);
+  for (uint32_t stripe = 1; stripe <= (1 << LOG_STRIPES); ++stripe)
+  {
+    const uint32_t seed = tools::make_pruning_seed(stripe, LOG_STRIPES);
+    ASSERT_NE(seed, 0);
+    ASSERT_EQ(tools::get_pruning_stripe(seed), stripe);
+    ASSERT_EQ(tools::get_pruning_log_stripes(seed), LOG_STRIPES);
+  }
+  ASSERT_EX(tools::make_pruning_seed(0, LOG_STRIPES));
+  ASSERT_EX(tools::make_pruning_seed((1 << LOG_STRIPES) + 1, LOG_STRIPES));
+  ASSERT_EX(tools::make_pruning_seed(1, 8));
+}
+
+TEST(pruning, block_stripe)
+{
+  const uint64_t blockchain_height = 100000;
+  ASSERT_EQ(tools::get_pruning_stripe(0, blockchain_height, LOG_STRIPES), 1);
+  ASSERT_EQ(tools::get_pruning_stripe(CRYPTONOTE_PRUNING_STRIPE_SIZE - 1, blockchain_height, LOG_STRIPES), 1);
+  ASSERT_EQ(tools::get_pruning_stripe(CRYPTONOTE_PRUNING_STRIPE_SIZE, blockchain_height, LOG_STRIPES), 2);
+  ASSERT_EQ(tools::get_pruning_stripe((CRYPTONOTE_PRUNING_STRIPE_SIZE << LOG_STRIPES) - 1, blockchain_height, LOG_STRIPES), 1 << LOG_STRIPES);
+  ASSERT_EQ(tools::get_pruning_stripe(CRYPTONOTE_PRUNING_STRIPE_SIZE << LOG_STRIPES, blockchain_height, LOG_STRIPES), 1);
+
+  // the tip is never pruned
+  ASSERT_NE(tools::get_pruning_stripe(blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS - 1, blockchain_height, LOG_STRIPES), 0);
+  ASSERT_EQ(tools::get_pruning_stripe(blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS, blockchain_height, LOG_STRIPES), 0);
+  ASSERT_EQ(tools::get_pruning_stripe(blockchain_height - 1, blockchain_height, LOG_STRIPES), 0);
+  ASSERT_EQ(tools::get_pruning_seed(blockchain_height - 1, blockchain_height, LOG_STRIPES), 0);
+  ASSERT_EQ(tools::get_pruning_seed(0, blockchain_height, LOG_STRIPES), tools::make_pruning_seed(1, LOG_STRIPES));
+}
+
+TEST(pruning, has_unpruned_block)
+{
+  const uint64_t blockchain_height = 100000;
+  const uint32_t seed = tools::make_pruning_seed(2, LOG_STRIPES);
+  for (uint64_t h = 0; h < blockchain_height; h += 97)
+  {
+    ASSERT_TRUE(tools::has_unpruned_block(h, blockchain_height, 0));
+    const uint32_t stripe = tools::get_pruning_stripe(h, blockchain_height, LOG_STRIPES);
+    ASSERT_EQ(tools::has_unpruned_block(h, blockchain_height, seed), stripe == 0 || stripe == 2);
+  }
+}
+
+TEST(pruning, next_unpruned)
+{
+  const uint64_t blockchain_height = 100000;
+  const uint32_t seed1 = tools::make_pruning_seed(1, LOG_STRIPES);
+  const uint32_t seed3 = tools::make_pruning_seed(3, LOG_STRIPES);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(1, blockchain_height, 0), 1);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(1, blockchain_height, seed1), 1);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(CRYPTONOTE_PRUNING_STRIPE_SIZE, blockchain_height, seed1), CRYPTONOTE_PRUNING_STRIPE_SIZE << LOG_STRIPES);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(0, blockchain_height, seed3), 2 * CRYPTONOTE_PRUNING_STRIPE_SIZE);
+  // the next stripe would be in the tip, which starts first
+  ASSERT_EQ(tools::get_next_unpruned_block_height(94000, blockchain_height, seed1), blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(blockchain_height - 1, blockchain_height, seed1), blockchain_height - 1);
+
+  // whatever the start, the result is the first height the seed has
+  for (uint64_t h = 0; h < blockchain_height; h += 1013)
+  {
+    const uint64_t next = tools::get_next_unpruned_block_height(h, blockchain_height, seed3);
+    ASSERT_GE(next, h);
+    ASSERT_TRUE(tools::has_unpruned_block(next, blockchain_height, seed3));
+    for (uint64_t i = h; i < next; i += 211)
+      ASSERT_FALSE(tools::has_unpruned_block(i, blockchain_height, seed3));
+  }
+}
+
+TEST(pruning, next_pruned)
+{
+  const uint64_t blockchain_height = 100000;
+  const uint32_t seed1 = tools::make_pruning_seed(1, LOG_STRIPES);
+  ASSERT_EQ(tools::get_next_pruned_block_height(0, blockchain_height, 0), blockchain_height);
+  ASSERT_EQ(tools::get_next_pruned_block_height(0, blockchain_height, seed1), CRYPTONOTE_PRUNING_STRIPE_SIZE);
+  ASSERT_EQ(tools::get_next_pruned_block_height(CRYPTONOTE_PRUNING_STRIPE_SIZE, blockchain_height, seed1), CRYPTONOTE_PRUNING_STRIPE_SIZE);
+  ASSERT_EQ(tools::get_next_pruned_block_height(blockchain_height - 1, blockchain_height, seed1), blockchain_height);
+}
+
+TEST(pruning, random_stripe)
+{
+  for (int i = 0; i < 1000; ++i)
+  {
+    const uint32_t stripe = tools::get_random_stripe();
+    ASSERT_GE(stripe, 1);
+    ASSERT_LE(stripe, 1 << LOG_STRIPES);
+  }
+}
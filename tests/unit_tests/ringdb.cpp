@@ -136,6 +136,44 @@ TEST(ringdb, different_genesis)
   ASSERT_FALSE(ringdb.get_ring(KEY_2, KEY_IMAGE_1, outs2));
 }
 
+TEST(ringdb, batch)
+{
+  RingDB ringdb;
+  std::vector<uint64_t> outs, outs2;
+  outs.push_back(43); outs.push_back(7320); outs.push_back(8429);
+  std::vector<crypto::key_image> key_images;
+  for (int n = 0; n < 100; ++n)
+    key_images.push_back(generate_key_image());
+  ringdb.batch_start();
+  for (const auto &key_image: key_images)
+    ASSERT_TRUE(ringdb.set_ring(KEY_1, key_image, outs, false));
+  ASSERT_TRUE(ringdb.get_ring(KEY_1, key_images[7], outs2));
+  ASSERT_EQ(outs, outs2);
+  ASSERT_TRUE(ringdb.set_ring(KEY_1, KEY_IMAGE_1, outs, true));
+  ringdb.batch_stop();
+  ASSERT_FALSE(ringdb.batch_active());
+  for (const auto &key_image: key_images)
+  {
+    outs2.clear();
+    ASSERT_TRUE(ringdb.get_ring(KEY_1, key_image, outs2));
+    ASSERT_EQ(outs, outs2);
+  }
+  ASSERT_TRUE(ringdb.get_ring(KEY_1, KEY_IMAGE_1, outs2));
+  ASSERT_EQ(outs2.size(), 3);
+  ASSERT_EQ(outs2[2], 43+7320+8429);
+}
+
+TEST(ringdb, batch_abort)
+{
+  RingDB ringdb;
+  std::vector<uint64_t> outs, outs2;
+  outs.push_back(43); outs.push_back(7320); outs.push_back(8429);
+  ringdb.batch_start();
+  ASSERT_TRUE(ringdb.set_ring(KEY_1, KEY_IMAGE_1, outs, false));
+  ringdb.batch_abort();
+  ASSERT_FALSE(ringdb.get_ring(KEY_1, KEY_IMAGE_1, outs2));
+}
+
 TEST(spent_outputs, not_found)
 {
   RingDB ringdb;
@@ -174,6 +212,23 @@ TEST(spent_outputs, vector)
   ASSERT_TRUE(ringdb.blackballed(std::make_pair(30, 5)));
 }
 
+TEST(spent_outputs, unsorted)
+{
+  RingDB ringdb;
+  std::vector<std::pair<uint64_t, uint64_t>> outputs;
+  outputs.push_back(std::make_pair(10, 8));
+  outputs.push_back(std::make_pair(0, 1));
+  outputs.push_back(std::make_pair(10, 3));
+  outputs.push_back(std::make_pair(10, 8));
+  ASSERT_TRUE(ringdb.blackball(outputs));
+  ASSERT_TRUE(ringdb.blackball(std::make_pair(10, 4)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(0, 1)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(10, 3)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(10, 4)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(10, 8)));
+  ASSERT_FALSE(ringdb.blackballed(std::make_pair(10, 5)));
+}
+
 TEST(spent_outputs, mark_as_unspent)
 {
   RingDB ringdb;
@@ -101,3 +101,120 @@ TEST_F(WalletSubaddress, OutOfBoundsIndexes)
     EXPECT_STREQ("index.minor is out of bound", e.what());  
   }   
 }
+
+TEST_F(WalletSubaddress, LookaheadExpansion)
+{
+  auto is_known = [this](const cryptonote::subaddress_index &index) {
+    const boost::optional<cryptonote::subaddress_index> found = w1.get_subaddress_index(w1.get_subaddress(index));
+    return found && *found == index;
+  };
+  const uint32_t last = w1.get_subaddress_lookahead().second - 1;
+  EXPECT_TRUE(is_known({0, 0}));
+  EXPECT_TRUE(is_known({0, last}));
+  EXPECT_FALSE(is_known({0, last + 1}));
+
+  w1.expand_subaddresses({0, 100});
+  EXPECT_TRUE(is_known({0, last + 1}));
+  EXPECT_TRUE(is_known({0, last + 100}));
+  EXPECT_FALSE(is_known({0, last + 101}));
+}
+
+TEST(SubaddressTable, InsertFind)
+{
+  cryptonote::subaddress_table table;
+  std::vector<crypto::public_key> keys;
+  for (size_t n = 0; n < 1000; ++n)
+    keys.push_back(cryptonote::keypair::generate(hw::get_device("default")).pub);
+  table.insert(3, 0, keys);
+  ASSERT_EQ(table.size(), keys.size());
+  ASSERT_EQ(table.num_generated(3), keys.size());
+  ASSERT_EQ(table.num_generated(2), 0);
+  ASSERT_EQ(table.num_generated(4), 0);
+  for (size_t n = 0; n < keys.size(); ++n)
+  {
+    auto found = table.find(keys[n]);
+    ASSERT_TRUE(found != table.end());
+    ASSERT_EQ(found->first, keys[n]);
+    ASSERT_EQ(found->second, (cryptonote::subaddress_index{3, (uint32_t)n}));
+  }
+  ASSERT_EQ(table.count(cryptonote::keypair::generate(hw::get_device("default")).pub), 0);
+  ASSERT_EQ(table.count(crypto::null_pkey), 0);
+  ASSERT_THROW(table.insert(crypto::null_pkey, {0, 0}), std::exception);
+
+  table.insert(keys[7], {5, 5});
+  ASSERT_EQ(table.size(), keys.size());
+  ASSERT_EQ(table.find(keys[7])->second, (cryptonote::subaddress_index{5, 5}));
+
+  table.clear();
+  ASSERT_TRUE(table.empty());
+  ASSERT_EQ(table.count(keys[0]), 0);
+  ASSERT_EQ(table.num_generated(3), 0);
+}
+
+TEST(SubaddressTable, StoreLoad)
+{
+  std::unordered_map<crypto::public_key, cryptonote::subaddress_index> map;
+  for (uint32_t major = 0; major < 3; ++major)
+    for (uint32_t minor = 0; minor < 50; ++minor)
+      map[cryptonote::keypair::generate(hw::get_device("default")).pub] = {major, minor};
+  const cryptonote::subaddress_table table(map);
+  ASSERT_EQ(table.size(), map.size());
+  ASSERT_EQ(table.num_generated(2), 50);
+
+  std::string blob;
+  table.store(blob);
+  cryptonote::subaddress_table loaded;
+  ASSERT_TRUE(loaded.load(blob));
+  ASSERT_EQ(loaded.size(), map.size());
+  ASSERT_EQ(loaded.num_generated(0), 50);
+  ASSERT_EQ(loaded.num_generated(3), 0);
+  for (const auto &e: map)
+  {
+    auto found = loaded.find(e.first);
+    ASSERT_TRUE(found != loaded.end());
+    ASSERT_EQ(found->second, e.second);
+  }
+
+  ASSERT_FALSE(loaded.load(blob.substr(0, blob.size() - 1)));
+  ASSERT_TRUE(loaded.empty());
+  std::string bad = blob;
+  bad[0] = 'x';
+  ASSERT_FALSE(loaded.load(bad));
+  // duplicate the first entry over the second
+  bad = blob;
+  const size_t entries = bad.size() - 40 * map.size();
+  bad.replace(entries + 40, 40, bad.substr(entries, 40));
+  ASSERT_FALSE(loaded.load(bad));
+
+  cryptonote::subaddress_table empty;
+  empty.store(blob);
+  ASSERT_TRUE(loaded.load(blob));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST(SubaddressTable, KeysSince)
+{
+  cryptonote::subaddress_table table;
+  std::vector<crypto::public_key> keys0, keys1;
+  for (size_t n = 0; n < 30; ++n)
+  {
+    keys0.push_back(cryptonote::keypair::generate(hw::get_device("default")).pub);
+    keys1.push_back(cryptonote::keypair::generate(hw::get_device("default")).pub);
+  }
+  table.insert(0, 0, std::vector<crypto::public_key>(keys0.begin(), keys0.begin() + 10));
+  const std::vector<uint32_t> generated = table.get_generated();
+  ASSERT_EQ(generated, std::vector<uint32_t>({10}));
+
+  table.insert(0, 10, std::vector<crypto::public_key>(keys0.begin() + 10, keys0.end()));
+  table.insert(1, 0, keys1);
+  std::vector<std::vector<crypto::public_key>> since;
+  table.get_keys_since(generated, since);
+  ASSERT_EQ(since.size(), 2);
+  ASSERT_EQ(since[0], std::vector<crypto::public_key>(keys0.begin() + 10, keys0.end()));
+  ASSERT_EQ(since[1], keys1);
+
+  table.get_keys_since(table.get_generated(), since);
+  ASSERT_EQ(since.size(), 2);
+  ASSERT_TRUE(since[0].empty());
+  ASSERT_TRUE(since[1].empty());
+}
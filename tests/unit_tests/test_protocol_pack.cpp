@@ -53,3 +53,175 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+namespace
+{
+  struct flat_test_inner
+  {
+    std::string name;
+    int32_t value;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(value)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct flat_test_outer
+  {
+    uint64_t height;
+    double ratio;
+    bool flag;
+    std::vector<uint64_t> amounts;
+    std::vector<std::string> blobs;
+    flat_test_inner inner;
+    std::list<flat_test_inner> inners;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(height)
+      KV_SERIALIZE(ratio)
+      KV_SERIALIZE(flag)
+      KV_SERIALIZE(amounts)
+      KV_SERIALIZE(blobs)
+      KV_SERIALIZE(inner)
+      KV_SERIALIZE(inners)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  flat_test_outer make_flat_test_outer()
+  {
+    flat_test_outer o;
+    o.height = 1234567890123;
+    o.ratio = 0.25;
+    o.flag = true;
+    o.amounts = {1, 2, 300000, std::numeric_limits<uint64_t>::max()};
+    o.blobs = {"", "a", std::string(100000, 'x')};
+    o.inner.name = "inner";
+    o.inner.value = -42;
+    for (int i = 0; i < 3; ++i)
+      o.inners.push_back({std::string(i, 'y'), i});
+    return o;
+  }
+
+  void check_flat_test_outer(const flat_test_outer &a, const flat_test_outer &b)
+  {
+    ASSERT_EQ(a.height, b.height);
+    ASSERT_EQ(a.ratio, b.ratio);
+    ASSERT_EQ(a.flag, b.flag);
+    ASSERT_EQ(a.amounts, b.amounts);
+    ASSERT_EQ(a.blobs, b.blobs);
+    ASSERT_EQ(a.inner.name, b.inner.name);
+    ASSERT_EQ(a.inner.value, b.inner.value);
+    ASSERT_EQ(a.inners.size(), b.inners.size());
+    for (auto i = a.inners.begin(), j = b.inners.begin(); i != a.inners.end(); ++i, ++j)
+    {
+      ASSERT_EQ(i->name, j->name);
+      ASSERT_EQ(i->value, j->value);
+    }
+  }
+}
+
+TEST(protocol_pack, flat_storage_reads_portable_storage)
+{
+  const flat_test_outer o = make_flat_test_outer();
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(o.store(ps));
+  std::string buff;
+  ASSERT_TRUE(ps.store_to_binary(buff));
+
+  epee::serialization::portable_storage_flat flat;
+  ASSERT_TRUE(flat.load_from_binary(buff));
+  flat_test_outer o2;
+  ASSERT_TRUE(o2.load(flat));
+  check_flat_test_outer(o, o2);
+}
+
+TEST(protocol_pack, portable_storage_reads_flat_storage)
+{
+  const flat_test_outer o = make_flat_test_outer();
+  epee::serialization::portable_storage_flat flat;
+  ASSERT_TRUE(o.store(flat));
+  std::string buff;
+  ASSERT_TRUE(flat.store_to_binary(buff));
+
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(ps.load_from_binary(buff));
+  flat_test_outer o2;
+  ASSERT_TRUE(o2.load(ps));
+  check_flat_test_outer(o, o2);
+
+  // a parsed storage packs back to the same bytes
+  epee::serialization::portable_storage_flat flat2;
+  ASSERT_TRUE(flat2.load_from_binary(buff));
+  std::string buff2;
+  ASSERT_TRUE(flat2.store_to_binary(buff2));
+  ASSERT_EQ(buff, buff2);
+}
+
+TEST(protocol_pack, flat_storage_meta_entry)
+{
+  epee::serialization::section s;
+  s.m_entries.insert(std::make_pair("n", epee::serialization::storage_entry(uint32_t(7))));
+  s.m_entries.insert(std::make_pair("s", epee::serialization::storage_entry(std::string("str"))));
+  epee::serialization::array_entry_t<uint16_t> a;
+  a.m_array = {1, 2, 3};
+  s.m_entries.insert(std::make_pair("a", epee::serialization::storage_entry(epee::serialization::array_entry(a))));
+
+  epee::serialization::portable_storage_flat flat;
+  ASSERT_TRUE(flat.set_value("meta", epee::serialization::storage_entry(s), nullptr));
+  std::string buff;
+  ASSERT_TRUE(flat.store_to_binary(buff));
+
+  epee::serialization::portable_storage_flat flat2;
+  ASSERT_TRUE(flat2.load_from_binary(buff));
+  epee::serialization::storage_entry e;
+  ASSERT_TRUE(flat2.get_value("meta", e, nullptr));
+  const epee::serialization::section &s2 = boost::get<epee::serialization::section>(e);
+  ASSERT_EQ(3, s2.m_entries.size());
+  ASSERT_EQ(7, boost::get<uint32_t>(s2.m_entries.at("n")));
+  ASSERT_EQ("str", boost::get<std::string>(s2.m_entries.at("s")));
+  const auto &a2 = boost::get<epee::serialization::array_entry_t<uint16_t>>(boost::get<epee::serialization::array_entry>(s2.m_entries.at("a")));
+  ASSERT_EQ(a.m_array, a2.m_array);
+}
+
+TEST(protocol_pack, flat_storage_rejects_truncated_input)
+{
+  flat_test_outer o = make_flat_test_outer();
+  o.blobs.back().resize(10);
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(o, buff));
+
+  for (size_t size = 0; size < buff.size(); ++size)
+  {
+    const std::string truncated = buff.substr(0, size);
+    epee::serialization::portable_storage_flat flat;
+    ASSERT_FALSE(flat.load_from_binary(truncated));
+  }
+  epee::serialization::portable_storage_flat flat;
+  ASSERT_TRUE(flat.load_from_binary(buff));
+}
+
+TEST(protocol_pack, flat_storage_ignores_mismatched_types)
+{
+  // as with portable_storage, a field of the wrong type reads as missing
+  epee::serialization::portable_storage_flat flat;
+  ASSERT_TRUE(flat.open_section("height", nullptr, true) != nullptr);
+  ASSERT_TRUE(flat.set_value("ratio", std::string("not a number"), nullptr));
+  ASSERT_TRUE(flat.set_value("flag", true, nullptr));
+  std::string buff;
+  ASSERT_TRUE(flat.store_to_binary(buff));
+
+  epee::serialization::portable_storage_flat flat2;
+  ASSERT_TRUE(flat2.load_from_binary(buff));
+  uint64_t height = 5;
+  ASSERT_FALSE(flat2.get_value("height", height, nullptr));
+  ASSERT_EQ(5, height);
+  double ratio = 0.5;
+  ASSERT_FALSE(flat2.get_value("ratio", ratio, nullptr));
+
+  flat_test_outer o = make_flat_test_outer();
+  ASSERT_NO_THROW(o.load(flat2));
+  ASSERT_EQ(1234567890123, o.height);
+  ASSERT_EQ(0.25, o.ratio);
+  ASSERT_TRUE(o.flag);
+}
@@ -144,3 +144,52 @@ TEST(threadpool, leaf_reentrancy)
   waiter.wait(tpool.get());
   ASSERT_EQ(counter, 500000);
 }
+
+TEST(threadpool, priorities)
+{
+  // no worker thread, the tasks only run when waiting
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(1));
+  tools::threadpool::waiter waiter;
+
+  std::vector<int> order;
+  tpool->submit(&waiter, [&](){ order.push_back(2); }, false, tools::threadpool::PRIORITY_LOW);
+  tpool->submit(&waiter, [&](){ order.push_back(1); }, false, tools::threadpool::PRIORITY_NORMAL);
+  tpool->submit(&waiter, [&](){ order.push_back(0); }, false, tools::threadpool::PRIORITY_HIGH);
+  tpool->submit(&waiter, [&](){ order.push_back(3); }, false, tools::threadpool::PRIORITY_LOW);
+  waiter.wait(tpool.get());
+  ASSERT_EQ(order, std::vector<int>({0, 1, 2, 3}));
+}
+
+TEST(threadpool, stats)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(1));
+  tools::threadpool::waiter waiter;
+
+  for (size_t n = 0; n < 100; ++n)
+    tpool->submit(&waiter, [](){});
+  ASSERT_EQ(tpool->get_stats().queue_depth, 100);
+  waiter.wait(tpool.get());
+
+  const tools::threadpool::stats stats = tpool->get_stats();
+  ASSERT_EQ(stats.threads, 1);
+  ASSERT_EQ(stats.queue_depth, 0);
+  ASSERT_EQ(stats.tasks, 100);
+  ASSERT_EQ(stats.steals, 0);
+  ASSERT_GE(stats.max_latency_us, stats.average_latency_us);
+}
+
+TEST(threadpool, affinity)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(4));
+  tools::threadpool::waiter waiter;
+
+  tpool->set_affinity(true);
+  std::atomic<unsigned int> counter(0);
+  for (size_t n = 0; n < 4096; ++n)
+  {
+    tpool->submit(&waiter, [&counter](){++counter;});
+  }
+  waiter.wait(tpool.get());
+  tpool->set_affinity(false);
+  ASSERT_EQ(counter, 4096);
+}
@@ -0,0 +1,173 @@
+// Copyright (c) 2018 X-CASH Project, Derived from 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// FIXME: move this into a full wallet2 unit test suite, if possible
+
+
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+
+#include "file_io_utils.h"
+#include "crypto/crypto.h"
+#include "wallet/wallet2.h"
+#include "wallet/wallet_cache_journal.h"
+
+namespace
+{
+  class CacheJournal : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+      crypto::generate_chacha_key("journal", key, 1);
+    }
+
+    virtual void TearDown()
+    {
+      boost::filesystem::remove(path);
+    }
+
+    std::string path;
+    crypto::chacha_key key;
+  };
+}
+
+TEST_F(CacheJournal, missing)
+{
+  std::vector<std::string> payloads;
+  uint64_t good_size = 1;
+  ASSERT_TRUE(tools::cache_journal::read(path, key, payloads, good_size));
+  ASSERT_TRUE(payloads.empty());
+  ASSERT_EQ(good_size, 0);
+}
+
+TEST_F(CacheJournal, append_read)
+{
+  uint64_t size;
+  ASSERT_TRUE(tools::cache_journal::append(path, 0, key, {"foo", ""}, size));
+  ASSERT_TRUE(tools::cache_journal::append(path, size, key, {std::string(1000, 'x')}, size));
+
+  std::vector<std::string> payloads;
+  uint64_t good_size;
+  ASSERT_TRUE(tools::cache_journal::read(path, key, payloads, good_size));
+  ASSERT_EQ(good_size, size);
+  ASSERT_EQ(payloads.size(), 3);
+  ASSERT_EQ(payloads[0], "foo");
+  ASSERT_EQ(payloads[1], "");
+  ASSERT_EQ(payloads[2], std::string(1000, 'x'));
+
+  std::string raw;
+  ASSERT_TRUE(epee::file_io_utils::load_file_to_string(path, raw));
+  ASSERT_EQ(raw.find("foo"), std::string::npos);
+}
+
+TEST_F(CacheJournal, torn_tail)
+{
+  uint64_t size, torn_size;
+  ASSERT_TRUE(tools::cache_journal::append(path, 0, key, {"foo"}, size));
+  ASSERT_TRUE(tools::cache_journal::append(path, size, key, {"bar"}, torn_size));
+  boost::filesystem::resize_file(path, torn_size - 1);
+
+  std::vector<std::string> payloads;
+  uint64_t good_size;
+  ASSERT_TRUE(tools::cache_journal::read(path, key, payloads, good_size));
+  ASSERT_EQ(good_size, size);
+  ASSERT_EQ(payloads.size(), 1);
+  ASSERT_EQ(payloads[0], "foo");
+
+  // the next append cuts the torn record off
+  ASSERT_TRUE(tools::cache_journal::append(path, good_size, key, {"baz"}, size));
+  ASSERT_TRUE(tools::cache_journal::read(path, key, payloads, good_size));
+  ASSERT_EQ(good_size, size);
+  ASSERT_EQ(payloads.size(), 2);
+  ASSERT_EQ(payloads[1], "baz");
+}
+
+TEST_F(CacheJournal, wrong_key)
+{
+  uint64_t size;
+  ASSERT_TRUE(tools::cache_journal::append(path, 0, key, {"foo"}, size));
+
+  std::vector<std::string> payloads;
+  uint64_t good_size;
+  crypto::chacha_key wrong_key;
+  crypto::generate_chacha_key("wrong", wrong_key, 1);
+  ASSERT_TRUE(tools::cache_journal::read(path, wrong_key, payloads, good_size));
+  ASSERT_TRUE(payloads.empty());
+  ASSERT_EQ(good_size, 0);
+}
+
+TEST_F(CacheJournal, wallet_store_load)
+{
+  const epee::wipeable_string password("test");
+  const crypto::hash txid = crypto::rand<crypto::hash>();
+  const crypto::secret_key tx_key = rct::rct2sk(rct::skGen());
+  const std::vector<crypto::secret_key> additional_tx_keys = {rct::rct2sk(rct::skGen())};
+
+  std::string cache;
+  cryptonote::account_public_address lookahead_address;
+  {
+    tools::wallet2 w;
+    w.generate(path, password);
+    w.store();
+    ASSERT_TRUE(epee::file_io_utils::load_file_to_string(path, cache));
+
+    w.set_tx_note(txid, "note");
+    w.add_subaddress_account("account");
+    w.store();
+    w.set_attribute("attribute", "value");
+    w.set_tx_key(txid, tx_key, additional_tx_keys);
+    w.store();
+    lookahead_address = w.get_subaddress({1, 5});
+  }
+
+  // small changes go to the journal, the snapshot is left alone
+  std::string cache_after;
+  ASSERT_TRUE(epee::file_io_utils::load_file_to_string(path, cache_after));
+  ASSERT_EQ(cache, cache_after);
+  ASSERT_TRUE(boost::filesystem::exists(path + ".journal"));
+
+  tools::wallet2 w;
+  w.load(path, password);
+  ASSERT_EQ(w.get_tx_note(txid), "note");
+  ASSERT_EQ(w.get_num_subaddress_accounts(), 2);
+  ASSERT_EQ(w.get_subaddress_label({1, 0}), "account");
+  ASSERT_EQ(w.get_attribute("attribute"), "value");
+  const auto index = w.get_subaddress_index(lookahead_address);
+  ASSERT_TRUE(index);
+  ASSERT_EQ(*index, (cryptonote::subaddress_index{1, 5}));
+  crypto::secret_key loaded_tx_key;
+  std::vector<crypto::secret_key> loaded_additional_tx_keys;
+  ASSERT_TRUE(w.get_tx_key(txid, loaded_tx_key, loaded_additional_tx_keys));
+  ASSERT_EQ(loaded_tx_key, tx_key);
+  ASSERT_EQ(loaded_additional_tx_keys, additional_tx_keys);
+
+  boost::filesystem::remove(path + ".keys");
+  boost::filesystem::remove(path + ".journal");
+}